@@ -0,0 +1,148 @@
+/*
+ * bench_copier.c - Surface copier benchmark, for all kernels
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <libavutil/common.h>
+#include "ffvacopier.h"
+#include "test_utils.h"
+#include "time_utils.h"
+
+/* Default number of iterations of each benchmark */
+#define DEFAULT_ITERATIONS 100
+
+typedef struct {
+    const char *name;
+    uint32_t src_fourcc;
+    uint32_t dst_fourcc;
+    uint32_t width;
+    uint32_t height;
+} Benchmark;
+
+static const Benchmark g_benchmarks[] = {
+    { "NV12 copy 1080p",
+      TEST_FOURCC_NV12, TEST_FOURCC_NV12, 1920, 1080 },
+    { "NV12 to I420 1080p",
+      TEST_FOURCC_NV12, TEST_FOURCC_I420, 1920, 1080 },
+    { "NV12 to YV12 1080p",
+      TEST_FOURCC_NV12, TEST_FOURCC_YV12, 1920, 1080 },
+    { "P010 to P016 1080p",
+      TEST_FOURCC_P010, TEST_FOURCC_P016, 1920, 1080 },
+    { "NV12 copy 2160p",
+      TEST_FOURCC_NV12, TEST_FOURCC_NV12, 3840, 2160 },
+};
+
+// Returns the average time of ffva_copier_copy(), in microseconds, or a
+// negative value if the kernels are not supported by the CPU
+static double
+bench_copier(const TestImage *src, const TestImage *dst,
+    const char *kernels_name, uint32_t num_threads, uint32_t num_iterations)
+{
+    FFVACopier *copier;
+    uint64_t start_time;
+    uint32_t i;
+
+    setenv("FFVA_KERNELS", kernels_name, 1);
+    copier = ffva_copier_new(num_threads);
+    unsetenv("FFVA_KERNELS");
+    if (!copier)
+        return -1.0;
+    if (strcmp(ffva_copier_get_kernels_name(copier), kernels_name) != 0) {
+        ffva_copier_free(copier);
+        return -1.0;
+    }
+
+    // Warm up worker threads and caches
+    ffva_copier_copy(copier, &src->image, &dst->image);
+
+    start_time = get_time_us();
+    for (i = 0; i < num_iterations; i++) {
+        if (ffva_copier_copy(copier, &src->image, &dst->image) < 0)
+            break;
+    }
+    ffva_copier_free(copier);
+    if (i != num_iterations)
+        return -1.0;
+    return (double)(get_time_us() - start_time) / num_iterations;
+}
+
+// Runs the supplied benchmark with all kernels the CPU supports, with one
+// and with all threads
+static bool
+run_benchmark(const Benchmark *b, uint32_t num_iterations)
+{
+    TestImage src = { { 0, } }, dst = { { 0, } };
+    const char * const *kernels_name;
+    double c_time = 0.0, st_time, mt_time;
+
+    if (!test_image_init(&src, b->src_fourcc, b->width, b->height) ||
+        !test_image_init(&dst, b->dst_fourcc, b->width, b->height)) {
+        test_image_finalize(&src);
+        test_image_finalize(&dst);
+        return false;
+    }
+    test_image_fill(&src);
+
+    for (kernels_name = g_test_kernels; *kernels_name; kernels_name++) {
+        st_time = bench_copier(&src, &dst, *kernels_name, 1, num_iterations);
+        if (st_time < 0.0)
+            continue;
+        mt_time = bench_copier(&src, &dst, *kernels_name, 0, num_iterations);
+        if (mt_time < 0.0)
+            continue;
+        if (c_time == 0.0)
+            c_time = st_time;
+
+        printf("%-24s  %-6s  %8.2f  %8.2f  %5.2fx  %5.2fx\n", b->name,
+            *kernels_name, st_time / 1000.0, mt_time / 1000.0,
+            c_time / st_time, c_time / mt_time);
+    }
+
+    test_image_finalize(&src);
+    test_image_finalize(&dst);
+    return c_time > 0.0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    uint32_t i, num_iterations = DEFAULT_ITERATIONS;
+    int ret = EXIT_SUCCESS;
+
+    if (argc > 1)
+        num_iterations = FFMAX(strtoul(argv[1], NULL, 0), 1);
+
+    printf("Times in ms per frame, averaged over %u iterations, and gains "
+        "over the C kernels\nwith one thread, with one and all threads. "
+        "Images are in cached memory, where\nstreaming loads help less "
+        "than from mapped VA surfaces\n\n", num_iterations);
+    printf("%-24s  %-6s  %8s  %8s  %6s  %6s\n", "Benchmark", "Kernel",
+        "1 thread", "threads", "gain", "gain");
+
+    for (i = 0; i < FF_ARRAY_ELEMS(g_benchmarks); i++) {
+        if (!run_benchmark(&g_benchmarks[i], num_iterations)) {
+            fprintf(stderr, "%s: failed to run benchmark\n",
+                g_benchmarks[i].name);
+            ret = EXIT_FAILURE;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,179 @@
+/*
+ * bench_scaler.c - CPU scaler benchmark, against swscale
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <libavutil/common.h>
+#include <libswscale/swscale.h>
+#include "ffvascaler.h"
+#include "test_utils.h"
+#include "time_utils.h"
+
+/* Default number of iterations of each benchmark */
+#define DEFAULT_ITERATIONS 100
+
+typedef struct {
+    const char *name;
+    uint32_t src_fourcc;
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_fourcc;
+    uint32_t dst_width;
+    uint32_t dst_height;
+    FFVAScalerMethod method;
+} Benchmark;
+
+static const Benchmark g_benchmarks[] = {
+    { "NV12 1080p to 720p, bilinear",
+      TEST_FOURCC_NV12, 1920, 1080, TEST_FOURCC_NV12, 1280, 720,
+      FFVA_SCALER_METHOD_BILINEAR },
+    { "NV12 1080p to I420 480p, bicubic",
+      TEST_FOURCC_NV12, 1920, 1080, TEST_FOURCC_I420, 854, 480,
+      FFVA_SCALER_METHOD_BICUBIC },
+    { "NV12 720p to 1080p, bicubic",
+      TEST_FOURCC_NV12, 1280, 720, TEST_FOURCC_NV12, 1920, 1080,
+      FFVA_SCALER_METHOD_BICUBIC },
+    { "NV12 to BGRA 1080p",
+      TEST_FOURCC_NV12, 1920, 1080, TEST_FOURCC_BGRA, 1920, 1080,
+      FFVA_SCALER_METHOD_BILINEAR },
+    { "RGBA to NV12 1080p",
+      TEST_FOURCC_RGBA, 1920, 1080, TEST_FOURCC_NV12, 1920, 1080,
+      FFVA_SCALER_METHOD_BILINEAR },
+};
+
+// Returns the average time of ffva_scaler_process(), in microseconds
+static double
+bench_scaler(const Benchmark *b, const TestImage *src, const TestImage *dst,
+    uint32_t num_threads, uint32_t num_iterations, const char **name_ptr)
+{
+    FFVAScaler *scaler;
+    uint64_t start_time;
+    uint32_t i;
+
+    scaler = ffva_scaler_new(num_threads);
+    if (!scaler)
+        return -1.0;
+    *name_ptr = ffva_scaler_get_kernels_name(scaler);
+
+    // Warm up worker threads, caches and filter tables
+    ffva_scaler_process(scaler, &src->image, NULL, &dst->image, NULL,
+        b->method);
+
+    start_time = get_time_us();
+    for (i = 0; i < num_iterations; i++) {
+        if (ffva_scaler_process(scaler, &src->image, NULL, &dst->image, NULL,
+                b->method) < 0)
+            break;
+    }
+    ffva_scaler_free(scaler);
+    if (i != num_iterations)
+        return -1.0;
+    return (double)(get_time_us() - start_time) / num_iterations;
+}
+
+// Returns the average time of sws_scale(), in microseconds
+static double
+bench_sws(const Benchmark *b, const TestImage *src, const TestImage *dst,
+    uint32_t num_iterations)
+{
+    struct SwsContext *sws;
+    const uint8_t *src_planes[3];
+    uint8_t *dst_planes[3];
+    int src_pitches[3], dst_pitches[3];
+    uint64_t start_time;
+    uint32_t i;
+
+    sws = sws_getContext(src->image.width, src->image.height,
+        test_image_get_pix_fmt(src), dst->image.width, dst->image.height,
+        test_image_get_pix_fmt(dst),
+        b->method == FFVA_SCALER_METHOD_BICUBIC ? SWS_BICUBIC : SWS_BILINEAR,
+        NULL, NULL, NULL);
+    if (!sws)
+        return -1.0;
+
+    test_image_get_planes(src, (uint8_t **)src_planes, src_pitches);
+    test_image_get_planes(dst, dst_planes, dst_pitches);
+    sws_scale(sws, src_planes, src_pitches, 0, src->image.height,
+        dst_planes, dst_pitches);
+
+    start_time = get_time_us();
+    for (i = 0; i < num_iterations; i++)
+        sws_scale(sws, src_planes, src_pitches, 0, src->image.height,
+            dst_planes, dst_pitches);
+    sws_freeContext(sws);
+    return (double)(get_time_us() - start_time) / num_iterations;
+}
+
+// Runs the supplied benchmark with one and with all threads, then swscale
+static bool
+run_benchmark(const Benchmark *b, uint32_t num_iterations)
+{
+    TestImage src = { { 0, } }, dst = { { 0, } };
+    const char *kernels_name = NULL;
+    double sws_time, st_time, mt_time;
+    bool success = false;
+
+    if (!test_image_init(&src, b->src_fourcc, b->src_width, b->src_height) ||
+        !test_image_init(&dst, b->dst_fourcc, b->dst_width, b->dst_height))
+        goto cleanup;
+    test_image_fill(&src);
+
+    st_time = bench_scaler(b, &src, &dst, 1, num_iterations, &kernels_name);
+    mt_time = bench_scaler(b, &src, &dst, 0, num_iterations, &kernels_name);
+    sws_time = bench_sws(b, &src, &dst, num_iterations);
+    if (st_time < 0.0 || mt_time < 0.0 || sws_time < 0.0)
+        goto cleanup;
+
+    printf("%-32s  %-6s  %8.2f  %8.2f  %8.2f  %5.2fx  %5.2fx\n", b->name,
+        kernels_name, st_time / 1000.0, mt_time / 1000.0, sws_time / 1000.0,
+        sws_time / st_time, sws_time / mt_time);
+    success = true;
+
+cleanup:
+    test_image_finalize(&src);
+    test_image_finalize(&dst);
+    return success;
+}
+
+int
+main(int argc, char *argv[])
+{
+    uint32_t i, num_iterations = DEFAULT_ITERATIONS;
+    int ret = EXIT_SUCCESS;
+
+    if (argc > 1)
+        num_iterations = FFMAX(strtoul(argv[1], NULL, 0), 1);
+
+    printf("Times in ms per frame, averaged over %u iterations, and gains "
+        "over swscale\nwith one and all threads. The kernels are selected "
+        "with the FFVA_KERNELS\nenvironment variable\n\n", num_iterations);
+    printf("%-32s  %-6s  %8s  %8s  %8s  %6s  %6s\n", "Benchmark", "Kernel",
+        "1 thread", "threads", "swscale", "gain", "gain");
+
+    for (i = 0; i < FF_ARRAY_ELEMS(g_benchmarks); i++) {
+        if (!run_benchmark(&g_benchmarks[i], num_iterations)) {
+            fprintf(stderr, "%s: failed to run benchmark\n",
+                g_benchmarks[i].name);
+            ret = EXIT_FAILURE;
+        }
+    }
+    return ret;
+}
@@ -56,4 +56,18 @@
 #define GL_RG8                  GL_RG8_EXT
 #endif
 
+/* Timer queries, from GL_ARB_timer_query or GL_EXT_disjoint_timer_query */
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED         0x88BF
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT         0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT     0x8FBB
+#endif
+
 #endif /* EGL_COMPAT_H */
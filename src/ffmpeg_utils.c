@@ -34,6 +34,44 @@ ffmpeg_strerror(int errnum, char errbuf[BUFSIZ])
     return errbuf;
 }
 
+// Opens and identifies the supplied media file, and selects its first video
+// stream
+int
+ffmpeg_open_video_stream(AVFormatContext **fmtctx_ptr, const char *filename,
+    AVDictionary **options, AVStream **stream_ptr)
+{
+    AVFormatContext *fmtctx;
+    AVStream *stream = NULL;
+    unsigned int i;
+    int ret;
+
+    ret = avformat_open_input(fmtctx_ptr, filename, NULL, options);
+    if (ret != 0)
+        return ret;
+    fmtctx = *fmtctx_ptr;
+    ret = avformat_find_stream_info(fmtctx, NULL);
+    if (ret < 0)
+        goto error;
+
+    for (i = 0; i < fmtctx->nb_streams; i++) {
+        if (fmtctx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
+            !stream)
+            stream = fmtctx->streams[i];
+        else
+            fmtctx->streams[i]->discard = AVDISCARD_ALL;
+    }
+    if (!stream) {
+        ret = AVERROR_STREAM_NOT_FOUND;
+        goto error;
+    }
+    *stream_ptr = stream;
+    return 0;
+
+error:
+    avformat_close_input(fmtctx_ptr);
+    return ret;
+}
+
 // Translates FFmpeg codec and profile to VA profile
 bool
 ffmpeg_to_vaapi_profile(enum AVCodecID ff_codec, int ff_profile,
@@ -102,6 +140,45 @@ ffmpeg_to_vaapi_profile(enum AVCodecID ff_codec, int ff_profile,
     return profile != -1;
 }
 
+// Translates FFmpeg codec and profile to the list of compatible VA profiles
+uint32_t
+ffmpeg_to_vaapi_profiles(enum AVCodecID ff_codec, int ff_profile,
+    VAProfile profiles[FFMPEG_MAX_VA_PROFILES])
+{
+    uint32_t num_profiles = 0;
+
+    if (!ffmpeg_to_vaapi_profile(ff_codec, ff_profile, &profiles[0]))
+        return 0;
+
+    // A decoder of a superset profile can decode the stream as well
+    switch (profiles[num_profiles++]) {
+    case VAProfileMPEG2Simple:
+        profiles[num_profiles++] = VAProfileMPEG2Main;
+        break;
+    case VAProfileMPEG4Simple:
+        profiles[num_profiles++] = VAProfileMPEG4AdvancedSimple;
+        // fall-through
+    case VAProfileMPEG4AdvancedSimple:
+        profiles[num_profiles++] = VAProfileMPEG4Main;
+        break;
+    case VAProfileH264ConstrainedBaseline:
+        profiles[num_profiles++] = VAProfileH264Main;
+        // fall-through
+    case VAProfileH264Main:
+        profiles[num_profiles++] = VAProfileH264High;
+        break;
+    case VAProfileVC1Simple:
+        profiles[num_profiles++] = VAProfileVC1Main;
+        // fall-through
+    case VAProfileVC1Main:
+        profiles[num_profiles++] = VAProfileVC1Advanced;
+        break;
+    default:
+        break;
+    }
+    return num_profiles;
+}
+
 struct ffva_pix_fmt_map {
     enum AVPixelFormat pix_fmt;
     uint32_t va_fourcc;
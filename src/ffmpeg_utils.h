@@ -30,11 +30,30 @@
 const char *
 ffmpeg_strerror(int errnum, char errbuf[BUFSIZ]);
 
+/**
+ * Opens and identifies the supplied media file, and selects its first video
+ * stream, discarding all others. On error, the file is closed again
+ */
+int
+ffmpeg_open_video_stream(AVFormatContext **fmtctx_ptr, const char *filename,
+    AVDictionary **options, AVStream **stream_ptr);
+
 /** Translates FFmpeg codec and profile to VA profile */
 bool
 ffmpeg_to_vaapi_profile(enum AVCodecID ff_codec, int ff_profile,
     VAProfile *profile_ptr);
 
+/** Maximum number of VA profiles compatible with an FFmpeg profile */
+#define FFMPEG_MAX_VA_PROFILES 3
+
+/**
+ * Translates FFmpeg codec and profile to the list of compatible VA
+ * profiles, in order of preference. Returns the number of profiles
+ */
+uint32_t
+ffmpeg_to_vaapi_profiles(enum AVCodecID ff_codec, int ff_profile,
+    VAProfile profiles[FFMPEG_MAX_VA_PROFILES]);
+
 /** Translates FFmpeg pixel format to a VA fourcc */
 bool
 ffmpeg_to_vaapi_pix_fmt(enum AVPixelFormat pix_fmt, uint32_t *fourcc_ptr,
@@ -0,0 +1,596 @@
+/*
+ * ffvacopier.c - Fast copy from uncached surface memory
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <libavutil/common.h>
+#include "ffvacopier.h"
+#include "ffvakernels.h"
+
+#if USE_X86_KERNELS
+# include <immintrin.h>
+#endif
+#if USE_NEON_KERNELS
+# include <arm_neon.h>
+#endif
+
+/* Maximum number of planes of any supported format */
+#define FFVA_COPIER_MAX_PLANES 3
+
+/* Number of bytes read at once into the bounce buffer, which has to fit
+   into the L1 cache along with the destination rows */
+#define CHUNK_SIZE 4096
+
+/* Largest alignment required by streaming loads */
+#define MAX_LOAD_ALIGN 32
+
+typedef enum {
+    OP_COPY = 0,
+    OP_DEINTERLEAVE,
+    OP_EXPAND_P010,
+} Operation;
+
+typedef enum {
+    CONVERSION_NONE = 0,
+    CONVERSION_NV12_TO_NV12,
+    CONVERSION_NV12_TO_I420,
+    CONVERSION_NV12_TO_YV12,
+    CONVERSION_P010_TO_P010,
+    CONVERSION_P010_TO_P016,
+} Conversion;
+
+typedef struct {
+    uint32_t src_fourcc;
+    uint32_t dst_fourcc;
+    Conversion conversion;
+} ConversionInfo;
+
+typedef struct {
+    Operation op;
+    const uint8_t *src;
+    uint32_t src_pitch;
+    uint8_t *dst[2];
+    uint32_t dst_pitches[2];
+    uint32_t row_size;                  /* in bytes, of source rows */
+    uint32_t height;
+} PlaneCopy;
+
+typedef struct {
+    FFVACopier *copier;
+    PlaneCopy planes[FFVA_COPIER_MAX_PLANES];
+    uint32_t num_planes;
+} CopyArgs;
+
+typedef struct {
+    uint32_t load_align;
+    void (*stream_load)(uint8_t *dst, const uint8_t *src, uint32_t n);
+    void (*deinterleave)(uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src,
+        uint32_t n);
+    void (*expand_p010)(uint16_t *dst, const uint16_t *src, uint32_t n);
+} Kernels;
+
+struct ffva_copier_s {
+    const void *klass;
+    const Kernels *kernels;
+    const char *kernels_name;
+    FFVASlicePool *pool;
+    uint8_t *bounce[FFVA_SLICE_POOL_MAX_THREADS];
+};
+
+static const ConversionInfo g_conversions[] = {
+    { VA_FOURCC('N','V','1','2'), VA_FOURCC('N','V','1','2'),
+      CONVERSION_NV12_TO_NV12 },
+    { VA_FOURCC('N','V','1','2'), VA_FOURCC('I','4','2','0'),
+      CONVERSION_NV12_TO_I420 },
+    { VA_FOURCC('N','V','1','2'), VA_FOURCC('Y','V','1','2'),
+      CONVERSION_NV12_TO_YV12 },
+    { VA_FOURCC('P','0','1','0'), VA_FOURCC('P','0','1','0'),
+      CONVERSION_P010_TO_P010 },
+    { VA_FOURCC('P','0','1','0'), VA_FOURCC('P','0','1','6'),
+      CONVERSION_P010_TO_P016 },
+    { 0, }
+};
+
+static Conversion
+find_conversion(uint32_t src_fourcc, uint32_t dst_fourcc)
+{
+    const ConversionInfo *c;
+
+    for (c = g_conversions; c->src_fourcc != 0; c++) {
+        if (c->src_fourcc == src_fourcc && c->dst_fourcc == dst_fourcc)
+            return c->conversion;
+    }
+    return CONVERSION_NONE;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Kernels                                                           --- */
+/* ------------------------------------------------------------------------- */
+
+// Splits n pairs of interleaved U/V samples into separate planes
+static void
+deinterleave_c(uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src,
+    uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        dst_u[i] = src[2 * i];
+        dst_v[i] = src[2 * i + 1];
+    }
+}
+
+// Expands n MSB-aligned 10-bit samples to the full 16-bit range
+static void
+expand_p010_c(uint16_t *dst, const uint16_t *src, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = src[i] | (src[i] >> 10);
+}
+
+static const Kernels g_kernels_c = {
+    1, NULL, deinterleave_c, expand_p010_c
+};
+
+#if USE_X86_KERNELS
+// Reads n bytes of uncached memory with streaming loads. Both src and n
+// are multiples of 16 bytes
+static void __attribute__((target("sse4.1")))
+stream_load_sse4(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    uint32_t i;
+
+    _mm_mfence();
+    for (i = 0; i + 64 <= n; i += 64) {
+        const __m128i a = _mm_stream_load_si128((__m128i *)(src + i));
+        const __m128i b = _mm_stream_load_si128((__m128i *)(src + i + 16));
+        const __m128i c = _mm_stream_load_si128((__m128i *)(src + i + 32));
+        const __m128i d = _mm_stream_load_si128((__m128i *)(src + i + 48));
+
+        _mm_storeu_si128((__m128i *)(dst + i), a);
+        _mm_storeu_si128((__m128i *)(dst + i + 16), b);
+        _mm_storeu_si128((__m128i *)(dst + i + 32), c);
+        _mm_storeu_si128((__m128i *)(dst + i + 48), d);
+    }
+    for (; i < n; i += 16)
+        _mm_storeu_si128((__m128i *)(dst + i),
+            _mm_stream_load_si128((__m128i *)(src + i)));
+}
+
+static void __attribute__((target("sse4.1")))
+deinterleave_sse4(uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src,
+    uint32_t n)
+{
+    const __m128i mask = _mm_set1_epi16(0xff);
+    uint32_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *)&src[2 * i]);
+        const __m128i b = _mm_loadu_si128((const __m128i *)&src[2 * i + 16]);
+
+        _mm_storeu_si128((__m128i *)&dst_u[i], _mm_packus_epi16(
+                _mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)&dst_v[i], _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+
+    if (i < n)
+        deinterleave_c(dst_u + i, dst_v + i, src + 2 * i, n - i);
+}
+
+static void __attribute__((target("sse4.1")))
+expand_p010_sse4(uint16_t *dst, const uint16_t *src, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+
+        _mm_storeu_si128((__m128i *)&dst[i],
+            _mm_or_si128(v, _mm_srli_epi16(v, 10)));
+    }
+
+    if (i < n)
+        expand_p010_c(dst + i, src + i, n - i);
+}
+
+static const Kernels g_kernels_sse4 = {
+    16, stream_load_sse4, deinterleave_sse4, expand_p010_sse4
+};
+
+// Reads n bytes of uncached memory with streaming loads. Both src and n
+// are multiples of 32 bytes
+static void __attribute__((target("avx2")))
+stream_load_avx2(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    uint32_t i;
+
+    _mm_mfence();
+    for (i = 0; i + 128 <= n; i += 128) {
+        const __m256i a = _mm256_stream_load_si256((__m256i *)(src + i));
+        const __m256i b = _mm256_stream_load_si256((__m256i *)(src + i + 32));
+        const __m256i c = _mm256_stream_load_si256((__m256i *)(src + i + 64));
+        const __m256i d = _mm256_stream_load_si256((__m256i *)(src + i + 96));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), a);
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), b);
+        _mm256_storeu_si256((__m256i *)(dst + i + 64), c);
+        _mm256_storeu_si256((__m256i *)(dst + i + 96), d);
+    }
+    for (; i < n; i += 32)
+        _mm256_storeu_si256((__m256i *)(dst + i),
+            _mm256_stream_load_si256((__m256i *)(src + i)));
+}
+
+static void __attribute__((target("avx2")))
+deinterleave_avx2(uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src,
+    uint32_t n)
+{
+    const __m256i mask = _mm256_set1_epi16(0xff);
+    uint32_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)&src[2 * i]);
+        const __m256i b =
+            _mm256_loadu_si256((const __m256i *)&src[2 * i + 32]);
+        const __m256i u = _mm256_packus_epi16(
+            _mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        const __m256i v = _mm256_packus_epi16(
+            _mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+
+        // Packing operates on 128-bit lanes, restore the sample order
+        _mm256_storeu_si256((__m256i *)&dst_u[i],
+            _mm256_permute4x64_epi64(u, _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_si256((__m256i *)&dst_v[i],
+            _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    if (i < n)
+        deinterleave_sse4(dst_u + i, dst_v + i, src + 2 * i, n - i);
+}
+
+static void __attribute__((target("avx2")))
+expand_p010_avx2(uint16_t *dst, const uint16_t *src, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&src[i]);
+
+        _mm256_storeu_si256((__m256i *)&dst[i],
+            _mm256_or_si256(v, _mm256_srli_epi16(v, 10)));
+    }
+
+    if (i < n)
+        expand_p010_sse4(dst + i, src + i, n - i);
+}
+
+static const Kernels g_kernels_avx2 = {
+    32, stream_load_avx2, deinterleave_avx2, expand_p010_avx2
+};
+#endif
+
+#if USE_NEON_KERNELS
+static void
+deinterleave_neon(uint8_t *dst_u, uint8_t *dst_v, const uint8_t *src,
+    uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        const uint8x16x2_t uv = vld2q_u8(&src[2 * i]);
+
+        vst1q_u8(&dst_u[i], uv.val[0]);
+        vst1q_u8(&dst_v[i], uv.val[1]);
+    }
+
+    if (i < n)
+        deinterleave_c(dst_u + i, dst_v + i, src + 2 * i, n - i);
+}
+
+static void
+expand_p010_neon(uint16_t *dst, const uint16_t *src, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        const uint16x8_t v = vld1q_u16(&src[i]);
+
+        vst1q_u16(&dst[i], vorrq_u16(v, vshrq_n_u16(v, 10)));
+    }
+
+    if (i < n)
+        expand_p010_c(dst + i, src + i, n - i);
+}
+
+// There are no streaming loads on ARM, surfaces are read directly
+static const Kernels g_kernels_neon = {
+    1, NULL, deinterleave_neon, expand_p010_neon
+};
+#endif
+
+// Kernels sets, best first
+static const FFVAKernelsInfo g_kernels_list[] = {
+#if USE_X86_KERNELS
+    { "AVX2",   FFVA_CPU_FEATURE_AVX2,   &g_kernels_avx2 },
+    { "SSE4.1", FFVA_CPU_FEATURE_SSE4_1, &g_kernels_sse4 },
+#endif
+#if USE_NEON_KERNELS
+    { "NEON",   FFVA_CPU_FEATURE_NEON,   &g_kernels_neon },
+#endif
+    { "C",      0,                       &g_kernels_c },
+};
+
+/* ------------------------------------------------------------------------- */
+/* --- Copy                                                              --- */
+/* ------------------------------------------------------------------------- */
+
+// Reads n bytes from src into the bounce buffer, and returns where they
+// start in there. Streaming loads are aligned, and so could read a little
+// before and after, though never across a page boundary
+static const uint8_t *
+load_chunk(const Kernels *kernels, uint8_t *bounce, const uint8_t *src,
+    uint32_t n)
+{
+    const uintptr_t mask = kernels->load_align - 1;
+    const uint32_t offset = (uintptr_t)src & mask;
+
+    if (!kernels->stream_load)
+        return src;
+
+    kernels->stream_load(bounce, src - offset, (offset + n + mask) & ~mask);
+    return bounce + offset;
+}
+
+static void
+copy_row(FFVACopier *copier, uint8_t *bounce, const PlaneCopy *pc,
+    uint32_t y)
+{
+    const Kernels * const kernels = copier->kernels;
+    const uint8_t * const src = pc->src + y * pc->src_pitch;
+    uint8_t * const dst0 = pc->dst[0] + y * pc->dst_pitches[0];
+    uint8_t * const dst1 = pc->dst[1] ? pc->dst[1] + y * pc->dst_pitches[1] :
+        NULL;
+    const uint8_t *p;
+    uint32_t x, n;
+
+    for (x = 0; x < pc->row_size; x += n) {
+        n = FFMIN(pc->row_size - x, CHUNK_SIZE);
+        p = load_chunk(kernels, bounce, src + x, n);
+        switch (pc->op) {
+        case OP_COPY:
+            memcpy(dst0 + x, p, n);
+            break;
+        case OP_DEINTERLEAVE:
+            kernels->deinterleave(dst0 + x / 2, dst1 + x / 2, p, n / 2);
+            break;
+        case OP_EXPAND_P010:
+            kernels->expand_p010((uint16_t *)(dst0 + x),
+                (const uint16_t *)p, n / 2);
+            break;
+        }
+    }
+}
+
+static void
+copy_slice(void *arg, uint32_t slice, uint32_t num_slices)
+{
+    const CopyArgs * const args = arg;
+    FFVACopier * const copier = args->copier;
+    uint32_t i, y, y0, y1;
+
+    for (i = 0; i < args->num_planes; i++) {
+        const PlaneCopy * const pc = &args->planes[i];
+
+        ffva_slice_get_range(pc->height, 1, slice, num_slices, &y0, &y1);
+        for (y = y0; y < y1; y++)
+            copy_row(copier, copier->bounce[slice], pc, y);
+    }
+}
+
+static void
+init_plane_copy(PlaneCopy *pc, Operation op, const FFVAScalerImage *src,
+    uint32_t src_plane, const FFVAScalerImage *dst, uint32_t dst_plane,
+    uint32_t row_size, uint32_t height)
+{
+    pc->op = op;
+    pc->src = src->pixels[src_plane];
+    pc->src_pitch = src->pitches[src_plane];
+    pc->dst[0] = dst->pixels[dst_plane];
+    pc->dst_pitches[0] = dst->pitches[dst_plane];
+    pc->dst[1] = NULL;
+    pc->dst_pitches[1] = 0;
+    pc->row_size = row_size;
+    pc->height = height;
+}
+
+// Determines the plane copies for the supplied images
+static int
+init_copy_args(CopyArgs *args, const FFVAScalerImage *src,
+    const FFVAScalerImage *dst)
+{
+    const uint32_t chroma_width = (src->width + 1) & ~1U;
+    const uint32_t chroma_height = (src->height + 1) / 2;
+    PlaneCopy *pc;
+    uint32_t u;
+
+    switch (find_conversion(src->fourcc, dst->fourcc)) {
+    case CONVERSION_NV12_TO_NV12:
+        init_plane_copy(&args->planes[0], OP_COPY, src, 0, dst, 0,
+            src->width, src->height);
+        init_plane_copy(&args->planes[1], OP_COPY, src, 1, dst, 1,
+            chroma_width, chroma_height);
+        args->num_planes = 2;
+        break;
+    case CONVERSION_NV12_TO_I420:
+    case CONVERSION_NV12_TO_YV12:
+        init_plane_copy(&args->planes[0], OP_COPY, src, 0, dst, 0,
+            src->width, src->height);
+        // YV12 stores the V plane before the U plane
+        u = dst->fourcc == VA_FOURCC('Y','V','1','2') ? 2 : 1;
+        pc = &args->planes[1];
+        init_plane_copy(pc, OP_DEINTERLEAVE, src, 1, dst, u,
+            chroma_width, chroma_height);
+        pc->dst[1] = dst->pixels[3 - u];
+        pc->dst_pitches[1] = dst->pitches[3 - u];
+        args->num_planes = 2;
+        break;
+    case CONVERSION_P010_TO_P010:
+        init_plane_copy(&args->planes[0], OP_COPY, src, 0, dst, 0,
+            src->width * 2, src->height);
+        init_plane_copy(&args->planes[1], OP_COPY, src, 1, dst, 1,
+            chroma_width * 2, chroma_height);
+        args->num_planes = 2;
+        break;
+    case CONVERSION_P010_TO_P016:
+        init_plane_copy(&args->planes[0], OP_EXPAND_P010, src, 0, dst, 0,
+            src->width * 2, src->height);
+        init_plane_copy(&args->planes[1], OP_EXPAND_P010, src, 1, dst, 1,
+            chroma_width * 2, chroma_height);
+        args->num_planes = 2;
+        break;
+    default:
+        return AVERROR(ENOTSUP);
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Interface                                                         --- */
+/* ------------------------------------------------------------------------- */
+
+static const AVClass *
+ffva_copier_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVACopier",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Creates a new copier with num_threads row slices (0 = automatic)
+FFVACopier *
+ffva_copier_new(uint32_t num_threads)
+{
+    const FFVAKernelsInfo *kernels_info;
+    FFVACopier *copier;
+    uint32_t i;
+
+    copier = calloc(1, sizeof(*copier));
+    if (!copier)
+        return NULL;
+
+    copier->klass = ffva_copier_class();
+    kernels_info = ffva_kernels_select(g_kernels_list,
+        FF_ARRAY_ELEMS(g_kernels_list));
+    copier->kernels = kernels_info->kernels;
+    copier->kernels_name = kernels_info->name;
+    copier->pool = ffva_slice_pool_new(num_threads);
+    if (!copier->pool)
+        goto error_create_pool;
+    num_threads = ffva_slice_pool_get_num_threads(copier->pool);
+
+    for (i = 0; i < num_threads; i++) {
+        copier->bounce[i] = av_malloc(CHUNK_SIZE + 2 * MAX_LOAD_ALIGN);
+        if (!copier->bounce[i])
+            goto error_alloc_bounce;
+    }
+
+    av_log(copier, AV_LOG_VERBOSE, "using %s kernels, %u threads\n",
+        copier->kernels_name, num_threads);
+    return copier;
+
+    /* ERRORS */
+error_create_pool:
+    av_log(copier, AV_LOG_ERROR, "failed to create worker threads\n");
+    ffva_copier_free(copier);
+    return NULL;
+error_alloc_bounce:
+    av_log(copier, AV_LOG_ERROR, "failed to allocate bounce buffer\n");
+    ffva_copier_free(copier);
+    return NULL;
+}
+
+// Destroys the supplied copier
+void
+ffva_copier_free(FFVACopier *copier)
+{
+    uint32_t i;
+
+    if (!copier)
+        return;
+
+    ffva_slice_pool_free(copier->pool);
+    for (i = 0; i < FFVA_SLICE_POOL_MAX_THREADS; i++)
+        av_freep(&copier->bounce[i]);
+    free(copier);
+}
+
+// Releases copier and resets the supplied pointer to NULL
+void
+ffva_copier_freep(FFVACopier **copier_ptr)
+{
+    if (!copier_ptr)
+        return;
+    ffva_copier_free(*copier_ptr);
+    *copier_ptr = NULL;
+}
+
+// Returns the name of the kernels selected for this CPU
+const char *
+ffva_copier_get_kernels_name(FFVACopier *copier)
+{
+    return copier ? copier->kernels_name : NULL;
+}
+
+// Determines whether images could be copied between the supplied fourccs
+bool
+ffva_copier_has_conversion(uint32_t src_fourcc, uint32_t dst_fourcc)
+{
+    return find_conversion(src_fourcc, dst_fourcc) != CONVERSION_NONE;
+}
+
+// Copies src_image into dst_image, of the same size
+int
+ffva_copier_copy(FFVACopier *copier, const FFVAScalerImage *src_image,
+    const FFVAScalerImage *dst_image)
+{
+    CopyArgs args;
+    int ret;
+
+    if (!copier || !src_image || !dst_image)
+        return AVERROR(EINVAL);
+    if (src_image->width != dst_image->width ||
+        src_image->height != dst_image->height)
+        return AVERROR(EINVAL);
+
+    ret = init_copy_args(&args, src_image, dst_image);
+    if (ret < 0)
+        return ret;
+    args.copier = copier;
+    ffva_slice_pool_run(copier->pool, copy_slice, &args);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * ffvacopier.h - Fast copy from uncached surface memory
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_COPIER_H
+#define FFVA_COPIER_H
+
+#include "ffvascaler.h"
+
+/*
+ * Mapped VA surfaces are often uncached, or write-combined, memory that
+ * plain loads read very slowly. The copier reads such memory in chunks
+ * with streaming loads (MOVNTDQA), into a small buffer that remains in
+ * cache, and copies or de-interleaves the pixels from there. Row slices
+ * of each plane are processed in parallel. Kernels are selected at run
+ * time for the CPU: AVX2, SSE4.1, NEON or plain C. They also work on
+ * ordinary cached memory, e.g. for software decoded frames.
+ */
+
+typedef struct ffva_copier_s            FFVACopier;
+
+/** Creates a new copier with num_threads row slices (0 = automatic) */
+FFVACopier *
+ffva_copier_new(uint32_t num_threads);
+
+/** Destroys the supplied copier */
+void
+ffva_copier_free(FFVACopier *copier);
+
+/** Releases copier and resets the supplied pointer to NULL */
+void
+ffva_copier_freep(FFVACopier **copier_ptr);
+
+/** Returns the name of the kernels selected for this CPU */
+const char *
+ffva_copier_get_kernels_name(FFVACopier *copier);
+
+/** Determines whether images could be copied between the supplied fourccs */
+bool
+ffva_copier_has_conversion(uint32_t src_fourcc, uint32_t dst_fourcc);
+
+/**
+ * Copies src_image into dst_image, of the same size. Supported copies are
+ * NV12 to NV12, I420 or YV12, and P010 to P010 or P016, with the 10-bit
+ * samples expanded to the full 16-bit range in the latter case
+ */
+int
+ffva_copier_copy(FFVACopier *copier, const FFVAScalerImage *src_image,
+    const FFVAScalerImage *dst_image);
+
+#endif /* FFVA_COPIER_H */
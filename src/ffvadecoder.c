@@ -23,7 +23,9 @@
 #include "sysdeps.h"
 #include <pthread.h>
 #include <libavformat/avformat.h>
+#include <libavutil/dict.h>
 #include <libavutil/pixdesc.h>
+#include <libavutil/mathematics.h>
 #include <libavcodec/vaapi.h>
 #include "ffvadecoder.h"
 #include "ffvadisplay.h"
@@ -32,6 +34,7 @@
 #include "ffmpeg_compat.h"
 #include "ffmpeg_utils.h"
 #include "vaapi_utils.h"
+#include "time_utils.h"
 
 enum {
     STATE_INITIALIZED   = 1 << 0,
@@ -52,13 +55,28 @@ struct ffva_decoder_s {
     uint32_t num_va_profiles;
     FFVASurface *va_surfaces;
     uint32_t num_va_surfaces;
+    uint32_t va_surfaces_fourcc;
+    uint32_t num_extra_surfaces;
     FFVASurface **va_surfaces_queue;
+    pthread_mutex_t va_surfaces_queue_lock;
     uint32_t va_surfaces_queue_length;
     uint32_t va_surfaces_queue_head;
     uint32_t va_surfaces_queue_tail;
+    FFVADecoderCreateSurfacesFunc create_surfaces;
+    void *create_surfaces_data;
 
     volatile uint32_t state;
+    uint32_t flags;
     FFVADecoderFrame decoded_frame;
+    AVRational time_base;
+    AVRational frame_rate;
+    int64_t next_pts;
+
+    /* Elementary stream input, i.e. when there is no demuxer */
+    uint8_t *packet_buf;
+    uint32_t packet_buf_size;
+    bool has_pending_frame;
+    bool draining;
 };
 
 /* ------------------------------------------------------------------------ */
@@ -146,33 +164,56 @@ vaapi_acquire_surface(FFVADecoder *dec, FFVASurface **out_surface_ptr)
 {
     FFVASurface *surface;
 
+    pthread_mutex_lock(&dec->va_surfaces_queue_lock);
     surface = dec->va_surfaces_queue[dec->va_surfaces_queue_head];
+    if (surface) {
+        dec->va_surfaces_queue[dec->va_surfaces_queue_head] = NULL;
+        dec->va_surfaces_queue_head = (dec->va_surfaces_queue_head + 1) %
+            dec->va_surfaces_queue_length;
+    }
+    pthread_mutex_unlock(&dec->va_surfaces_queue_lock);
     if (!surface)
         return AVERROR_BUG;
 
-    dec->va_surfaces_queue[dec->va_surfaces_queue_head] = NULL;
-    dec->va_surfaces_queue_head = (dec->va_surfaces_queue_head + 1) %
-        dec->va_surfaces_queue_length;
-
     if (out_surface_ptr)
         *out_surface_ptr = surface;
     return 0;
 }
 
-// Releases a surface back to the queue of free VA surfaces
+// Releases a surface back to the queue of free VA surfaces. Decoded frames
+// could be released from another thread than the decoding one
 static int
 vaapi_release_surface(FFVADecoder *dec, FFVASurface *s)
 {
-    FFVASurface * const surface_in_queue =
-        dec->va_surfaces_queue[dec->va_surfaces_queue_tail];
+    int ret = 0;
+
+    pthread_mutex_lock(&dec->va_surfaces_queue_lock);
+    if (dec->va_surfaces_queue[dec->va_surfaces_queue_tail])
+        ret = AVERROR_BUG;
+    else {
+        dec->va_surfaces_queue[dec->va_surfaces_queue_tail] = s;
+        dec->va_surfaces_queue_tail = (dec->va_surfaces_queue_tail + 1) %
+            dec->va_surfaces_queue_length;
+    }
+    pthread_mutex_unlock(&dec->va_surfaces_queue_lock);
+    return ret;
+}
 
-    if (surface_in_queue)
-        return AVERROR_BUG;
+// Checks whether a surface is available for decoding the next frame
+static bool
+vaapi_has_free_surface(FFVADecoder *dec)
+{
+    bool has_free_surface;
 
-    dec->va_surfaces_queue[dec->va_surfaces_queue_tail] = s;
-    dec->va_surfaces_queue_tail = (dec->va_surfaces_queue_tail + 1) %
-        dec->va_surfaces_queue_length;
-    return 0;
+    // The surfaces are only allocated once the first frame is decoded
+    if (dec->va_surfaces_queue_length == 0)
+        return true;
+
+    pthread_mutex_lock(&dec->va_surfaces_queue_lock);
+    has_free_surface =
+        dec->va_surfaces_queue[dec->va_surfaces_queue_head] != NULL;
+    pthread_mutex_unlock(&dec->va_surfaces_queue_lock);
+    return has_free_surface;
 }
 
 // Checks whether the supplied config, i.e. (profile, entrypoint) pair, exists
@@ -193,6 +234,46 @@ vaapi_has_config(FFVADecoder *dec, VAProfile profile, VAEntrypoint entrypoint)
     return true;
 }
 
+// Creates the pool of VA surfaces, from external memory if possible
+static VAStatus
+vaapi_create_surfaces(FFVADecoder *dec, uint32_t chroma, uint32_t width,
+    uint32_t height, VASurfaceID *surfaces, uint32_t num_surfaces)
+{
+    struct vaapi_context * const vactx = &dec->va_context;
+    int ret;
+
+    if (dec->create_surfaces) {
+        ret = dec->create_surfaces(dec->create_surfaces_data, chroma,
+            width, height, surfaces, num_surfaces);
+        if (ret == 0)
+            return VA_STATUS_SUCCESS;
+        if (ret != AVERROR(ENOSYS))
+            av_log(dec, AV_LOG_WARNING, "failed to allocate external "
+                "surfaces, falling back to VA driver allocation\n");
+    }
+    return vaCreateSurfaces(vactx->display, width, height, chroma,
+        num_surfaces, surfaces);
+}
+
+// Determines the format of the supplied VA surface, as laid out in memory
+// by the VA driver, or assumes NV12 if the driver could not tell
+static uint32_t
+vaapi_get_surface_fourcc(FFVADecoder *dec, VASurfaceID va_surface)
+{
+    struct vaapi_context * const vactx = &dec->va_context;
+    VAImage va_image;
+    VAStatus va_status;
+    uint32_t fourcc;
+
+    va_status = vaDeriveImage(vactx->display, va_surface, &va_image);
+    if (va_status != VA_STATUS_SUCCESS)
+        return VA_FOURCC('N','V','1','2');
+
+    fourcc = va_image.format.fourcc;
+    vaDestroyImage(vactx->display, va_image.image_id);
+    return fourcc;
+}
+
 // Initializes VA decoder comprising of VA config, surfaces and context
 static int
 vaapi_init_decoder(FFVADecoder *dec, VAProfile profile, VAEntrypoint entrypoint)
@@ -226,7 +307,8 @@ vaapi_init_decoder(FFVADecoder *dec, VAProfile profile, VAEntrypoint entrypoint)
         return vaapi_to_ffmpeg_error(va_status);
 
     static const int SCRATCH_SURFACES = 4;
-    ret = vaapi_ensure_surfaces(dec, avctx->refs + 1 + SCRATCH_SURFACES);
+    ret = vaapi_ensure_surfaces(dec, avctx->refs + 1 + SCRATCH_SURFACES +
+        dec->num_extra_surfaces);
     if (ret != 0)
         goto error_cleanup;
 
@@ -234,16 +316,18 @@ vaapi_init_decoder(FFVADecoder *dec, VAProfile profile, VAEntrypoint entrypoint)
     if (!va_surfaces)
         goto error_cleanup;
 
-    va_status = vaCreateSurfaces(vactx->display,
-        avctx->coded_width, avctx->coded_height, VA_RT_FORMAT_YUV420,
-        dec->num_va_surfaces, va_surfaces);
+    va_status = vaapi_create_surfaces(dec, VA_RT_FORMAT_YUV420,
+        avctx->coded_width, avctx->coded_height, va_surfaces,
+        dec->num_va_surfaces);
     if (!va_check_status(va_status, "vaCreateSurfaces()"))
         goto error_cleanup;
 
+    dec->va_surfaces_fourcc = vaapi_get_surface_fourcc(dec, va_surfaces[0]);
     for (i = 0; i < dec->num_va_surfaces; i++) {
         FFVASurface * const s = &dec->va_surfaces[i];
         ffva_surface_init(s, va_surfaces[i], VA_RT_FORMAT_YUV420,
             avctx->coded_width, avctx->coded_height);
+        s->fourcc = dec->va_surfaces_fourcc;
         dec->va_surfaces_queue[i] = s;
     }
     dec->va_surfaces_queue_head = 0;
@@ -311,57 +395,45 @@ static enum AVPixelFormat
 vaapi_get_format(AVCodecContext *avctx, const enum AVPixelFormat *pix_fmts)
 {
     FFVADecoder * const dec = avctx->opaque;
-    VAProfile profiles[3];
+    VAProfile profiles[FFMPEG_MAX_VA_PROFILES];
     uint32_t i, num_profiles;
 
+    // Decode in software only, without VA display
+    if (!dec->va_context.display)
+        goto error_no_va_decoder;
+
     // Find a VA format
     for (i = 0; pix_fmts[i] != AV_PIX_FMT_NONE; i++) {
         if (pix_fmts[i] == AV_PIX_FMT_VAAPI)
             break;
     }
     if (pix_fmts[i] == AV_PIX_FMT_NONE)
-        return AV_PIX_FMT_NONE;
+        goto error_no_va_decoder;
 
     // Find a suitable VA profile that fits FFmpeg config
-    num_profiles = 0;
-    if (!ffmpeg_to_vaapi_profile(avctx->codec_id, avctx->profile,
-            &profiles[num_profiles]))
-        return AV_PIX_FMT_NONE;
+    num_profiles = ffmpeg_to_vaapi_profiles(avctx->codec_id, avctx->profile,
+        profiles);
+    if (num_profiles == 0)
+        goto error_no_va_decoder;
 
-    switch (profiles[num_profiles++]) {
-    case VAProfileMPEG2Simple:
-        profiles[num_profiles++] = VAProfileMPEG2Main;
-        break;
-    case VAProfileMPEG4Simple:
-        profiles[num_profiles++] = VAProfileMPEG4AdvancedSimple;
-        // fall-through
-    case VAProfileMPEG4AdvancedSimple:
-        profiles[num_profiles++] = VAProfileMPEG4Main;
-        break;
-    case VAProfileH264ConstrainedBaseline:
-        profiles[num_profiles++] = VAProfileH264Main;
-        // fall-through
-    case VAProfileH264Main:
-        profiles[num_profiles++] = VAProfileH264High;
-        break;
-    case VAProfileVC1Simple:
-        profiles[num_profiles++] = VAProfileVC1Main;
-        // fall-through
-    case VAProfileVC1Main:
-        profiles[num_profiles++] = VAProfileVC1Advanced;
-        break;
-    default:
-        break;
-    }
     for (i = 0; i < num_profiles; i++) {
         if (vaapi_has_config(dec, profiles[i], VAEntrypointVLD))
             break;
     }
     if (i == num_profiles)
-        return AV_PIX_FMT_NONE;
+        goto error_no_va_decoder;
     if (vaapi_init_decoder(dec, profiles[i], VAEntrypointVLD) < 0)
-        return AV_PIX_FMT_NONE;
+        goto error_no_va_decoder;
     return AV_PIX_FMT_VAAPI;
+
+    /* ERRORS */
+error_no_va_decoder:
+    if (!(dec->flags & FFVA_DECODER_FLAG_SOFTWARE_FALLBACK))
+        return AV_PIX_FMT_NONE;
+    av_log(dec, AV_LOG_WARNING, "no VA-API decoder for codec %d, profile "
+        "%d, falling back to software decoding\n", avctx->codec_id,
+        avctx->profile);
+    return avcodec_default_get_format(avctx, pix_fmts);
 }
 
 // Common initialization of AVFrame fields for VA-API purposes
@@ -386,7 +458,8 @@ vaapi_get_buffer2(AVCodecContext *avctx, AVFrame *frame, int flags)
     AVBufferRef *buf;
     int ret;
 
-    if (!(avctx->codec->capabilities & CODEC_CAP_DR1))
+    if (!(avctx->codec->capabilities & CODEC_CAP_DR1) ||
+        frame->format != AV_PIX_FMT_VAAPI)
         return avcodec_default_get_buffer2(avctx, frame, flags);
 
     ret = vaapi_acquire_surface(dec, &s);
@@ -414,6 +487,9 @@ vaapi_get_buffer(AVCodecContext *avctx, AVFrame *frame)
     FFVASurface *s;
     int ret;
 
+    if (avctx->pix_fmt != AV_PIX_FMT_VAAPI)
+        return avcodec_default_get_buffer(avctx, frame);
+
     ret = vaapi_acquire_surface(dec, &s);
     if (ret != 0)
         return ret;
@@ -441,8 +517,14 @@ static void
 vaapi_release_buffer(AVCodecContext *avctx, AVFrame *frame)
 {
     FFVADecoder * const dec = avctx->opaque;
-    FFVASurface * const s = vaapi_get_frame_surface(avctx, frame);
+    FFVASurface *s;
+
+    if (avctx->pix_fmt != AV_PIX_FMT_VAAPI) {
+        avcodec_default_release_buffer(avctx, frame);
+        return;
+    }
 
+    s = vaapi_get_frame_surface(avctx, frame);
     memset(frame->data, 0, sizeof(frame->data));
     if (s && vaapi_release_surface(dec, s) != 0)
         return;
@@ -479,7 +561,8 @@ vaapi_init(FFVADecoder *dec)
     memset(vactx, 0, sizeof(*vactx));
     vactx->config_id = VA_INVALID_ID;
     vactx->context_id = VA_INVALID_ID;
-    vactx->display = dec->display->va_display;
+    vactx->display = dec->display ? dec->display->va_display : NULL;
+    pthread_mutex_init(&dec->va_surfaces_queue_lock, NULL);
 }
 
 // Destroys all VA-API related resources
@@ -503,6 +586,7 @@ vaapi_finalize(FFVADecoder *dec)
     dec->va_surfaces_queue_length = 0;
     free(dec->va_profiles);
     dec->num_va_profiles = 0;
+    pthread_mutex_destroy(&dec->va_surfaces_queue_lock);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -529,6 +613,27 @@ decoder_init_context(FFVADecoder *dec, AVCodecContext *avctx)
     vaapi_init_context(dec);
 }
 
+// Decodes keyframes only, if requested. Frame threading is disabled as it
+// delays the output by one frame per thread, i.e. by as many keyframes
+static void
+decoder_init_skip_frame(FFVADecoder *dec)
+{
+    AVCodecContext * const avctx = dec->avctx;
+
+    if (!(dec->flags & FFVA_DECODER_FLAG_KEYFRAMES_ONLY))
+        return;
+    avctx->skip_frame = AVDISCARD_NONKEY;
+    avctx->thread_type &= ~FF_THREAD_FRAME;
+}
+
+// Checks whether the supplied packet is dropped before decoding
+static inline bool
+decoder_skip_packet(FFVADecoder *dec, int pkt_flags)
+{
+    return (dec->flags & FFVA_DECODER_FLAG_KEYFRAMES_ONLY) &&
+        !(pkt_flags & AV_PKT_FLAG_KEY);
+}
+
 static int
 decoder_init(FFVADecoder *dec, FFVADisplay *display)
 {
@@ -551,38 +656,48 @@ decoder_finalize(FFVADecoder *dec)
 static int
 decoder_open(FFVADecoder *dec, const char *filename)
 {
-    AVFormatContext *fmtctx;
     AVCodecContext *avctx;
     AVCodec *codec;
+    AVDictionary *options = NULL;
     char errbuf[BUFSIZ];
-    int i, ret;
+    int ret;
 
     if (dec->state & STATE_OPENED)
         return 0;
 
-    // Open and identify media file
-    ret = avformat_open_input(&dec->fmtctx, filename, NULL, NULL);
-    if (ret != 0)
-        goto error_open_file;
-    ret = avformat_find_stream_info(dec->fmtctx, NULL);
+    // Probe as little data as possible, and hand packets over as soon as
+    // they are read, for live sources
+    if (dec->flags & FFVA_DECODER_FLAG_LOW_LATENCY) {
+        av_dict_set(&options, "fflags", "nobuffer", 0);
+        av_dict_set(&options, "probesize", "32", 0);
+        av_dict_set(&options, "analyzeduration", "100000", 0);
+        av_dict_set(&options, "max_delay", "0", 0);
+    }
+
+    // Open and identify media file, and find the video stream
+    ret = ffmpeg_open_video_stream(&dec->fmtctx, filename, &options,
+        &dec->stream);
+    av_dict_free(&options);
     if (ret < 0)
-        goto error_identify_file;
+        goto error_open_file;
     av_dump_format(dec->fmtctx, 0, filename, 0);
-    fmtctx = dec->fmtctx;
-
-    // Find the video stream and identify the codec
-    for (i = 0; i < fmtctx->nb_streams; i++) {
-        if (fmtctx->streams[i]->codec->codec_type == AVMEDIA_TYPE_VIDEO &&
-            !dec->stream)
-            dec->stream = fmtctx->streams[i];
-        else
-            fmtctx->streams[i]->discard = AVDISCARD_ALL;
-    }
-    if (!dec->stream)
-        goto error_no_video_stream;
 
     avctx = dec->stream->codec;
     decoder_init_context(dec, avctx);
+    dec->time_base = dec->stream->time_base;
+    dec->frame_rate = dec->stream->avg_frame_rate;
+
+    // Output frames in decode order if the stream has no reordering. That
+    // cannot be forced otherwise, or frames would be displayed out of order
+    if (dec->flags & FFVA_DECODER_FLAG_LOW_LATENCY) {
+        if (avctx->has_b_frames == 0)
+            avctx->flags |= CODEC_FLAG_LOW_DELAY;
+        else
+            av_log(dec, AV_LOG_WARNING, "stream reorders frames, decoding "
+                "incurs %d frame(s) of delay\n", avctx->has_b_frames);
+        avctx->thread_count = 1;
+    }
+    decoder_init_skip_frame(dec);
 
     codec = avcodec_find_decoder(avctx->codec_id);
     if (!codec)
@@ -600,16 +715,9 @@ decoder_open(FFVADecoder *dec, const char *filename)
 
     /* ERRORS */
 error_open_file:
-    av_log(dec, AV_LOG_ERROR, "failed to open file `%s': %s\n", filename,
-        ffmpeg_strerror(ret, errbuf));
-    return ret;
-error_identify_file:
-    av_log(dec, AV_LOG_ERROR, "failed to identify file `%s': %s\n", filename,
-        ffmpeg_strerror(ret, errbuf));
+    av_log(dec, AV_LOG_ERROR, "failed to open video stream from `%s': %s\n",
+        filename, ffmpeg_strerror(ret, errbuf));
     return ret;
-error_no_video_stream:
-    av_log(dec, AV_LOG_ERROR, "failed to find a video stream\n");
-    return AVERROR_STREAM_NOT_FOUND;
 error_no_codec:
     av_log(dec, AV_LOG_ERROR, "failed to find codec info for codec %d\n",
         avctx->codec_id);
@@ -622,6 +730,77 @@ error_alloc_frame:
     return AVERROR(ENOMEM);
 }
 
+static int
+decoder_open_codec(FFVADecoder *dec, const FFVADecoderCodecParams *params)
+{
+    AVCodecContext *avctx;
+    AVCodec *codec;
+    int ret;
+
+    if (dec->state & STATE_OPENED)
+        return 0;
+
+    codec = avcodec_find_decoder(params->codec);
+    if (!codec)
+        goto error_no_codec;
+
+    avctx = avcodec_alloc_context3(codec);
+    if (!avctx)
+        goto error_alloc_context;
+    decoder_init_context(dec, avctx);
+
+    avctx->codec_type = AVMEDIA_TYPE_VIDEO;
+    avctx->codec_id = params->codec;
+    avctx->profile = params->profile;
+    avctx->width = params->width;
+    avctx->height = params->height;
+    avctx->coded_width = params->width;
+    avctx->coded_height = params->height;
+    if (params->extradata && params->extradata_size > 0) {
+        avctx->extradata = av_mallocz(params->extradata_size +
+            FF_INPUT_BUFFER_PADDING_SIZE);
+        if (!avctx->extradata)
+            goto error_alloc_extradata;
+        memcpy(avctx->extradata, params->extradata, params->extradata_size);
+        avctx->extradata_size = params->extradata_size;
+    }
+
+    dec->time_base = params->time_base;
+    if (dec->time_base.num <= 0 || dec->time_base.den <= 0)
+        dec->time_base = AV_TIME_BASE_Q;
+    dec->frame_rate = params->frame_rate;
+    decoder_init_skip_frame(dec);
+
+    ret = avcodec_open2(avctx, codec, NULL);
+    if (ret < 0)
+        goto error_open_codec;
+
+    dec->frame = av_frame_alloc();
+    if (!dec->frame)
+        goto error_alloc_frame;
+
+    dec->state |= STATE_OPENED;
+    return 0;
+
+    /* ERRORS */
+error_no_codec:
+    av_log(dec, AV_LOG_ERROR, "failed to find codec info for codec %d\n",
+        params->codec);
+    return AVERROR_DECODER_NOT_FOUND;
+error_alloc_context:
+    av_log(dec, AV_LOG_ERROR, "failed to allocate codec context\n");
+    return AVERROR(ENOMEM);
+error_alloc_extradata:
+    av_log(dec, AV_LOG_ERROR, "failed to allocate codec extradata\n");
+    return AVERROR(ENOMEM);
+error_open_codec:
+    av_log(dec, AV_LOG_ERROR, "failed to open codec %d\n", params->codec);
+    return ret;
+error_alloc_frame:
+    av_log(dec, AV_LOG_ERROR, "failed to allocate video frame\n");
+    return AVERROR(ENOMEM);
+}
+
 static void
 decoder_close(FFVADecoder *dec)
 {
@@ -629,6 +808,11 @@ decoder_close(FFVADecoder *dec)
 
     if (dec->avctx) {
         avcodec_close(dec->avctx);
+        // The codec context is only owned for elementary stream input
+        if (!dec->fmtctx) {
+            av_freep(&dec->avctx->extradata);
+            av_free(dec->avctx);
+        }
         dec->avctx = NULL;
     }
 
@@ -636,11 +820,48 @@ decoder_close(FFVADecoder *dec)
         avformat_close_input(&dec->fmtctx);
         dec->fmtctx = NULL;
     }
+    dec->stream = NULL;
     av_frame_free(&dec->frame);
+    av_freep(&dec->packet_buf);
+    dec->packet_buf_size = 0;
 
     dec->state &= ~STATE_OPENED;
 }
 
+// Determines the presentation timestamp and duration of the decoded frame,
+// in AV_TIME_BASE units. Missing values are interpolated from the previous
+// frame, or from the stream frame rate
+static void
+handle_frame_timestamps(FFVADecoder *dec, AVFrame *frame,
+    FFVADecoderFrame *dec_frame)
+{
+    const AVRational time_base = dec->time_base;
+    const AVRational frame_rate = dec->frame_rate;
+    int64_t pts, duration;
+
+    duration = av_frame_get_pkt_duration(frame);
+    if (duration > 0)
+        duration = av_rescale_q(duration, time_base, AV_TIME_BASE_Q);
+    else if (frame_rate.num > 0 && frame_rate.den > 0) {
+        duration = av_rescale_q(1, av_inv_q(frame_rate), AV_TIME_BASE_Q);
+        duration += duration * frame->repeat_pict / 2;
+    }
+    else
+        duration = 0;
+
+    pts = av_frame_get_best_effort_timestamp(frame);
+    if (pts != AV_NOPTS_VALUE)
+        pts = av_rescale_q(pts, time_base, AV_TIME_BASE_Q);
+    else if (dec->next_pts != AV_NOPTS_VALUE)
+        pts = dec->next_pts;
+    else
+        pts = 0;
+
+    dec_frame->pts = pts;
+    dec_frame->duration = duration;
+    dec->next_pts = duration > 0 ? pts + duration : AV_NOPTS_VALUE;
+}
+
 static int
 handle_frame(FFVADecoder *dec, AVFrame *frame)
 {
@@ -649,18 +870,30 @@ handle_frame(FFVADecoder *dec, AVFrame *frame)
     int data_offset;
 
     dec_frame->frame = frame;
-    dec_frame->surface = vaapi_get_frame_surface(dec->avctx, frame);
-    if (!dec_frame->surface)
-        return AVERROR(EFAULT);
-
-    data_offset = frame->data[0] - frame->data[3];
-    dec_frame->has_crop_rect = data_offset > 0   ||
-        frame->width  != dec->avctx->coded_width ||
-        frame->height != dec->avctx->coded_height;
-    crop_rect->x = data_offset % frame->linesize[0];
-    crop_rect->y = data_offset / frame->linesize[0];
+    if (frame->format == AV_PIX_FMT_VAAPI) {
+        dec_frame->surface = vaapi_get_frame_surface(dec->avctx, frame);
+        if (!dec_frame->surface)
+            return AVERROR(EFAULT);
+
+        data_offset = frame->data[0] - frame->data[3];
+        dec_frame->has_crop_rect = data_offset > 0   ||
+            frame->width  != dec->avctx->coded_width ||
+            frame->height != dec->avctx->coded_height;
+        crop_rect->x = data_offset % frame->linesize[0];
+        crop_rect->y = data_offset / frame->linesize[0];
+    }
+    else {
+        // Software decoded frame, with the visible region at the origin
+        dec_frame->surface = NULL;
+        dec_frame->has_crop_rect = false;
+        crop_rect->x = 0;
+        crop_rect->y = 0;
+    }
     crop_rect->width = frame->width;
     crop_rect->height = frame->height;
+
+    handle_frame_timestamps(dec, frame, dec_frame);
+    dec_frame->arrival_time = frame->reordered_opaque;
     return 0;
 }
 
@@ -706,9 +939,12 @@ decoder_run(FFVADecoder *dec)
         else if (ret < 0)
             goto error_read_frame;
 
-        // Decode video packet
-        if (packet.stream_index == dec->stream->index)
+        // Decode video packet, tagging the frame with the arrival time
+        if (packet.stream_index == dec->stream->index &&
+            !decoder_skip_packet(dec, packet.flags)) {
+            dec->avctx->reordered_opaque = get_time_us();
             ret = decode_packet(dec, &packet, NULL);
+        }
         else
             ret = AVERROR(EAGAIN);
         av_free_packet(&packet);
@@ -731,12 +967,48 @@ error_read_frame:
     return ret;
 }
 
+// Discards any data queued in the decoder, e.g. before restarting at a
+// keyframe. Surfaces held for reference frames are released
 static int
 decoder_flush(FFVADecoder *dec)
 {
+    if (!(dec->state & STATE_OPENED))
+        return 0;
+
+    avcodec_flush_buffers(dec->avctx);
+    dec->next_pts = AV_NOPTS_VALUE;
+    dec->has_pending_frame = false;
+    dec->draining = false;
     return 0;
 }
 
+// Seeks to the keyframe at, or before, the supplied timestamp, and discards
+// what was queued for decoding
+static int
+decoder_seek(FFVADecoder *dec, int64_t pts)
+{
+    char errbuf[BUFSIZ];
+    int ret;
+
+    if (!(dec->state & STATE_OPENED) || !dec->fmtctx)
+        return AVERROR(EINVAL);
+
+    pts = av_rescale_q(pts, AV_TIME_BASE_Q, dec->stream->time_base);
+    if (dec->stream->start_time != AV_NOPTS_VALUE)
+        pts += dec->stream->start_time;
+    ret = av_seek_frame(dec->fmtctx, dec->stream->index, pts,
+        AVSEEK_FLAG_BACKWARD);
+    if (ret < 0)
+        goto error_seek;
+    return decoder_flush(dec);
+
+    /* ERRORS */
+error_seek:
+    av_log(dec, AV_LOG_ERROR, "failed to seek: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    return ret;
+}
+
 static int
 decoder_start(FFVADecoder *dec)
 {
@@ -745,6 +1017,9 @@ decoder_start(FFVADecoder *dec)
     if (!(dec->state & STATE_OPENED))
         return AVERROR_UNKNOWN;
 
+    dec->next_pts = AV_NOPTS_VALUE;
+    dec->has_pending_frame = false;
+    dec->draining = false;
     dec->state |= STATE_STARTED;
     return 0;
 }
@@ -759,6 +1034,89 @@ decoder_stop(FFVADecoder *dec)
     return 0;
 }
 
+// Decodes the supplied application packet. The decoded frame, if any, is
+// kept pending until it is acquired with decoder_receive_frame()
+static int
+decoder_send_packet(FFVADecoder *dec, const FFVADecoderPacket *dec_packet)
+{
+    AVPacket packet;
+    int ret;
+
+    if (!(dec->state & STATE_OPENED) || dec->fmtctx)
+        return AVERROR(EINVAL);
+    if (!(dec->state & STATE_STARTED)) {
+        ret = decoder_start(dec);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (dec->has_pending_frame)
+        return AVERROR(EAGAIN);
+    if (dec->draining)
+        return AVERROR_EOF;
+    if (!dec_packet) {
+        dec->draining = true;
+        return 0;
+    }
+    if (decoder_skip_packet(dec,
+            (dec_packet->flags & FFVA_DECODER_PACKET_FLAG_KEY) ?
+            AV_PKT_FLAG_KEY : 0))
+        return 0;
+    if (!vaapi_has_free_surface(dec))
+        return AVERROR(EAGAIN);
+
+    av_init_packet(&packet);
+    if (dec_packet->flags & FFVA_DECODER_PACKET_FLAG_PADDED)
+        packet.data = (uint8_t *)dec_packet->data;
+    else {
+        // FFmpeg parsers may read past the end of the supplied data
+        av_fast_padded_malloc(&dec->packet_buf, &dec->packet_buf_size,
+            dec_packet->size);
+        if (!dec->packet_buf)
+            return AVERROR(ENOMEM);
+        memcpy(dec->packet_buf, dec_packet->data, dec_packet->size);
+        packet.data = dec->packet_buf;
+    }
+    packet.size = dec_packet->size;
+    packet.pts = dec_packet->pts;
+    packet.dts = dec_packet->dts;
+    packet.duration = dec_packet->duration;
+    if (dec_packet->flags & FFVA_DECODER_PACKET_FLAG_KEY)
+        packet.flags |= AV_PKT_FLAG_KEY;
+
+    dec->avctx->reordered_opaque = get_time_us();
+    ret = decode_packet(dec, &packet, NULL);
+    if (ret == 0)
+        dec->has_pending_frame = true;
+    else if (ret != AVERROR(EAGAIN))
+        return ret;
+    return 0;
+}
+
+// Returns the pending frame decoded from application packets, or the next
+// cached frame once the decoder is draining
+static int
+decoder_receive_frame(FFVADecoder *dec)
+{
+    AVPacket packet;
+    int got_frame, ret;
+
+    if (dec->has_pending_frame) {
+        dec->has_pending_frame = false;
+        return 0;
+    }
+    if (!dec->draining)
+        return AVERROR(EAGAIN);
+
+    av_init_packet(&packet);
+    packet.data = NULL;
+    packet.size = 0;
+    ret = decode_packet(dec, &packet, &got_frame);
+    if (ret == AVERROR(EAGAIN) && !got_frame)
+        ret = AVERROR_EOF;
+    return ret;
+}
+
 static int
 decoder_get_frame(FFVADecoder *dec, FFVADecoderFrame **out_frame_ptr)
 {
@@ -771,7 +1129,7 @@ decoder_get_frame(FFVADecoder *dec, FFVADecoderFrame **out_frame_ptr)
             return ret;
     }
 
-    ret = decoder_run(dec);
+    ret = dec->fmtctx ? decoder_run(dec) : decoder_receive_frame(dec);
     if (ret == 0)
         frame = &dec->decoded_frame;
 
@@ -797,9 +1155,6 @@ ffva_decoder_new(FFVADisplay *display)
 {
     FFVADecoder *dec;
 
-    if (!display)
-        return NULL;
-
     dec = calloc(1, sizeof(*dec));
     if (!dec)
         return NULL;
@@ -832,6 +1187,36 @@ ffva_decoder_freep(FFVADecoder **dec_ptr)
     *dec_ptr = NULL;
 }
 
+// Sets the function used to allocate the pool of decoded surfaces
+void
+ffva_decoder_set_surface_allocator(FFVADecoder *dec,
+    FFVADecoderCreateSurfacesFunc func, void *user_data)
+{
+    if (!dec)
+        return;
+
+    dec->create_surfaces = func;
+    dec->create_surfaces_data = user_data;
+}
+
+// Sets FFVA_DECODER_FLAG_* flags
+void
+ffva_decoder_set_flags(FFVADecoder *dec, uint32_t flags)
+{
+    if (!dec)
+        return;
+    dec->flags = flags;
+}
+
+// Sets the number of extra surfaces decoded frames may hold
+void
+ffva_decoder_set_num_extra_surfaces(FFVADecoder *dec, uint32_t num_surfaces)
+{
+    if (!dec)
+        return;
+    dec->num_extra_surfaces = num_surfaces;
+}
+
 // Initializes the decoder instance for the supplied video file by name
 int
 ffva_decoder_open(FFVADecoder *dec, const char *filename)
@@ -841,6 +1226,15 @@ ffva_decoder_open(FFVADecoder *dec, const char *filename)
     return decoder_open(dec, filename);
 }
 
+// Initializes the decoder instance for an elementary stream
+int
+ffva_decoder_open_codec(FFVADecoder *dec, const FFVADecoderCodecParams *params)
+{
+    if (!dec || !params)
+        return AVERROR(EINVAL);
+    return decoder_open_codec(dec, params);
+}
+
 // Destroys the decoder resources used for processing the previous file
 void
 ffva_decoder_close(FFVADecoder *dec)
@@ -877,6 +1271,15 @@ ffva_decoder_flush(FFVADecoder *dec)
     return decoder_flush(dec);
 }
 
+// Seeks to the keyframe at, or before, the supplied timestamp
+int
+ffva_decoder_seek(FFVADecoder *dec, int64_t pts)
+{
+    if (!dec)
+        return AVERROR(EINVAL);
+    return decoder_seek(dec, pts);
+}
+
 // Returns some media info from an opened file
 bool
 ffva_decoder_get_info(FFVADecoder *dec, FFVADecoderInfo *info)
@@ -891,9 +1294,28 @@ ffva_decoder_get_info(FFVADecoder *dec, FFVADecoderInfo *info)
     info->profile       = avctx->profile;
     info->width         = avctx->width;
     info->height        = avctx->height;
+    info->duration      = 0;
+    if (dec->fmtctx && dec->fmtctx->duration > 0)
+        info->duration  = dec->fmtctx->duration;
+
+    // Decoded surfaces are allocated on the first frame, in YUV 4:2:0
+    info->chroma        = VA_RT_FORMAT_YUV420;
+    info->fourcc        = dec->va_surfaces_fourcc ?
+        dec->va_surfaces_fourcc : VA_FOURCC('N','V','1','2');
     return true;
 }
 
+// Submits the next packet of an elementary stream
+int
+ffva_decoder_send_packet(FFVADecoder *dec, const FFVADecoderPacket *packet)
+{
+    if (!dec)
+        return AVERROR(EINVAL);
+    if (packet && !packet->data && packet->size > 0)
+        return AVERROR(EINVAL);
+    return decoder_send_packet(dec, packet);
+}
+
 // Acquires the next decoded frame
 int
 ffva_decoder_get_frame(FFVADecoder *dec, FFVADecoderFrame **out_frame_ptr)
@@ -32,22 +32,85 @@
 typedef struct ffva_decoder_s           FFVADecoder;
 typedef struct ffva_decoder_info_s      FFVADecoderInfo;
 typedef struct ffva_decoder_frame_s     FFVADecoderFrame;
+typedef struct ffva_decoder_codec_params_s FFVADecoderCodecParams;
+typedef struct ffva_decoder_packet_s    FFVADecoderPacket;
+
+enum {
+    /* Minimize the delay from packet arrival to decoded frame output, with
+       minimal probing, no demuxer buffering and no frame reordering where
+       the stream allows */
+    FFVA_DECODER_FLAG_LOW_LATENCY = 1 << 0,
+    /* Only decode keyframes, e.g. for thumbnails. Other packets are
+       dropped before they reach the codec */
+    FFVA_DECODER_FLAG_KEYFRAMES_ONLY = 1 << 1,
+    /* Decode in software if the stream cannot be decoded with VA-API.
+       The resulting frames have no VA surface attached */
+    FFVA_DECODER_FLAG_SOFTWARE_FALLBACK = 1 << 2,
+};
+
+enum {
+    /* The packet holds the start of a keyframe */
+    FFVA_DECODER_PACKET_FLAG_KEY = 1 << 0,
+    /* The packet data is followed by FF_INPUT_BUFFER_PADDING_SIZE zero
+       bytes, so that it can be decoded without being copied first */
+    FFVA_DECODER_PACKET_FLAG_PADDED = 1 << 1,
+};
+
+/**
+ * Allocates a pool of VA surfaces from external memory. Returns zero on
+ * success, or a negative AVERROR code to let the decoder fall back to
+ * allocating the surfaces itself
+ */
+typedef int (*FFVADecoderCreateSurfacesFunc)(void *user_data, uint32_t chroma,
+    uint32_t width, uint32_t height, VASurfaceID *surfaces,
+    uint32_t num_surfaces);
 
 struct ffva_decoder_info_s {
     int codec;
     int profile;
     int width;
     int height;
+    int64_t duration;           /* in AV_TIME_BASE units, or 0 if unknown */
+    uint32_t chroma;            /* VA chroma format of decoded surfaces */
+    uint32_t fourcc;            /* VA fourcc of decoded surfaces */
+};
+
+/* Elementary stream parameters, for decoders fed with packets */
+struct ffva_decoder_codec_params_s {
+    int codec;                  /* AVCodecID */
+    int profile;                /* FF_PROFILE_*, or FF_PROFILE_UNKNOWN */
+    int width;
+    int height;
+    const uint8_t *extradata;   /* codec specific headers, e.g. avcC */
+    uint32_t extradata_size;
+    AVRational time_base;       /* of packet timestamps, or {0,0} for us */
+    AVRational frame_rate;      /* or {0,0} if unknown */
+};
+
+/* Buffer of compressed data, owned by the application */
+struct ffva_decoder_packet_s {
+    const uint8_t *data;
+    uint32_t size;
+    int64_t pts;                /* in time_base units, or AV_NOPTS_VALUE */
+    int64_t dts;                /* in time_base units, or AV_NOPTS_VALUE */
+    int64_t duration;           /* in time_base units, or 0 if unknown */
+    uint32_t flags;             /* FFVA_DECODER_PACKET_FLAG_* */
 };
 
 struct ffva_decoder_frame_s {
     AVFrame *frame;
-    FFVASurface *surface;
+    FFVASurface *surface;       /* or NULL for software decoded frames */
     VARectangle crop_rect;
     bool has_crop_rect;
+    int64_t pts;                /* in AV_TIME_BASE units */
+    int64_t duration;           /* in AV_TIME_BASE units, or 0 if unknown */
+    uint64_t arrival_time;      /* monotonic time the packet was read, in us */
 };
 
-/** Creates a new decoder instance */
+/**
+ * Creates a new decoder instance for the supplied display, or NULL to only
+ * decode in software, with FFVA_DECODER_FLAG_SOFTWARE_FALLBACK set
+ */
 FFVADecoder *
 ffva_decoder_new(FFVADisplay *display);
 
@@ -59,10 +122,38 @@ ffva_decoder_free(FFVADecoder *dec);
 void
 ffva_decoder_freep(FFVADecoder **dec_ptr);
 
+/**
+ * Sets the function used to allocate the pool of decoded surfaces. This has
+ * to be called before the decoder is started. The VA surfaces are destroyed
+ * by the decoder, though any backing memory remains owned by the allocator
+ */
+void
+ffva_decoder_set_surface_allocator(FFVADecoder *dec,
+    FFVADecoderCreateSurfacesFunc func, void *user_data);
+
+/** Sets FFVA_DECODER_FLAG_* flags. This has to be called before open */
+void
+ffva_decoder_set_flags(FFVADecoder *dec, uint32_t flags);
+
+/**
+ * Sets the number of surfaces to allocate on top of the ones the decoder
+ * needs, for decoded frames the user holds beyond the next decode call.
+ * This has to be called before the decoder is started
+ */
+void
+ffva_decoder_set_num_extra_surfaces(FFVADecoder *dec, uint32_t num_surfaces);
+
 /** Initializes the decoder instance for the supplied video file by name */
 int
 ffva_decoder_open(FFVADecoder *dec, const char *filename);
 
+/**
+ * Initializes the decoder instance for an elementary stream, whose packets
+ * are then supplied with ffva_decoder_send_packet()
+ */
+int
+ffva_decoder_open_codec(FFVADecoder *dec, const FFVADecoderCodecParams *params);
+
 /** Destroys the decoder resources used for processing the previous file */
 void
 ffva_decoder_close(FFVADecoder *dec);
@@ -75,15 +166,42 @@ ffva_decoder_start(FFVADecoder *dec);
 void
 ffva_decoder_stop(FFVADecoder *dec);
 
-/** Flushes any source data to be decoded */
+/** Discards any source data queued for decoding, e.g. before a seek */
 int
 ffva_decoder_flush(FFVADecoder *dec);
 
-/** Returns some media info from an opened file */
+/**
+ * Seeks to the keyframe at, or before, the supplied timestamp in AV_TIME_BASE
+ * units. Any data queued for decoding is discarded
+ */
+int
+ffva_decoder_seek(FFVADecoder *dec, int64_t pts);
+
+/**
+ * Returns some media info from an opened file. The surface format is the
+ * one the VA driver reports once surfaces are allocated, or the one they
+ * would be allocated in until then
+ */
 bool
 ffva_decoder_get_info(FFVADecoder *dec, FFVADecoderInfo *info);
 
-/** Acquires the next decoded frame */
+/**
+ * Submits the next packet of an elementary stream opened with
+ * ffva_decoder_open_codec(), or NULL to drain the decoder at end of stream.
+ * The packet data is only read during this call, and is not copied if it
+ * is padded. Returns AVERROR(EAGAIN) if the packet cannot be accepted yet,
+ * because the last decoded frame was not acquired, or because all surfaces
+ * are still held by the application: the same packet has to be sent again
+ * once a frame was acquired, or released
+ */
+int
+ffva_decoder_send_packet(FFVADecoder *dec, const FFVADecoderPacket *packet);
+
+/**
+ * Acquires the next decoded frame. For elementary streams, this returns
+ * AVERROR(EAGAIN) if more packets need to be sent, and AVERROR_EOF once
+ * the decoder was completely drained
+ */
 int
 ffva_decoder_get_frame(FFVADecoder *dec, FFVADecoderFrame **out_frame_ptr);
 
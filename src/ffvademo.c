@@ -22,16 +22,34 @@
 
 #define _GNU_SOURCE 1
 #include "sysdeps.h"
+#include <math.h>
+#include <float.h>
 #include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <libavformat/avformat.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
 #include <va/va_drmcommon.h>
 #include "ffvadisplay.h"
 #include "ffvadecoder.h"
-#include "ffvafilter.h"
+#include "ffvadownloader.h"
+#include "ffvafilterservice.h"
+#include "ffvaladder.h"
+#include "ffvasurfacepool.h"
+#include "ffvaformat.h"
+#include "ffvascalepolicy.h"
+#include "ffvascheduler.h"
+#include "ffvamailbox.h"
+#include "ffvapacketfile.h"
+#include "ffvaparalleldecoder.h"
+#include "ffvaprober.h"
+#include "ffvathumbnailer.h"
 #include "ffvarenderer.h"
 #include "ffmpeg_utils.h"
 #include "vaapi_utils.h"
+#include "vaapi_trace.h"
+#include "time_utils.h"
 
 #if USE_DRM
 # include "ffvarenderer_drm.h"
@@ -58,9 +76,31 @@
 #define DEFAULT_RENDERER FFVA_RENDERER_TYPE_EGL
 #endif
 
+// Number of VPP output surfaces
+#define FILTER_SURFACE_POOL_DEPTH 4
+
+// Maximum number of outputs of the scaling ladder
+#define LADDER_MAX_OUTPUTS 8
+
+// Maximum number of reference frames held for deinterlacing. This is bound
+// by the number of scratch surfaces the decoder allocates
+#define DEINTERLACE_MAX_REFERENCES 2
+
+// Maximum number of frames the renderer could keep queued in the driver
+#if USE_EGL
+#define MAX_QUEUED_FRAMES FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES
+#else
+#define MAX_QUEUED_FRAMES 0
+#endif
+
 // Default memory type
 #define DEFAULT_MEM_TYPE MEM_TYPE_DMA_BUF
 
+typedef enum {
+    DEINTERLACE_RATE_FIELD = 1,
+    DEINTERLACE_RATE_FRAME,
+} DeinterlaceRate;
+
 typedef enum {
     MEM_TYPE_DMA_BUF = 1,
     MEM_TYPE_GEM_BUF,
@@ -74,8 +114,43 @@ typedef struct {
     uint32_t mem_type;
     enum AVPixelFormat pix_fmt;
     int list_pix_fmts;
+    float denoise;
+    float sharpen;
+    float hue;
+    float saturation;
+    float brightness;
+    float contrast;
+    uint32_t deinterlace;
+    uint32_t deinterlace_rate;
     uint32_t window_width;
     uint32_t window_height;
+    char *output_filename;
+    uint32_t swap_interval;
+    int damage;
+    uint32_t max_queued_frames;
+    int print_stats;
+    int sync;
+    int low_latency;
+    int push;
+    char *extract_packets;
+    int packet_file;
+    uint32_t loop;
+    uint32_t parallel;
+    int probe;
+    char *probe_list;
+    char *probe_cache;
+    uint32_t probe_threads;
+    uint32_t probe_io;
+    char *thumbnails;
+    uint32_t thumbnail_width;
+    uint32_t thumbnail_height;
+    float thumbnail_interval;
+    uint32_t thumbnail_columns;
+    uint32_t thumbnail_rows;
+    int download;
+    uint32_t download_threads;
+    uint32_t download_copy_threads;
+    char *ladder;
 } Options;
 
 typedef struct {
@@ -84,13 +159,48 @@ typedef struct {
     FFVADisplay *display;
     VADisplay va_display;
     FFVADecoder *decoder;
-    FFVAFilter *filter;
+    AVFormatContext *push_fmtctx;
+    AVStream *push_stream;
+    FFVAPacketFile *packet_file;
+    FFVAParallelDecoder *parallel_decoder;
+    FFVADownloader *downloader;
+    uint32_t packet_index;
+    uint32_t num_loops;
+    int64_t packet_ts_offset;
+    FFVAFilterService *filter_service;
+    FFVAFilterJobParams filter_params;
+    bool use_filter;
     uint32_t filter_chroma;
     uint32_t filter_fourcc;
-    FFVASurface filter_surface;
+    FFVASurfacePool *filter_surface_pool;
+    FFVASurface *filter_surfaces[FILTER_SURFACE_POOL_DEPTH];
+    uint32_t num_filter_surfaces;
+    FFVADecoderFrame deint_frames[1 + DEINTERLACE_MAX_REFERENCES];
+    uint32_t num_deint_frames;
+    uint32_t deint_next_frame;
+    uint32_t deint_num_forward_refs;
+    uint32_t deint_num_backward_refs;
     FFVARenderer *renderer;
     uint32_t renderer_width;
     uint32_t renderer_height;
+    FFVAScalePolicy *scale_policy;
+    bool has_timed_frame;           /* GPU time not accounted for yet */
+    uint64_t timed_frame_vpp_time;
+    uint64_t timed_frame_cpu_time;
+    FFVAScheduler *scheduler;
+    FFVADecoderFrame repeat_frame;
+    VARectangle repeat_rect;
+    uint32_t repeat_flags;
+    bool has_repeat_frame;
+    bool repeat_frames;
+    FFVAMailbox *mailbox;
+    pthread_t decode_thread;
+    int decode_ret;
+    uint64_t num_latencies;
+    uint64_t total_latency;
+    uint64_t min_latency;
+    uint64_t max_latency;
+    FILE *output_file;
 } App;
 
 #define OFFSET(x) offsetof(App, options.x)
@@ -101,6 +211,63 @@ static const AVOption app_options[] = {
       AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 4096 },
     { "window_height", "window height", OFFSET(window_height),
       AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 4096 },
+    { "output", "file to write rendered RGBA frames to", OFFSET(output_filename),
+      AV_OPT_TYPE_STRING, },
+    { "swap_interval", "number of vblanks per presented frame",
+      OFFSET(swap_interval), AV_OPT_TYPE_INT, { .i64 = 1 }, 0, 1 },
+    { "damage", "only present the video rectangle as damaged",
+      OFFSET(damage), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, },
+    { "max_queued_frames", "maximum number of frames queued in the driver",
+      OFFSET(max_queued_frames), AV_OPT_TYPE_INT, { .i64 = 0 }, 0,
+      MAX_QUEUED_FRAMES },
+    { "print_stats", "print presentation statistics", OFFSET(print_stats),
+      AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, },
+    { "sync", "pace presentation to the frame timestamps", OFFSET(sync),
+      AV_OPT_TYPE_INT, { .i64 = 1 }, 0, 1, },
+    { "low_latency", "present the latest frame with minimal delay",
+      OFFSET(low_latency), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, },
+    { "push", "demux in the application, and push packets to the decoder",
+      OFFSET(push), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, },
+    { "extract_packets", "packet file to extract the video stream to",
+      OFFSET(extract_packets), AV_OPT_TYPE_STRING, },
+    { "packet_file", "read video packets from a packet file",
+      OFFSET(packet_file), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, },
+    { "loop", "number of times to play the packet file, or 0 for ever",
+      OFFSET(loop), AV_OPT_TYPE_INT, { .i64 = 1 }, 0, INT_MAX, },
+    { "parallel", "number of decoders for GOP-parallel decoding",
+      OFFSET(parallel), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, },
+    { "probe", "probe files, or directories, as JSON lines", OFFSET(probe),
+      AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, },
+    { "probe_list", "file listing the paths to probe", OFFSET(probe_list),
+      AV_OPT_TYPE_STRING, },
+    { "probe_cache", "file to cache probing results into",
+      OFFSET(probe_cache), AV_OPT_TYPE_STRING, },
+    { "probe_threads", "number of probing threads, or 0 for all CPUs",
+      OFFSET(probe_threads), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1024, },
+    { "probe_io", "maximum number of files read concurrently, or 0 for 4",
+      OFFSET(probe_io), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1024, },
+    { "thumbnails", "directory to write keyframe thumbnails to",
+      OFFSET(thumbnails), AV_OPT_TYPE_STRING, },
+    { "thumbnail_width", "thumbnail width", OFFSET(thumbnail_width),
+      AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 4096, },
+    { "thumbnail_height", "thumbnail height", OFFSET(thumbnail_height),
+      AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 4096, },
+    { "thumbnail_interval", "seconds between thumbnails, or 0 for keyframes",
+      OFFSET(thumbnail_interval), AV_OPT_TYPE_FLOAT, { .dbl = 0 }, 0,
+      FLT_MAX, },
+    { "thumbnail_columns", "number of thumbnails per sprite sheet row",
+      OFFSET(thumbnail_columns), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 256, },
+    { "thumbnail_rows", "number of thumbnail rows per sprite sheet",
+      OFFSET(thumbnail_rows), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 256, },
+    { "download", "download decoded frames to system memory, and exit",
+      OFFSET(download), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, },
+    { "download_threads", "number of download threads, or 0 for 2",
+      OFFSET(download_threads), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, },
+    { "download_copy_threads", "number of threads copying each frame, or 0 "
+      "for one per CPU", OFFSET(download_copy_threads), AV_OPT_TYPE_INT,
+      { .i64 = 1 }, 0, 64, },
+    { "ladder", "sizes of the scaling ladder outputs to produce, and exit",
+      OFFSET(ladder), AV_OPT_TYPE_STRING, },
     { "renderer", "renderer type to use", OFFSET(renderer_type),
       AV_OPT_TYPE_FLAGS, { .i64 = DEFAULT_RENDERER }, 0, INT_MAX, 0,
       "renderer" },
@@ -124,12 +291,56 @@ static const AVOption app_options[] = {
       AV_OPT_TYPE_PIXEL_FMT, { .i64 = AV_PIX_FMT_NONE }, -1, AV_PIX_FMT_NB-1, },
     { "list_pix_fmts", "list output pixel formats", OFFSET(list_pix_fmts),
       AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, },
+    { "denoise", "noise reduction level", OFFSET(denoise),
+      AV_OPT_TYPE_FLOAT, { .dbl = NAN }, -FLT_MAX, FLT_MAX, },
+    { "sharpen", "sharpening level", OFFSET(sharpen),
+      AV_OPT_TYPE_FLOAT, { .dbl = NAN }, -FLT_MAX, FLT_MAX, },
+    { "hue", "color balance hue", OFFSET(hue),
+      AV_OPT_TYPE_FLOAT, { .dbl = NAN }, -FLT_MAX, FLT_MAX, },
+    { "saturation", "color balance saturation", OFFSET(saturation),
+      AV_OPT_TYPE_FLOAT, { .dbl = NAN }, -FLT_MAX, FLT_MAX, },
+    { "brightness", "color balance brightness", OFFSET(brightness),
+      AV_OPT_TYPE_FLOAT, { .dbl = NAN }, -FLT_MAX, FLT_MAX, },
+    { "contrast", "color balance contrast", OFFSET(contrast),
+      AV_OPT_TYPE_FLOAT, { .dbl = NAN }, -FLT_MAX, FLT_MAX, },
+    { "deinterlace", "deinterlacing method", OFFSET(deinterlace),
+      AV_OPT_TYPE_FLAGS, { .i64 = FFVA_DEINTERLACE_METHOD_NONE }, 0, UINT_MAX,
+      0, "deinterlace" },
+    { "none", "no deinterlacing", 0, AV_OPT_TYPE_CONST,
+      { .i64 = FFVA_DEINTERLACE_METHOD_NONE }, 0, 0, 0, "deinterlace" },
+    { "bob", "bob deinterlacing", 0, AV_OPT_TYPE_CONST,
+      { .i64 = FFVA_DEINTERLACE_METHOD_BOB }, 0, 0, 0, "deinterlace" },
+    { "weave", "weave deinterlacing", 0, AV_OPT_TYPE_CONST,
+      { .i64 = FFVA_DEINTERLACE_METHOD_WEAVE }, 0, 0, 0, "deinterlace" },
+    { "motion_adaptive", "motion adaptive deinterlacing", 0,
+      AV_OPT_TYPE_CONST, { .i64 = FFVA_DEINTERLACE_METHOD_MOTION_ADAPTIVE },
+      0, 0, 0, "deinterlace" },
+    { "motion_compensated", "motion compensated deinterlacing", 0,
+      AV_OPT_TYPE_CONST,
+      { .i64 = FFVA_DEINTERLACE_METHOD_MOTION_COMPENSATED },
+      0, 0, 0, "deinterlace" },
+    { "deinterlace_rate", "deinterlacing output rate",
+      OFFSET(deinterlace_rate), AV_OPT_TYPE_FLAGS,
+      { .i64 = DEINTERLACE_RATE_FIELD }, 0, UINT_MAX, 0, "deinterlace_rate" },
+    { "field", "one output frame per field", 0, AV_OPT_TYPE_CONST,
+      { .i64 = DEINTERLACE_RATE_FIELD }, 0, 0, 0, "deinterlace_rate" },
+    { "frame", "one output frame per frame", 0, AV_OPT_TYPE_CONST,
+      { .i64 = DEINTERLACE_RATE_FRAME }, 0, 0, 0, "deinterlace_rate" },
     { NULL, }
 };
 
 static void
 app_free(App *app);
 
+static void
+app_flush_filter_surfaces(App *app);
+
+static void
+app_pop_deint_frame(App *app);
+
+static void
+app_release_repeat_frame(App *app);
+
 static const char *
 get_basename(const char *filename)
 {
@@ -152,12 +363,77 @@ print_help(const char *prog)
            "-y, --window-height=HEIGHT");
     printf("  %-28s  select a particular renderer (string) [default='x11']\n",
            "-r, --renderer=TYPE");
+    printf("  %-28s  render offscreen and write RGBA frames to FILE "
+           "(EGL only)\n", "-o, --output=FILE");
+    printf("  %-28s  vblanks per presented frame (int) [default=1] "
+           "(EGL only)\n", "    --swap-interval=N");
+    printf("  %-28s  only present the video rectangle as damaged "
+           "(EGL only)\n", "    --damage");
+    printf("  %-28s  maximum frames queued in the driver (int) [default=0] "
+           "(EGL only)\n", "    --max-queued-frames=N");
+    printf("  %-28s  print presentation statistics\n",
+           "    --stats");
+    printf("  %-28s  present frames as soon as they are decoded\n",
+           "    --no-sync");
+    printf("  %-28s  live mode: decode with minimal delay, and always "
+           "present the latest frame\n", "    --low-latency");
+    printf("  %-28s  demux the file in the application, and push packets "
+           "to the decoder\n", "    --push");
+    printf("  %-28s  extract the video packets to a packet file, and exit\n",
+           "    --extract-packets=FILE");
+    printf("  %-28s  the video file is a packet file\n", "    --packet-file");
+    printf("  %-28s  play the packet file COUNT times, or 0 for ever "
+           "(default: 1)\n", "    --loop=COUNT");
+    printf("  %-28s  decode segments of the packet file on N decoders in "
+           "parallel\n", "    --parallel=N");
+    printf("  %-28s  probe the video file, or all files of the directory, "
+           "as JSON lines\n", "    --probe");
+    printf("  %-28s  probe the paths listed in FILE, or stdin for '-'\n",
+           "    --probe-list=FILE");
+    printf("  %-28s  cache probing results into FILE\n",
+           "    --probe-cache=FILE");
+    printf("  %-28s  number of probing threads (default: all CPUs)\n",
+           "    --probe-threads=N");
+    printf("  %-28s  maximum number of files read at once, or 0 for 4 "
+           "(default: 0)\n", "    --probe-io=N");
+    printf("  %-28s  write keyframe thumbnails to DIR, and exit\n",
+           "    --thumbnails=DIR");
+    printf("  %-28s  thumbnail size, either dimension may be 0 "
+           "(default: 160x0)\n", "    --thumbnail-size=WxH");
+    printf("  %-28s  seconds between thumbnails (default: every keyframe)\n",
+           "    --thumbnail-interval=SECS");
+    printf("  %-28s  tile thumbnails into sprite sheets of C columns and "
+           "R rows\n", "    --thumbnail-grid=CxR");
+    printf("  %-28s  download decoded frames to system memory, decoding "
+           "in software if needed\n", "    --download");
+    printf("  %-28s  number of download threads, or 0 for 2 "
+           "(default: 0)\n", "    --download-threads=N");
+    printf("  %-28s  number of threads copying each frame, 0 for one per "
+           "CPU (default: 1)\n", "    --download-copy-threads=N");
+    printf("  %-28s  scale decoded frames to all the comma separated "
+           "sizes, and exit\n", "    --ladder=WxH[,WxH...]");
     printf("  %-28s  VA buffer export memory type (string) [default='auto']\n",
            "-m, --mem-type=TYPE");
     printf("  %-28s  output pixel format (AVPixelFormat) [default=none]\n",
            "-f, --format=FORMAT");
     printf("  %-28s  list output pixel formats\n",
            "    --list-formats");
+    printf("  %-28s  noise reduction level (float) [default=off]\n",
+           "    --denoise=VALUE");
+    printf("  %-28s  sharpening level (float) [default=off]\n",
+           "    --sharpen=VALUE");
+    printf("  %-28s  color balance hue (float) [default=off]\n",
+           "    --hue=VALUE");
+    printf("  %-28s  color balance saturation (float) [default=off]\n",
+           "    --saturation=VALUE");
+    printf("  %-28s  color balance brightness (float) [default=off]\n",
+           "    --brightness=VALUE");
+    printf("  %-28s  color balance contrast (float) [default=off]\n",
+           "    --contrast=VALUE");
+    printf("  %-28s  deinterlacing method (string) [default='none']\n",
+           "    --deinterlace=METHOD");
+    printf("  %-28s  deinterlacing output rate (string) [default='field']\n",
+           "    --deinterlace-rate=RATE");
 }
 
 static const AVClass *
@@ -183,7 +459,7 @@ app_new(void)
 
     app->klass = app_class();
     av_opt_set_defaults(app);
-    ffva_surface_init_defaults(&app->filter_surface);
+    ffva_filter_job_params_init_defaults(&app->filter_params);
     return app;
 }
 
@@ -193,10 +469,24 @@ app_free(App *app)
     if (!app)
         return;
 
+    while (app->num_deint_frames > 0)
+        app_pop_deint_frame(app);
+    app_release_repeat_frame(app);
     ffva_renderer_freep(&app->renderer);
-    va_destroy_surface(app->va_display, &app->filter_surface.id);
-    ffva_filter_freep(&app->filter);
+    if (app->output_file) {
+        fclose(app->output_file);
+        app->output_file = NULL;
+    }
+    app_flush_filter_surfaces(app);
+    ffva_surface_pool_freep(&app->filter_surface_pool);
+    ffva_scale_policy_freep(&app->scale_policy);
+    ffva_scheduler_freep(&app->scheduler);
+    ffva_mailbox_freep(&app->mailbox);
     ffva_decoder_freep(&app->decoder);
+    if (app->push_fmtctx)
+        avformat_close_input(&app->push_fmtctx);
+    ffva_parallel_decoder_freep(&app->parallel_decoder);
+    ffva_packet_file_freep(&app->packet_file);
     ffva_display_freep(&app->display);
     av_opt_free(app);
     free(app);
@@ -219,13 +509,33 @@ error_create_display:
     return false;
 }
 
+// Allocates the decoder surfaces from renderer memory, whenever possible
+static int
+app_create_decoder_surfaces(void *user_data, uint32_t chroma, uint32_t width,
+    uint32_t height, VASurfaceID *surfaces, uint32_t num_surfaces)
+{
+    App * const app = user_data;
+
+    return ffva_renderer_create_surfaces(app->renderer, chroma, width, height,
+        surfaces, num_surfaces);
+}
+
 static bool
 app_ensure_decoder(App *app)
 {
+    uint32_t flags = 0;
+
     if (!app->decoder) {
         app->decoder = ffva_decoder_new(app->display);
         if (!app->decoder)
             goto error_create_decoder;
+        ffva_decoder_set_surface_allocator(app->decoder,
+            app_create_decoder_surfaces, app);
+        if (app->options.low_latency)
+            flags |= FFVA_DECODER_FLAG_LOW_LATENCY;
+        if (app->options.download)
+            flags |= FFVA_DECODER_FLAG_SOFTWARE_FALLBACK;
+        ffva_decoder_set_flags(app->decoder, flags);
     }
     return true;
 
@@ -235,75 +545,368 @@ error_create_decoder:
     return false;
 }
 
+// Opens the video file for demuxing in the application, and the decoder for
+// the elementary stream packets that are pushed to it
 static bool
-app_ensure_filter(App *app)
+app_open_push_decoder(App *app)
 {
     const Options * const options = &app->options;
-    const int *formats, *format = NULL;
+    FFVADecoderCodecParams params;
+    AVCodecContext *avctx;
+    char errbuf[BUFSIZ];
+    int ret;
 
-    if (!app->filter) {
-        app->filter = ffva_filter_new(app->display);
-        if (!app->filter)
-            goto error_create_filter;
+    ret = avformat_open_input(&app->push_fmtctx, options->filename, NULL,
+        NULL);
+    if (ret != 0)
+        goto error_open_file;
+    ret = avformat_find_stream_info(app->push_fmtctx, NULL);
+    if (ret < 0)
+        goto error_open_file;
+    ret = av_find_best_stream(app->push_fmtctx, AVMEDIA_TYPE_VIDEO, -1, -1,
+        NULL, 0);
+    if (ret < 0)
+        goto error_open_file;
+    app->push_stream = app->push_fmtctx->streams[ret];
+    avctx = app->push_stream->codec;
+
+    memset(&params, 0, sizeof(params));
+    params.codec = avctx->codec_id;
+    params.profile = avctx->profile;
+    params.width = avctx->width;
+    params.height = avctx->height;
+    params.extradata = avctx->extradata;
+    params.extradata_size = avctx->extradata_size;
+    params.time_base = app->push_stream->time_base;
+    params.frame_rate = app->push_stream->avg_frame_rate;
+    return ffva_decoder_open_codec(app->decoder, &params) == 0;
+
+    /* ERRORS */
+error_open_file:
+    av_log(app, AV_LOG_ERROR, "failed to open video stream from `%s': %s\n",
+        options->filename, ffmpeg_strerror(ret, errbuf));
+    return false;
+}
+
+// Maps the packet file, and opens the decoder for the packets it holds
+static bool
+app_open_packet_file_decoder(App *app)
+{
+    FFVADecoderCodecParams params;
+
+    app->packet_file = ffva_packet_file_new(app->options.filename);
+    if (!app->packet_file)
+        return false;
+
+    if (app->options.parallel > 0) {
+        app->parallel_decoder = ffva_parallel_decoder_new(app->display,
+            app->packet_file, app->options.parallel);
+        return app->parallel_decoder != NULL;
     }
+    if (!ffva_packet_file_get_codec_params(app->packet_file, &params))
+        return false;
+    return ffva_decoder_open_codec(app->decoder, &params) == 0;
+}
+
+static bool
+app_open_decoder(App *app)
+{
+    if (app->options.parallel > 0 && !app->options.packet_file)
+        goto error_parallel_input;
+    if (app->options.packet_file)
+        return app_open_packet_file_decoder(app);
+    if (app->options.push)
+        return app_open_push_decoder(app);
+    return ffva_decoder_open(app->decoder, app->options.filename) == 0;
+
+    /* ERRORS */
+error_parallel_input:
+    av_log(app, AV_LOG_ERROR, "parallel decoding requires a packet file\n");
+    return false;
+}
+
+static bool
+app_has_filter_ops(App *app)
+{
+    const Options * const options = &app->options;
+
+    return !isnan(options->denoise) || !isnan(options->sharpen) ||
+        !isnan(options->hue) || !isnan(options->saturation) ||
+        !isnan(options->brightness) || !isnan(options->contrast) ||
+        options->deinterlace != FFVA_DEINTERLACE_METHOD_NONE;
+}
+
+static bool
+app_set_filter_op(App *app, FFVAFilterOp op, const char *name, float value)
+{
+    char errbuf[BUFSIZ];
+    int ret;
 
-    if (options->pix_fmt == AV_PIX_FMT_NONE)
+    if (isnan(value))
         return true;
 
-    formats = ffva_filter_get_formats(app->filter);
-    if (formats) {
-        for (format = formats; *format != AV_PIX_FMT_NONE; format++) {
-            if (*format == options->pix_fmt)
-                break;
-        }
-    }
-    if (!format || *format == AV_PIX_FMT_NONE)
-        goto error_unsupported_format;
+    app->filter_params.op_values[op] = value;
+    ret = ffva_filter_service_check_params(app->filter_service,
+        &app->filter_params);
+    if (ret < 0)
+        goto error_set_operation;
+    return true;
 
-    if (!ffmpeg_to_vaapi_pix_fmt(options->pix_fmt, &app->filter_fourcc,
-            &app->filter_chroma))
-        goto error_unsupported_format;
+    /* ERRORS */
+error_set_operation:
+    av_log(app, AV_LOG_ERROR, "failed to set %s to %g: %s\n", name, value,
+        ffmpeg_strerror(ret, errbuf));
+    return false;
+}
+
+static bool
+app_ensure_filter_ops(App *app)
+{
+    const Options * const options = &app->options;
+    char errbuf[BUFSIZ];
+    int ret;
+
+    if (!app_set_filter_op(app, FFVA_FILTER_OP_DENOISE, "denoise",
+            options->denoise))
+        return false;
+    if (!app_set_filter_op(app, FFVA_FILTER_OP_SHARPEN, "sharpen",
+            options->sharpen))
+        return false;
+    if (!app_set_filter_op(app, FFVA_FILTER_OP_HUE, "hue",
+            options->hue))
+        return false;
+    if (!app_set_filter_op(app, FFVA_FILTER_OP_SATURATION, "saturation",
+            options->saturation))
+        return false;
+    if (!app_set_filter_op(app, FFVA_FILTER_OP_BRIGHTNESS, "brightness",
+            options->brightness))
+        return false;
+    if (!app_set_filter_op(app, FFVA_FILTER_OP_CONTRAST, "contrast",
+            options->contrast))
+        return false;
+
+    app->filter_params.deinterlace_method = options->deinterlace;
+    ret = ffva_filter_service_check_params(app->filter_service,
+        &app->filter_params);
+    if (ret < 0)
+        goto error_set_deinterlace_method;
+    return true;
+
+    /* ERRORS */
+error_set_deinterlace_method:
+    av_log(app, AV_LOG_ERROR, "failed to set deinterlacing method: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    return false;
+}
+
+// Uses the video processing service of the display, which VPP jobs carry
+// their own state to, so that its VPP contexts are shared
+static bool
+app_ensure_filter(App *app)
+{
+    if (!app->filter_service) {
+        app->filter_service = ffva_filter_service_get(app->display);
+        if (!app->filter_service)
+            goto error_create_filter;
+        ffva_filter_job_params_init_defaults(&app->filter_params);
+        if (!app_ensure_filter_ops(app))
+            return false;
+    }
     return true;
 
     /* ERRORS */
 error_create_filter:
     av_log(app, AV_LOG_ERROR, "failed to create video processing pipeline\n");
     return false;
+}
+
+// Returns the media info of the opened decoder, or parallel decoder
+static bool
+app_get_decoder_info(App *app, FFVADecoderInfo *info)
+{
+    if (app->parallel_decoder)
+        return ffva_parallel_decoder_get_info(app->parallel_decoder, info);
+    return ffva_decoder_get_info(app->decoder, info);
+}
+
+// Determines the cheapest chain of formats from the decoder to the renderer,
+// and whether VPP is needed at all. The decoder has to be opened first, so
+// that the format of its surfaces is known
+static bool
+app_negotiate_formats(App *app)
+{
+    const Options * const options = &app->options;
+    FFVAFormatConstraints constraints;
+    FFVAFormatPath path;
+    FFVADecoderInfo info;
+    enum AVPixelFormat pix_fmt;
+    int ret;
+
+    if (!app_get_decoder_info(app, &info))
+        goto error_no_decoder_info;
+
+    memset(&constraints, 0, sizeof(constraints));
+    constraints.src_fourcc = info.fourcc;
+    constraints.renderer_formats = ffva_renderer_get_formats(app->renderer);
+    constraints.need_filter = app_has_filter_ops(app);
+    if (options->pix_fmt != AV_PIX_FMT_NONE &&
+        !ffmpeg_to_vaapi_pix_fmt(options->pix_fmt,
+            &constraints.required_fourcc, NULL))
+        goto error_unsupported_format;
+
+    if (app->filter_service)
+        constraints.filter_formats =
+            ffva_filter_service_get_formats(app->filter_service);
+    ret = ffva_format_negotiate(&constraints, &path);
+    if (ret < 0 && !app->filter_service) {
+        // try again with VPP, the decoded surfaces cannot be used as is
+        if (!app_ensure_filter(app))
+            return false;
+        constraints.filter_formats =
+            ffva_filter_service_get_formats(app->filter_service);
+        ret = ffva_format_negotiate(&constraints, &path);
+    }
+    if (ret < 0)
+        goto error_no_path;
+
+    app->use_filter = path.use_filter;
+    if (!path.use_filter) {
+        av_log(app, AV_LOG_INFO, "format path: decoder %.4s -> renderer "
+            "(cost %u)\n", (char *)&constraints.src_fourcc, path.cost);
+        ffva_filter_job_params_init_defaults(&app->filter_params);
+
+        // VPP may still be used for downscaling, in the decoder format
+        app->filter_fourcc = info.fourcc;
+        app->filter_chroma = info.chroma;
+        return true;
+    }
+    av_log(app, AV_LOG_INFO, "format path: decoder %.4s -> VPP %.4s -> "
+        "renderer (cost %u)\n", (char *)&constraints.src_fourcc,
+        (char *)&path.fourcc, path.cost);
+
+    if (!vaapi_to_ffmpeg_pix_fmt(path.fourcc, &pix_fmt))
+        goto error_no_path;
+    app->filter_params.pix_fmt = pix_fmt;
+    if (ffva_filter_service_check_params(app->filter_service,
+            &app->filter_params) < 0)
+        goto error_no_path;
+    app->filter_fourcc = path.fourcc;
+    app->filter_chroma = path.chroma;
+    return true;
+
+    /* ERRORS */
+error_no_decoder_info:
+    av_log(app, AV_LOG_ERROR, "failed to get decoded surfaces format\n");
+    return false;
 error_unsupported_format:
     av_log(app, AV_LOG_ERROR, "unsupported output format %s\n",
         av_get_pix_fmt_name(options->pix_fmt));
     return false;
+error_no_path:
+    if (options->pix_fmt != AV_PIX_FMT_NONE)
+        av_log(app, AV_LOG_ERROR, "output format %s cannot be produced or "
+            "rendered\n", av_get_pix_fmt_name(options->pix_fmt));
+    else
+        av_log(app, AV_LOG_ERROR, "no format suitable for the renderer\n");
+    return false;
 }
 
 static bool
-app_ensure_filter_surface(App *app, uint32_t width, uint32_t height)
+app_ensure_filter_surface_pool(App *app)
 {
-    FFVASurface * const s = &app->filter_surface;
-    VASurfaceID va_surface;
-    VASurfaceAttrib attrib;
-    VAStatus va_status;
+    if (!app->filter_surface_pool) {
+        app->filter_surface_pool = ffva_surface_pool_new(app->display,
+            FILTER_SURFACE_POOL_DEPTH);
+        if (!app->filter_surface_pool)
+            goto error_create_pool;
+    }
+    return true;
+
+    /* ERRORS */
+error_create_pool:
+    av_log(app, AV_LOG_ERROR, "failed to create VPP output surface pool\n");
+    return false;
+}
+
+// Tracks a VPP output surface submitted to the renderer, until the renderer
+// releases it
+static void
+app_queue_filter_surface(App *app, FFVASurface *s)
+{
+    app->filter_surfaces[app->num_filter_surfaces++] = s;
+}
 
-    if (!app->filter)
-        return true; // VPP not needed (checked in app_ensure_filter())
+// Returns a VPP output surface to the pool, once the renderer no longer
+// reads from it. Other surfaces are not tracked, and are ignored
+static void
+app_release_filter_surface(void *user_data, FFVASurface *s)
+{
+    App * const app = user_data;
+    uint32_t i;
 
-    if (width == s->width && height == s->height)
-        return true;
+    for (i = 0; i < app->num_filter_surfaces; i++) {
+        if (app->filter_surfaces[i] == s)
+            break;
+    }
+    if (i == app->num_filter_surfaces)
+        return;
+
+    ffva_surface_pool_release(app->filter_surface_pool, s);
+    for (i = i + 1; i < app->num_filter_surfaces; i++)
+        app->filter_surfaces[i - 1] = app->filter_surfaces[i];
+    app->num_filter_surfaces--;
+}
 
-    attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
-    attrib.type = VASurfaceAttribPixelFormat;
-    attrib.value.type = VAGenericValueTypeInteger;
-    attrib.value.value.i = app->filter_fourcc;
+static void
+app_flush_filter_surfaces(App *app)
+{
+    uint32_t i;
 
-    va_destroy_surface(app->va_display, &s->id);
-    va_status = vaCreateSurfaces(app->va_display, app->filter_chroma,
-        width, height, &va_surface, 1, &attrib, 1);
-    if (!va_check_status(va_status, "vaCreateSurfaces()"))
-        return false;
+    ffva_renderer_release_surfaces(app->renderer);
+    for (i = 0; i < app->num_filter_surfaces; i++)
+        ffva_surface_pool_release(app->filter_surface_pool,
+            app->filter_surfaces[i]);
+    app->num_filter_surfaces = 0;
+}
+
+#if USE_EGL
+// Writes a frame read back from the offscreen renderer to the output file
+static void
+app_write_frame(void *user_data, const uint8_t *pixels, uint32_t width,
+    uint32_t height, uint32_t stride)
+{
+    App * const app = user_data;
+    uint32_t y;
+
+    for (y = 0; y < height; y++) {
+        if (fwrite(pixels + y * stride, width * 4, 1, app->output_file) != 1) {
+            av_log(app, AV_LOG_ERROR, "failed to write output frame\n");
+            return;
+        }
+    }
+}
+
+static bool
+app_ensure_output(App *app)
+{
+    const Options * const options = &app->options;
 
-    ffva_surface_init(s, va_surface, app->filter_chroma, width, height);
-    s->fourcc = app->filter_fourcc;
+    if (!app->output_file) {
+        app->output_file = fopen(options->output_filename, "wb");
+        if (!app->output_file)
+            goto error_open_file;
+        ffva_renderer_egl_set_readback_func(app->renderer, app_write_frame,
+            app);
+    }
     return true;
+
+    /* ERRORS */
+error_open_file:
+    av_log(app, AV_LOG_ERROR, "failed to open output file '%s'\n",
+        options->output_filename);
+    return false;
 }
+#endif
 
 static bool
 app_ensure_renderer(App *app)
@@ -311,6 +914,10 @@ app_ensure_renderer(App *app)
     const Options * const options = &app->options;
     uint32_t flags = 0;
 
+    if (options->output_filename &&
+        options->renderer_type != FFVA_RENDERER_TYPE_EGL)
+        goto error_output_renderer;
+
     if (!app->renderer) {
         switch (options->renderer_type) {
 #if USE_DRM
@@ -339,7 +946,20 @@ app_ensure_renderer(App *app)
                 flags |= FFVA_RENDERER_EGL_MEM_TYPE_MESA_TEXTURE;
                 break;
             }
+            if (options->output_filename)
+                flags |= FFVA_RENDERER_EGL_OFFSCREEN;
+            if (options->swap_interval == 0)
+                flags |= FFVA_RENDERER_EGL_NO_VSYNC;
+            if (options->damage)
+                flags |= FFVA_RENDERER_EGL_DAMAGE;
             app->renderer = ffva_renderer_egl_new(app->display, flags);
+            if (!app->renderer)
+                break;
+            if (!ffva_renderer_egl_set_max_queued_frames(app->renderer,
+                    options->max_queued_frames))
+                return false;
+            if (options->output_filename && !app_ensure_output(app))
+                return false;
             break;
 #endif
         default:
@@ -347,6 +967,8 @@ app_ensure_renderer(App *app)
         }
         if (!app->renderer)
             goto error_create_renderer;
+        ffva_renderer_set_release_func(app->renderer,
+            app_release_filter_surface, app);
     }
     return true;
 
@@ -354,6 +976,9 @@ app_ensure_renderer(App *app)
 error_create_renderer:
     av_log(app, AV_LOG_ERROR, "failed to create renderer\n");
     return false;
+error_output_renderer:
+    av_log(app, AV_LOG_ERROR, "writing output frames needs the EGL renderer\n");
+    return false;
 }
 
 static bool
@@ -372,28 +997,124 @@ app_ensure_renderer_size(App *app, uint32_t width, uint32_t height)
 }
 
 static bool
-app_process_surface(App *app, FFVASurface *s, const VARectangle *rect,
-    uint32_t flags)
+app_ensure_scale_policy(App *app)
 {
-    FFVASurface * const d = &app->filter_surface;
+    if (!app->scale_policy) {
+        app->scale_policy = ffva_scale_policy_new();
+        if (!app->scale_policy)
+            return false;
+    }
+    return true;
+}
 
-    if (!app_ensure_filter_surface(app, s->width, s->height))
-        return false;
+// Paces presentation to the frame timestamps, unless frames are written out,
+// or the renderer does not present them at all
+static bool
+app_ensure_scheduler(App *app)
+{
+    const Options * const options = &app->options;
+    uint64_t refresh_interval;
 
-    if (ffva_filter_set_cropping_rectangle(app->filter, rect) < 0)
-        return false;
+    if (!options->sync || options->low_latency || options->output_filename ||
+        options->renderer_type == FFVA_RENDERER_TYPE_DRM)
+        return true;
 
-    if (ffva_filter_process(app->filter, s, d, flags) < 0)
-        return false;
+    if (!app->scheduler) {
+        app->scheduler = ffva_scheduler_new();
+        if (!app->scheduler)
+            return false;
+    }
+
+    // the display refresh rate is known ahead, rather than estimated
+    if (ffva_renderer_get_refresh_interval(app->renderer, &refresh_interval))
+        ffva_scheduler_set_refresh_interval(app->scheduler, refresh_interval);
+
+#if AV_FEATURE_AVFRAME_REF
+    // present the last frame again on refresh cycles without any new frame,
+    // if presentations are throttled to vblanks, and unless deinterlacing
+    // needs references that are gone by then
+    app->repeat_frames =
+        ffva_renderer_get_type(app->renderer) == FFVA_RENDERER_TYPE_EGL &&
+        options->swap_interval != 0 &&
+        app->deint_num_forward_refs + app->deint_num_backward_refs == 0;
+    ffva_scheduler_set_repeat_frames(app->scheduler, app->repeat_frames);
+#endif
     return true;
 }
 
+static FFVASurface *
+app_process_surface(App *app, FFVASurface *s, const VARectangle *rect,
+    uint32_t width, uint32_t height, uint32_t flags)
+{
+    FFVASurface *d;
+
+    if (!app_ensure_filter_surface_pool(app))
+        return NULL;
+
+    // All surfaces are still displayed, wait for the renderer to finish
+    if (app->num_filter_surfaces == FILTER_SURFACE_POOL_DEPTH)
+        ffva_renderer_release_surfaces(app->renderer);
+
+    d = ffva_surface_pool_acquire(app->filter_surface_pool,
+        app->filter_fourcc, app->filter_chroma, width, height);
+    if (!d)
+        return NULL;
+
+    if (ffva_filter_service_process(app->filter_service, s, rect, d, NULL,
+            &app->filter_params, flags) < 0)
+        goto error;
+    return d;
+
+error:
+    ffva_surface_pool_release(app->filter_surface_pool, d);
+    return NULL;
+}
+
+// Waits for the GPU to complete all the work the frame depends on, so that
+// the time it then spends on that frame alone can be measured
+static void
+app_begin_timed_frame(App *app, FFVASurface *s)
+{
+    VAStatus va_status;
+
+    ffva_renderer_release_surfaces(app->renderer);
+    va_status = vaSyncSurface(app->va_display, s->id);
+    va_check_status(va_status, "vaSyncSurface()");
+}
+
+// Accounts for the time of the last timed frame, once the GPU had a frame
+// interval to complete it. The sample is skipped if the renderer has no
+// result yet, rather than waited for. Renderers that cannot tell the GPU
+// time at all are timed on the CPU side
+static void
+app_end_timed_frame(App *app)
+{
+    uint64_t render_time;
+    int ret;
+
+    if (!app->has_timed_frame)
+        return;
+    app->has_timed_frame = false;
+
+    ret = ffva_renderer_get_gpu_time(app->renderer, &render_time);
+    if (ret == AVERROR(ENOSYS))
+        render_time = app->timed_frame_cpu_time;
+    else if (ret < 0)
+        return;
+    ffva_scale_policy_end_frame(app->scale_policy,
+        app->timed_frame_vpp_time + render_time);
+}
+
 static bool
 app_render_surface(App *app, FFVASurface *s, const VARectangle *rect,
     uint32_t flags)
 {
     const Options * const options = &app->options;
     uint32_t renderer_width, renderer_height;
+    uint64_t start_time, vpp_time = 0;
+    bool scale_in_vpp, is_timed, success;
+    VAStatus va_status;
+    FFVASurface *d;
 
     renderer_width = options->window_width ? options->window_width :
         rect->width;
@@ -401,28 +1122,117 @@ app_render_surface(App *app, FFVASurface *s, const VARectangle *rect,
         rect->height;
     if (!app_ensure_renderer_size(app, renderer_width, renderer_height))
         return false;
-
-    if (app->filter) {
-        if (!app_process_surface(app, s, rect, flags))
+    app_end_timed_frame(app);
+
+    // downscale the source rectangle to the window size with VPP, rather
+    // than in the renderer, when that turns out to be cheaper
+    scale_in_vpp = ffva_scale_policy_begin_frame(app->scale_policy, rect,
+        renderer_width, renderer_height, app->use_filter);
+    is_timed = ffva_scale_policy_is_frame_timed(app->scale_policy);
+    if (is_timed)
+        app_begin_timed_frame(app, s);
+
+    if (app->use_filter || scale_in_vpp) {
+        if (!app_ensure_filter(app))
             return false;
+        start_time = get_time_us();
+        d = app_process_surface(app, s, rect,
+            scale_in_vpp ? renderer_width : s->width,
+            scale_in_vpp ? renderer_height : s->height, flags);
+        if (!d)
+            return false;
+        if (is_timed) {
+            va_status = vaSyncSurface(app->va_display, d->id);
+            va_check_status(va_status, "vaSyncSurface()");
+            vpp_time = get_time_us() - start_time;
+        }
 
         // drop deinterlacing, color standard and scaling flags
-        flags &= ~(VA_TOP_FIELD|VA_BOTTOM_FIELD|0xf0|VA_FILTER_SCALING_MASK);
+        flags &= ~(VA_TOP_FIELD|VA_BOTTOM_FIELD|0xf0|VA_FILTER_SCALING_MASK|
+            FFVA_FILTER_FLAG_BOTTOM_FIELD_FIRST);
+
+        app_queue_filter_surface(app, d);
+        start_time = get_time_us();
+        success = ffva_renderer_put_surface(app->renderer, d, NULL, NULL,
+            flags);
+    }
+    else {
+        flags &= ~FFVA_FILTER_FLAG_BOTTOM_FIELD_FIRST;
+        start_time = get_time_us();
+        success = ffva_renderer_put_surface(app->renderer, s, rect, NULL,
+            flags);
+    }
 
-        return ffva_renderer_put_surface(app->renderer, &app->filter_surface,
-            NULL, NULL, flags);
+    // The GPU time of the frame is read back with the next frame
+    if (is_timed && success) {
+        app->timed_frame_vpp_time = vpp_time;
+        app->timed_frame_cpu_time = get_time_us() - start_time;
+        app->has_timed_frame = true;
     }
-    return ffva_renderer_put_surface(app->renderer, s, rect, NULL, flags);
+    return success;
 }
 
+// Releases the frame held for repeats
+static void
+app_release_repeat_frame(App *app)
+{
+    if (!app->has_repeat_frame)
+        return;
+
+    av_frame_free(&app->repeat_frame.frame);
+    app->has_repeat_frame = false;
+}
+
+// Holds the frame just presented, so that it can be presented again
 static int
-app_render_frame(App *app, FFVADecoderFrame *dec_frame)
+app_hold_repeat_frame(App *app, FFVADecoderFrame *dec_frame,
+    const VARectangle *rect, uint32_t flags)
+{
+#if AV_FEATURE_AVFRAME_REF
+    if (!app->repeat_frames)
+        return 0;
+
+    if (!app->has_repeat_frame || app->repeat_frame.surface !=
+        dec_frame->surface) {
+        app_release_repeat_frame(app);
+        app->repeat_frame = *dec_frame;
+        app->repeat_frame.frame = av_frame_clone(dec_frame->frame);
+        if (!app->repeat_frame.frame)
+            return AVERROR(ENOMEM);
+        app->has_repeat_frame = true;
+    }
+    app->repeat_rect = *rect;
+    app->repeat_flags = flags;
+#endif
+    return 0;
+}
+
+// Presents the last frame again, as requested by the scheduler
+static int
+app_repeat_frame(App *app)
+{
+    if (!app->has_repeat_frame)
+        return AVERROR_BUG;
+
+    ffva_scheduler_wait(app->scheduler);
+    if (!app_render_surface(app, app->repeat_frame.surface,
+            &app->repeat_rect, app->repeat_flags))
+        return AVERROR_UNKNOWN;
+    ffva_scheduler_frame_presented(app->scheduler);
+    return 0;
+}
+
+static int
+app_render_fields(App *app, FFVADecoderFrame *dec_frame)
 {
+    const Options * const options = &app->options;
     FFVASurface * const s = dec_frame->surface;
     AVFrame * const frame = dec_frame->frame;
     const VARectangle *rect;
     VARectangle tmp_rect;
-    uint32_t i, flags;
+    FFVASchedulerAction action;
+    uint32_t i, num_fields, flags;
+    int ret;
 
     if (dec_frame->has_crop_rect)
         rect = &dec_frame->crop_rect;
@@ -434,34 +1244,435 @@ app_render_frame(App *app, FFVADecoderFrame *dec_frame)
         rect = &tmp_rect;
     }
 
+    num_fields = 1;
+    if (frame->interlaced_frame &&
+        options->deinterlace_rate != DEINTERLACE_RATE_FRAME)
+        num_fields = 2;
+
     flags = 0;
-    for (i = 0; i < 1 + !!frame->interlaced_frame; i++) {
+    if (frame->interlaced_frame && !frame->top_field_first)
+        flags |= FFVA_FILTER_FLAG_BOTTOM_FIELD_FIRST;
+    for (i = 0; i < num_fields; i++) {
         flags &= ~(VA_TOP_FIELD|VA_BOTTOM_FIELD);
         if (frame->interlaced_frame) {
             flags |= ((i == 0) ^ !!frame->top_field_first) == 0 ?
                 VA_TOP_FIELD : VA_BOTTOM_FIELD;
         }
+
+        // each field is shown for its share of the frame duration, and the
+        // previous field is presented again until this one is due
+        for (;;) {
+            action = ffva_scheduler_schedule_frame(app->scheduler,
+                dec_frame->pts + i * dec_frame->duration / num_fields,
+                dec_frame->duration / num_fields);
+            if (action != FFVA_SCHEDULER_ACTION_REPEAT)
+                break;
+            ret = app_repeat_frame(app);
+            if (ret < 0)
+                return ret;
+        }
+        if (action == FFVA_SCHEDULER_ACTION_DROP)
+            continue;
+        ffva_scheduler_wait(app->scheduler);
         if (!app_render_surface(app, s, rect, flags))
             return AVERROR_UNKNOWN;
+        ffva_scheduler_frame_presented(app->scheduler);
+
+        ret = app_hold_repeat_frame(app, dec_frame, rect, flags);
+        if (ret < 0)
+            return ret;
     }
     return 0;
 }
 
-static int
-app_decode_frame(App *app)
+static bool
+app_ensure_deinterlace_references(App *app)
 {
-    FFVADecoderFrame *dec_frame;
+    const Options * const options = &app->options;
+    uint32_t num_forward_refs = 0, num_backward_refs = 0;
+    char errbuf[BUFSIZ];
     int ret;
 
-    ret = ffva_decoder_get_frame(app->decoder, &dec_frame);
-    if (ret == 0) {
-        ret = app_render_frame(app, dec_frame);
-        ffva_decoder_put_frame(app->decoder, dec_frame);
-    }
-    return ret;
-}
+    if (!app->filter_service ||
+        options->deinterlace == FFVA_DEINTERLACE_METHOD_NONE)
+        return true;
 
-static bool
+    ret = ffva_filter_service_get_deinterlace_references(app->filter_service,
+        options->deinterlace, &num_forward_refs, &num_backward_refs);
+    if (ret < 0)
+        goto error_get_references;
+
+#if !AV_FEATURE_AVFRAME_REF
+    // decoded frames cannot be held beyond the next decode call
+    num_forward_refs = num_backward_refs = 0;
+#endif
+    // waiting for future references would add latency
+    if (options->low_latency)
+        num_backward_refs = 0;
+    if (num_backward_refs > DEINTERLACE_MAX_REFERENCES)
+        num_backward_refs = DEINTERLACE_MAX_REFERENCES;
+    if (num_forward_refs > DEINTERLACE_MAX_REFERENCES - num_backward_refs)
+        num_forward_refs = DEINTERLACE_MAX_REFERENCES - num_backward_refs;
+    app->deint_num_forward_refs = num_forward_refs;
+    app->deint_num_backward_refs = num_backward_refs;
+    return true;
+
+    /* ERRORS */
+error_get_references:
+    av_log(app, AV_LOG_ERROR, "failed to query deinterlacing references: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    return false;
+}
+
+// Renders the frame at the supplied index of the deinterlacing window, with
+// the surrounding frames as references
+static int
+app_render_deint_frame(App *app, uint32_t index)
+{
+    FFVAFilterJobParams * const params = &app->filter_params;
+    uint32_t i;
+    int ret;
+
+    // past frames, most recent first
+    params->num_forward_refs = FFMIN(app->deint_num_forward_refs, index);
+    for (i = 0; i < params->num_forward_refs; i++)
+        params->forward_refs[i] = app->deint_frames[index - 1 - i].surface;
+
+    // future frames, closest first
+    params->num_backward_refs = FFMIN(app->deint_num_backward_refs,
+        app->num_deint_frames - 1 - index);
+    for (i = 0; i < params->num_backward_refs; i++)
+        params->backward_refs[i] = app->deint_frames[index + 1 + i].surface;
+
+    ret = app_render_fields(app, &app->deint_frames[index]);
+    params->num_forward_refs = 0;
+    params->num_backward_refs = 0;
+    return ret;
+}
+
+static void
+app_pop_deint_frame(App *app)
+{
+    uint32_t i;
+
+    if (app->num_deint_frames == 0)
+        return;
+
+    av_frame_free(&app->deint_frames[0].frame);
+    for (i = 1; i < app->num_deint_frames; i++)
+        app->deint_frames[i - 1] = app->deint_frames[i];
+    app->num_deint_frames--;
+    if (app->deint_next_frame > 0)
+        app->deint_next_frame--;
+}
+
+// Renders all the frames remaining in the deinterlacing window
+static int
+app_flush_deint_frames(App *app)
+{
+    int ret = 0;
+
+    while (ret == 0 && app->deint_next_frame < app->num_deint_frames)
+        ret = app_render_deint_frame(app, app->deint_next_frame++);
+
+    while (app->num_deint_frames > 0)
+        app_pop_deint_frame(app);
+    app->deint_next_frame = 0;
+    return ret;
+}
+
+static int
+app_render_frame(App *app, FFVADecoderFrame *dec_frame)
+{
+#if AV_FEATURE_AVFRAME_REF
+    const uint32_t num_forward_refs = app->deint_num_forward_refs;
+    const uint32_t num_backward_refs = app->deint_num_backward_refs;
+    FFVADecoderFrame *deint_frame;
+    int ret;
+
+    if (num_forward_refs + num_backward_refs == 0)
+        return app_render_fields(app, dec_frame);
+
+    // keep the decoded surface alive while it is needed as a reference
+    deint_frame = &app->deint_frames[app->num_deint_frames];
+    *deint_frame = *dec_frame;
+    deint_frame->frame = av_frame_clone(dec_frame->frame);
+    if (!deint_frame->frame)
+        return AVERROR(ENOMEM);
+    app->num_deint_frames++;
+
+    // render frames for which enough future references are available
+    while (app->deint_next_frame < app->num_deint_frames &&
+           app->num_deint_frames - 1 - app->deint_next_frame >=
+           num_backward_refs) {
+        ret = app_render_deint_frame(app, app->deint_next_frame++);
+        if (ret < 0)
+            return ret;
+    }
+
+    // drop frames that are no longer needed as past references
+    while (app->deint_next_frame > num_forward_refs)
+        app_pop_deint_frame(app);
+    return 0;
+#else
+    return app_render_fields(app, dec_frame);
+#endif
+}
+
+// Pushes the supplied packet to the decoder, or NULL to drain it
+static int
+app_send_packet(App *app, const FFVADecoderPacket *dec_packet)
+{
+    int ret;
+
+    ret = ffva_decoder_send_packet(app->decoder, dec_packet);
+
+    // No frame is pending at this point, so every surface is held by us
+    if (ret == AVERROR(EAGAIN))
+        goto error_no_surfaces;
+    return ret;
+
+    /* ERRORS */
+error_no_surfaces:
+    av_log(app, AV_LOG_ERROR, "all decoder surfaces are held for display\n");
+    return AVERROR(ENOBUFS);
+}
+
+// Reads the next video packet from the file and pushes it to the decoder,
+// or drains the decoder at the end of the file
+static int
+app_push_packet(App *app)
+{
+    FFVADecoderPacket dec_packet;
+    AVPacket packet;
+    int ret;
+
+    do {
+        ret = av_read_frame(app->push_fmtctx, &packet);
+        if (ret == AVERROR_EOF)
+            return app_send_packet(app, NULL);
+        if (ret < 0)
+            return ret;
+        if (packet.stream_index == app->push_stream->index)
+            break;
+        av_free_packet(&packet);
+    } while (1);
+
+    // Demuxed packets are padded, so they are decoded in place
+    memset(&dec_packet, 0, sizeof(dec_packet));
+    dec_packet.data = packet.data;
+    dec_packet.size = packet.size;
+    dec_packet.pts = packet.pts;
+    dec_packet.dts = packet.dts;
+    dec_packet.duration = packet.duration;
+    dec_packet.flags = FFVA_DECODER_PACKET_FLAG_PADDED;
+    if (packet.flags & AV_PKT_FLAG_KEY)
+        dec_packet.flags |= FFVA_DECODER_PACKET_FLAG_KEY;
+    ret = app_send_packet(app, &dec_packet);
+    av_free_packet(&packet);
+    return ret;
+}
+
+// Pushes the next packet from the packet file to the decoder, wrapping
+// around with shifted timestamps while there are loops left to play
+static int
+app_push_cached_packet(App *app)
+{
+    const Options * const options = &app->options;
+    FFVAPacketFile * const pf = app->packet_file;
+    FFVADecoderPacket dec_packet;
+    int ret;
+
+    if (app->packet_index == ffva_packet_file_get_num_packets(pf)) {
+        if (app->packet_index == 0 ||
+            (options->loop > 0 && ++app->num_loops >= options->loop))
+            return app_send_packet(app, NULL);
+        app->packet_index = 0;
+        app->packet_ts_offset += ffva_packet_file_get_duration(pf);
+    }
+
+    if (!ffva_packet_file_get_packet(pf, app->packet_index, &dec_packet))
+        return AVERROR_INVALIDDATA;
+    if (dec_packet.pts != AV_NOPTS_VALUE)
+        dec_packet.pts += app->packet_ts_offset;
+    if (dec_packet.dts != AV_NOPTS_VALUE)
+        dec_packet.dts += app->packet_ts_offset;
+
+    // The packet is only consumed once the decoder accepted it
+    ret = app_send_packet(app, &dec_packet);
+    if (ret == 0)
+        app->packet_index++;
+    return ret;
+}
+
+// Acquires the next decoded frame, pushing packets to the decoder as needed
+static int
+app_get_frame(App *app, FFVADecoderFrame **dec_frame_ptr)
+{
+    int ret;
+
+    if (app->parallel_decoder)
+        return ffva_parallel_decoder_get_frame(app->parallel_decoder,
+            dec_frame_ptr);
+
+    do {
+        ret = ffva_decoder_get_frame(app->decoder, dec_frame_ptr);
+        if (ret != AVERROR(EAGAIN))
+            break;
+        if (app->packet_file)
+            ret = app_push_cached_packet(app);
+        else if (app->push_fmtctx)
+            ret = app_push_packet(app);
+        else
+            break;
+    } while (ret == 0);
+    return ret;
+}
+
+// Releases a frame acquired with app_get_frame()
+static void
+app_put_frame(App *app, FFVADecoderFrame *dec_frame)
+{
+    if (app->parallel_decoder)
+        ffva_parallel_decoder_put_frame(app->parallel_decoder, dec_frame);
+    else
+        ffva_decoder_put_frame(app->decoder, dec_frame);
+}
+
+#if AV_FEATURE_AVFRAME_REF
+// Accounts for the latency from packet arrival to presentation completion
+static void
+app_account_latency(App *app, uint64_t arrival_time)
+{
+    const uint64_t latency = get_time_us() - arrival_time;
+
+    if (app->num_latencies++ == 0 || latency < app->min_latency)
+        app->min_latency = latency;
+    if (latency > app->max_latency)
+        app->max_latency = latency;
+    app->total_latency += latency;
+}
+
+// Releases a decoded frame that was held for the mailbox
+static void
+app_free_mailbox_frame(void *user_data, void *item)
+{
+    FFVADecoderFrame * const dec_frame = item;
+
+    av_frame_free(&dec_frame->frame);
+    free(dec_frame);
+}
+
+// Decodes frames and posts them to the mailbox, until the end of stream or
+// until the mailbox gets closed
+static void *
+app_decode_thread(void *arg)
+{
+    App * const app = arg;
+    FFVADecoderFrame *dec_frame, *frame;
+    int ret;
+
+    do {
+        ret = app_get_frame(app, &dec_frame);
+        if (ret != 0)
+            continue;
+
+        // keep the decoded surface alive until it is presented, or replaced
+        frame = malloc(sizeof(*frame));
+        if (frame) {
+            *frame = *dec_frame;
+            frame->frame = av_frame_clone(dec_frame->frame);
+        }
+        app_put_frame(app, dec_frame);
+        if (!frame || !frame->frame) {
+            free(frame);
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        if (!ffva_mailbox_post(app->mailbox, frame)) {
+            app_free_mailbox_frame(app, frame);
+            ret = AVERROR(EPIPE);
+            break;
+        }
+    } while (ret == 0 || ret == AVERROR(EAGAIN));
+
+    app->decode_ret = ret;
+    ffva_mailbox_close(app->mailbox);
+    return NULL;
+}
+
+// Decodes in a separate thread, and always presents the latest frame, so
+// that decoded frames never queue up behind a slower presentation
+static int
+app_run_mailbox(App *app)
+{
+    FFVADecoderFrame *frame;
+    int ret = 0;
+
+    app->mailbox = ffva_mailbox_new(app_free_mailbox_frame, app);
+    if (!app->mailbox)
+        return AVERROR(ENOMEM);
+    if (pthread_create(&app->decode_thread, NULL, app_decode_thread, app) != 0)
+        goto error_create_thread;
+
+    while ((frame = ffva_mailbox_take(app->mailbox)) != NULL) {
+        if (ret == 0) {
+            ret = app_render_frame(app, frame);
+            if (ret == 0)
+                app_account_latency(app, frame->arrival_time);
+            else
+                ffva_mailbox_close(app->mailbox);
+        }
+        app_free_mailbox_frame(app, frame);
+    }
+    pthread_join(app->decode_thread, NULL);
+
+    if (ret == 0)
+        ret = app->decode_ret;
+    return ret;
+
+    /* ERRORS */
+error_create_thread:
+    av_log(app, AV_LOG_ERROR, "failed to create decoder thread\n");
+    ffva_mailbox_freep(&app->mailbox);
+    return AVERROR(EAGAIN);
+}
+
+// Prints out the latency and mailbox statistics of the low-latency mode
+static void
+app_report_latency(App *app)
+{
+    uint64_t num_posted = 0, num_replaced = 0;
+
+    if (!app->mailbox)
+        return;
+
+    ffva_mailbox_get_counts(app->mailbox, &num_posted, &num_replaced);
+    av_log(app, AV_LOG_INFO, "decoded %" PRIu64 " frames, %" PRIu64
+        " replaced before presentation\n", num_posted, num_replaced);
+    if (app->num_latencies > 0)
+        av_log(app, AV_LOG_INFO, "arrival to present latency: %.2f ms mean, "
+            "%.2f ms min, %.2f ms max\n",
+            app->total_latency / 1000.0 / app->num_latencies,
+            app->min_latency / 1000.0, app->max_latency / 1000.0);
+}
+#endif
+
+static int
+app_decode_frame(App *app)
+{
+    FFVADecoderFrame *dec_frame;
+    int ret;
+
+    ret = app_get_frame(app, &dec_frame);
+    if (ret == 0) {
+        ret = app_render_frame(app, dec_frame);
+        app_put_frame(app, dec_frame);
+    }
+    return ret;
+}
+
+static bool
 app_list_formats(App *app)
 {
     const int *formats;
@@ -472,7 +1683,7 @@ app_list_formats(App *app)
     if (!app_ensure_filter(app))
         return false;
 
-    formats = ffva_filter_get_formats(app->filter);
+    formats = ffva_filter_service_get_formats(app->filter_service);
     if (!formats)
         return false;
 
@@ -486,6 +1697,336 @@ app_list_formats(App *app)
     return true;
 }
 
+// Probes the supplied files and directories, and prints out JSON lines
+static bool
+app_probe(App *app)
+{
+    const Options * const options = &app->options;
+    FFVAProber *prober;
+    bool success = false;
+
+    if (!app_ensure_display(app))
+        return false;
+
+    prober = ffva_prober_new(app->display);
+    if (!prober)
+        goto error_create_prober;
+    ffva_prober_set_concurrency(prober, options->probe_threads,
+        options->probe_io);
+
+    if (options->probe_cache &&
+        ffva_prober_set_cache_file(prober, options->probe_cache) < 0)
+        goto cleanup;
+    if (options->filename &&
+        ffva_prober_add_path(prober, options->filename) < 0)
+        goto cleanup;
+    if (options->probe_list &&
+        ffva_prober_add_list(prober, options->probe_list) < 0)
+        goto cleanup;
+    if (ffva_prober_run(prober, stdout) < 0)
+        goto cleanup;
+    if (options->print_stats)
+        ffva_prober_report(prober);
+    success = true;
+
+cleanup:
+    ffva_prober_freep(&prober);
+    return success;
+
+    /* ERRORS */
+error_create_prober:
+    av_log(app, AV_LOG_ERROR, "failed to create prober\n");
+    return false;
+}
+
+static bool
+app_thumbnail(App *app)
+{
+    const Options * const options = &app->options;
+    FFVAThumbnailer *thumbnailer;
+    bool success = false;
+
+    if (!options->thumbnail_columns != !options->thumbnail_rows)
+        goto error_invalid_grid;
+    if (!app_ensure_display(app))
+        return false;
+
+    thumbnailer = ffva_thumbnailer_new(app->display);
+    if (!thumbnailer)
+        goto error_create_thumbnailer;
+
+    if (ffva_thumbnailer_set_size(thumbnailer, options->thumbnail_width,
+            options->thumbnail_height) < 0)
+        goto cleanup;
+    if (ffva_thumbnailer_set_interval(thumbnailer,
+            options->thumbnail_interval * AV_TIME_BASE) < 0)
+        goto cleanup;
+    if (ffva_thumbnailer_set_grid(thumbnailer, options->thumbnail_columns,
+            options->thumbnail_rows) < 0)
+        goto cleanup;
+    if (ffva_thumbnailer_run(thumbnailer, options->filename,
+            options->thumbnails) < 0)
+        goto cleanup;
+    if (options->print_stats)
+        ffva_thumbnailer_report(thumbnailer);
+    success = true;
+
+cleanup:
+    ffva_thumbnailer_freep(&thumbnailer);
+    return success;
+
+    /* ERRORS */
+error_create_thumbnailer:
+    av_log(app, AV_LOG_ERROR, "failed to create thumbnailer\n");
+    return false;
+error_invalid_grid:
+    av_log(app, AV_LOG_ERROR, "invalid sprite sheet grid %ux%u\n",
+        options->thumbnail_columns, options->thumbnail_rows);
+    return false;
+}
+
+// Receives the oldest downloaded frame, and releases it right away
+static int
+app_receive_download(App *app, AVFrame *frame)
+{
+    int ret;
+
+    ret = ffva_downloader_receive(app->downloader, frame);
+    if (ret == 0)
+        av_frame_unref(frame);
+    return ret;
+}
+
+// Decodes all frames, and downloads them to system memory while the next
+// frames are being decoded
+static bool
+app_download(App *app)
+{
+    const Options * const options = &app->options;
+    FFVADecoderFrame *dec_frame;
+    AVFrame *frame = NULL;
+    uint32_t num_queued_frames;
+    char errbuf[BUFSIZ];
+    bool success = false;
+    int ret;
+
+    // Frames are decoded in software if there is no VA display, though the
+    // parallel decoder only decodes with VA-API
+    if (options->parallel > 0 && !app_ensure_display(app))
+        return false;
+    if (!app->display) {
+        app->display = ffva_display_new(NULL);
+        if (app->display)
+            app->va_display = ffva_display_get_va_display(app->display);
+        else
+            av_log(app, AV_LOG_WARNING, "failed to create VA display, "
+                "decoding in software\n");
+    }
+    if (!app_ensure_decoder(app))
+        return false;
+
+    app->downloader = ffva_downloader_new(app->display,
+        options->download_threads);
+    if (!app->downloader)
+        goto error_create_downloader;
+    ffva_downloader_set_format(app->downloader, options->pix_fmt);
+    ffva_downloader_set_copy_threads(app->downloader,
+        options->download_copy_threads);
+    frame = av_frame_alloc();
+    if (!frame)
+        goto error_alloc_frame;
+
+    if (!app_open_decoder(app))
+        goto cleanup;
+
+    // Queued frames keep their surfaces, on top of the ones decoders need
+    num_queued_frames = ffva_downloader_get_num_queued_frames(app->downloader);
+    if (app->parallel_decoder) {
+        ffva_parallel_decoder_set_num_extra_surfaces(app->parallel_decoder,
+            num_queued_frames);
+        ret = ffva_parallel_decoder_start(app->parallel_decoder);
+    }
+    else {
+        ffva_decoder_set_num_extra_surfaces(app->decoder, num_queued_frames);
+        ret = ffva_decoder_start(app->decoder);
+    }
+    if (ret < 0)
+        goto cleanup;
+
+    for (;;) {
+        ret = app_get_frame(app, &dec_frame);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            goto error_decode_frame;
+
+        // Drain the oldest download when the queue is full
+        while ((ret = ffva_downloader_submit(app->downloader, dec_frame)) ==
+               AVERROR(EAGAIN)) {
+            ret = app_receive_download(app, frame);
+            if (ret < 0)
+                break;
+        }
+        app_put_frame(app, dec_frame);
+        if (ret < 0)
+            goto error_download_frame;
+    }
+
+    while ((ret = app_receive_download(app, frame)) == 0)
+        ;
+    if (ret != AVERROR(EAGAIN))
+        goto error_download_frame;
+
+    if (options->print_stats) {
+        ffva_parallel_decoder_report(app->parallel_decoder);
+        ffva_downloader_report(app->downloader);
+    }
+    ffva_decoder_stop(app->decoder);
+    ffva_decoder_close(app->decoder);
+    success = true;
+
+cleanup:
+    av_frame_free(&frame);
+    ffva_downloader_freep(&app->downloader);
+    return success;
+
+    /* ERRORS */
+error_create_downloader:
+    av_log(app, AV_LOG_ERROR, "failed to create downloader\n");
+    return false;
+error_alloc_frame:
+    av_log(app, AV_LOG_ERROR, "failed to allocate video frame\n");
+    goto cleanup;
+error_decode_frame:
+    av_log(app, AV_LOG_ERROR, "failed to decode frame: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_download_frame:
+    av_log(app, AV_LOG_ERROR, "failed to download frame: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+}
+
+// Parses the comma separated list of ladder output sizes
+static bool
+app_parse_ladder_outputs(App *app, FFVALadderOutput *outputs,
+    uint32_t *num_outputs_ptr)
+{
+    const Options * const options = &app->options;
+    const char *str = options->ladder;
+    unsigned int width, height;
+    uint32_t num_outputs = 0;
+    int n;
+
+    for (;;) {
+        if (num_outputs == LADDER_MAX_OUTPUTS)
+            goto error_too_many_outputs;
+        if (sscanf(str, "%ux%u%n", &width, &height, &n) < 2 ||
+            !width || !height)
+            goto error_invalid_size;
+
+        outputs[num_outputs].width = width;
+        outputs[num_outputs].height = height;
+        outputs[num_outputs].pix_fmt = options->pix_fmt;
+        outputs[num_outputs].flags = VA_FILTER_SCALING_HQ;
+        num_outputs++;
+
+        str += n;
+        if (*str == '\0')
+            break;
+        if (*str++ != ',')
+            goto error_invalid_size;
+    }
+    *num_outputs_ptr = num_outputs;
+    return true;
+
+    /* ERRORS */
+error_too_many_outputs:
+    av_log(app, AV_LOG_ERROR, "too many ladder outputs (max %d)\n",
+        LADDER_MAX_OUTPUTS);
+    return false;
+error_invalid_size:
+    av_log(app, AV_LOG_ERROR, "invalid ladder output size '%s'\n", str);
+    return false;
+}
+
+// Decodes all frames, and scales each of them to all the ladder outputs
+static bool
+app_ladder(App *app)
+{
+    const Options * const options = &app->options;
+    FFVALadderOutput outputs[LADDER_MAX_OUTPUTS];
+    FFVASurface *out_surfaces[LADDER_MAX_OUTPUTS];
+    FFVADecoderFrame *dec_frame;
+    FFVALadder *ladder = NULL;
+    uint32_t i, num_outputs;
+    char errbuf[BUFSIZ];
+    bool success = false;
+    int ret;
+
+    if (!app_parse_ladder_outputs(app, outputs, &num_outputs))
+        return false;
+    if (!app_ensure_display(app))
+        return false;
+    if (!app_ensure_decoder(app))
+        return false;
+
+    ladder = ffva_ladder_new(app->display, outputs, num_outputs);
+    if (!ladder)
+        goto error_create_ladder;
+
+    if (!app_open_decoder(app))
+        goto cleanup;
+    if (app->parallel_decoder)
+        ret = ffva_parallel_decoder_start(app->parallel_decoder);
+    else
+        ret = ffva_decoder_start(app->decoder);
+    if (ret < 0)
+        goto cleanup;
+
+    for (;;) {
+        ret = app_get_frame(app, &dec_frame);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            goto error_decode_frame;
+
+        ret = ffva_ladder_process(ladder, dec_frame->surface,
+            dec_frame->has_crop_rect ? &dec_frame->crop_rect : NULL,
+            out_surfaces);
+        app_put_frame(app, dec_frame);
+        if (ret < 0)
+            goto error_process_frame;
+        for (i = 0; i < num_outputs; i++)
+            ffva_ladder_release_surface(ladder, out_surfaces[i]);
+    }
+
+    if (options->print_stats) {
+        ffva_parallel_decoder_report(app->parallel_decoder);
+        ffva_ladder_report(ladder);
+    }
+    ffva_decoder_stop(app->decoder);
+    ffva_decoder_close(app->decoder);
+    success = true;
+
+cleanup:
+    ffva_ladder_freep(&ladder);
+    return success;
+
+    /* ERRORS */
+error_create_ladder:
+    av_log(app, AV_LOG_ERROR, "failed to create scaling ladder\n");
+    return false;
+error_decode_frame:
+    av_log(app, AV_LOG_ERROR, "failed to decode frame: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_process_frame:
+    av_log(app, AV_LOG_ERROR, "failed to scale frame: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+}
+
 static bool
 app_list_info(App *app)
 {
@@ -511,10 +2052,27 @@ app_run(App *app)
     if (app_list_info(app))
         return true;
 
+    if (options->probe || options->probe_list)
+        return app_probe(app);
+
     if (!options->filename)
         goto error_no_filename;
 
-    need_filter = options->pix_fmt != AV_PIX_FMT_NONE;
+    if (options->extract_packets)
+        return ffva_packet_file_extract(options->extract_packets,
+            options->filename) == 0;
+
+    if (options->thumbnails)
+        return app_thumbnail(app);
+
+    if (options->download)
+        return app_download(app);
+
+    if (options->ladder)
+        return app_ladder(app);
+
+    need_filter = options->pix_fmt != AV_PIX_FMT_NONE ||
+        app_has_filter_ops(app);
 
     if (!app_ensure_display(app))
         return false;
@@ -524,24 +2082,60 @@ app_run(App *app)
         return false;
     if (!app_ensure_decoder(app))
         return false;
-    if (!app_ensure_renderer(app))
+    if (!app_open_decoder(app))
         return false;
-
-    if (ffva_decoder_open(app->decoder, options->filename) < 0)
+    if (!app_negotiate_formats(app))
         return false;
-    if (ffva_decoder_start(app->decoder) < 0)
+    if (!app_ensure_scale_policy(app))
         return false;
-
-    if (!ffva_decoder_get_info(app->decoder, &info))
+    if (!app_ensure_deinterlace_references(app))
+        return false;
+    if (!app_ensure_scheduler(app))
         return false;
 
+    if (app->parallel_decoder) {
+        if (ffva_parallel_decoder_start(app->parallel_decoder) < 0)
+            return false;
+    }
+    else {
+        if (ffva_decoder_start(app->decoder) < 0)
+            return false;
+        if (!ffva_decoder_get_info(app->decoder, &info))
+            return false;
+    }
+
+#if AV_FEATURE_AVFRAME_REF
+    if (options->low_latency)
+        ret = app_run_mailbox(app);
+    else
+#endif
     do {
         ret = app_decode_frame(app);
     } while (ret == 0 || ret == AVERROR(EAGAIN));
     if (ret != AVERROR_EOF)
         goto error_decode_frame;
+    ret = app_flush_deint_frames(app);
+    app_release_repeat_frame(app);
+    if (ret < 0)
+        goto error_decode_frame;
+#if USE_EGL
+    if (app->renderer &&
+        ffva_renderer_get_type(app->renderer) == FFVA_RENDERER_TYPE_EGL) {
+        ffva_renderer_egl_flush(app->renderer);
+        if (options->print_stats)
+            ffva_renderer_egl_report(app->renderer);
+    }
+#endif
+    if (options->print_stats) {
+        ffva_scheduler_report(app->scheduler);
+        ffva_parallel_decoder_report(app->parallel_decoder);
+#if AV_FEATURE_AVFRAME_REF
+        app_report_latency(app);
+#endif
+    }
     ffva_decoder_stop(app->decoder);
     ffva_decoder_close(app->decoder);
+    app_flush_filter_surfaces(app);
     return true;
 
     /* ERRORS */
@@ -554,6 +2148,23 @@ error_decode_frame:
     return false;
 }
 
+// Sets a pair of integer options from a WxH string, where H may be omitted
+static int
+app_set_size_options(App *app, const char *str, const char *width_name,
+    const char *height_name)
+{
+    unsigned int width, height = 0;
+    int ret;
+
+    if (sscanf(str, "%ux%u", &width, &height) < 1)
+        return AVERROR(EINVAL);
+
+    ret = av_opt_set_int(app, width_name, width, 0);
+    if (ret == 0)
+        ret = av_opt_set_int(app, height_name, height, 0);
+    return ret;
+}
+
 static bool
 app_parse_options(App *app, int argc, char *argv[])
 {
@@ -562,6 +2173,38 @@ app_parse_options(App *app, int argc, char *argv[])
 
     enum {
         OPT_LIST_FORMATS = 1000,
+        OPT_DENOISE,
+        OPT_SHARPEN,
+        OPT_HUE,
+        OPT_SATURATION,
+        OPT_BRIGHTNESS,
+        OPT_CONTRAST,
+        OPT_DEINTERLACE,
+        OPT_DEINTERLACE_RATE,
+        OPT_SWAP_INTERVAL,
+        OPT_DAMAGE,
+        OPT_MAX_QUEUED_FRAMES,
+        OPT_STATS,
+        OPT_NO_SYNC,
+        OPT_LOW_LATENCY,
+        OPT_PUSH,
+        OPT_EXTRACT_PACKETS,
+        OPT_PACKET_FILE,
+        OPT_LOOP,
+        OPT_PARALLEL,
+        OPT_PROBE,
+        OPT_PROBE_LIST,
+        OPT_PROBE_CACHE,
+        OPT_PROBE_THREADS,
+        OPT_PROBE_IO,
+        OPT_THUMBNAILS,
+        OPT_THUMBNAIL_SIZE,
+        OPT_THUMBNAIL_INTERVAL,
+        OPT_THUMBNAIL_GRID,
+        OPT_DOWNLOAD,
+        OPT_DOWNLOAD_THREADS,
+        OPT_DOWNLOAD_COPY_THREADS,
+        OPT_LADDER,
     };
 
     static const struct option long_options[] = {
@@ -569,14 +2212,48 @@ app_parse_options(App *app, int argc, char *argv[])
         { "window-width",   required_argument,  NULL, 'x'                   },
         { "window-height",  required_argument,  NULL, 'y'                   },
         { "renderer",       required_argument,  NULL, 'r'                   },
+        { "output",         required_argument,  NULL, 'o'                   },
         { "mem-type",       required_argument,  NULL, 'm'                   },
         { "format",         required_argument,  NULL, 'f'                   },
         { "list-formats",   no_argument,        NULL, OPT_LIST_FORMATS      },
+        { "denoise",        required_argument,  NULL, OPT_DENOISE           },
+        { "sharpen",        required_argument,  NULL, OPT_SHARPEN           },
+        { "hue",            required_argument,  NULL, OPT_HUE               },
+        { "saturation",     required_argument,  NULL, OPT_SATURATION        },
+        { "brightness",     required_argument,  NULL, OPT_BRIGHTNESS        },
+        { "contrast",       required_argument,  NULL, OPT_CONTRAST          },
+        { "deinterlace",    required_argument,  NULL, OPT_DEINTERLACE       },
+        { "deinterlace-rate", required_argument, NULL, OPT_DEINTERLACE_RATE },
+        { "swap-interval",  required_argument,  NULL, OPT_SWAP_INTERVAL     },
+        { "damage",         no_argument,        NULL, OPT_DAMAGE            },
+        { "max-queued-frames", required_argument, NULL, OPT_MAX_QUEUED_FRAMES },
+        { "stats",          no_argument,        NULL, OPT_STATS             },
+        { "no-sync",        no_argument,        NULL, OPT_NO_SYNC           },
+        { "low-latency",    no_argument,        NULL, OPT_LOW_LATENCY       },
+        { "push",           no_argument,        NULL, OPT_PUSH              },
+        { "extract-packets", required_argument, NULL, OPT_EXTRACT_PACKETS   },
+        { "packet-file",    no_argument,        NULL, OPT_PACKET_FILE       },
+        { "loop",           required_argument,  NULL, OPT_LOOP              },
+        { "parallel",       required_argument,  NULL, OPT_PARALLEL          },
+        { "probe",          no_argument,        NULL, OPT_PROBE             },
+        { "probe-list",     required_argument,  NULL, OPT_PROBE_LIST        },
+        { "probe-cache",    required_argument,  NULL, OPT_PROBE_CACHE       },
+        { "probe-threads",  required_argument,  NULL, OPT_PROBE_THREADS     },
+        { "probe-io",       required_argument,  NULL, OPT_PROBE_IO          },
+        { "thumbnails",     required_argument,  NULL, OPT_THUMBNAILS        },
+        { "thumbnail-size", required_argument,  NULL, OPT_THUMBNAIL_SIZE    },
+        { "thumbnail-interval", required_argument, NULL, OPT_THUMBNAIL_INTERVAL },
+        { "thumbnail-grid", required_argument,  NULL, OPT_THUMBNAIL_GRID    },
+        { "download",       no_argument,        NULL, OPT_DOWNLOAD          },
+        { "download-threads", required_argument, NULL, OPT_DOWNLOAD_THREADS },
+        { "download-copy-threads", required_argument, NULL,
+          OPT_DOWNLOAD_COPY_THREADS },
+        { "ladder",         required_argument,  NULL, OPT_LADDER            },
         { NULL, }
     };
 
     for (;;) {
-        v = getopt_long(argc, argv, "-hx:y:r:m:f:", long_options, &o);
+        v = getopt_long(argc, argv, "-hx:y:r:o:m:f:", long_options, &o);
         if (v < 0)
             break;
 
@@ -595,6 +2272,9 @@ app_parse_options(App *app, int argc, char *argv[])
         case 'r':
             ret = av_opt_set(app, "renderer", optarg, 0);
             break;
+        case 'o':
+            ret = av_opt_set(app, "output", optarg, 0);
+            break;
         case 'm':
             ret = av_opt_set(app, "mem_type", optarg, 0);
             break;
@@ -604,6 +2284,104 @@ app_parse_options(App *app, int argc, char *argv[])
         case OPT_LIST_FORMATS:
             ret = av_opt_set_int(app, "list_pix_fmts", 1, 0);
             break;
+        case OPT_DENOISE:
+            ret = av_opt_set(app, "denoise", optarg, 0);
+            break;
+        case OPT_SHARPEN:
+            ret = av_opt_set(app, "sharpen", optarg, 0);
+            break;
+        case OPT_HUE:
+            ret = av_opt_set(app, "hue", optarg, 0);
+            break;
+        case OPT_SATURATION:
+            ret = av_opt_set(app, "saturation", optarg, 0);
+            break;
+        case OPT_BRIGHTNESS:
+            ret = av_opt_set(app, "brightness", optarg, 0);
+            break;
+        case OPT_CONTRAST:
+            ret = av_opt_set(app, "contrast", optarg, 0);
+            break;
+        case OPT_DEINTERLACE:
+            ret = av_opt_set(app, "deinterlace", optarg, 0);
+            break;
+        case OPT_DEINTERLACE_RATE:
+            ret = av_opt_set(app, "deinterlace_rate", optarg, 0);
+            break;
+        case OPT_SWAP_INTERVAL:
+            ret = av_opt_set(app, "swap_interval", optarg, 0);
+            break;
+        case OPT_DAMAGE:
+            ret = av_opt_set_int(app, "damage", 1, 0);
+            break;
+        case OPT_MAX_QUEUED_FRAMES:
+            ret = av_opt_set(app, "max_queued_frames", optarg, 0);
+            break;
+        case OPT_STATS:
+            ret = av_opt_set_int(app, "print_stats", 1, 0);
+            break;
+        case OPT_NO_SYNC:
+            ret = av_opt_set_int(app, "sync", 0, 0);
+            break;
+        case OPT_LOW_LATENCY:
+            ret = av_opt_set_int(app, "low_latency", 1, 0);
+            break;
+        case OPT_PUSH:
+            ret = av_opt_set_int(app, "push", 1, 0);
+            break;
+        case OPT_EXTRACT_PACKETS:
+            ret = av_opt_set(app, "extract_packets", optarg, 0);
+            break;
+        case OPT_PACKET_FILE:
+            ret = av_opt_set_int(app, "packet_file", 1, 0);
+            break;
+        case OPT_LOOP:
+            ret = av_opt_set(app, "loop", optarg, 0);
+            break;
+        case OPT_PARALLEL:
+            ret = av_opt_set(app, "parallel", optarg, 0);
+            break;
+        case OPT_PROBE:
+            ret = av_opt_set_int(app, "probe", 1, 0);
+            break;
+        case OPT_PROBE_LIST:
+            ret = av_opt_set(app, "probe_list", optarg, 0);
+            break;
+        case OPT_PROBE_CACHE:
+            ret = av_opt_set(app, "probe_cache", optarg, 0);
+            break;
+        case OPT_PROBE_THREADS:
+            ret = av_opt_set(app, "probe_threads", optarg, 0);
+            break;
+        case OPT_PROBE_IO:
+            ret = av_opt_set(app, "probe_io", optarg, 0);
+            break;
+        case OPT_THUMBNAILS:
+            ret = av_opt_set(app, "thumbnails", optarg, 0);
+            break;
+        case OPT_THUMBNAIL_SIZE:
+            ret = app_set_size_options(app, optarg, "thumbnail_width",
+                "thumbnail_height");
+            break;
+        case OPT_THUMBNAIL_INTERVAL:
+            ret = av_opt_set(app, "thumbnail_interval", optarg, 0);
+            break;
+        case OPT_THUMBNAIL_GRID:
+            ret = app_set_size_options(app, optarg, "thumbnail_columns",
+                "thumbnail_rows");
+            break;
+        case OPT_DOWNLOAD:
+            ret = av_opt_set_int(app, "download", 1, 0);
+            break;
+        case OPT_DOWNLOAD_THREADS:
+            ret = av_opt_set(app, "download_threads", optarg, 0);
+            break;
+        case OPT_DOWNLOAD_COPY_THREADS:
+            ret = av_opt_set(app, "download_copy_threads", optarg, 0);
+            break;
+        case OPT_LADDER:
+            ret = av_opt_set(app, "ladder", optarg, 0);
+            break;
         case '\1':
             ret = av_opt_set(app, "filename", optarg, 0);
             break;
@@ -647,5 +2425,7 @@ main(int argc, char *argv[])
 
 cleanup:
     app_free(app);
+    // Failed runs are when VA-API traces matter most, so always report
+    va_trace_report();
     return ret;
 }
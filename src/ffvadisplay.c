@@ -23,6 +23,7 @@
 #include "sysdeps.h"
 #include "ffvadisplay.h"
 #include "ffvadisplay_priv.h"
+#include "ffvafilterservice.h"
 #include "vaapi_utils.h"
 
 typedef bool (*FFVADisplayOpenFunc)(FFVADisplay *display);
@@ -226,6 +227,7 @@ display_finalize(FFVADisplay *display)
 {
     const FFVADisplayClass * const klass = display->klass;
 
+    ffva_filter_service_freep(&display->filter_service);
     if (display->va_display)
         vaTerminate(display->va_display);
     if (klass->close)
@@ -30,6 +30,8 @@ struct ffva_display_s {
     void *native_display;
     VADisplay va_display;
     char *display_name;
+    struct ffva_filter_service_s *filter_service;
+    bool filter_service_failed;
 };
 
 #endif /* FFVA_DISPLAY_PRIV_H */
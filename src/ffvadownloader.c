@@ -0,0 +1,703 @@
+/*
+ * ffvadownloader.c - Asynchronous surface downloader
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <libavutil/buffer.h>
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include "ffvadownloader.h"
+#include "ffvacopier.h"
+#include "ffvadisplay.h"
+#include "ffmpeg_compat.h"
+#include "ffmpeg_utils.h"
+#include "vaapi_utils.h"
+#include "time_utils.h"
+
+// Default number of download threads
+#define DEFAULT_NUM_THREADS 2
+
+// Number of frames each thread could have queued for download
+#define FRAMES_PER_THREAD 2
+
+// Default number of threads the copier of each download thread uses. The
+// download threads already copy several frames in parallel
+#define DEFAULT_NUM_COPY_THREADS 1
+
+// Alignment of the downloaded frame lines, in bytes
+#define LINE_ALIGN 32
+
+enum {
+    JOB_STATE_FREE = 0,
+    JOB_STATE_QUEUED,
+    JOB_STATE_RUNNING,
+    JOB_STATE_DONE,
+};
+
+typedef struct {
+    uint32_t state;
+    AVFrame *src_frame;         /* reference to the decoded frame */
+    FFVASurface *surface;
+    VARectangle crop_rect;
+    int64_t pts;
+    AVFrame *dst_frame;
+    uint64_t num_bytes;         /* copied from the surface */
+    int ret;
+} Job;
+
+typedef struct {
+    FFVADownloader *dl;
+    pthread_t thread;
+    bool has_thread;
+    VAImage va_image;
+    FFVACopier *copier;
+    AVBufferPool *pools[4];
+    int pool_sizes[4];
+    uint64_t busy_time;
+    uint64_t num_bytes;
+} Worker;
+
+struct ffva_downloader_s {
+    const void *klass;
+    VADisplay va_display;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;    /* a job was queued, or stop requested */
+    pthread_cond_t done_cond;   /* a job is done */
+    Worker *workers;
+    uint32_t num_workers;
+    enum AVPixelFormat pix_fmt;     /* requested output format, if any */
+    uint32_t num_copy_threads;
+    Job *jobs;
+    uint32_t num_jobs;
+    uint32_t submit_index;      /* next job to be queued */
+    uint32_t run_index;         /* next job to be run by a worker */
+    uint32_t receive_index;     /* next job to be received */
+    bool is_stopped;
+    uint32_t num_frames;
+    uint32_t num_software_frames;
+    uint64_t wait_time;
+};
+
+static const AVClass *
+ffva_downloader_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVADownloader",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+static void
+job_reset(Job *job)
+{
+#if AV_FEATURE_AVFRAME_REF
+    av_frame_free(&job->src_frame);
+    av_frame_free(&job->dst_frame);
+#endif
+    job->surface = NULL;
+    job->num_bytes = 0;
+    job->state = JOB_STATE_FREE;
+    job->ret = 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Download threads                                                 --- */
+/* ------------------------------------------------------------------------ */
+
+#if AV_FEATURE_AVFRAME_REF
+// Allocates the frame buffers from the worker pools, which are reallocated
+// whenever the frame format or size changes
+static int
+worker_alloc_frame(Worker *w, AVFrame *frame, enum AVPixelFormat pix_fmt,
+    int width, int height)
+{
+    const AVPixFmtDescriptor * const desc = av_pix_fmt_desc_get(pix_fmt);
+    int i, h, size, ret;
+
+    if (!desc)
+        return AVERROR(EINVAL);
+
+    ret = av_image_fill_linesizes(frame->linesize, pix_fmt,
+        FFALIGN(width, LINE_ALIGN));
+    if (ret < 0)
+        return ret;
+
+    for (i = 0; i < 4 && frame->linesize[i] > 0; i++) {
+        h = i > 0 ? -((-height) >> desc->log2_chroma_h) : height;
+        size = frame->linesize[i] * h;
+        if (w->pools[i] && w->pool_sizes[i] != size)
+            av_buffer_pool_uninit(&w->pools[i]);
+        if (!w->pools[i]) {
+            w->pools[i] = av_buffer_pool_init(size, av_buffer_alloc);
+            if (!w->pools[i])
+                return AVERROR(ENOMEM);
+            w->pool_sizes[i] = size;
+        }
+        frame->buf[i] = av_buffer_pool_get(w->pools[i]);
+        if (!frame->buf[i])
+            return AVERROR(ENOMEM);
+        frame->data[i] = frame->buf[i]->data;
+    }
+    frame->format = pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    return 0;
+}
+
+// Ensures the worker VA image matches the supplied surface
+static int
+worker_ensure_image(Worker *w, FFVASurface *surface, uint32_t fourcc)
+{
+    VADisplay const va_display = w->dl->va_display;
+    VAImageFormat va_format;
+    VAStatus va_status;
+
+    if (w->va_image.image_id != VA_INVALID_ID) {
+        if (w->va_image.format.fourcc == fourcc &&
+            w->va_image.width == surface->width &&
+            w->va_image.height == surface->height)
+            return 0;
+        vaDestroyImage(va_display, w->va_image.image_id);
+        va_image_init_defaults(&w->va_image);
+    }
+
+    memset(&va_format, 0, sizeof(va_format));
+    va_format.fourcc = fourcc;
+    va_format.byte_order = VA_LSB_FIRST;
+    va_status = vaCreateImage(va_display, &va_format, surface->width,
+        surface->height, &w->va_image);
+    if (!va_check_status(va_status, "vaCreateImage()")) {
+        va_image_init_defaults(&w->va_image);
+        return vaapi_to_ffmpeg_error(va_status);
+    }
+    return 0;
+}
+
+// Copies the visible region of the job surface into a new frame. The
+// surface is read into the worker image, or directly if that fails, and
+// converted to the requested output format if the copier supports it.
+// The region is aligned down to the chroma subsampling, and widened by as
+// much, so that all planes start at the same position
+static int
+worker_download_surface(Worker *w, Job *job)
+{
+    VADisplay const va_display = w->dl->va_display;
+    FFVASurface * const surface = job->surface;
+    const uint32_t fourcc = surface->fourcc ? surface->fourcc :
+        VA_FOURCC('N','V','1','2');
+    const AVPixFmtDescriptor *desc;
+    enum AVPixelFormat pix_fmt, dst_pix_fmt;
+    uint32_t dst_fourcc, x_mask, y_mask;
+    VARectangle crop_rect;
+    FFVAScalerImage src_image, dst_image;
+    VAImage derived_image, *va_image;
+    VAStatus va_status;
+    AVFrame *frame;
+    uint8_t *pixels;
+    int i, x_offsets[4], widths[4], heights[4], y, ret;
+
+    if (!vaapi_to_ffmpeg_pix_fmt(fourcc, &pix_fmt) ||
+        !(desc = av_pix_fmt_desc_get(pix_fmt)))
+        return AVERROR(ENOTSUP);
+
+    crop_rect = job->crop_rect;
+    x_mask = (1U << desc->log2_chroma_w) - 1;
+    y_mask = (1U << desc->log2_chroma_h) - 1;
+    crop_rect.width += crop_rect.x & x_mask;
+    crop_rect.x &= ~x_mask;
+    crop_rect.height += crop_rect.y & y_mask;
+    crop_rect.y &= ~y_mask;
+
+    if (!w->copier) {
+        w->copier = ffva_copier_new(w->dl->num_copy_threads);
+        if (!w->copier)
+            return AVERROR(ENOMEM);
+    }
+
+    dst_pix_fmt = pix_fmt;
+    if (w->dl->pix_fmt != AV_PIX_FMT_NONE &&
+        ffmpeg_to_vaapi_pix_fmt(w->dl->pix_fmt, &dst_fourcc, NULL) &&
+        ffva_copier_has_conversion(fourcc, dst_fourcc))
+        dst_pix_fmt = w->dl->pix_fmt;
+    else
+        dst_fourcc = fourcc;
+
+    va_status = vaSyncSurface(va_display, surface->id);
+    if (!va_check_status(va_status, "vaSyncSurface()"))
+        return vaapi_to_ffmpeg_error(va_status);
+
+    va_image_init_defaults(&derived_image);
+    va_image = &w->va_image;
+    ret = worker_ensure_image(w, surface, fourcc);
+    if (ret == 0) {
+        va_status = vaGetImage(va_display, surface->id, 0, 0,
+            surface->width, surface->height, va_image->image_id);
+        if (va_status != VA_STATUS_SUCCESS)
+            ret = vaapi_to_ffmpeg_error(va_status);
+    }
+    if (ret < 0) {
+        va_status = vaDeriveImage(va_display, surface->id, &derived_image);
+        if (!va_check_status(va_status, "vaDeriveImage()"))
+            return vaapi_to_ffmpeg_error(va_status);
+        if (derived_image.format.fourcc != fourcc)
+            goto error_unsupported_format;
+        va_image = &derived_image;
+    }
+
+    frame = av_frame_alloc();
+    if (!frame)
+        goto error_alloc_frame;
+    job->dst_frame = frame;
+    ret = worker_alloc_frame(w, frame, dst_pix_fmt, crop_rect.width,
+        crop_rect.height);
+    if (ret < 0)
+        goto cleanup;
+
+    pixels = va_map_buffer(va_display, va_image->buf);
+    if (!pixels) {
+        ret = AVERROR(EIO);
+        goto cleanup;
+    }
+
+    // Byte offsets of the crop rectangle, and visible widths, per plane
+    memset(x_offsets, 0, sizeof(x_offsets));
+    if (crop_rect.x > 0)
+        av_image_fill_linesizes(x_offsets, pix_fmt, crop_rect.x);
+    av_image_fill_linesizes(widths, pix_fmt, crop_rect.width);
+    memset(&src_image, 0, sizeof(src_image));
+    src_image.fourcc = fourcc;
+    src_image.width = crop_rect.width;
+    src_image.height = crop_rect.height;
+    for (i = 0; i < va_image->num_planes && i < 3; i++) {
+        y = crop_rect.y;
+        heights[i] = crop_rect.height;
+        if (i > 0) {
+            y >>= desc->log2_chroma_h;
+            heights[i] = -((-heights[i]) >> desc->log2_chroma_h);
+        }
+        src_image.pixels[i] = pixels + va_image->offsets[i] +
+            y * va_image->pitches[i] + x_offsets[i];
+        src_image.pitches[i] = va_image->pitches[i];
+        job->num_bytes += (uint64_t)widths[i] * heights[i];
+    }
+
+    // Surfaces are mostly uncached memory, that the copier reads with
+    // streaming loads
+    if (ffva_copier_has_conversion(fourcc, dst_fourcc)) {
+        memset(&dst_image, 0, sizeof(dst_image));
+        dst_image.fourcc = dst_fourcc;
+        dst_image.width = crop_rect.width;
+        dst_image.height = crop_rect.height;
+        for (i = 0; i < 3 && frame->data[i]; i++) {
+            dst_image.pixels[i] = frame->data[i];
+            dst_image.pitches[i] = frame->linesize[i];
+        }
+        ret = ffva_copier_copy(w->copier, &src_image, &dst_image);
+    }
+    else {
+        for (i = 0; i < va_image->num_planes && i < 3; i++)
+            av_image_copy_plane(frame->data[i], frame->linesize[i],
+                src_image.pixels[i], src_image.pitches[i], widths[i],
+                heights[i]);
+        ret = 0;
+    }
+    va_unmap_buffer(va_display, va_image->buf, NULL);
+
+cleanup:
+    if (derived_image.image_id != VA_INVALID_ID)
+        vaDestroyImage(va_display, derived_image.image_id);
+    return ret;
+
+    /* ERRORS */
+error_unsupported_format:
+    av_log(w->dl, AV_LOG_ERROR, "unsupported surface format %.4s\n",
+        (const char *)&derived_image.format.fourcc);
+    vaDestroyImage(va_display, derived_image.image_id);
+    return AVERROR(ENOTSUP);
+error_alloc_frame:
+    ret = AVERROR(ENOMEM);
+    goto cleanup;
+}
+
+// Delivers a software decoded frame, which is already in system memory
+static int
+worker_reference_frame(Worker *w, Job *job)
+{
+    job->dst_frame = av_frame_clone(job->src_frame);
+    if (!job->dst_frame)
+        return AVERROR(ENOMEM);
+    return 0;
+}
+
+static void *
+worker_thread(void *arg)
+{
+    Worker * const w = arg;
+    FFVADownloader * const dl = w->dl;
+    uint64_t start_time, busy_time;
+    Job *job;
+    int ret;
+
+    pthread_mutex_lock(&dl->lock);
+    for (;;) {
+        while (!dl->is_stopped && dl->run_index == dl->submit_index)
+            pthread_cond_wait(&dl->job_cond, &dl->lock);
+        if (dl->is_stopped)
+            break;
+        job = &dl->jobs[dl->run_index++ % dl->num_jobs];
+        job->state = JOB_STATE_RUNNING;
+        pthread_mutex_unlock(&dl->lock);
+
+        start_time = get_time_us();
+        ret = job->surface ? worker_download_surface(w, job) :
+            worker_reference_frame(w, job);
+        if (ret == 0) {
+            job->dst_frame->pts = job->pts;
+            job->dst_frame->key_frame = job->src_frame->key_frame;
+        }
+        busy_time = get_time_us() - start_time;
+
+        pthread_mutex_lock(&dl->lock);
+        w->busy_time += busy_time;
+        w->num_bytes += job->num_bytes;
+        av_frame_free(&job->src_frame);
+        job->ret = ret;
+        job->state = JOB_STATE_DONE;
+        pthread_cond_broadcast(&dl->done_cond);
+    }
+    pthread_mutex_unlock(&dl->lock);
+    return NULL;
+}
+#endif
+
+static void
+stop_workers(FFVADownloader *dl)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&dl->lock);
+    dl->is_stopped = true;
+    pthread_cond_broadcast(&dl->job_cond);
+    pthread_mutex_unlock(&dl->lock);
+
+    for (i = 0; i < dl->num_workers; i++) {
+        Worker * const w = &dl->workers[i];
+        if (w->has_thread)
+            pthread_join(w->thread, NULL);
+        w->has_thread = false;
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Interface                                                        --- */
+/* ------------------------------------------------------------------------ */
+
+static int
+downloader_init(FFVADownloader *dl, FFVADisplay *display,
+    uint32_t num_threads)
+{
+    uint32_t i;
+
+    dl->klass = ffva_downloader_class();
+    dl->va_display = display ? ffva_display_get_va_display(display) : NULL;
+    dl->pix_fmt = AV_PIX_FMT_NONE;
+    dl->num_copy_threads = DEFAULT_NUM_COPY_THREADS;
+    pthread_mutex_init(&dl->lock, NULL);
+    pthread_cond_init(&dl->job_cond, NULL);
+    pthread_cond_init(&dl->done_cond, NULL);
+
+#if !AV_FEATURE_AVFRAME_REF
+    goto error_unsupported;
+#endif
+
+    dl->num_workers = num_threads > 0 ? num_threads : DEFAULT_NUM_THREADS;
+    dl->workers = calloc(dl->num_workers, sizeof(*dl->workers));
+    if (!dl->workers)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < dl->num_workers; i++) {
+        Worker * const w = &dl->workers[i];
+        w->dl = dl;
+        va_image_init_defaults(&w->va_image);
+    }
+
+    dl->num_jobs = dl->num_workers * FRAMES_PER_THREAD;
+    dl->jobs = calloc(dl->num_jobs, sizeof(*dl->jobs));
+    if (!dl->jobs)
+        return AVERROR(ENOMEM);
+
+#if AV_FEATURE_AVFRAME_REF
+    for (i = 0; i < dl->num_workers; i++) {
+        Worker * const w = &dl->workers[i];
+        if (pthread_create(&w->thread, NULL, worker_thread, w) != 0)
+            goto error_create_thread;
+        w->has_thread = true;
+    }
+#endif
+    return 0;
+
+    /* ERRORS */
+#if AV_FEATURE_AVFRAME_REF
+error_create_thread:
+    av_log(dl, AV_LOG_ERROR, "failed to create download thread\n");
+    return AVERROR(EAGAIN);
+#else
+error_unsupported:
+    av_log(dl, AV_LOG_ERROR, "reference counted frames are required\n");
+    return AVERROR(ENOSYS);
+#endif
+}
+
+static void
+downloader_finalize(FFVADownloader *dl)
+{
+    uint32_t i, j;
+
+    stop_workers(dl);
+
+    for (i = 0; i < dl->num_jobs; i++)
+        job_reset(&dl->jobs[i]);
+    free(dl->jobs);
+
+    for (i = 0; i < dl->num_workers; i++) {
+        Worker * const w = &dl->workers[i];
+        if (w->va_image.image_id != VA_INVALID_ID)
+            vaDestroyImage(dl->va_display, w->va_image.image_id);
+        ffva_copier_freep(&w->copier);
+#if AV_FEATURE_AVFRAME_REF
+        for (j = 0; j < FF_ARRAY_ELEMS(w->pools); j++)
+            av_buffer_pool_uninit(&w->pools[j]);
+#endif
+    }
+    free(dl->workers);
+
+    pthread_cond_destroy(&dl->done_cond);
+    pthread_cond_destroy(&dl->job_cond);
+    pthread_mutex_destroy(&dl->lock);
+}
+
+// Creates a new downloader for surfaces from the supplied display, if any
+FFVADownloader *
+ffva_downloader_new(FFVADisplay *display, uint32_t num_threads)
+{
+    FFVADownloader *dl;
+
+    dl = calloc(1, sizeof(*dl));
+    if (!dl)
+        return NULL;
+    if (downloader_init(dl, display, num_threads) != 0)
+        goto error;
+    return dl;
+
+error:
+    ffva_downloader_free(dl);
+    return NULL;
+}
+
+// Destroys the supplied downloader, discarding any pending frame
+void
+ffva_downloader_free(FFVADownloader *dl)
+{
+    if (!dl)
+        return;
+    downloader_finalize(dl);
+    free(dl);
+}
+
+// Releases downloader and resets the supplied pointer to NULL
+void
+ffva_downloader_freep(FFVADownloader **dl_ptr)
+{
+    if (!dl_ptr)
+        return;
+    ffva_downloader_free(*dl_ptr);
+    *dl_ptr = NULL;
+}
+
+// Sets the number of threads the copier of each download thread uses
+int
+ffva_downloader_set_copy_threads(FFVADownloader *dl, uint32_t num_threads)
+{
+    if (!dl)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&dl->lock);
+    dl->num_copy_threads = num_threads;
+    pthread_mutex_unlock(&dl->lock);
+    return 0;
+}
+
+// Returns the number of frames that could be queued for download
+uint32_t
+ffva_downloader_get_num_queued_frames(FFVADownloader *dl)
+{
+    return dl ? dl->num_jobs : 0;
+}
+
+// Selects the pixel format of downloaded frames
+int
+ffva_downloader_set_format(FFVADownloader *dl, enum AVPixelFormat pix_fmt)
+{
+    if (!dl)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&dl->lock);
+    dl->pix_fmt = pix_fmt;
+    pthread_mutex_unlock(&dl->lock);
+    return 0;
+}
+
+// Queues the supplied decoded frame for download
+int
+ffva_downloader_submit(FFVADownloader *dl, const FFVADecoderFrame *frame)
+{
+#if AV_FEATURE_AVFRAME_REF
+    AVFrame *src_frame;
+    Job *job;
+
+    if (!dl || !frame || !frame->frame)
+        return AVERROR(EINVAL);
+    if (frame->surface && !dl->va_display)
+        goto error_no_display;
+
+    pthread_mutex_lock(&dl->lock);
+    if (dl->submit_index - dl->receive_index == dl->num_jobs)
+        goto error_queue_full;
+
+    // Keep the decoded surface alive until it is downloaded
+    src_frame = av_frame_clone(frame->frame);
+    if (!src_frame)
+        goto error_clone_frame;
+
+    job = &dl->jobs[dl->submit_index % dl->num_jobs];
+    job->src_frame = src_frame;
+    job->surface = frame->surface;
+    job->crop_rect = frame->crop_rect;
+    job->pts = frame->pts;
+    job->state = JOB_STATE_QUEUED;
+    dl->submit_index++;
+    pthread_cond_signal(&dl->job_cond);
+    pthread_mutex_unlock(&dl->lock);
+    return 0;
+
+    /* ERRORS */
+error_no_display:
+    av_log(dl, AV_LOG_ERROR, "no VA display to download surfaces from\n");
+    return AVERROR(EINVAL);
+error_queue_full:
+    pthread_mutex_unlock(&dl->lock);
+    return AVERROR(EAGAIN);
+error_clone_frame:
+    pthread_mutex_unlock(&dl->lock);
+    return AVERROR(ENOMEM);
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+// Waits for the oldest submitted frame to be downloaded
+int
+ffva_downloader_receive(FFVADownloader *dl, AVFrame *frame)
+{
+#if AV_FEATURE_AVFRAME_REF
+    uint64_t start_time;
+    Job *job;
+    int ret;
+
+    if (!dl || !frame)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&dl->lock);
+    if (dl->receive_index == dl->submit_index) {
+        pthread_mutex_unlock(&dl->lock);
+        return AVERROR(EAGAIN);
+    }
+
+    job = &dl->jobs[dl->receive_index % dl->num_jobs];
+    if (job->state != JOB_STATE_DONE) {
+        start_time = get_time_us();
+        do {
+            pthread_cond_wait(&dl->done_cond, &dl->lock);
+        } while (job->state != JOB_STATE_DONE);
+        dl->wait_time += get_time_us() - start_time;
+    }
+
+    ret = job->ret;
+    if (ret == 0) {
+        av_frame_unref(frame);
+        av_frame_move_ref(frame, job->dst_frame);
+        dl->num_frames++;
+        if (!job->surface)
+            dl->num_software_frames++;
+    }
+    job_reset(job);
+    dl->receive_index++;
+    pthread_mutex_unlock(&dl->lock);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+// Returns the download statistics
+bool
+ffva_downloader_get_stats(FFVADownloader *dl, FFVADownloaderStats *stats)
+{
+    uint32_t i;
+
+    if (!dl || !stats)
+        return false;
+
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&dl->lock);
+    stats->num_threads = dl->num_workers;
+    stats->num_frames = dl->num_frames;
+    stats->num_software_frames = dl->num_software_frames;
+    stats->wait_time = dl->wait_time;
+    for (i = 0; i < dl->num_workers; i++) {
+        stats->num_bytes += dl->workers[i].num_bytes;
+        stats->download_time += dl->workers[i].busy_time;
+    }
+    pthread_mutex_unlock(&dl->lock);
+    return true;
+}
+
+// Prints out the download statistics
+void
+ffva_downloader_report(FFVADownloader *dl)
+{
+    FFVADownloaderStats stats;
+
+    if (!ffva_downloader_get_stats(dl, &stats) || stats.num_frames == 0)
+        return;
+
+    av_log(dl, AV_LOG_INFO, "downloaded %u frames (%u software decoded) on "
+        "%u threads: %.1f MB, %.2f ms per frame, %.2f ms waited per frame\n",
+        stats.num_frames, stats.num_software_frames, stats.num_threads,
+        stats.num_bytes / 1048576.0,
+        stats.download_time / (1000.0 * stats.num_frames),
+        stats.wait_time / (1000.0 * stats.num_frames));
+}
@@ -0,0 +1,121 @@
+/*
+ * ffvadownloader.h - Asynchronous surface downloader
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_DOWNLOADER_H
+#define FFVA_DOWNLOADER_H
+
+#include "ffvadisplay.h"
+#include "ffvadecoder.h"
+
+/*
+ * The downloader copies decoded frames to system memory from a pool of
+ * threads, so that the copy of a frame overlaps with the decoding of the
+ * next ones. Each thread keeps its own VA image, reused as long as the
+ * surface format and size do not change, and its own pools of frame
+ * buffers. Frames are received in the order they were submitted, as
+ * reference counted AVFrames cropped to the visible region, whose left
+ * and top edges are aligned down to the chroma subsampling. Surface
+ * memory is read with the streaming-load kernels of FFVACopier. Software
+ * decoded frames go through the same queue, and are only referenced.
+ */
+
+typedef struct ffva_downloader_s        FFVADownloader;
+typedef struct ffva_downloader_stats_s  FFVADownloaderStats;
+
+/** Download statistics */
+struct ffva_downloader_stats_s {
+    uint32_t num_threads;
+    uint32_t num_frames;
+    uint32_t num_software_frames;
+    uint64_t num_bytes;         /* copied from VA surfaces */
+    uint64_t download_time;     /* spent in download threads, in us */
+    uint64_t wait_time;         /* spent waiting for frames, in us */
+};
+
+/**
+ * Creates a new downloader for surfaces from the supplied display, with
+ * the supplied number of threads, or zero for the default. The display
+ * could be NULL if all frames are decoded in software
+ */
+FFVADownloader *
+ffva_downloader_new(FFVADisplay *display, uint32_t num_threads);
+
+/** Destroys the supplied downloader, discarding any pending frame */
+void
+ffva_downloader_free(FFVADownloader *dl);
+
+/** Releases downloader and resets the supplied pointer to NULL */
+void
+ffva_downloader_freep(FFVADownloader **dl_ptr);
+
+/**
+ * Sets the number of threads the copier of each download thread uses to
+ * copy a frame, or zero for one per CPU. The default is one thread, since
+ * download threads already work on several frames. This has to be called
+ * before the first frame is submitted
+ */
+int
+ffva_downloader_set_copy_threads(FFVADownloader *dl, uint32_t num_threads);
+
+/**
+ * Returns the number of frames that could be queued for download. Queued
+ * frames keep their surfaces referenced, so the decoder has to allocate
+ * that many extra surfaces, see ffva_decoder_set_num_extra_surfaces()
+ */
+uint32_t
+ffva_downloader_get_num_queued_frames(FFVADownloader *dl);
+
+/**
+ * Selects the pixel format of downloaded frames, or AV_PIX_FMT_NONE to
+ * keep the surface format (default). NV12 surfaces could be converted to
+ * AV_PIX_FMT_YUV420P. Frames that could not be converted are delivered
+ * in their original format
+ */
+int
+ffva_downloader_set_format(FFVADownloader *dl, enum AVPixelFormat pix_fmt);
+
+/**
+ * Queues the supplied decoded frame for download. The frame is referenced,
+ * so that it could be released to the decoder right away. Returns
+ * AVERROR(EAGAIN) if the queue is full, i.e. a frame has to be received
+ * first
+ */
+int
+ffva_downloader_submit(FFVADownloader *dl, const FFVADecoderFrame *frame);
+
+/**
+ * Waits for the oldest submitted frame to be downloaded, and moves it into
+ * the supplied AVFrame, with pts in AV_TIME_BASE units. Returns
+ * AVERROR(EAGAIN) if no frame was submitted
+ */
+int
+ffva_downloader_receive(FFVADownloader *dl, AVFrame *frame);
+
+/** Returns the download statistics */
+bool
+ffva_downloader_get_stats(FFVADownloader *dl, FFVADownloaderStats *stats);
+
+/** Prints out the download statistics */
+void
+ffva_downloader_report(FFVADownloader *dl);
+
+#endif /* FFVA_DOWNLOADER_H */
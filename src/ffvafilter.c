@@ -23,6 +23,7 @@
 #include "sysdeps.h"
 #include "ffvafilter.h"
 #include "ffvadisplay_priv.h"
+#include "ffvascaler.h"
 #include "ffmpeg_utils.h"
 #include "vaapi_utils.h"
 
@@ -30,25 +31,118 @@
 # include <va/va_vpp.h>
 #endif
 
+/* Number of pipeline parameter buffers kept alive for reuse, enough for
+   two full compositions */
+#define FFVA_FILTER_PARAMS_BUFFERS (2 * FFVA_FILTER_MAX_LAYERS)
+
+/* Maximum number of filters in the VPP pipeline: deinterlacing, denoise,
+   sharpen and color balance */
+#define FFVA_FILTER_MAX_FILTERS 4
+
+/* Number of deinterlacing filter variants: field parity x field order */
+#define FFVA_FILTER_DEINTERLACE_VARIANTS 4
+
+/* Background color of the first layer, subsequent ones are transparent */
+#define FFVA_FILTER_BACKGROUND_COLOR 0xff000000
+
+typedef struct {
+    VAImage va_image;
+    FFVAScalerImage image;
+    bool is_derived;
+} FFVAFilterImage;
+
+#if USE_VA_VPP
+typedef struct {
+    VASurfaceID surface;
+    VARectangle src_rect;
+    VARectangle dst_rect;
+    uint32_t flags;
+    uint32_t background_color;
+    float alpha;
+} FFVAFilterParamsDesc;
+
+typedef struct {
+    VABufferID va_buffer;
+    VAProcPipelineParameterBuffer params;
+    FFVAFilterParamsDesc desc;
+    VABlendState blend_state;
+    uint32_t seqno;
+} FFVAFilterParamsBuffer;
+
+typedef struct {
+    uint32_t is_supported : 1;
+    uint32_t is_enabled : 1;
+    float value;
+    VAProcFilterValueRange range;
+} FFVAFilterOpState;
+#endif
+
 struct ffva_filter_s {
     const void *klass;
     FFVADisplay *display;
     VADisplay va_display;
     VAConfigID va_config;
     VAContextID va_context;
+    FFVAScaler *scaler;
     int pix_fmt;
     int *pix_fmts;
     VARectangle crop_rect;
     VARectangle target_rect;
     uint32_t use_crop_rect : 1;
     uint32_t use_target_rect : 1;
+#if USE_VA_VPP
+    FFVAFilterParamsBuffer params_buffers[FFVA_FILTER_PARAMS_BUFFERS];
+    uint32_t params_buffer_index;
+    uint32_t params_seqno;
+    VABufferID va_params_buffers[FFVA_FILTER_MAX_LAYERS];
+    uint32_t blend_flags;
+    uint32_t pipeline_caps_queried : 1;
+    FFVASurface compose_surface;
+    FFVAScaler *blit_scaler;
+    FFVAFilterOpState ops[FFVA_FILTER_OP_COUNT];
+    uint32_t deinterlace_methods;
+    FFVADeinterlaceMethod deinterlace_method;
+    VABufferID denoise_buffer;
+    VABufferID sharpen_buffer;
+    VABufferID color_balance_buffer;
+    VABufferID deinterlace_buffers[FFVA_FILTER_DEINTERLACE_VARIANTS];
+    VABufferID static_va_filters[FFVA_FILTER_MAX_FILTERS - 1];
+    uint32_t num_static_va_filters;
+    VABufferID va_filters[FFVA_FILTER_MAX_FILTERS];
+    uint32_t num_va_filters;
+    VASurfaceID forward_refs[FFVA_FILTER_MAX_REFERENCES];
+    uint32_t num_forward_refs;
+    VASurfaceID backward_refs[FFVA_FILTER_MAX_REFERENCES];
+    uint32_t num_backward_refs;
+    uint32_t num_va_forward_refs;
+    uint32_t num_va_backward_refs;
+    uint32_t deinterlace_num_forward_refs;
+    uint32_t deinterlace_num_backward_refs;
+    uint32_t deinterlace_caps_queried : 1;
+    uint32_t filter_caps_queried : 1;
+    uint32_t filter_buffers_changed : 1;
+#endif
 };
 
+static inline bool
+is_valid_op(FFVAFilterOp op)
+{
+    return op >= FFVA_FILTER_OP_DENOISE && op < FFVA_FILTER_OP_COUNT;
+}
+
+static inline bool
+is_valid_deinterlace_method(FFVADeinterlaceMethod method)
+{
+    return method >= FFVA_DEINTERLACE_METHOD_NONE &&
+        method <= FFVA_DEINTERLACE_METHOD_MOTION_COMPENSATED;
+}
+
 static bool
 has_vpp(FFVADisplay *display)
 {
     bool has_vpp = false;
 #if USE_VA_VPP
+    const char * const env = getenv("FFVA_VPP");
     VAEntrypoint *va_entrypoints = NULL;
     int i, va_num_entrypoints;
     VAStatus va_status;
@@ -56,6 +150,10 @@ has_vpp(FFVADisplay *display)
     if (!display)
         return false;
 
+    // FFVA_VPP=0 forces CPU processing, e.g. to test it
+    if (env && strcmp(env, "0") == 0)
+        return false;
+
     va_num_entrypoints = vaMaxNumEntrypoints(display->va_display);
     va_entrypoints = malloc(va_num_entrypoints * sizeof(*va_entrypoints));
     if (!va_entrypoints)
@@ -75,6 +173,31 @@ cleanup:
     return has_vpp;
 }
 
+// Determines the set of target formats the CPU scaler can produce
+static bool
+ensure_cpu_formats(FFVAFilter *filter)
+{
+    const uint32_t *fourccs = ffva_scaler_get_formats();
+    enum AVPixelFormat pix_fmt;
+    uint32_t i, n;
+
+    if (filter->pix_fmts)
+        return true;
+
+    for (n = 0; fourccs[n] != 0; n++)
+        ;
+    filter->pix_fmts = malloc((n + 1) * sizeof(*filter->pix_fmts));
+    if (!filter->pix_fmts)
+        return false;
+
+    for (i = 0, n = 0; fourccs[i] != 0; i++) {
+        if (vaapi_to_ffmpeg_pix_fmt(fourccs[i], &pix_fmt))
+            filter->pix_fmts[n++] = pix_fmt;
+    }
+    filter->pix_fmts[n] = AV_PIX_FMT_NONE;
+    return true;
+}
+
 static bool
 ensure_formats(FFVAFilter *filter)
 {
@@ -82,7 +205,12 @@ ensure_formats(FFVAFilter *filter)
     VASurfaceAttrib *surface_attribs = NULL;
     uint32_t i, n, num_surface_attribs = 0;
     VAStatus va_status;
+#endif
 
+    if (filter->scaler)
+        return ensure_cpu_formats(filter);
+
+#if USE_VA_VPP
     if (filter->pix_fmts)
         return true;
 
@@ -142,6 +270,869 @@ find_format(FFVAFilter *filter, int pix_fmt)
     return false;
 }
 
+// Maps the supplied surface to system memory, for CPU processing
+static int
+map_surface(FFVAFilter *filter, FFVASurface *surface, FFVAFilterImage *fimg,
+    bool read)
+{
+    VAImageFormat va_format;
+    VAStatus va_status;
+    uint8_t *pixels;
+    uint32_t i;
+
+    va_image_init_defaults(&fimg->va_image);
+    fimg->is_derived = false;
+
+    va_status = vaSyncSurface(filter->va_display, surface->id);
+    if (!va_check_status(va_status, "vaSyncSurface()"))
+        return vaapi_to_ffmpeg_error(va_status);
+
+    // Access the surface contents directly, if the layout is supported
+    va_status = vaDeriveImage(filter->va_display, surface->id,
+        &fimg->va_image);
+    if (va_status == VA_STATUS_SUCCESS) {
+        if (ffva_scaler_has_format(fimg->va_image.format.fourcc))
+            fimg->is_derived = true;
+        else {
+            vaDestroyImage(filter->va_display, fimg->va_image.image_id);
+            va_image_init_defaults(&fimg->va_image);
+        }
+    }
+
+    // Otherwise, go through an intermediate image
+    if (!fimg->is_derived) {
+        memset(&va_format, 0, sizeof(va_format));
+        va_format.fourcc = surface->fourcc ? surface->fourcc :
+            VA_FOURCC('N','V','1','2');
+        va_format.byte_order = VA_LSB_FIRST;
+        va_status = vaCreateImage(filter->va_display, &va_format,
+            surface->width, surface->height, &fimg->va_image);
+        if (!va_check_status(va_status, "vaCreateImage()"))
+            return vaapi_to_ffmpeg_error(va_status);
+
+        if (read) {
+            va_status = vaGetImage(filter->va_display, surface->id, 0, 0,
+                surface->width, surface->height, fimg->va_image.image_id);
+            if (!va_check_status(va_status, "vaGetImage()"))
+                goto error;
+        }
+    }
+
+    pixels = va_map_buffer(filter->va_display, fimg->va_image.buf);
+    if (!pixels) {
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
+        goto error;
+    }
+
+    // Derived images could be larger, up to the driver alignment
+    fimg->image.fourcc = fimg->va_image.format.fourcc;
+    fimg->image.width = FFMIN(fimg->va_image.width, surface->width);
+    fimg->image.height = FFMIN(fimg->va_image.height, surface->height);
+    for (i = 0; i < 3; i++) {
+        if (i < fimg->va_image.num_planes) {
+            fimg->image.pixels[i] = pixels + fimg->va_image.offsets[i];
+            fimg->image.pitches[i] = fimg->va_image.pitches[i];
+        }
+        else {
+            fimg->image.pixels[i] = NULL;
+            fimg->image.pitches[i] = 0;
+        }
+    }
+    return 0;
+
+error:
+    vaDestroyImage(filter->va_display, fimg->va_image.image_id);
+    va_image_init_defaults(&fimg->va_image);
+    return vaapi_to_ffmpeg_error(va_status);
+}
+
+// Unmaps the supplied surface, committing pixels back if needed
+static int
+unmap_surface(FFVAFilter *filter, FFVASurface *surface, FFVAFilterImage *fimg,
+    bool write)
+{
+    VAStatus va_status = VA_STATUS_SUCCESS;
+
+    if (fimg->va_image.image_id == VA_INVALID_ID)
+        return 0;
+
+    va_unmap_buffer(filter->va_display, fimg->va_image.buf, NULL);
+    if (write && !fimg->is_derived) {
+        va_status = vaPutImage(filter->va_display, surface->id,
+            fimg->va_image.image_id, 0, 0, surface->width, surface->height,
+            0, 0, surface->width, surface->height);
+        va_check_status(va_status, "vaPutImage()");
+    }
+    vaDestroyImage(filter->va_display, fimg->va_image.image_id);
+    va_image_init_defaults(&fimg->va_image);
+    return va_status == VA_STATUS_SUCCESS ? 0 :
+        vaapi_to_ffmpeg_error(va_status);
+}
+
+// Returns the CPU scaling method matching the VPP scaling flags
+static inline FFVAScalerMethod
+get_scaler_method(uint32_t flags)
+{
+    return (flags & VA_FILTER_SCALING_MASK) == VA_FILTER_SCALING_HQ ?
+        FFVA_SCALER_METHOD_BICUBIC : FFVA_SCALER_METHOD_BILINEAR;
+}
+
+// Crops, scales and converts the supplied layers with the CPU scaler
+static int
+process_cpu(FFVAFilter *filter, const FFVAFilterLayer *layers,
+    uint32_t num_layers, FFVASurface *dst_surface, uint32_t flags)
+{
+    FFVAFilterImage src_image, dst_image;
+    uint32_t i;
+    int ret;
+
+    for (i = 0; i < num_layers; i++) {
+        if (!layers[i].surface)
+            return AVERROR(EINVAL);
+        if (layers[i].alpha < 1.0f)
+            return AVERROR(ENOTSUP);
+    }
+
+    ret = map_surface(filter, dst_surface, &dst_image,
+        num_layers > 1 || layers[0].target_rect != NULL);
+    if (ret < 0)
+        return ret;
+
+    // Paint the background, unless the first layer covers it all
+    if (layers[0].target_rect) {
+        const VARectangle * const r = layers[0].target_rect;
+
+        if (r->x != 0 || r->y != 0 || r->width != dst_surface->width ||
+            r->height != dst_surface->height)
+            ret = ffva_scaler_clear(filter->scaler, &dst_image.image);
+    }
+
+    for (i = 0; ret == 0 && i < num_layers; i++) {
+        const FFVAFilterLayer * const layer = &layers[i];
+
+        ret = map_surface(filter, layer->surface, &src_image, true);
+        if (ret < 0)
+            break;
+        ret = ffva_scaler_process(filter->scaler, &src_image.image,
+            layer->crop_rect, &dst_image.image, layer->target_rect,
+            get_scaler_method(flags));
+        unmap_surface(filter, layer->surface, &src_image, false);
+    }
+
+    if (unmap_surface(filter, dst_surface, &dst_image, ret == 0) < 0 &&
+        ret == 0)
+        ret = AVERROR(EIO);
+    return ret;
+}
+
+#if USE_VA_VPP
+static const VAProcColorBalanceType g_color_balance_types[] = {
+    [FFVA_FILTER_OP_HUE]        = VAProcColorBalanceHue,
+    [FFVA_FILTER_OP_SATURATION] = VAProcColorBalanceSaturation,
+    [FFVA_FILTER_OP_BRIGHTNESS] = VAProcColorBalanceBrightness,
+    [FFVA_FILTER_OP_CONTRAST]   = VAProcColorBalanceContrast,
+};
+
+static const VAProcDeinterlacingType g_deinterlacing_types[] = {
+    [FFVA_DEINTERLACE_METHOD_NONE] = VAProcDeinterlacingNone,
+    [FFVA_DEINTERLACE_METHOD_BOB] = VAProcDeinterlacingBob,
+    [FFVA_DEINTERLACE_METHOD_WEAVE] = VAProcDeinterlacingWeave,
+    [FFVA_DEINTERLACE_METHOD_MOTION_ADAPTIVE] =
+        VAProcDeinterlacingMotionAdaptive,
+    [FFVA_DEINTERLACE_METHOD_MOTION_COMPENSATED] =
+        VAProcDeinterlacingMotionCompensated,
+};
+
+static inline bool
+is_color_balance_op(FFVAFilterOp op)
+{
+    return op >= FFVA_FILTER_OP_HUE && op <= FFVA_FILTER_OP_CONTRAST;
+}
+
+// Queries the capabilities of a filter controlled by a single value
+static void
+query_filter_cap(FFVAFilter *filter, VAProcFilterType type, FFVAFilterOp op)
+{
+    FFVAFilterOpState * const op_state = &filter->ops[op];
+    VAProcFilterCap filter_cap;
+    unsigned int num_filter_caps = 1;
+    VAStatus va_status;
+
+    va_status = vaQueryVideoProcFilterCaps(filter->va_display,
+        filter->va_context, type, &filter_cap, &num_filter_caps);
+    if (!va_check_status(va_status, "vaQueryVideoProcFilterCaps()"))
+        return;
+    if (num_filter_caps < 1)
+        return;
+
+    op_state->is_supported = 1;
+    op_state->range = filter_cap.range;
+}
+
+// Queries the capabilities of the color balance filter
+static void
+query_color_balance_caps(FFVAFilter *filter)
+{
+    VAProcFilterCapColorBalance filter_caps[VAProcColorBalanceCount];
+    unsigned int i, num_filter_caps = VAProcColorBalanceCount;
+    VAStatus va_status;
+    FFVAFilterOp op;
+
+    va_status = vaQueryVideoProcFilterCaps(filter->va_display,
+        filter->va_context, VAProcFilterColorBalance, filter_caps,
+        &num_filter_caps);
+    if (!va_check_status(va_status, "vaQueryVideoProcFilterCaps()"))
+        return;
+
+    for (i = 0; i < num_filter_caps; i++) {
+        for (op = FFVA_FILTER_OP_HUE; op <= FFVA_FILTER_OP_CONTRAST; op++) {
+            if (g_color_balance_types[op] != filter_caps[i].type)
+                continue;
+            filter->ops[op].is_supported = 1;
+            filter->ops[op].range = filter_caps[i].range;
+        }
+    }
+}
+
+// Queries the capabilities of the deinterlacing filter
+static void
+query_deinterlacing_caps(FFVAFilter *filter)
+{
+    VAProcFilterCapDeinterlacing filter_caps[VAProcDeinterlacingCount];
+    unsigned int i, num_filter_caps = VAProcDeinterlacingCount;
+    FFVADeinterlaceMethod method;
+    VAStatus va_status;
+
+    va_status = vaQueryVideoProcFilterCaps(filter->va_display,
+        filter->va_context, VAProcFilterDeinterlacing, filter_caps,
+        &num_filter_caps);
+    if (!va_check_status(va_status, "vaQueryVideoProcFilterCaps()"))
+        return;
+
+    for (i = 0; i < num_filter_caps; i++) {
+        for (method = FFVA_DEINTERLACE_METHOD_BOB;
+             method <= FFVA_DEINTERLACE_METHOD_MOTION_COMPENSATED; method++) {
+            if (g_deinterlacing_types[method] == filter_caps[i].type)
+                filter->deinterlace_methods |= 1U << method;
+        }
+    }
+}
+
+// Determines the set of filters supported by the VPP pipeline
+static void
+ensure_filter_caps(FFVAFilter *filter)
+{
+    VAProcFilterType filters[VAProcFilterCount];
+    unsigned int i, num_filters = VAProcFilterCount;
+    VAStatus va_status;
+
+    if (filter->filter_caps_queried)
+        return;
+    filter->filter_caps_queried = 1;
+
+    va_status = vaQueryVideoProcFilters(filter->va_display, filter->va_context,
+        filters, &num_filters);
+    if (!va_check_status(va_status, "vaQueryVideoProcFilters()"))
+        return;
+
+    for (i = 0; i < num_filters; i++) {
+        switch (filters[i]) {
+        case VAProcFilterNoiseReduction:
+            query_filter_cap(filter, filters[i], FFVA_FILTER_OP_DENOISE);
+            break;
+        case VAProcFilterSharpening:
+            query_filter_cap(filter, filters[i], FFVA_FILTER_OP_SHARPEN);
+            break;
+        case VAProcFilterColorBalance:
+            query_color_balance_caps(filter);
+            break;
+        case VAProcFilterDeinterlacing:
+            query_deinterlacing_caps(filter);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Creates a filter parameter buffer for a filter controlled by a single value
+static bool
+create_filter_buffer(FFVAFilter *filter, VAProcFilterType type,
+    FFVAFilterOp op, VABufferID *buf_id_ptr)
+{
+    VAProcFilterParameterBuffer filter_param;
+
+    filter_param.type = type;
+    filter_param.value = filter->ops[op].value;
+    return va_create_buffer(filter->va_display, filter->va_context,
+        VAProcFilterParameterBufferType, sizeof(filter_param), &filter_param,
+        buf_id_ptr, NULL);
+}
+
+// Creates the color balance filter buffer, one element per attribute
+static bool
+create_color_balance_buffer(FFVAFilter *filter, VABufferID *buf_id_ptr)
+{
+    VAProcFilterParameterBufferColorBalance filter_params[4];
+    uint32_t num_filter_params = 0;
+    VAStatus va_status;
+    FFVAFilterOp op;
+
+    for (op = FFVA_FILTER_OP_HUE; op <= FFVA_FILTER_OP_CONTRAST; op++) {
+        VAProcFilterParameterBufferColorBalance * const filter_param =
+            &filter_params[num_filter_params];
+
+        if (!filter->ops[op].is_enabled)
+            continue;
+        filter_param->type = VAProcFilterColorBalance;
+        filter_param->attrib = g_color_balance_types[op];
+        filter_param->value = filter->ops[op].value;
+        num_filter_params++;
+    }
+    if (!num_filter_params)
+        return true;
+
+    va_status = vaCreateBuffer(filter->va_display, filter->va_context,
+        VAProcFilterParameterBufferType, sizeof(filter_params[0]),
+        num_filter_params, filter_params, buf_id_ptr);
+    return va_check_status(va_status, "vaCreateBuffer()");
+}
+
+static void
+destroy_filter_buffers(FFVAFilter *filter)
+{
+    uint32_t i;
+
+    va_destroy_buffer(filter->va_display, &filter->denoise_buffer);
+    va_destroy_buffer(filter->va_display, &filter->sharpen_buffer);
+    va_destroy_buffer(filter->va_display, &filter->color_balance_buffer);
+    for (i = 0; i < FFVA_FILTER_DEINTERLACE_VARIANTS; i++)
+        va_destroy_buffer(filter->va_display,
+            &filter->deinterlace_buffers[i]);
+    filter->num_static_va_filters = 0;
+}
+
+static void
+init_filter_buffers(FFVAFilter *filter)
+{
+    uint32_t i;
+
+    filter->denoise_buffer = VA_INVALID_ID;
+    filter->sharpen_buffer = VA_INVALID_ID;
+    filter->color_balance_buffer = VA_INVALID_ID;
+    for (i = 0; i < FFVA_FILTER_DEINTERLACE_VARIANTS; i++)
+        filter->deinterlace_buffers[i] = VA_INVALID_ID;
+    filter->num_static_va_filters = 0;
+}
+
+// Builds the filter buffers that do not depend on the source surface
+static bool
+ensure_filter_buffers(FFVAFilter *filter)
+{
+    FFVAFilterOpState * const ops = filter->ops;
+    uint32_t n;
+
+    if (!filter->filter_buffers_changed)
+        return true;
+
+    destroy_filter_buffers(filter);
+    filter->filter_buffers_changed = 0;
+
+    if (ops[FFVA_FILTER_OP_DENOISE].is_enabled) {
+        if (!create_filter_buffer(filter, VAProcFilterNoiseReduction,
+                FFVA_FILTER_OP_DENOISE, &filter->denoise_buffer))
+            goto error;
+    }
+    if (ops[FFVA_FILTER_OP_SHARPEN].is_enabled) {
+        if (!create_filter_buffer(filter, VAProcFilterSharpening,
+                FFVA_FILTER_OP_SHARPEN, &filter->sharpen_buffer))
+            goto error;
+    }
+    if (!create_color_balance_buffer(filter, &filter->color_balance_buffer))
+        goto error;
+
+    n = 0;
+    if (filter->denoise_buffer != VA_INVALID_ID)
+        filter->static_va_filters[n++] = filter->denoise_buffer;
+    if (filter->sharpen_buffer != VA_INVALID_ID)
+        filter->static_va_filters[n++] = filter->sharpen_buffer;
+    if (filter->color_balance_buffer != VA_INVALID_ID)
+        filter->static_va_filters[n++] = filter->color_balance_buffer;
+    filter->num_static_va_filters = n;
+    return true;
+
+error:
+    destroy_filter_buffers(filter);
+    filter->filter_buffers_changed = 1;
+    return false;
+}
+
+// Returns the deinterlacing filter buffer for the supplied process flags
+static VABufferID
+ensure_deinterlace_buffer(FFVAFilter *filter, uint32_t flags)
+{
+    VAProcFilterParameterBufferDeinterlacing filter_param;
+    uint32_t variant = 0;
+    VABufferID *buf_id_ptr;
+
+    if (flags & FFVA_FILTER_FLAG_BOTTOM_FIELD_FIRST)
+        variant |= VA_DEINTERLACING_BOTTOM_FIELD_FIRST;
+    if (flags & VA_BOTTOM_FIELD)
+        variant |= VA_DEINTERLACING_BOTTOM_FIELD;
+
+    buf_id_ptr = &filter->deinterlace_buffers[variant];
+    if (*buf_id_ptr != VA_INVALID_ID)
+        return *buf_id_ptr;
+
+    filter_param.type = VAProcFilterDeinterlacing;
+    filter_param.algorithm = g_deinterlacing_types[filter->deinterlace_method];
+    filter_param.flags = variant;
+    if (!va_create_buffer(filter->va_display, filter->va_context,
+            VAProcFilterParameterBufferType, sizeof(filter_param),
+            &filter_param, buf_id_ptr, NULL))
+        return VA_INVALID_ID;
+    return *buf_id_ptr;
+}
+
+// Determines the number of reference surfaces the deinterlacer requires
+static bool
+ensure_deinterlace_caps(FFVAFilter *filter)
+{
+    VAProcPipelineCaps pipeline_caps;
+    VABufferID deinterlace_buffer;
+    VAStatus va_status;
+
+    if (filter->deinterlace_caps_queried)
+        return true;
+
+    filter->deinterlace_num_forward_refs = 0;
+    filter->deinterlace_num_backward_refs = 0;
+    if (filter->deinterlace_method == FFVA_DEINTERLACE_METHOD_NONE) {
+        filter->deinterlace_caps_queried = 1;
+        return true;
+    }
+
+    if (!ensure_filter_buffers(filter))
+        return false;
+    deinterlace_buffer = ensure_deinterlace_buffer(filter, 0);
+    if (deinterlace_buffer == VA_INVALID_ID)
+        return false;
+
+    memset(&pipeline_caps, 0, sizeof(pipeline_caps));
+    va_status = vaQueryVideoProcPipelineCaps(filter->va_display,
+        filter->va_context, &deinterlace_buffer, 1, &pipeline_caps);
+    if (!va_check_status(va_status, "vaQueryVideoProcPipelineCaps()"))
+        return false;
+
+    filter->deinterlace_num_forward_refs = FFMIN(
+        pipeline_caps.num_forward_references, FFVA_FILTER_MAX_REFERENCES);
+    filter->deinterlace_num_backward_refs = FFMIN(
+        pipeline_caps.num_backward_references, FFVA_FILTER_MAX_REFERENCES);
+    filter->deinterlace_caps_queried = 1;
+    return true;
+}
+
+// Builds the filter chain to apply to the supplied source surface. Returns
+// the VPP filter flags to use
+static uint32_t
+build_filter_chain(FFVAFilter *filter, uint32_t flags, bool *success_ptr)
+{
+    VABufferID deinterlace_buffer = VA_INVALID_ID;
+    uint32_t n = 0;
+
+    *success_ptr = false;
+    filter->num_va_forward_refs = 0;
+    filter->num_va_backward_refs = 0;
+    if (!ensure_filter_buffers(filter))
+        return flags;
+
+    if (filter->deinterlace_method != FFVA_DEINTERLACE_METHOD_NONE &&
+        (flags & (VA_TOP_FIELD|VA_BOTTOM_FIELD))) {
+        if (!ensure_deinterlace_caps(filter))
+            return flags;
+        deinterlace_buffer = ensure_deinterlace_buffer(filter, flags);
+        if (deinterlace_buffer == VA_INVALID_ID)
+            return flags;
+
+        // the field to output is conveyed through the deinterlacing filter
+        flags &= ~(VA_TOP_FIELD|VA_BOTTOM_FIELD);
+
+        // reference surfaces are only meaningful to deinterlacing
+        filter->num_va_forward_refs = FFMIN(filter->num_forward_refs,
+            filter->deinterlace_num_forward_refs);
+        filter->num_va_backward_refs = FFMIN(filter->num_backward_refs,
+            filter->deinterlace_num_backward_refs);
+    }
+
+    // deinterlacing always comes first
+    if (deinterlace_buffer != VA_INVALID_ID)
+        filter->va_filters[n++] = deinterlace_buffer;
+    memcpy(&filter->va_filters[n], filter->static_va_filters,
+        filter->num_static_va_filters * sizeof(filter->va_filters[0]));
+    filter->num_va_filters = n + filter->num_static_va_filters;
+    *success_ptr = true;
+    return flags & ~FFVA_FILTER_FLAG_BOTTOM_FIELD_FIRST;
+}
+
+static void
+params_buffers_init(FFVAFilter *filter)
+{
+    uint32_t i;
+
+    for (i = 0; i < FFVA_FILTER_PARAMS_BUFFERS; i++)
+        filter->params_buffers[i].va_buffer = VA_INVALID_ID;
+    filter->params_buffer_index = 0;
+}
+
+static void
+params_buffers_finalize(FFVAFilter *filter)
+{
+    uint32_t i;
+
+    for (i = 0; i < FFVA_FILTER_PARAMS_BUFFERS; i++)
+        va_destroy_buffer(filter->va_display,
+            &filter->params_buffers[i].va_buffer);
+}
+
+// Fills in the VPP pipeline parameters for the supplied buffer slot
+static void
+params_buffer_init_params(FFVAFilter *filter, FFVAFilterParamsBuffer *pb,
+    const FFVAFilterParamsDesc *desc, VAProcPipelineParameterBuffer *params)
+{
+    memset(params, 0, sizeof(*params));
+    params->surface = desc->surface;
+    params->surface_region = &pb->desc.src_rect;
+    params->surface_color_standard = VAProcColorStandardNone;
+    params->output_region = &pb->desc.dst_rect;
+    params->output_color_standard = VAProcColorStandardNone;
+    params->output_background_color = desc->background_color;
+    params->filter_flags = desc->flags;
+    params->filters = filter->num_va_filters > 0 ? filter->va_filters : NULL;
+    params->num_filters = filter->num_va_filters;
+    params->forward_references = filter->num_va_forward_refs > 0 ?
+        filter->forward_refs : NULL;
+    params->num_forward_references = filter->num_va_forward_refs;
+    params->backward_references = filter->num_va_backward_refs > 0 ?
+        filter->backward_refs : NULL;
+    params->num_backward_references = filter->num_va_backward_refs;
+    params->blend_state = desc->alpha < 1.0f ? &pb->blend_state : NULL;
+}
+
+// Checks whether the buffer slot already holds the supplied parameters
+static bool
+params_buffer_match(FFVAFilter *filter, FFVAFilterParamsBuffer *pb,
+    const FFVAFilterParamsDesc *desc)
+{
+    VAProcPipelineParameterBuffer params;
+
+    if (pb->va_buffer == VA_INVALID_ID)
+        return false;
+    if (memcmp(&pb->desc, desc, sizeof(*desc)) != 0)
+        return false;
+
+    params_buffer_init_params(filter, pb, desc, &params);
+    return memcmp(&pb->params, &params, sizeof(params)) == 0;
+}
+
+// Looks up a pipeline parameter buffer holding the supplied parameters,
+// or refills the least recently allocated one. Buffers already used for
+// the current submission are never recycled
+static FFVAFilterParamsBuffer *
+params_buffer_lookup(FFVAFilter *filter, const FFVAFilterParamsDesc *desc)
+{
+    FFVAFilterParamsBuffer *pb;
+    VAProcPipelineParameterBuffer *va_params;
+    uint32_t i;
+
+    for (i = 0; i < FFVA_FILTER_PARAMS_BUFFERS; i++) {
+        pb = &filter->params_buffers[i];
+        if (pb->seqno != filter->params_seqno &&
+            params_buffer_match(filter, pb, desc))
+            goto found;
+    }
+
+    for (i = 0; i < FFVA_FILTER_PARAMS_BUFFERS; i++) {
+        pb = &filter->params_buffers[filter->params_buffer_index];
+        filter->params_buffer_index = (filter->params_buffer_index + 1) %
+            FFVA_FILTER_PARAMS_BUFFERS;
+        if (pb->seqno != filter->params_seqno)
+            break;
+    }
+    if (i == FFVA_FILTER_PARAMS_BUFFERS)
+        return NULL;
+
+    if (pb->va_buffer == VA_INVALID_ID) {
+        if (!va_create_buffer(filter->va_display, filter->va_context,
+                VAProcPipelineParameterBufferType, sizeof(*va_params), NULL,
+                &pb->va_buffer, NULL))
+            return NULL;
+    }
+
+    pb->desc = *desc;
+    memset(&pb->blend_state, 0, sizeof(pb->blend_state));
+    pb->blend_state.flags = VA_BLEND_GLOBAL_ALPHA;
+    pb->blend_state.global_alpha = desc->alpha;
+    params_buffer_init_params(filter, pb, desc, &pb->params);
+
+    va_params = va_map_buffer(filter->va_display, pb->va_buffer);
+    if (!va_params)
+        goto error;
+    memcpy(va_params, &pb->params, sizeof(*va_params));
+    va_unmap_buffer(filter->va_display, pb->va_buffer, (void **)&va_params);
+
+found:
+    pb->seqno = filter->params_seqno;
+    return pb;
+
+error:
+    va_destroy_buffer(filter->va_display, &pb->va_buffer);
+    return NULL;
+}
+
+// Initializes a pipeline parameters descriptor with the supplied regions
+static int
+params_desc_init(FFVAFilterParamsDesc *desc, FFVASurface *src_surface,
+    const VARectangle *src_rect, FFVASurface *dst_surface,
+    const VARectangle *dst_rect, uint32_t flags)
+{
+    memset(desc, 0, sizeof(*desc));
+    desc->surface = src_surface->id;
+    desc->flags = flags;
+    desc->background_color = FFVA_FILTER_BACKGROUND_COLOR;
+    desc->alpha = 1.0f;
+
+    // Build surface region (source)
+    if (src_rect) {
+        if (src_rect->x + src_rect->width > src_surface->width ||
+            src_rect->y + src_rect->height > src_surface->height)
+            return AVERROR(ERANGE);
+        desc->src_rect = *src_rect;
+    }
+    else {
+        desc->src_rect.width = src_surface->width;
+        desc->src_rect.height = src_surface->height;
+    }
+
+    // Build output region (target)
+    if (dst_rect) {
+        if (dst_rect->x + dst_rect->width > dst_surface->width ||
+            dst_rect->y + dst_rect->height > dst_surface->height)
+            return AVERROR(ERANGE);
+        desc->dst_rect = *dst_rect;
+    }
+    else {
+        desc->dst_rect.width = dst_surface->width;
+        desc->dst_rect.height = dst_surface->height;
+    }
+    return 0;
+}
+
+// Submits the supplied pipeline parameter buffers as a single VPP operation
+static VAStatus
+submit_params_buffers(FFVAFilter *filter, FFVASurface *dst_surface,
+    VABufferID *va_buffers, uint32_t num_va_buffers)
+{
+    VAStatus va_status;
+
+    va_status = vaBeginPicture(filter->va_display, filter->va_context,
+        dst_surface->id);
+    if (!va_check_status(va_status, "vaBeginPicture()"))
+        return va_status;
+
+    va_status = vaRenderPicture(filter->va_display, filter->va_context,
+        va_buffers, num_va_buffers);
+    if (!va_check_status(va_status, "vaRenderPicture()")) {
+        vaEndPicture(filter->va_display, filter->va_context);
+        return va_status;
+    }
+
+    va_status = vaEndPicture(filter->va_display, filter->va_context);
+    if (!va_check_status(va_status, "vaEndPicture()"))
+        return va_status;
+    return VA_STATUS_SUCCESS;
+}
+
+// Determines the blending capabilities of the VPP pipeline
+static void
+ensure_pipeline_caps(FFVAFilter *filter)
+{
+    VAProcPipelineCaps pipeline_caps;
+    VAStatus va_status;
+
+    if (filter->pipeline_caps_queried)
+        return;
+    filter->pipeline_caps_queried = 1;
+
+    memset(&pipeline_caps, 0, sizeof(pipeline_caps));
+    va_status = vaQueryVideoProcPipelineCaps(filter->va_display,
+        filter->va_context, NULL, 0, &pipeline_caps);
+    if (!va_check_status(va_status, "vaQueryVideoProcPipelineCaps()"))
+        return;
+    filter->blend_flags = pipeline_caps.blend_flags;
+}
+
+// Looks up the pipeline parameter buffer that paints the supplied layer into
+// a region of the destination surface
+static int
+get_layer_params_buffer(FFVAFilter *filter, const FFVAFilterLayer *layer,
+    FFVASurface *dst_surface, const VARectangle *dst_rect, uint32_t flags,
+    bool fill_background, FFVAFilterParamsBuffer **pb_ptr)
+{
+    FFVAFilterParamsDesc desc;
+    int ret;
+
+    if (!layer->surface)
+        return AVERROR(EINVAL);
+    ret = params_desc_init(&desc, layer->surface, layer->crop_rect,
+        dst_surface, dst_rect, flags);
+    if (ret < 0)
+        return ret;
+
+    if (layer->alpha < 1.0f) {
+        ensure_pipeline_caps(filter);
+        if (!(filter->blend_flags & VA_BLEND_GLOBAL_ALPHA))
+            return AVERROR(ENOTSUP);
+        desc.alpha = layer->alpha < 0.0f ? 0.0f : layer->alpha;
+    }
+    if (!fill_background)
+        desc.background_color = 0;
+
+    *pb_ptr = params_buffer_lookup(filter, &desc);
+    return *pb_ptr ? 0 : AVERROR(ENOMEM);
+}
+
+// Ensures the intermediate composition surface has the format of the
+// destination surface, and the supplied size
+static int
+ensure_compose_surface(FFVAFilter *filter, FFVASurface *dst_surface,
+    uint32_t width, uint32_t height)
+{
+    FFVASurface * const s = &filter->compose_surface;
+    VASurfaceID va_surface;
+    VASurfaceAttrib attrib;
+    VAStatus va_status;
+
+    if (s->id != VA_INVALID_ID && s->fourcc == dst_surface->fourcc &&
+        s->chroma == dst_surface->chroma && s->width == width &&
+        s->height == height)
+        return 0;
+    va_destroy_surface(filter->va_display, &s->id);
+
+    attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attrib.type = VASurfaceAttribPixelFormat;
+    attrib.value.type = VAGenericValueTypeInteger;
+    attrib.value.value.i = dst_surface->fourcc;
+
+    va_status = vaCreateSurfaces(filter->va_display, dst_surface->chroma,
+        width, height, &va_surface, 1, &attrib, dst_surface->fourcc ? 1 : 0);
+    if (!va_check_status(va_status, "vaCreateSurfaces()")) {
+        ffva_surface_init_defaults(s);
+        return vaapi_to_ffmpeg_error(va_status);
+    }
+    ffva_surface_init(s, va_surface, dst_surface->chroma, width, height);
+    s->fourcc = dst_surface->fourcc;
+    return 0;
+}
+
+// Copies the whole source surface into a region of the destination surface
+// with the CPU, leaving the rest of the destination surface untouched
+static int
+blit_surface(FFVAFilter *filter, FFVASurface *src_surface,
+    FFVASurface *dst_surface, const VARectangle *dst_rect)
+{
+    FFVAFilterImage src_image, dst_image;
+    int ret;
+
+    if (!filter->blit_scaler) {
+        filter->blit_scaler = ffva_scaler_new(0);
+        if (!filter->blit_scaler)
+            return AVERROR(ENOMEM);
+    }
+
+    ret = map_surface(filter, dst_surface, &dst_image, true);
+    if (ret < 0)
+        return ret;
+    ret = map_surface(filter, src_surface, &src_image, true);
+    if (ret == 0) {
+        ret = ffva_scaler_process(filter->blit_scaler, &src_image.image,
+            NULL, &dst_image.image, dst_rect, FFVA_SCALER_METHOD_BILINEAR);
+        unmap_surface(filter, src_surface, &src_image, false);
+    }
+
+    if (unmap_surface(filter, dst_surface, &dst_image, ret == 0) < 0 &&
+        ret == 0)
+        ret = AVERROR(EIO);
+    return ret;
+}
+
+// Composes the supplied layers one VPP pass at a time. Drivers fill the
+// area outside of the output region of each pass, so layers after the
+// first one are rendered into an intermediate surface of the size of their
+// target rectangle, and then copied into the destination surface
+static int
+compose_multipass(FFVAFilter *filter, const FFVAFilterLayer *layers,
+    uint32_t num_layers, FFVASurface *dst_surface, uint32_t flags)
+{
+    FFVAFilterParamsBuffer *pb;
+    FFVASurface *surface;
+    VARectangle rect;
+    VAStatus va_status;
+    bool is_direct;
+    uint32_t i;
+    int ret;
+
+    for (i = 0; i < num_layers; i++) {
+        const FFVAFilterLayer * const layer = &layers[i];
+
+        if (layer->target_rect)
+            rect = *layer->target_rect;
+        else {
+            rect.x = 0;
+            rect.y = 0;
+            rect.width = dst_surface->width;
+            rect.height = dst_surface->height;
+        }
+        is_direct = i == 0 || (rect.x == 0 && rect.y == 0 &&
+            rect.width == dst_surface->width &&
+            rect.height == dst_surface->height);
+
+        // The intermediate surface has nothing to blend the layer with
+        if (i > 0 && layer->alpha < 1.0f)
+            return AVERROR(ENOTSUP);
+
+        if (is_direct)
+            surface = dst_surface;
+        else {
+            if (rect.x + rect.width > dst_surface->width ||
+                rect.y + rect.height > dst_surface->height)
+                return AVERROR(ERANGE);
+            ret = ensure_compose_surface(filter, dst_surface, rect.width,
+                rect.height);
+            if (ret < 0)
+                return ret;
+            surface = &filter->compose_surface;
+        }
+
+        filter->params_seqno++;
+        ret = get_layer_params_buffer(filter, layer, surface,
+            is_direct ? layer->target_rect : NULL, flags, true, &pb);
+        if (ret < 0)
+            return ret;
+
+        va_status = submit_params_buffers(filter, surface, &pb->va_buffer, 1);
+        if (va_status != VA_STATUS_SUCCESS)
+            return vaapi_to_ffmpeg_error(va_status);
+
+        if (!is_direct) {
+            ret = blit_surface(filter, surface, dst_surface, &rect);
+            if (ret < 0)
+                return ret;
+        }
+    }
+    return 0;
+}
+#endif
+
 /* ------------------------------------------------------------------------- */
 /* --- Interface                                                         --- */
 /* ------------------------------------------------------------------------- */
@@ -165,7 +1156,7 @@ ffva_filter_new(FFVADisplay *display)
     FFVAFilter *filter;
     VAStatus va_status;
 
-    if (!display || !has_vpp(display))
+    if (!display)
         return NULL;
 
     filter = calloc(1, sizeof(*filter));
@@ -178,6 +1169,26 @@ ffva_filter_new(FFVADisplay *display)
     filter->va_config = VA_INVALID_ID;
     filter->va_context = VA_INVALID_ID;
     filter->pix_fmt = AV_PIX_FMT_NONE;
+#if USE_VA_VPP
+    params_buffers_init(filter);
+    init_filter_buffers(filter);
+    ffva_surface_init_defaults(&filter->compose_surface);
+#endif
+
+    // Fallback to CPU processing, without any VPP operation
+    if (!has_vpp(display)) {
+        filter->scaler = ffva_scaler_new(0);
+        if (!filter->scaler)
+            goto error;
+#if USE_VA_VPP
+        filter->filter_caps_queried = 1;
+        filter->pipeline_caps_queried = 1;
+#endif
+        av_log(filter, AV_LOG_INFO, "VPP is not available, using CPU "
+            "video processing (%s)\n",
+            ffva_scaler_get_kernels_name(filter->scaler));
+        return filter;
+    }
 
     va_status = vaCreateConfig(filter->va_display, VAProfileNone,
         VAEntrypointVideoProc, NULL, 0, &filter->va_config);
@@ -203,10 +1214,19 @@ ffva_filter_free(FFVAFilter *filter)
         return;
 
     if (filter->va_display) {
+#if USE_VA_VPP
+        params_buffers_finalize(filter);
+        destroy_filter_buffers(filter);
+        va_destroy_surface(filter->va_display, &filter->compose_surface.id);
+#endif
         va_destroy_context(filter->va_display, &filter->va_context);
         va_destroy_config(filter->va_display, &filter->va_config);
         filter->va_display = NULL;
     }
+    ffva_scaler_freep(&filter->scaler);
+#if USE_VA_VPP
+    ffva_scaler_freep(&filter->blit_scaler);
+#endif
     av_freep(&filter->pix_fmts);
     free(filter);
 }
@@ -227,90 +1247,109 @@ ffva_filter_process(FFVAFilter *filter, FFVASurface *src_surface,
     FFVASurface *dst_surface, uint32_t flags)
 {
 #if USE_VA_VPP
-    VAProcPipelineParameterBuffer *va_vpp_params = NULL;
-    VABufferID va_vpp_params_buf = VA_INVALID_ID;
+    FFVAFilterParamsBuffer *pb;
+    FFVAFilterParamsDesc desc;
     VAStatus va_status;
-    const VARectangle *src_rect, *dst_rect;
-    VARectangle src_rect_tmp, dst_rect_tmp;
+    bool success;
+    int ret;
+#endif
 
-    // Build surface region (source)
-    if (filter->use_crop_rect) {
-        src_rect = &filter->crop_rect;
-        if (src_rect->x + src_rect->width > src_surface->width ||
-            src_rect->y + src_rect->height > src_surface->height)
-            return AVERROR(ERANGE);
-    }
-    else {
-        src_rect = &src_rect_tmp;
-        src_rect_tmp.x = 0;
-        src_rect_tmp.y = 0;
-        src_rect_tmp.width = src_surface->width;
-        src_rect_tmp.height = src_surface->height;
-    }
+    if (filter->scaler) {
+        FFVAFilterLayer layer;
 
-    // Build output region (target)
-    if (filter->use_target_rect) {
-        dst_rect = &filter->target_rect;
-        if (dst_rect->x + dst_rect->width > dst_surface->width ||
-            dst_rect->y + dst_rect->height > dst_surface->height)
-            return AVERROR(ERANGE);
+        layer.surface = src_surface;
+        layer.crop_rect = filter->use_crop_rect ? &filter->crop_rect : NULL;
+        layer.target_rect = filter->use_target_rect ?
+            &filter->target_rect : NULL;
+        layer.alpha = 1.0f;
+        return process_cpu(filter, &layer, 1, dst_surface, flags);
     }
-    else {
-        dst_rect = &dst_rect_tmp;
-        dst_rect_tmp.x = 0;
-        dst_rect_tmp.y = 0;
-        dst_rect_tmp.width = dst_surface->width;
-        dst_rect_tmp.height = dst_surface->height;
-    }
-
-    // Fill in VPP params
-    if (!va_create_buffer(
-            filter->va_display, filter->va_context,
-            VAProcPipelineParameterBufferType, sizeof(*va_vpp_params), NULL,
-            &va_vpp_params_buf, (void *)&va_vpp_params))
-        goto error_create_buffer;
-
-    memset(va_vpp_params, 0, sizeof(*va_vpp_params));
-    va_vpp_params->surface = src_surface->id;
-    va_vpp_params->surface_region = src_rect;
-    va_vpp_params->surface_color_standard = VAProcColorStandardNone;
-    va_vpp_params->output_region = dst_rect;
-    va_vpp_params->output_color_standard = VAProcColorStandardNone;
-    va_vpp_params->output_background_color = 0xff000000;
-    va_vpp_params->filter_flags = flags;
-    va_vpp_params->filters = NULL;
-    va_vpp_params->num_filters = 0;
 
-    va_unmap_buffer(filter->va_display, va_vpp_params_buf,
-        (void **)&va_vpp_params);
+#if USE_VA_VPP
+    ret = params_desc_init(&desc, src_surface,
+        filter->use_crop_rect ? &filter->crop_rect : NULL, dst_surface,
+        filter->use_target_rect ? &filter->target_rect : NULL, flags);
+    if (ret < 0)
+        return ret;
 
-    // Execute VPP pipeline
-    va_status = vaBeginPicture(filter->va_display, filter->va_context,
-        dst_surface->id);
-    if (!va_check_status(va_status, "vaBeginPicture()"))
-        goto error_vaapi_status;
+    // Build filter chain
+    desc.flags = build_filter_chain(filter, flags, &success);
+    if (!success)
+        goto error_create_buffer;
 
-    va_status = vaRenderPicture(filter->va_display, filter->va_context,
-        &va_vpp_params_buf, 1);
-    if (!va_check_status(va_status, "vaRenderPicture()"))
-        goto error_vaapi_status;
+    // Fill in VPP params, or reuse an up-to-date pipeline parameter buffer
+    filter->params_seqno++;
+    pb = params_buffer_lookup(filter, &desc);
+    if (!pb)
+        goto error_create_buffer;
 
-    va_status = vaEndPicture(filter->va_display, filter->va_context);
-    if (!va_check_status(va_status, "vaEndPicture()"))
+    // Execute VPP pipeline
+    va_status = submit_params_buffers(filter, dst_surface, &pb->va_buffer, 1);
+    if (va_status != VA_STATUS_SUCCESS)
         goto error_vaapi_status;
-
-    va_destroy_buffer(filter->va_display, &va_vpp_params_buf);
     return 0;
 
 error_create_buffer:
     return AVERROR(ENOMEM);
 error_vaapi_status:
-    va_destroy_buffer(filter->va_display, &va_vpp_params_buf);
+    va_destroy_buffer(filter->va_display, &pb->va_buffer);
     return vaapi_to_ffmpeg_error(va_status);
 #endif
     return AVERROR(ENOSYS);
 }
 
+// Composes the supplied layers into the destination surface
+int
+ffva_filter_compose(FFVAFilter *filter, const FFVAFilterLayer *layers,
+    uint32_t num_layers, FFVASurface *dst_surface, uint32_t flags)
+{
+#if USE_VA_VPP
+    FFVAFilterParamsBuffer *pb;
+    VAStatus va_status;
+    uint32_t i;
+    bool success;
+    int ret;
+#endif
+
+    if (!filter || !layers || !dst_surface)
+        return AVERROR(EINVAL);
+    if (num_layers == 0 || num_layers > FFVA_FILTER_MAX_LAYERS)
+        return AVERROR(ERANGE);
+
+    if (filter->scaler)
+        return process_cpu(filter, layers, num_layers, dst_surface, flags);
+
+#if USE_VA_VPP
+    flags = build_filter_chain(filter, flags, &success);
+    if (!success)
+        return AVERROR(ENOMEM);
+
+    // Drivers that blend layers also compose several of them in one pass
+    ensure_pipeline_caps(filter);
+    if (num_layers > 1 && !filter->blend_flags)
+        return compose_multipass(filter, layers, num_layers, dst_surface,
+            flags);
+
+    // Fill in VPP params for each layer, painted in order over the
+    // background of the first one
+    filter->params_seqno++;
+    for (i = 0; i < num_layers; i++) {
+        ret = get_layer_params_buffer(filter, &layers[i], dst_surface,
+            layers[i].target_rect, flags, i == 0, &pb);
+        if (ret < 0)
+            return ret;
+        filter->va_params_buffers[i] = pb->va_buffer;
+    }
+
+    va_status = submit_params_buffers(filter, dst_surface,
+        filter->va_params_buffers, num_layers);
+    if (va_status != VA_STATUS_SUCCESS)
+        return vaapi_to_ffmpeg_error(va_status);
+    return 0;
+#endif
+    return AVERROR(ENOSYS);
+}
+
 // Determines the set of supported target formats for video processing
 const int *
 ffva_filter_get_formats(FFVAFilter *filter)
@@ -334,7 +1373,7 @@ ffva_filter_set_format(FFVAFilter *filter, int pix_fmt)
         return AVERROR(ENOTSUP);
 
     filter->pix_fmt = pix_fmt;
-    return AVERROR(ENOSYS);
+    return 0;
 }
 
 // Sets the source surface cropping rectangle to use for video processing
@@ -362,3 +1401,172 @@ ffva_filter_set_target_rectangle(FFVAFilter *filter, const VARectangle *rect)
         filter->target_rect = *rect;
     return 0;
 }
+
+// Checks whether the supplied video processing operation is supported
+bool
+ffva_filter_has_operation(FFVAFilter *filter, FFVAFilterOp op)
+{
+    if (!filter || !is_valid_op(op))
+        return false;
+
+#if USE_VA_VPP
+    ensure_filter_caps(filter);
+    return filter->ops[op].is_supported;
+#endif
+    return false;
+}
+
+// Determines the range of values accepted by the supplied operation
+bool
+ffva_filter_get_operation_range(FFVAFilter *filter, FFVAFilterOp op,
+    FFVAFilterOpRange *range)
+{
+    if (!range || !ffva_filter_has_operation(filter, op))
+        return false;
+
+#if USE_VA_VPP
+    range->min_value = filter->ops[op].range.min_value;
+    range->max_value = filter->ops[op].range.max_value;
+    range->default_value = filter->ops[op].range.default_value;
+    range->step = filter->ops[op].range.step;
+    return true;
+#endif
+    return false;
+}
+
+// Enables the supplied video processing operation with the given value
+int
+ffva_filter_set_operation(FFVAFilter *filter, FFVAFilterOp op, float value)
+{
+#if USE_VA_VPP
+    FFVAFilterOpState *op_state;
+#endif
+
+    if (!filter || !is_valid_op(op))
+        return AVERROR(EINVAL);
+
+    if (!ffva_filter_has_operation(filter, op))
+        return AVERROR(ENOTSUP);
+
+#if USE_VA_VPP
+    op_state = &filter->ops[op];
+    if (value < op_state->range.min_value ||
+        value > op_state->range.max_value)
+        return AVERROR(ERANGE);
+
+    if (!op_state->is_enabled || op_state->value != value) {
+        op_state->is_enabled = 1;
+        op_state->value = value;
+        filter->filter_buffers_changed = 1;
+    }
+    return 0;
+#endif
+    return AVERROR(ENOSYS);
+}
+
+// Disables the supplied video processing operation
+int
+ffva_filter_reset_operation(FFVAFilter *filter, FFVAFilterOp op)
+{
+    if (!filter || !is_valid_op(op))
+        return AVERROR(EINVAL);
+
+#if USE_VA_VPP
+    if (filter->ops[op].is_enabled) {
+        filter->ops[op].is_enabled = 0;
+        filter->filter_buffers_changed = 1;
+    }
+#endif
+    return 0;
+}
+
+// Checks whether the supplied deinterlacing method is supported
+bool
+ffva_filter_has_deinterlace_method(FFVAFilter *filter,
+    FFVADeinterlaceMethod method)
+{
+    if (!filter || !is_valid_deinterlace_method(method))
+        return false;
+    if (method == FFVA_DEINTERLACE_METHOD_NONE)
+        return true;
+
+#if USE_VA_VPP
+    ensure_filter_caps(filter);
+    return (filter->deinterlace_methods & (1U << method)) != 0;
+#endif
+    return false;
+}
+
+// Sets the deinterlacing method to use for interlaced source surfaces
+int
+ffva_filter_set_deinterlace_method(FFVAFilter *filter,
+    FFVADeinterlaceMethod method)
+{
+    if (!filter || !is_valid_deinterlace_method(method))
+        return AVERROR(EINVAL);
+
+    if (!ffva_filter_has_deinterlace_method(filter, method))
+        return AVERROR(ENOTSUP);
+
+#if USE_VA_VPP
+    if (filter->deinterlace_method != method) {
+        filter->deinterlace_method = method;
+        filter->filter_buffers_changed = 1;
+        filter->deinterlace_caps_queried = 0;
+    }
+    return 0;
+#endif
+    return AVERROR(ENOSYS);
+}
+
+// Determines the number of reference surfaces needed for deinterlacing
+int
+ffva_filter_get_deinterlace_references(FFVAFilter *filter,
+    uint32_t *num_forward_refs_ptr, uint32_t *num_backward_refs_ptr)
+{
+    if (!filter)
+        return AVERROR(EINVAL);
+
+#if USE_VA_VPP
+    if (!ensure_deinterlace_caps(filter))
+        return AVERROR(EIO);
+    if (num_forward_refs_ptr)
+        *num_forward_refs_ptr = filter->deinterlace_num_forward_refs;
+    if (num_backward_refs_ptr)
+        *num_backward_refs_ptr = filter->deinterlace_num_backward_refs;
+    return 0;
+#endif
+    return AVERROR(ENOSYS);
+}
+
+// Sets the past and future surfaces to use as references for deinterlacing
+int
+ffva_filter_set_references(FFVAFilter *filter,
+    FFVASurface **forward_refs, uint32_t num_forward_refs,
+    FFVASurface **backward_refs, uint32_t num_backward_refs)
+{
+#if USE_VA_VPP
+    uint32_t i;
+#endif
+
+    if (!filter)
+        return AVERROR(EINVAL);
+    if (num_forward_refs > FFVA_FILTER_MAX_REFERENCES ||
+        num_backward_refs > FFVA_FILTER_MAX_REFERENCES)
+        return AVERROR(ERANGE);
+    if ((num_forward_refs > 0 && !forward_refs) ||
+        (num_backward_refs > 0 && !backward_refs))
+        return AVERROR(EINVAL);
+
+#if USE_VA_VPP
+    for (i = 0; i < num_forward_refs; i++)
+        filter->forward_refs[i] = forward_refs[i]->id;
+    filter->num_forward_refs = num_forward_refs;
+
+    for (i = 0; i < num_backward_refs; i++)
+        filter->backward_refs[i] = backward_refs[i]->id;
+    filter->num_backward_refs = num_backward_refs;
+    return 0;
+#endif
+    return AVERROR(ENOSYS);
+}
@@ -28,8 +28,64 @@
 #include "ffvasurface.h"
 
 typedef struct ffva_filter_s            FFVAFilter;
+typedef struct ffva_filter_op_range_s   FFVAFilterOpRange;
+typedef struct ffva_filter_layer_s      FFVAFilterLayer;
 
-/** Creates a new filter instance */
+/** Maximum number of layers for ffva_filter_compose() */
+#define FFVA_FILTER_MAX_LAYERS 16
+
+/** Maximum number of reference surfaces, in either direction */
+#define FFVA_FILTER_MAX_REFERENCES 4
+
+/** Additional flags to ffva_filter_process(), on top of VA filter flags */
+enum {
+    /** The source surface holds an interlaced frame, bottom field first */
+    FFVA_FILTER_FLAG_BOTTOM_FIELD_FIRST = 1 << 24,
+};
+
+/** Video processing operations that are controlled by a single value */
+typedef enum {
+    FFVA_FILTER_OP_DENOISE = 1,
+    FFVA_FILTER_OP_SHARPEN,
+    FFVA_FILTER_OP_HUE,
+    FFVA_FILTER_OP_SATURATION,
+    FFVA_FILTER_OP_BRIGHTNESS,
+    FFVA_FILTER_OP_CONTRAST,
+} FFVAFilterOp;
+
+/** Number of single-valued operations, i.e. the last FFVAFilterOp + 1 */
+#define FFVA_FILTER_OP_COUNT (FFVA_FILTER_OP_CONTRAST + 1)
+
+/** Deinterlacing algorithms */
+typedef enum {
+    FFVA_DEINTERLACE_METHOD_NONE = 0,
+    FFVA_DEINTERLACE_METHOD_BOB,
+    FFVA_DEINTERLACE_METHOD_WEAVE,
+    FFVA_DEINTERLACE_METHOD_MOTION_ADAPTIVE,
+    FFVA_DEINTERLACE_METHOD_MOTION_COMPENSATED,
+} FFVADeinterlaceMethod;
+
+/** Range of values accepted by a video processing operation */
+struct ffva_filter_op_range_s {
+    float min_value;
+    float max_value;
+    float default_value;
+    float step;
+};
+
+/** Source surface to compose into a region of the destination surface */
+struct ffva_filter_layer_s {
+    FFVASurface *surface;
+    const VARectangle *crop_rect;       /* NULL for the whole surface */
+    const VARectangle *target_rect;     /* NULL for the whole destination */
+    float alpha;                        /* global alpha, 1.0 for opaque */
+};
+
+/**
+ * Creates a new filter instance. Video processing falls back to the CPU
+ * scaler if the VA driver has no VPP, or if the FFVA_VPP environment
+ * variable is set to 0
+ */
 FFVAFilter *
 ffva_filter_new(FFVADisplay *display);
 
@@ -46,6 +102,11 @@ int
 ffva_filter_process(FFVAFilter *filter, FFVASurface *src_surface,
     FFVASurface *dst_surface, uint32_t flags);
 
+/** Composes the supplied layers, in order, into the destination surface */
+int
+ffva_filter_compose(FFVAFilter *filter, const FFVAFilterLayer *layers,
+    uint32_t num_layers, FFVASurface *dst_surface, uint32_t flags);
+
 /** Determines the set of supported target formats for video processing */
 const int *
 ffva_filter_get_formats(FFVAFilter *filter);
@@ -62,4 +123,42 @@ ffva_filter_set_cropping_rectangle(FFVAFilter *filter, const VARectangle *rect);
 int
 ffva_filter_set_target_rectangle(FFVAFilter *filter, const VARectangle *rect);
 
+/** Checks whether the supplied video processing operation is supported */
+bool
+ffva_filter_has_operation(FFVAFilter *filter, FFVAFilterOp op);
+
+/** Determines the range of values accepted by the supplied operation */
+bool
+ffva_filter_get_operation_range(FFVAFilter *filter, FFVAFilterOp op,
+    FFVAFilterOpRange *range);
+
+/** Enables the supplied video processing operation with the given value */
+int
+ffva_filter_set_operation(FFVAFilter *filter, FFVAFilterOp op, float value);
+
+/** Disables the supplied video processing operation */
+int
+ffva_filter_reset_operation(FFVAFilter *filter, FFVAFilterOp op);
+
+/** Checks whether the supplied deinterlacing method is supported */
+bool
+ffva_filter_has_deinterlace_method(FFVAFilter *filter,
+    FFVADeinterlaceMethod method);
+
+/** Sets the deinterlacing method to use for interlaced source surfaces */
+int
+ffva_filter_set_deinterlace_method(FFVAFilter *filter,
+    FFVADeinterlaceMethod method);
+
+/** Determines the number of reference surfaces needed for deinterlacing */
+int
+ffva_filter_get_deinterlace_references(FFVAFilter *filter,
+    uint32_t *num_forward_refs_ptr, uint32_t *num_backward_refs_ptr);
+
+/** Sets the past and future surfaces to use as references for deinterlacing */
+int
+ffva_filter_set_references(FFVAFilter *filter,
+    FFVASurface **forward_refs, uint32_t num_forward_refs,
+    FFVASurface **backward_refs, uint32_t num_backward_refs);
+
 #endif /* FFVA_FILTER_H */
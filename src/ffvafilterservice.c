@@ -0,0 +1,567 @@
+/*
+ * ffvafilterservice.c - Shared video processing service
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <math.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "ffvafilterservice.h"
+#include "ffvafilter.h"
+#include "ffvadisplay_priv.h"
+#include "ffmpeg_utils.h"
+#include "vaapi_utils.h"
+#include "time_utils.h"
+
+/* Default number of VPP contexts of the display-wide service */
+#define FFVA_FILTER_SERVICE_DEFAULT_LANES 2
+
+/* Maximum number of jobs a lane submits before syncing them */
+#define FFVA_FILTER_SERVICE_MAX_BATCH 8
+
+struct ffva_filter_job_s {
+    FFVAFilterJob *next;
+    FFVASurface *src_surface;
+    FFVASurface *dst_surface;
+    VARectangle src_rect;
+    VARectangle dst_rect;
+    FFVAFilterJobParams params;
+    uint32_t use_src_rect : 1;
+    uint32_t use_dst_rect : 1;
+    uint32_t is_done : 1;
+    uint32_t flags;
+    uint64_t submit_time;
+    int status;
+};
+
+typedef struct {
+    FFVAFilterService *service;
+    FFVAFilter *filter;
+    pthread_mutex_t lock;               /* of the filter and its state */
+    FFVADeinterlaceMethod deinterlace_method;
+    uint32_t has_references : 1;
+    uint32_t has_thread : 1;
+    pthread_t thread;
+} FFVAFilterServiceLane;
+
+struct ffva_filter_service_s {
+    const void *klass;
+    FFVADisplay *display;
+    VADisplay va_display;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;
+    pthread_cond_t done_cond;
+    FFVAFilterJob *queue_head;
+    FFVAFilterJob *queue_tail;
+    FFVAFilterJob *free_jobs;
+    FFVAFilterServiceLane *lanes;
+    uint32_t num_lanes;
+    bool quit;
+    uint32_t queue_depth;
+    uint32_t max_queue_depth;
+    uint64_t num_jobs;
+    uint64_t num_batches;
+    uint64_t total_latency;
+    uint64_t max_latency;
+};
+
+static pthread_mutex_t g_service_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Applies the supplied job params to the lane filter. The deinterlacing
+// method and references are only set once used, as the filter could
+// support neither
+static int
+lane_set_params(FFVAFilterServiceLane *lane, const FFVAFilterJobParams *params)
+{
+    FFVAFilterOp op;
+    int ret;
+
+    ret = ffva_filter_set_format(lane->filter, params->pix_fmt);
+    if (ret < 0)
+        return ret;
+
+    for (op = FFVA_FILTER_OP_DENOISE; op < FFVA_FILTER_OP_COUNT; op++) {
+        if (isnan(params->op_values[op]))
+            ret = ffva_filter_reset_operation(lane->filter, op);
+        else
+            ret = ffva_filter_set_operation(lane->filter, op,
+                params->op_values[op]);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (lane->deinterlace_method != params->deinterlace_method) {
+        ret = ffva_filter_set_deinterlace_method(lane->filter,
+            params->deinterlace_method);
+        if (ret < 0)
+            return ret;
+        lane->deinterlace_method = params->deinterlace_method;
+    }
+
+    if (lane->has_references || params->num_forward_refs > 0 ||
+        params->num_backward_refs > 0) {
+        ret = ffva_filter_set_references(lane->filter,
+            (FFVASurface **)params->forward_refs, params->num_forward_refs,
+            (FFVASurface **)params->backward_refs,
+            params->num_backward_refs);
+        if (ret < 0)
+            return ret;
+        lane->has_references = params->num_forward_refs > 0 ||
+            params->num_backward_refs > 0;
+    }
+    return 0;
+}
+
+// Submits the supplied job to the lane's VPP context
+static int
+lane_process_job(FFVAFilterServiceLane *lane, FFVAFilterJob *job)
+{
+    int ret;
+
+    ret = lane_set_params(lane, &job->params);
+    if (ret < 0)
+        return ret;
+
+    ret = ffva_filter_set_cropping_rectangle(lane->filter,
+        job->use_src_rect ? &job->src_rect : NULL);
+    if (ret < 0)
+        return ret;
+
+    ret = ffva_filter_set_target_rectangle(lane->filter,
+        job->use_dst_rect ? &job->dst_rect : NULL);
+    if (ret < 0)
+        return ret;
+
+    return ffva_filter_process(lane->filter, job->src_surface,
+        job->dst_surface, job->flags);
+}
+
+// Processes back-to-back jobs from the service queue in batches. All jobs
+// of a batch are submitted first, then synced, so that the GPU runs them
+// without waiting for the CPU in between
+static void *
+lane_thread(void *arg)
+{
+    FFVAFilterServiceLane * const lane = arg;
+    FFVAFilterService * const service = lane->service;
+    FFVAFilterJob *jobs[FFVA_FILTER_SERVICE_MAX_BATCH];
+    uint32_t i, num_jobs;
+    VAStatus va_status;
+    uint64_t latency;
+
+    pthread_mutex_lock(&service->lock);
+    for (;;) {
+        while (!service->queue_head && !service->quit)
+            pthread_cond_wait(&service->job_cond, &service->lock);
+        if (!service->queue_head)
+            break;
+
+        for (num_jobs = 0; num_jobs < FFVA_FILTER_SERVICE_MAX_BATCH &&
+                 service->queue_head; num_jobs++) {
+            jobs[num_jobs] = service->queue_head;
+            service->queue_head = jobs[num_jobs]->next;
+            service->queue_depth--;
+        }
+        if (!service->queue_head)
+            service->queue_tail = NULL;
+        pthread_mutex_unlock(&service->lock);
+
+        pthread_mutex_lock(&lane->lock);
+        for (i = 0; i < num_jobs; i++)
+            jobs[i]->status = lane_process_job(lane, jobs[i]);
+
+        // The first sync waits for the whole batch, the others are free
+        for (i = 0; i < num_jobs; i++) {
+            if (jobs[i]->status < 0)
+                continue;
+            va_status = vaSyncSurface(service->va_display,
+                jobs[i]->dst_surface->id);
+            if (!va_check_status(va_status, "vaSyncSurface()"))
+                jobs[i]->status = vaapi_to_ffmpeg_error(va_status);
+        }
+        pthread_mutex_unlock(&lane->lock);
+
+        pthread_mutex_lock(&service->lock);
+        for (i = 0; i < num_jobs; i++) {
+            latency = get_time_us() - jobs[i]->submit_time;
+            service->total_latency += latency;
+            if (service->max_latency < latency)
+                service->max_latency = latency;
+            jobs[i]->is_done = 1;
+        }
+        service->num_jobs += num_jobs;
+        service->num_batches++;
+        pthread_cond_broadcast(&service->done_cond);
+    }
+    pthread_mutex_unlock(&service->lock);
+    return NULL;
+}
+
+static FFVAFilterJob *
+job_alloc(FFVAFilterService *service)
+{
+    FFVAFilterJob *job;
+
+    job = service->free_jobs;
+    if (job)
+        service->free_jobs = job->next;
+    else {
+        job = malloc(sizeof(*job));
+        if (!job)
+            return NULL;
+    }
+    memset(job, 0, sizeof(*job));
+    return job;
+}
+
+static void
+job_release(FFVAFilterService *service, FFVAFilterJob *job)
+{
+    job->next = service->free_jobs;
+    service->free_jobs = job;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Interface                                                         --- */
+/* ------------------------------------------------------------------------- */
+
+// Initializes job params with no operation, in the target format
+void
+ffva_filter_job_params_init_defaults(FFVAFilterJobParams *params)
+{
+    uint32_t i;
+
+    if (!params)
+        return;
+
+    memset(params, 0, sizeof(*params));
+    params->pix_fmt = AV_PIX_FMT_NONE;
+    for (i = 0; i < FFVA_FILTER_OP_COUNT; i++)
+        params->op_values[i] = NAN;
+    params->deinterlace_method = FFVA_DEINTERLACE_METHOD_NONE;
+}
+
+static const AVClass *
+ffva_filter_service_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVAFilterService",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Creates a new video processing service with num_lanes VPP contexts
+FFVAFilterService *
+ffva_filter_service_new(FFVADisplay *display, uint32_t num_lanes)
+{
+    FFVAFilterService *service;
+    uint32_t i;
+
+    if (!display || !num_lanes)
+        return NULL;
+
+    service = calloc(1, sizeof(*service));
+    if (!service)
+        return NULL;
+
+    service->klass = ffva_filter_service_class();
+    service->display = display;
+    service->va_display = ffva_display_get_va_display(display);
+    pthread_mutex_init(&service->lock, NULL);
+    pthread_cond_init(&service->job_cond, NULL);
+    pthread_cond_init(&service->done_cond, NULL);
+
+    service->lanes = calloc(num_lanes, sizeof(*service->lanes));
+    if (!service->lanes)
+        goto error;
+    service->num_lanes = num_lanes;
+    for (i = 0; i < num_lanes; i++)
+        pthread_mutex_init(&service->lanes[i].lock, NULL);
+
+    for (i = 0; i < num_lanes; i++) {
+        FFVAFilterServiceLane * const lane = &service->lanes[i];
+
+        lane->service = service;
+        lane->filter = ffva_filter_new(display);
+        if (!lane->filter)
+            goto error_create_filter;
+        if (pthread_create(&lane->thread, NULL, lane_thread, lane) != 0)
+            goto error_create_thread;
+        lane->has_thread = 1;
+    }
+    return service;
+
+    /* ERRORS */
+error_create_filter:
+    av_log(service, AV_LOG_ERROR, "failed to create VPP context for lane %u\n",
+        i);
+    goto error;
+error_create_thread:
+    av_log(service, AV_LOG_ERROR, "failed to create thread for lane %u\n", i);
+error:
+    ffva_filter_service_free(service);
+    return NULL;
+}
+
+// Destroys the supplied video processing service, once all jobs are done
+void
+ffva_filter_service_free(FFVAFilterService *service)
+{
+    FFVAFilterJob *job;
+    uint32_t i;
+
+    if (!service)
+        return;
+
+    pthread_mutex_lock(&service->lock);
+    service->quit = true;
+    pthread_cond_broadcast(&service->job_cond);
+    pthread_mutex_unlock(&service->lock);
+
+    for (i = 0; i < service->num_lanes; i++) {
+        FFVAFilterServiceLane * const lane = &service->lanes[i];
+
+        if (lane->has_thread)
+            pthread_join(lane->thread, NULL);
+        ffva_filter_freep(&lane->filter);
+        pthread_mutex_destroy(&lane->lock);
+    }
+    free(service->lanes);
+
+    if (service->num_jobs > 0)
+        av_log(service, AV_LOG_VERBOSE, "%" PRIu64 " jobs in %" PRIu64
+            " batches, max queue depth %u, latency avg %" PRIu64 " us / max %"
+            PRIu64 " us\n", service->num_jobs, service->num_batches,
+            service->max_queue_depth,
+            service->total_latency / service->num_jobs, service->max_latency);
+
+    while ((job = service->free_jobs) != NULL) {
+        service->free_jobs = job->next;
+        free(job);
+    }
+    pthread_cond_destroy(&service->done_cond);
+    pthread_cond_destroy(&service->job_cond);
+    pthread_mutex_destroy(&service->lock);
+    free(service);
+}
+
+// Releases video processing service and resets the supplied pointer
+void
+ffva_filter_service_freep(FFVAFilterService **service_ptr)
+{
+    if (!service_ptr)
+        return;
+    ffva_filter_service_free(*service_ptr);
+    *service_ptr = NULL;
+}
+
+// Returns the video processing service shared by all display users. A
+// failure to create it is remembered, rather than retried on every call
+FFVAFilterService *
+ffva_filter_service_get(FFVADisplay *display)
+{
+    FFVAFilterService *service;
+
+    if (!display)
+        return NULL;
+
+    pthread_mutex_lock(&g_service_lock);
+    if (!display->filter_service && !display->filter_service_failed) {
+        display->filter_service = ffva_filter_service_new(display,
+            FFVA_FILTER_SERVICE_DEFAULT_LANES);
+        display->filter_service_failed = !display->filter_service;
+    }
+    service = display->filter_service;
+    pthread_mutex_unlock(&g_service_lock);
+    return service;
+}
+
+// Determines the set of supported target formats for video processing.
+// All lanes share the display, hence the capabilities of the first one
+const int *
+ffva_filter_service_get_formats(FFVAFilterService *service)
+{
+    FFVAFilterServiceLane *lane;
+    const int *formats;
+
+    if (!service)
+        return NULL;
+
+    lane = &service->lanes[0];
+    pthread_mutex_lock(&lane->lock);
+    formats = ffva_filter_get_formats(lane->filter);
+    pthread_mutex_unlock(&lane->lock);
+    return formats;
+}
+
+// Checks whether the lanes support the supplied job params
+int
+ffva_filter_service_check_params(FFVAFilterService *service,
+    const FFVAFilterJobParams *params)
+{
+    FFVAFilterServiceLane *lane;
+    int ret;
+
+    if (!service || !params)
+        return AVERROR(EINVAL);
+
+    lane = &service->lanes[0];
+    pthread_mutex_lock(&lane->lock);
+    ret = lane_set_params(lane, params);
+    pthread_mutex_unlock(&lane->lock);
+    return ret;
+}
+
+// Determines the number of reference surfaces needed for deinterlacing
+int
+ffva_filter_service_get_deinterlace_references(FFVAFilterService *service,
+    FFVADeinterlaceMethod method, uint32_t *num_forward_refs_ptr,
+    uint32_t *num_backward_refs_ptr)
+{
+    FFVAFilterServiceLane *lane;
+    int ret = 0;
+
+    if (!service)
+        return AVERROR(EINVAL);
+
+    lane = &service->lanes[0];
+    pthread_mutex_lock(&lane->lock);
+    if (lane->deinterlace_method != method) {
+        ret = ffva_filter_set_deinterlace_method(lane->filter, method);
+        if (ret == 0)
+            lane->deinterlace_method = method;
+    }
+    if (ret == 0)
+        ret = ffva_filter_get_deinterlace_references(lane->filter,
+            num_forward_refs_ptr, num_backward_refs_ptr);
+    pthread_mutex_unlock(&lane->lock);
+    return ret;
+}
+
+// Queues a video processing job, from src_surface into dst_surface
+FFVAFilterJob *
+ffva_filter_service_submit(FFVAFilterService *service,
+    FFVASurface *src_surface, const VARectangle *src_rect,
+    FFVASurface *dst_surface, const VARectangle *dst_rect,
+    const FFVAFilterJobParams *params, uint32_t flags)
+{
+    FFVAFilterJob *job;
+
+    if (!service || !src_surface || !dst_surface)
+        return NULL;
+
+    pthread_mutex_lock(&service->lock);
+    job = job_alloc(service);
+    if (!job)
+        goto error_alloc_job;
+
+    job->src_surface = src_surface;
+    job->dst_surface = dst_surface;
+    if (src_rect) {
+        job->src_rect = *src_rect;
+        job->use_src_rect = 1;
+    }
+    if (dst_rect) {
+        job->dst_rect = *dst_rect;
+        job->use_dst_rect = 1;
+    }
+    if (params)
+        job->params = *params;
+    else
+        ffva_filter_job_params_init_defaults(&job->params);
+    job->flags = flags;
+    job->submit_time = get_time_us();
+
+    if (service->queue_tail)
+        service->queue_tail->next = job;
+    else
+        service->queue_head = job;
+    service->queue_tail = job;
+    if (service->max_queue_depth < ++service->queue_depth)
+        service->max_queue_depth = service->queue_depth;
+    pthread_cond_signal(&service->job_cond);
+    pthread_mutex_unlock(&service->lock);
+    return job;
+
+    /* ERRORS */
+error_alloc_job:
+    av_log(service, AV_LOG_ERROR, "failed to allocate job\n");
+    pthread_mutex_unlock(&service->lock);
+    return NULL;
+}
+
+// Waits for the supplied job to complete, and releases it
+int
+ffva_filter_service_wait(FFVAFilterService *service, FFVAFilterJob *job)
+{
+    int status;
+
+    if (!service || !job)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&service->lock);
+    while (!job->is_done)
+        pthread_cond_wait(&service->done_cond, &service->lock);
+    status = job->status;
+    job_release(service, job);
+    pthread_mutex_unlock(&service->lock);
+    return status;
+}
+
+// Queues a video processing job, and waits for it to complete
+int
+ffva_filter_service_process(FFVAFilterService *service,
+    FFVASurface *src_surface, const VARectangle *src_rect,
+    FFVASurface *dst_surface, const VARectangle *dst_rect,
+    const FFVAFilterJobParams *params, uint32_t flags)
+{
+    FFVAFilterJob *job;
+
+    job = ffva_filter_service_submit(service, src_surface, src_rect,
+        dst_surface, dst_rect, params, flags);
+    if (!job)
+        return AVERROR(ENOMEM);
+    return ffva_filter_service_wait(service, job);
+}
+
+// Returns the queue and latency statistics of the service
+bool
+ffva_filter_service_get_stats(FFVAFilterService *service,
+    FFVAFilterServiceStats *stats)
+{
+    if (!service || !stats)
+        return false;
+
+    pthread_mutex_lock(&service->lock);
+    stats->num_lanes = service->num_lanes;
+    stats->queue_depth = service->queue_depth;
+    stats->max_queue_depth = service->max_queue_depth;
+    stats->num_jobs = service->num_jobs;
+    stats->num_batches = service->num_batches;
+    stats->avg_latency = service->num_jobs > 0 ?
+        service->total_latency / service->num_jobs : 0;
+    stats->max_latency = service->max_latency;
+    pthread_mutex_unlock(&service->lock);
+    return true;
+}
@@ -0,0 +1,127 @@
+/*
+ * ffvafilterservice.h - Shared video processing service
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_FILTER_SERVICE_H
+#define FFVA_FILTER_SERVICE_H
+
+#include <stdint.h>
+#include "ffvadisplay.h"
+#include "ffvasurface.h"
+#include "ffvafilter.h"
+
+typedef struct ffva_filter_service_s    FFVAFilterService;
+typedef struct ffva_filter_job_s        FFVAFilterJob;
+typedef struct ffva_filter_job_params_s FFVAFilterJobParams;
+typedef struct ffva_filter_service_stats_s FFVAFilterServiceStats;
+
+/**
+ * Video processing state of a job, besides its surfaces, rectangles and
+ * VA filter flags. Lanes apply it to their filter before each job, so that
+ * users with different states could share them
+ */
+struct ffva_filter_job_params_s {
+    int pix_fmt;                /* AV_PIX_FMT_NONE for the target format */
+    float op_values[FFVA_FILTER_OP_COUNT];      /* NAN if disabled */
+    FFVADeinterlaceMethod deinterlace_method;
+    FFVASurface *forward_refs[FFVA_FILTER_MAX_REFERENCES];
+    uint32_t num_forward_refs;
+    FFVASurface *backward_refs[FFVA_FILTER_MAX_REFERENCES];
+    uint32_t num_backward_refs;
+};
+
+/** Statistics of the video processing service */
+struct ffva_filter_service_stats_s {
+    uint32_t num_lanes;
+    uint32_t queue_depth;
+    uint32_t max_queue_depth;
+    uint64_t num_jobs;
+    uint64_t num_batches;       /* jobs submitted together, then synced */
+    uint64_t avg_latency;       /* in microseconds */
+    uint64_t max_latency;       /* in microseconds */
+};
+
+/** Initializes job params with no operation, in the target format */
+void
+ffva_filter_job_params_init_defaults(FFVAFilterJobParams *params);
+
+/** Creates a new video processing service with num_lanes VPP contexts */
+FFVAFilterService *
+ffva_filter_service_new(FFVADisplay *display, uint32_t num_lanes);
+
+/** Destroys the supplied video processing service, once all jobs are done */
+void
+ffva_filter_service_free(FFVAFilterService *service);
+
+/** Releases video processing service and resets the supplied pointer */
+void
+ffva_filter_service_freep(FFVAFilterService **service_ptr);
+
+/** Returns the video processing service shared by all display users */
+FFVAFilterService *
+ffva_filter_service_get(FFVADisplay *display);
+
+/** Determines the set of supported target formats for video processing */
+const int *
+ffva_filter_service_get_formats(FFVAFilterService *service);
+
+/**
+ * Checks whether the lanes support the supplied job params, i.e. the
+ * format, the operations and their values, and the deinterlacing method
+ */
+int
+ffva_filter_service_check_params(FFVAFilterService *service,
+    const FFVAFilterJobParams *params);
+
+/** Determines the number of reference surfaces needed for deinterlacing */
+int
+ffva_filter_service_get_deinterlace_references(FFVAFilterService *service,
+    FFVADeinterlaceMethod method, uint32_t *num_forward_refs_ptr,
+    uint32_t *num_backward_refs_ptr);
+
+/**
+ * Queues a video processing job, from src_surface into dst_surface. The
+ * params could be NULL for the defaults, and are copied. The surfaces,
+ * including the references, shall remain valid until the job is done
+ */
+FFVAFilterJob *
+ffva_filter_service_submit(FFVAFilterService *service,
+    FFVASurface *src_surface, const VARectangle *src_rect,
+    FFVASurface *dst_surface, const VARectangle *dst_rect,
+    const FFVAFilterJobParams *params, uint32_t flags);
+
+/** Waits for the supplied job to complete, and releases it */
+int
+ffva_filter_service_wait(FFVAFilterService *service, FFVAFilterJob *job);
+
+/** Queues a video processing job, and waits for it to complete */
+int
+ffva_filter_service_process(FFVAFilterService *service,
+    FFVASurface *src_surface, const VARectangle *src_rect,
+    FFVASurface *dst_surface, const VARectangle *dst_rect,
+    const FFVAFilterJobParams *params, uint32_t flags);
+
+/** Returns the queue and latency statistics of the service */
+bool
+ffva_filter_service_get_stats(FFVAFilterService *service,
+    FFVAFilterServiceStats *stats);
+
+#endif /* FFVA_FILTER_SERVICE_H */
@@ -0,0 +1,126 @@
+/*
+ * ffvaformat.c - Pixel format negotiation
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include "ffvaformat.h"
+#include "ffmpeg_utils.h"
+
+/* Fixed cost of a video processing pass, in the units of pixel costs */
+#define FFVA_FORMAT_FILTER_PASS_COST 16
+
+// Returns the relative memory cost of a pixel in the supplied format, i.e.
+// the number of bits per pixel divided by 2
+uint32_t
+ffva_format_get_pixel_cost(uint32_t fourcc)
+{
+    switch (fourcc) {
+    case VA_FOURCC('Y','8','0','0'):
+        return 4;
+    case VA_FOURCC('N','V','1','2'):
+    case VA_FOURCC('I','4','2','0'):
+    case VA_FOURCC('Y','V','1','2'):
+        return 6;
+    case VA_FOURCC('Y','U','Y','2'):
+    case VA_FOURCC('U','Y','V','Y'):
+    case VA_FOURCC('4','2','2','H'):
+        return 8;
+    case VA_FOURCC('P','0','1','0'):
+        return 12;
+    default:
+        break;
+    }
+    return 16;
+}
+
+// Returns the cost for the renderer to present the supplied format, or 0
+// if the format is not accepted
+static uint32_t
+get_renderer_cost(const FFVAFormatConstraints *constraints, uint32_t fourcc)
+{
+    const FFVAFormatCost *f;
+
+    if (!constraints->renderer_formats)
+        return ffva_format_get_pixel_cost(fourcc);
+
+    for (f = constraints->renderer_formats; f->fourcc != 0; f++) {
+        if (f->fourcc == fourcc)
+            return f->cost > 0 ? f->cost : 1;
+    }
+    return 0;
+}
+
+// Picks the cheapest chain of formats satisfying all constraints
+int
+ffva_format_negotiate(const FFVAFormatConstraints *constraints,
+    FFVAFormatPath *path)
+{
+    const int *pix_fmt;
+    uint32_t fourcc, chroma, cost, renderer_cost;
+
+    if (!constraints || !path)
+        return AVERROR(EINVAL);
+
+    path->use_filter = false;
+    path->fourcc = 0;
+    path->chroma = 0;
+    path->cost = UINT32_MAX;
+
+    // Direct path, decoded surfaces are presented as is
+    if (!constraints->need_filter && (!constraints->required_fourcc ||
+            constraints->required_fourcc == constraints->src_fourcc)) {
+        renderer_cost = get_renderer_cost(constraints,
+            constraints->src_fourcc);
+        if (renderer_cost > 0) {
+            path->fourcc = constraints->src_fourcc;
+            path->cost = renderer_cost;
+        }
+    }
+
+    // Filter path, through any output format the renderer accepts
+    if (!constraints->filter_formats)
+        goto end;
+    for (pix_fmt = constraints->filter_formats; *pix_fmt != AV_PIX_FMT_NONE;
+         pix_fmt++) {
+        if (!ffmpeg_to_vaapi_pix_fmt(*pix_fmt, &fourcc, &chroma))
+            continue;
+        if (constraints->required_fourcc &&
+            constraints->required_fourcc != fourcc)
+            continue;
+
+        renderer_cost = get_renderer_cost(constraints, fourcc);
+        if (renderer_cost == 0)
+            continue;
+
+        cost = FFVA_FORMAT_FILTER_PASS_COST + renderer_cost +
+            ffva_format_get_pixel_cost(constraints->src_fourcc) +
+            ffva_format_get_pixel_cost(fourcc);
+        if (cost < path->cost) {
+            path->use_filter = true;
+            path->fourcc = fourcc;
+            path->chroma = chroma;
+            path->cost = cost;
+        }
+    }
+
+end:
+    return path->cost != UINT32_MAX ? 0 : AVERROR(ENOENT);
+}
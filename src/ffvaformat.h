@@ -0,0 +1,65 @@
+/*
+ * ffvaformat.h - Pixel format negotiation
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_FORMAT_H
+#define FFVA_FORMAT_H
+
+#include <va/va.h>
+
+typedef struct ffva_format_cost_s       FFVAFormatCost;
+typedef struct ffva_format_constraints_s FFVAFormatConstraints;
+typedef struct ffva_format_path_s       FFVAFormatPath;
+
+/** Format accepted by a pipeline stage, and its relative per-pixel cost */
+struct ffva_format_cost_s {
+    uint32_t fourcc;
+    uint32_t cost;
+};
+
+/** Formats accepted by each stage of the decoder -> filter -> renderer
+    chain. A NULL renderer_formats list means any VA surface is accepted */
+struct ffva_format_constraints_s {
+    uint32_t src_fourcc;
+    const int *filter_formats;
+    const FFVAFormatCost *renderer_formats;
+    uint32_t required_fourcc;
+    bool need_filter;
+};
+
+/** Negotiated format path */
+struct ffva_format_path_s {
+    bool use_filter;
+    uint32_t fourcc;
+    uint32_t chroma;
+    uint32_t cost;
+};
+
+/** Returns the relative memory cost of a pixel in the supplied format */
+uint32_t
+ffva_format_get_pixel_cost(uint32_t fourcc);
+
+/** Picks the cheapest chain of formats satisfying all constraints */
+int
+ffva_format_negotiate(const FFVAFormatConstraints *constraints,
+    FFVAFormatPath *path);
+
+#endif /* FFVA_FORMAT_H */
@@ -0,0 +1,249 @@
+/*
+ * ffvakernels.c - CPU kernels selection and row-sliced threading
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <pthread.h>
+#include <unistd.h>
+#include <strings.h>
+#include <libavutil/common.h>
+#include "ffvakernels.h"
+
+typedef struct {
+    FFVASlicePool *pool;
+    uint32_t slice;
+} Worker;
+
+struct ffva_slice_pool_s {
+    const void *klass;
+    uint32_t num_threads;
+    Worker workers[FFVA_SLICE_POOL_MAX_THREADS];
+    pthread_t threads[FFVA_SLICE_POOL_MAX_THREADS];
+    uint32_t num_started_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t task_cond;
+    pthread_cond_t done_cond;
+    FFVASliceFunc task_func;
+    void *task_arg;
+    uint32_t task_seqno;
+    uint32_t num_pending;
+    bool quit;
+};
+
+/* ------------------------------------------------------------------------- */
+/* --- Kernels                                                           --- */
+/* ------------------------------------------------------------------------- */
+
+// Returns the FFVA_CPU_FEATURE_* flags of the running CPU
+uint32_t
+ffva_cpu_get_features(void)
+{
+    uint32_t features = 0;
+
+#if USE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1"))
+        features |= FFVA_CPU_FEATURE_SSE4_1;
+    if (__builtin_cpu_supports("avx2"))
+        features |= FFVA_CPU_FEATURE_AVX2;
+#endif
+#if USE_NEON_KERNELS
+    features |= FFVA_CPU_FEATURE_NEON;
+#endif
+    return features;
+}
+
+// Selects the best kernels for the running CPU, or the ones named by the
+// FFVA_KERNELS environment variable if the CPU supports them
+const FFVAKernelsInfo *
+ffva_kernels_select(const FFVAKernelsInfo *list, uint32_t num_kernels)
+{
+    const uint32_t features = ffva_cpu_get_features();
+    const char * const name = getenv("FFVA_KERNELS");
+    const FFVAKernelsInfo *best = NULL;
+    uint32_t i;
+
+    for (i = 0; i < num_kernels; i++) {
+        const FFVAKernelsInfo * const info = &list[i];
+
+        if ((info->cpu_features & features) != info->cpu_features)
+            continue;
+        if (name && strcasecmp(info->name, name) == 0)
+            return info;
+        if (!best)
+            best = info;
+    }
+    return best;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Threading                                                         --- */
+/* ------------------------------------------------------------------------- */
+
+// Splits size rows into slices, with a multiple of align rows each
+void
+ffva_slice_get_range(uint32_t size, uint32_t align, uint32_t slice,
+    uint32_t num_slices, uint32_t *start_ptr, uint32_t *end_ptr)
+{
+    const uint32_t rows = FFALIGN((size + num_slices - 1) / num_slices, align);
+    const uint32_t start = slice * rows;
+
+    *start_ptr = FFMIN(start, size);
+    *end_ptr = FFMIN(start + rows, size);
+}
+
+static void *
+worker_thread(void *arg)
+{
+    Worker * const worker = arg;
+    FFVASlicePool * const pool = worker->pool;
+    uint32_t seqno = 0;
+    FFVASliceFunc func;
+    void *task_arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->task_seqno == seqno && !pool->quit)
+            pthread_cond_wait(&pool->task_cond, &pool->lock);
+        if (pool->quit)
+            break;
+        seqno = pool->task_seqno;
+        func = pool->task_func;
+        task_arg = pool->task_arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        func(task_arg, worker->slice, pool->num_threads);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->num_pending == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static const AVClass *
+ffva_slice_pool_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVASlicePool",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Creates a new pool of num_threads threads (0 = automatic)
+FFVASlicePool *
+ffva_slice_pool_new(uint32_t num_threads)
+{
+    FFVASlicePool *pool;
+    uint32_t i;
+    long num_cpus;
+
+    if (num_threads == 0) {
+        num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = num_cpus > 0 ? num_cpus : 1;
+    }
+    num_threads = FFMIN(num_threads, FFVA_SLICE_POOL_MAX_THREADS);
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pool->klass = ffva_slice_pool_class();
+    pool->num_threads = num_threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->task_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    for (i = 1; i < num_threads; i++) {
+        Worker * const worker = &pool->workers[i];
+
+        worker->pool = pool;
+        worker->slice = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_thread, worker))
+            goto error_create_thread;
+        pool->num_started_threads = i;
+    }
+    return pool;
+
+    /* ERRORS */
+error_create_thread:
+    av_log(pool, AV_LOG_ERROR, "failed to create worker thread\n");
+    ffva_slice_pool_free(pool);
+    return NULL;
+}
+
+// Stops the threads and destroys the supplied pool
+void
+ffva_slice_pool_free(FFVASlicePool *pool)
+{
+    uint32_t i;
+
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->task_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 1; i <= pool->num_started_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->task_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+// Returns the number of threads, hence of slices, of the pool
+uint32_t
+ffva_slice_pool_get_num_threads(FFVASlicePool *pool)
+{
+    return pool ? pool->num_threads : 0;
+}
+
+// Runs func on all slices, the calling thread processing the first one
+void
+ffva_slice_pool_run(FFVASlicePool *pool, FFVASliceFunc func, void *arg)
+{
+    if (pool->num_threads == 1) {
+        func(arg, 0, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task_func = func;
+    pool->task_arg = arg;
+    pool->num_pending = pool->num_threads - 1;
+    pool->task_seqno++;
+    pthread_cond_broadcast(&pool->task_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    func(arg, 0, pool->num_threads);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->num_pending > 0)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,116 @@
+/*
+ * ffvakernels.h - CPU kernels selection and row-sliced threading
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_KERNELS_H
+#define FFVA_KERNELS_H
+
+#include <stdint.h>
+
+/*
+ * Internal support for the CPU image processing modules, i.e. FFVAScaler
+ * and FFVACopier. Each module provides sets of kernels for several
+ * instruction sets, and the best one the running CPU supports is selected
+ * at run time. The FFVA_KERNELS environment variable could name another
+ * one, e.g. "C", to compare or test kernels. Images are processed in row
+ * slices, in parallel on a pool of threads.
+ */
+
+/* Maximum number of row slices processed in parallel */
+#define FFVA_SLICE_POOL_MAX_THREADS 8
+
+#if defined __GNUC__ && (defined __i386__ || defined __x86_64__)
+# define USE_X86_KERNELS 1
+#else
+# define USE_X86_KERNELS 0
+#endif
+
+#if defined __ARM_NEON || defined __ARM_NEON__
+# define USE_NEON_KERNELS 1
+#else
+# define USE_NEON_KERNELS 0
+#endif
+
+/** CPU features that kernels could require */
+enum {
+    FFVA_CPU_FEATURE_SSE4_1     = 1 << 0,
+    FFVA_CPU_FEATURE_AVX2       = 1 << 1,
+    FFVA_CPU_FEATURE_NEON       = 1 << 2,
+};
+
+typedef struct ffva_kernels_info_s      FFVAKernelsInfo;
+typedef struct ffva_slice_pool_s        FFVASlicePool;
+
+/** A set of kernels, and the CPU features it requires */
+struct ffva_kernels_info_s {
+    const char *name;           /* as matched against FFVA_KERNELS */
+    uint32_t cpu_features;      /* FFVA_CPU_FEATURE_* */
+    const void *kernels;
+};
+
+/** Processes the supplied slice of rows, out of num_slices */
+typedef void (*FFVASliceFunc)(void *arg, uint32_t slice, uint32_t num_slices);
+
+/** Returns the FFVA_CPU_FEATURE_* flags of the running CPU */
+uint32_t
+ffva_cpu_get_features(void);
+
+/**
+ * Selects the first kernels of the list that the CPU supports, or the
+ * ones named by the FFVA_KERNELS environment variable if the CPU supports
+ * them. The list is sorted best first, and ends with kernels that require
+ * no CPU feature
+ */
+const FFVAKernelsInfo *
+ffva_kernels_select(const FFVAKernelsInfo *list, uint32_t num_kernels);
+
+/**
+ * Splits size rows into num_slices slices, with a multiple of align rows
+ * each, and returns the range of the supplied slice. The range could be
+ * empty for the last slices
+ */
+void
+ffva_slice_get_range(uint32_t size, uint32_t align, uint32_t slice,
+    uint32_t num_slices, uint32_t *start_ptr, uint32_t *end_ptr);
+
+/**
+ * Creates a new pool of num_threads threads, or one per CPU if zero, up
+ * to FFVA_SLICE_POOL_MAX_THREADS. The calling thread counts as one
+ */
+FFVASlicePool *
+ffva_slice_pool_new(uint32_t num_threads);
+
+/** Stops the threads and destroys the supplied pool */
+void
+ffva_slice_pool_free(FFVASlicePool *pool);
+
+/** Returns the number of threads, hence of slices, of the pool */
+uint32_t
+ffva_slice_pool_get_num_threads(FFVASlicePool *pool);
+
+/**
+ * Runs func on all slices, one per thread, and waits for them to
+ * complete. The calling thread processes the first slice
+ */
+void
+ffva_slice_pool_run(FFVASlicePool *pool, FFVASliceFunc func, void *arg);
+
+#endif /* FFVA_KERNELS_H */
@@ -0,0 +1,294 @@
+/*
+ * ffvaladder.c - Multi-output scaling ladder
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <inttypes.h>
+#include <libavutil/pixdesc.h>
+#include "ffvaladder.h"
+#include "ffvafilterservice.h"
+#include "ffvasurfacepool.h"
+#include "ffmpeg_utils.h"
+#include "vaapi_utils.h"
+#include "time_utils.h"
+
+/* Number of surfaces per output that could be held by the caller */
+#define FFVA_LADDER_SURFACES_PER_OUTPUT 3
+
+typedef struct {
+    FFVALadderOutput desc;
+    uint32_t fourcc;
+    uint32_t chroma;
+    uint64_t num_frames;
+    uint64_t total_time;
+} FFVALadderOutputState;
+
+struct ffva_ladder_s {
+    const void *klass;
+    FFVADisplay *display;
+    FFVAFilterService *filter_service;
+    FFVASurfacePool *surface_pool;
+    FFVALadderOutputState *outputs;
+    uint32_t num_outputs;
+};
+
+static bool
+has_format(const int *formats, int pix_fmt)
+{
+    const int *p;
+
+    if (formats) {
+        for (p = formats; *p != AV_PIX_FMT_NONE; p++) {
+            if (*p == pix_fmt)
+                return true;
+        }
+    }
+    return false;
+}
+
+static bool
+ladder_init_outputs(FFVALadder *ladder, const FFVALadderOutput *outputs,
+    uint32_t num_outputs)
+{
+    const int *formats = NULL;
+    uint32_t i;
+
+    ladder->outputs = calloc(num_outputs, sizeof(*ladder->outputs));
+    if (!ladder->outputs)
+        return false;
+    ladder->num_outputs = num_outputs;
+
+    for (i = 0; i < num_outputs; i++) {
+        FFVALadderOutputState * const output = &ladder->outputs[i];
+
+        output->desc = outputs[i];
+        if (!output->desc.width || !output->desc.height)
+            goto error_invalid_size;
+
+        if (output->desc.pix_fmt == AV_PIX_FMT_NONE) {
+            output->fourcc = 0;
+            output->chroma = VA_RT_FORMAT_YUV420;
+            continue;
+        }
+
+        if (!formats)
+            formats = ffva_filter_service_get_formats(ladder->filter_service);
+        if (!has_format(formats, output->desc.pix_fmt) ||
+            !ffmpeg_to_vaapi_pix_fmt(output->desc.pix_fmt, &output->fourcc,
+                &output->chroma))
+            goto error_unsupported_format;
+    }
+    return true;
+
+    /* ERRORS */
+error_invalid_size:
+    av_log(ladder, AV_LOG_ERROR, "invalid size for output %u\n", i);
+    return false;
+error_unsupported_format:
+    av_log(ladder, AV_LOG_ERROR, "unsupported format %s for output %u\n",
+        av_get_pix_fmt_name(outputs[i].pix_fmt), i);
+    return false;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Interface                                                         --- */
+/* ------------------------------------------------------------------------- */
+
+static const AVClass *
+ffva_ladder_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVALadder",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Creates a new scaling ladder producing the supplied set of outputs
+FFVALadder *
+ffva_ladder_new(FFVADisplay *display, const FFVALadderOutput *outputs,
+    uint32_t num_outputs)
+{
+    FFVALadder *ladder;
+
+    if (!display || !outputs || !num_outputs)
+        return NULL;
+
+    ladder = calloc(1, sizeof(*ladder));
+    if (!ladder)
+        return NULL;
+
+    ladder->klass = ffva_ladder_class();
+    ladder->display = display;
+
+    ladder->filter_service = ffva_filter_service_get(display);
+    if (!ladder->filter_service)
+        goto error;
+
+    if (!ladder_init_outputs(ladder, outputs, num_outputs))
+        goto error;
+
+    ladder->surface_pool = ffva_surface_pool_new(display,
+        num_outputs * FFVA_LADDER_SURFACES_PER_OUTPUT);
+    if (!ladder->surface_pool)
+        goto error;
+    return ladder;
+
+error:
+    ffva_ladder_free(ladder);
+    return NULL;
+}
+
+// Destroys the supplied scaling ladder
+void
+ffva_ladder_free(FFVALadder *ladder)
+{
+    if (!ladder)
+        return;
+
+    ffva_surface_pool_freep(&ladder->surface_pool);
+    free(ladder->outputs);
+    free(ladder);
+}
+
+// Releases scaling ladder and resets the supplied pointer to NULL
+void
+ffva_ladder_freep(FFVALadder **ladder_ptr)
+{
+    if (!ladder_ptr)
+        return;
+    ffva_ladder_free(*ladder_ptr);
+    *ladder_ptr = NULL;
+}
+
+// Returns the number of outputs of the scaling ladder
+uint32_t
+ffva_ladder_get_num_outputs(FFVALadder *ladder)
+{
+    return ladder ? ladder->num_outputs : 0;
+}
+
+// Produces all the outputs of the ladder from the supplied source surface.
+// Each output is waited for before the next one is submitted, so that its
+// cost, from submission to completion, is accounted for on its own. This
+// also keeps the outputs out of the service batches of other users
+int
+ffva_ladder_process(FFVALadder *ladder, FFVASurface *src_surface,
+    const VARectangle *src_rect, FFVASurface **out_surfaces)
+{
+    uint64_t start_time, end_time;
+    uint32_t i, num_surfaces = 0;
+    int ret;
+
+    if (!ladder || !src_surface || !out_surfaces)
+        return AVERROR(EINVAL);
+
+    for (i = 0; i < ladder->num_outputs; i++) {
+        FFVALadderOutputState * const output = &ladder->outputs[i];
+        FFVASurface *s;
+
+        s = ffva_surface_pool_acquire(ladder->surface_pool, output->fourcc,
+            output->chroma, output->desc.width, output->desc.height);
+        if (!s)
+            goto error_acquire_surface;
+        out_surfaces[num_surfaces++] = s;
+
+        start_time = get_time_us();
+        ret = ffva_filter_service_process(ladder->filter_service,
+            src_surface, src_rect, s, NULL, NULL, output->desc.flags);
+        if (ret < 0)
+            goto error_process;
+
+        end_time = get_time_us();
+        output->num_frames++;
+        output->total_time += end_time - start_time;
+    }
+    return 0;
+
+    /* ERRORS */
+error_acquire_surface:
+    ret = AVERROR(ENOMEM);
+    goto error_cleanup;
+error_process:
+    av_log(ladder, AV_LOG_ERROR, "failed to produce output %u\n", i);
+error_cleanup:
+    for (i = 0; i < num_surfaces; i++) {
+        ffva_surface_pool_release(ladder->surface_pool, out_surfaces[i]);
+        out_surfaces[i] = NULL;
+    }
+    return ret;
+}
+
+// Releases an output surface produced by ffva_ladder_process()
+void
+ffva_ladder_release_surface(FFVALadder *ladder, FFVASurface *surface)
+{
+    if (!ladder)
+        return;
+    ffva_surface_pool_release(ladder->surface_pool, surface);
+}
+
+// Returns the throughput statistics of the supplied output
+bool
+ffva_ladder_get_stats(FFVALadder *ladder, uint32_t index,
+    FFVALadderStats *stats)
+{
+    const FFVALadderOutputState *output;
+    double seconds;
+
+    if (!ladder || index >= ladder->num_outputs || !stats)
+        return false;
+
+    output = &ladder->outputs[index];
+    stats->num_frames = output->num_frames;
+    stats->total_time = output->total_time;
+    seconds = output->total_time / 1000000.0;
+    stats->frames_per_second = seconds > 0 ?
+        output->num_frames / seconds : 0.0;
+    stats->pixels_per_second = stats->frames_per_second *
+        output->desc.width * output->desc.height;
+    return true;
+}
+
+// Prints out the throughput statistics of all outputs
+void
+ffva_ladder_report(FFVALadder *ladder)
+{
+    FFVALadderStats stats;
+    uint32_t i;
+
+    if (!ladder)
+        return;
+
+    for (i = 0; i < ladder->num_outputs; i++) {
+        const FFVALadderOutput * const desc = &ladder->outputs[i].desc;
+
+        if (!ffva_ladder_get_stats(ladder, i, &stats))
+            continue;
+        av_log(ladder, AV_LOG_INFO, "output %u (%ux%u %s): %" PRIu64
+            " frames, %.1f fps, %.1f Mpixels/s\n", i, desc->width,
+            desc->height, desc->pix_fmt == AV_PIX_FMT_NONE ? "default" :
+            av_get_pix_fmt_name(desc->pix_fmt), stats.num_frames,
+            stats.frames_per_second, stats.pixels_per_second / 1e6);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * ffvaladder.h - Multi-output scaling ladder
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_LADDER_H
+#define FFVA_LADDER_H
+
+#include <stdint.h>
+#include "ffvadisplay.h"
+#include "ffvasurface.h"
+
+typedef struct ffva_ladder_s            FFVALadder;
+typedef struct ffva_ladder_output_s     FFVALadderOutput;
+typedef struct ffva_ladder_stats_s      FFVALadderStats;
+
+/** Description of an output of the scaling ladder */
+struct ffva_ladder_output_s {
+    uint32_t width;
+    uint32_t height;
+    int pix_fmt;                /* AV_PIX_FMT_NONE for the driver default */
+    uint32_t flags;             /* VA filter flags, e.g. scaling mode */
+};
+
+/** Throughput statistics of an output of the scaling ladder */
+struct ffva_ladder_stats_s {
+    uint64_t num_frames;
+    uint64_t total_time;        /* in microseconds */
+    double frames_per_second;
+    double pixels_per_second;
+};
+
+/** Creates a new scaling ladder producing the supplied set of outputs */
+FFVALadder *
+ffva_ladder_new(FFVADisplay *display, const FFVALadderOutput *outputs,
+    uint32_t num_outputs);
+
+/** Destroys the supplied scaling ladder */
+void
+ffva_ladder_free(FFVALadder *ladder);
+
+/** Releases scaling ladder and resets the supplied pointer to NULL */
+void
+ffva_ladder_freep(FFVALadder **ladder_ptr);
+
+/** Returns the number of outputs of the scaling ladder */
+uint32_t
+ffva_ladder_get_num_outputs(FFVALadder *ladder);
+
+/**
+ * Produces all the outputs of the ladder from the supplied source surface,
+ * one after the other so that the cost of each output is measured on its
+ * own. The output surfaces have to be released by the caller
+ */
+int
+ffva_ladder_process(FFVALadder *ladder, FFVASurface *src_surface,
+    const VARectangle *src_rect, FFVASurface **out_surfaces);
+
+/** Releases an output surface produced by ffva_ladder_process() */
+void
+ffva_ladder_release_surface(FFVALadder *ladder, FFVASurface *surface);
+
+/** Returns the throughput statistics of the supplied output */
+bool
+ffva_ladder_get_stats(FFVALadder *ladder, uint32_t index,
+    FFVALadderStats *stats);
+
+/** Prints out the throughput statistics of all outputs */
+void
+ffva_ladder_report(FFVALadder *ladder);
+
+#endif /* FFVA_LADDER_H */
@@ -0,0 +1,152 @@
+/*
+ * ffvamailbox.c - Latest-item-wins mailbox
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <pthread.h>
+#include "ffvamailbox.h"
+
+struct ffva_mailbox_s {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    void *item;
+    bool is_closed;
+    FFVAMailboxReleaseFunc release_func;
+    void *release_data;
+    uint64_t num_posted;
+    uint64_t num_replaced;
+};
+
+// Creates a new mailbox
+FFVAMailbox *
+ffva_mailbox_new(FFVAMailboxReleaseFunc release_func, void *user_data)
+{
+    FFVAMailbox *mailbox;
+
+    mailbox = calloc(1, sizeof(*mailbox));
+    if (!mailbox)
+        return NULL;
+
+    pthread_mutex_init(&mailbox->lock, NULL);
+    pthread_cond_init(&mailbox->cond, NULL);
+    mailbox->release_func = release_func;
+    mailbox->release_data = user_data;
+    return mailbox;
+}
+
+// Destroys the supplied mailbox, releasing any item left in it
+void
+ffva_mailbox_free(FFVAMailbox *mailbox)
+{
+    if (!mailbox)
+        return;
+
+    if (mailbox->item && mailbox->release_func)
+        mailbox->release_func(mailbox->release_data, mailbox->item);
+    pthread_cond_destroy(&mailbox->cond);
+    pthread_mutex_destroy(&mailbox->lock);
+    free(mailbox);
+}
+
+// Releases mailbox and resets the supplied pointer to NULL
+void
+ffva_mailbox_freep(FFVAMailbox **mailbox_ptr)
+{
+    if (!mailbox_ptr)
+        return;
+    ffva_mailbox_free(*mailbox_ptr);
+    *mailbox_ptr = NULL;
+}
+
+// Posts an item, replacing any previous one
+bool
+ffva_mailbox_post(FFVAMailbox *mailbox, void *item)
+{
+    void *old_item;
+
+    if (!mailbox || !item)
+        return false;
+
+    pthread_mutex_lock(&mailbox->lock);
+    if (mailbox->is_closed) {
+        pthread_mutex_unlock(&mailbox->lock);
+        return false;
+    }
+    old_item = mailbox->item;
+    mailbox->item = item;
+    mailbox->num_posted++;
+    if (old_item)
+        mailbox->num_replaced++;
+    pthread_cond_signal(&mailbox->cond);
+    pthread_mutex_unlock(&mailbox->lock);
+
+    // Release outside of the lock, this could take a while
+    if (old_item && mailbox->release_func)
+        mailbox->release_func(mailbox->release_data, old_item);
+    return true;
+}
+
+// Takes the latest item, waiting until one is posted
+void *
+ffva_mailbox_take(FFVAMailbox *mailbox)
+{
+    void *item;
+
+    if (!mailbox)
+        return NULL;
+
+    pthread_mutex_lock(&mailbox->lock);
+    while (!mailbox->item && !mailbox->is_closed)
+        pthread_cond_wait(&mailbox->cond, &mailbox->lock);
+    item = mailbox->item;
+    mailbox->item = NULL;
+    pthread_mutex_unlock(&mailbox->lock);
+    return item;
+}
+
+// Closes the mailbox
+void
+ffva_mailbox_close(FFVAMailbox *mailbox)
+{
+    if (!mailbox)
+        return;
+
+    pthread_mutex_lock(&mailbox->lock);
+    mailbox->is_closed = true;
+    pthread_cond_broadcast(&mailbox->cond);
+    pthread_mutex_unlock(&mailbox->lock);
+}
+
+// Returns the number of items posted, and replaced before being taken
+void
+ffva_mailbox_get_counts(FFVAMailbox *mailbox, uint64_t *num_posted_ptr,
+    uint64_t *num_replaced_ptr)
+{
+    if (!mailbox)
+        return;
+
+    pthread_mutex_lock(&mailbox->lock);
+    if (num_posted_ptr)
+        *num_posted_ptr = mailbox->num_posted;
+    if (num_replaced_ptr)
+        *num_replaced_ptr = mailbox->num_replaced;
+    pthread_mutex_unlock(&mailbox->lock);
+}
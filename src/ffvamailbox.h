@@ -0,0 +1,72 @@
+/*
+ * ffvamailbox.h - Latest-item-wins mailbox
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_MAILBOX_H
+#define FFVA_MAILBOX_H
+
+#include <stdint.h>
+
+/*
+ * A mailbox hands items over from one producer thread to one consumer
+ * thread through a single slot. Posting an item replaces, and releases,
+ * the one that was not taken yet, so that the consumer always gets the
+ * latest item and the producer never blocks.
+ */
+
+typedef struct ffva_mailbox_s           FFVAMailbox;
+
+/** Releases an item that was replaced before it could be taken */
+typedef void (*FFVAMailboxReleaseFunc)(void *user_data, void *item);
+
+/** Creates a new mailbox */
+FFVAMailbox *
+ffva_mailbox_new(FFVAMailboxReleaseFunc release_func, void *user_data);
+
+/** Destroys the supplied mailbox, releasing any item left in it */
+void
+ffva_mailbox_free(FFVAMailbox *mailbox);
+
+/** Releases mailbox and resets the supplied pointer to NULL */
+void
+ffva_mailbox_freep(FFVAMailbox **mailbox_ptr);
+
+/** Posts an item, replacing any previous one. Returns false if closed */
+bool
+ffva_mailbox_post(FFVAMailbox *mailbox, void *item);
+
+/**
+ * Takes the latest item, waiting until one is posted. Returns NULL once
+ * the mailbox is closed and empty
+ */
+void *
+ffva_mailbox_take(FFVAMailbox *mailbox);
+
+/** Closes the mailbox: no more items are accepted, and takers wake up */
+void
+ffva_mailbox_close(FFVAMailbox *mailbox);
+
+/** Returns the number of items posted, and replaced before being taken */
+void
+ffva_mailbox_get_counts(FFVAMailbox *mailbox, uint64_t *num_posted_ptr,
+    uint64_t *num_replaced_ptr);
+
+#endif /* FFVA_MAILBOX_H */
@@ -0,0 +1,478 @@
+/*
+ * ffvapacketfile.c - Pre-demuxed packet cache file
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libavformat/avformat.h>
+#include "ffvapacketfile.h"
+#include "ffmpeg_utils.h"
+
+#define PACKET_FILE_MAGIC       "FFVAPKTS"
+#define PACKET_FILE_VERSION     1
+
+// Alignment of every buffer in the file. Buffers are also followed by at
+// least that many zero bytes, which covers the FFmpeg input padding
+#define PACKET_FILE_ALIGNMENT   64
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t alignment;
+    int32_t codec;
+    int32_t profile;
+    int32_t width;
+    int32_t height;
+    int32_t time_base_num;
+    int32_t time_base_den;
+    int32_t frame_rate_num;
+    int32_t frame_rate_den;
+    int64_t duration;
+    uint64_t extradata_offset;
+    uint32_t extradata_size;
+    uint32_t num_packets;
+    uint64_t index_offset;
+} PacketFileHeader;
+
+typedef struct {
+    uint64_t offset;
+    int64_t pts;
+    int64_t dts;
+    int64_t duration;
+    uint32_t size;
+    uint32_t flags;
+} PacketFileEntry;
+
+typedef struct {
+    const void *klass;
+    FILE *fp;
+    uint64_t offset;
+    PacketFileEntry *entries;
+    uint32_t num_entries;
+    uint32_t max_entries;
+    int64_t min_pts;
+    int64_t max_pts;
+} PacketFileWriter;
+
+struct ffva_packet_file_s {
+    const void *klass;
+    uint8_t *data;
+    size_t size;
+    const PacketFileHeader *header;
+    const PacketFileEntry *entries;
+    bool is_padded;
+};
+
+static const AVClass *
+ffva_packet_file_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVAPacketFile",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Writer                                                           --- */
+/* ------------------------------------------------------------------------ */
+
+// Returns the error of the last failed I/O call. Short writes do not always
+// set errno, so that an I/O error is reported instead
+static inline int
+get_io_error(void)
+{
+    return errno ? AVERROR(errno) : AVERROR(EIO);
+}
+
+// Writes the supplied buffer at the current offset, followed by zeros up to
+// the next aligned offset, with at least PACKET_FILE_ALIGNMENT bytes
+static bool
+writer_write_buffer(PacketFileWriter *w, const void *data, uint32_t size)
+{
+    static const uint8_t zeros[2 * PACKET_FILE_ALIGNMENT];
+    uint32_t pad_size;
+
+    errno = 0;
+    pad_size = 2 * PACKET_FILE_ALIGNMENT - size % PACKET_FILE_ALIGNMENT;
+    if (size > 0 && fwrite(data, size, 1, w->fp) != 1)
+        return false;
+    if (fwrite(zeros, pad_size, 1, w->fp) != 1)
+        return false;
+    w->offset += size + pad_size;
+    return true;
+}
+
+// Appends the supplied packet, and records it into the offset table
+static int
+writer_add_packet(PacketFileWriter *w, const AVPacket *packet)
+{
+    PacketFileEntry *entry;
+    unsigned int size;
+    void *mem;
+
+    if (w->num_entries == w->max_entries) {
+        size = w->max_entries * sizeof(*w->entries);
+        w->max_entries = w->max_entries ? 2 * w->max_entries : 1024;
+        mem = av_fast_realloc(w->entries, &size,
+            w->max_entries * sizeof(*w->entries));
+        if (!mem)
+            return AVERROR(ENOMEM);
+        w->entries = mem;
+    }
+
+    entry = &w->entries[w->num_entries++];
+    entry->offset = w->offset;
+    entry->pts = packet->pts;
+    entry->dts = packet->dts;
+    entry->duration = packet->duration;
+    entry->size = packet->size;
+    entry->flags = 0;
+    if (packet->flags & AV_PKT_FLAG_KEY)
+        entry->flags |= FFVA_DECODER_PACKET_FLAG_KEY;
+
+    if (packet->pts != AV_NOPTS_VALUE) {
+        if (w->min_pts == AV_NOPTS_VALUE || packet->pts < w->min_pts)
+            w->min_pts = packet->pts;
+        if (w->max_pts == AV_NOPTS_VALUE ||
+            packet->pts + packet->duration > w->max_pts)
+            w->max_pts = packet->pts + packet->duration;
+    }
+
+    if (!writer_write_buffer(w, packet->data, packet->size))
+        return get_io_error();
+    return 0;
+}
+
+// Extracts the packets of the first video stream into a packet file
+int
+ffva_packet_file_extract(const char *filename, const char *video_filename)
+{
+    PacketFileWriter writer, * const w = &writer;
+    PacketFileHeader header;
+    AVFormatContext *fmtctx = NULL;
+    AVCodecContext *avctx;
+    AVStream *stream;
+    AVPacket packet;
+    char errbuf[BUFSIZ];
+    int ret;
+
+    if (!filename || !video_filename)
+        return AVERROR(EINVAL);
+
+    memset(w, 0, sizeof(*w));
+    w->klass = ffva_packet_file_class();
+    w->min_pts = AV_NOPTS_VALUE;
+    w->max_pts = AV_NOPTS_VALUE;
+
+    av_register_all();
+    ret = avformat_open_input(&fmtctx, video_filename, NULL, NULL);
+    if (ret != 0)
+        goto error_open_video;
+    ret = avformat_find_stream_info(fmtctx, NULL);
+    if (ret < 0)
+        goto error_open_video;
+    ret = av_find_best_stream(fmtctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (ret < 0)
+        goto error_open_video;
+    stream = fmtctx->streams[ret];
+    avctx = stream->codec;
+
+    w->fp = fopen(filename, "wb");
+    if (!w->fp)
+        goto error_create_file;
+
+    // Reserve space for the header, which is written last
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACKET_FILE_MAGIC, sizeof(header.magic));
+    header.version = PACKET_FILE_VERSION;
+    header.alignment = PACKET_FILE_ALIGNMENT;
+    if (!writer_write_buffer(w, &header, sizeof(header)))
+        goto error_write_file;
+
+    header.codec = avctx->codec_id;
+    header.profile = avctx->profile;
+    header.width = avctx->width;
+    header.height = avctx->height;
+    header.time_base_num = stream->time_base.num;
+    header.time_base_den = stream->time_base.den;
+    header.frame_rate_num = stream->avg_frame_rate.num;
+    header.frame_rate_den = stream->avg_frame_rate.den;
+    header.extradata_offset = w->offset;
+    header.extradata_size = avctx->extradata_size;
+    if (!writer_write_buffer(w, avctx->extradata, avctx->extradata_size))
+        goto error_write_file;
+
+    av_init_packet(&packet);
+    while ((ret = av_read_frame(fmtctx, &packet)) == 0) {
+        if (packet.stream_index == stream->index)
+            ret = writer_add_packet(w, &packet);
+        av_free_packet(&packet);
+        if (ret < 0)
+            goto error_write_packet;
+    }
+    if (ret != AVERROR_EOF)
+        goto error_read_packet;
+
+    header.num_packets = w->num_entries;
+    header.index_offset = w->offset;
+    if (w->min_pts != AV_NOPTS_VALUE)
+        header.duration = w->max_pts - w->min_pts;
+    if (!writer_write_buffer(w, w->entries,
+            w->num_entries * sizeof(*w->entries)))
+        goto error_write_file;
+
+    errno = 0;
+    if (fseek(w->fp, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, w->fp) != 1)
+        goto error_write_file;
+    if (fclose(w->fp) != 0) {
+        w->fp = NULL;
+        goto error_write_file;
+    }
+    w->fp = NULL;
+
+    av_log(w, AV_LOG_INFO, "extracted %u packets to `%s'\n",
+        w->num_entries, filename);
+    ret = 0;
+
+cleanup:
+    if (w->fp)
+        fclose(w->fp);
+    av_free(w->entries);
+    avformat_close_input(&fmtctx);
+    return ret;
+
+    /* ERRORS */
+error_open_video:
+    av_log(w, AV_LOG_ERROR, "failed to open video stream from `%s': %s\n",
+        video_filename, ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_create_file:
+    ret = get_io_error();
+    av_log(w, AV_LOG_ERROR, "failed to create packet file `%s': %s\n",
+        filename, ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_write_file:
+    ret = get_io_error();
+    av_log(w, AV_LOG_ERROR, "failed to write packet file `%s': %s\n",
+        filename, ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_write_packet:
+    av_log(w, AV_LOG_ERROR, "failed to write packet: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_read_packet:
+    av_log(w, AV_LOG_ERROR, "failed to read packet: %s\n",
+        ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Reader                                                           --- */
+/* ------------------------------------------------------------------------ */
+
+// Checks the supplied range lies within the mapped file
+static inline bool
+packet_file_has_range(FFVAPacketFile *pf, uint64_t offset, uint64_t size)
+{
+    return offset <= pf->size && size <= pf->size - offset;
+}
+
+// Validates the file header and offset table
+static bool
+packet_file_check(FFVAPacketFile *pf)
+{
+    const PacketFileHeader *header;
+
+    if (pf->size < sizeof(*header))
+        return false;
+
+    header = (const PacketFileHeader *)pf->data;
+    if (memcmp(header->magic, PACKET_FILE_MAGIC, sizeof(header->magic)) != 0)
+        return false;
+    if (header->version != PACKET_FILE_VERSION)
+        return false;
+    if (header->time_base_num <= 0 || header->time_base_den <= 0)
+        return false;
+    if (!packet_file_has_range(pf, header->extradata_offset,
+            header->extradata_size))
+        return false;
+    if (header->index_offset % sizeof(uint64_t) != 0 ||
+        !packet_file_has_range(pf, header->index_offset,
+            (uint64_t)header->num_packets * sizeof(*pf->entries)))
+        return false;
+
+    pf->header = header;
+    pf->entries = (const PacketFileEntry *)(pf->data + header->index_offset);
+    pf->is_padded = header->alignment >= FF_INPUT_BUFFER_PADDING_SIZE;
+    return true;
+}
+
+// Maps the supplied packet file in memory for reading
+FFVAPacketFile *
+ffva_packet_file_new(const char *filename)
+{
+    FFVAPacketFile *pf;
+    struct stat st;
+    void *data;
+    int fd;
+
+    if (!filename)
+        return NULL;
+
+    pf = calloc(1, sizeof(*pf));
+    if (!pf)
+        return NULL;
+    pf->klass = ffva_packet_file_class();
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        goto error_open_file;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+        goto error_map_file;
+
+    // The mapping remains valid once the file descriptor is closed
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    fd = -1;
+    if (data == MAP_FAILED)
+        goto error_map_file;
+    pf->data = data;
+    pf->size = st.st_size;
+    madvise(pf->data, pf->size, MADV_WILLNEED);
+
+    if (!packet_file_check(pf))
+        goto error_invalid_file;
+    return pf;
+
+    /* ERRORS */
+error_open_file:
+    av_log(pf, AV_LOG_ERROR, "failed to open packet file `%s'\n", filename);
+    ffva_packet_file_free(pf);
+    return NULL;
+error_map_file:
+    av_log(pf, AV_LOG_ERROR, "failed to map packet file `%s'\n", filename);
+    if (fd >= 0)
+        close(fd);
+    ffva_packet_file_free(pf);
+    return NULL;
+error_invalid_file:
+    av_log(pf, AV_LOG_ERROR, "invalid packet file `%s'\n", filename);
+    ffva_packet_file_free(pf);
+    return NULL;
+}
+
+// Unmaps and destroys the supplied packet file instance
+void
+ffva_packet_file_free(FFVAPacketFile *pf)
+{
+    if (!pf)
+        return;
+    if (pf->data)
+        munmap(pf->data, pf->size);
+    free(pf);
+}
+
+// Releases packet file instance and resets the supplied pointer to NULL
+void
+ffva_packet_file_freep(FFVAPacketFile **pf_ptr)
+{
+    if (!pf_ptr)
+        return;
+    ffva_packet_file_free(*pf_ptr);
+    *pf_ptr = NULL;
+}
+
+// Fills in the decoder parameters for the stream
+bool
+ffva_packet_file_get_codec_params(FFVAPacketFile *pf,
+    FFVADecoderCodecParams *params)
+{
+    const PacketFileHeader *header;
+
+    if (!pf || !params)
+        return false;
+
+    header = pf->header;
+    memset(params, 0, sizeof(*params));
+    params->codec = header->codec;
+    params->profile = header->profile;
+    params->width = header->width;
+    params->height = header->height;
+    if (header->extradata_size > 0) {
+        params->extradata = pf->data + header->extradata_offset;
+        params->extradata_size = header->extradata_size;
+    }
+    params->time_base.num = header->time_base_num;
+    params->time_base.den = header->time_base_den;
+    params->frame_rate.num = header->frame_rate_num;
+    params->frame_rate.den = header->frame_rate_den;
+    return true;
+}
+
+// Returns the number of packets in the file
+uint32_t
+ffva_packet_file_get_num_packets(FFVAPacketFile *pf)
+{
+    return pf ? pf->header->num_packets : 0;
+}
+
+// Returns the total duration of the stream, in time_base units
+int64_t
+ffva_packet_file_get_duration(FFVAPacketFile *pf)
+{
+    return pf ? pf->header->duration : 0;
+}
+
+// Fills in the packet at the supplied index
+bool
+ffva_packet_file_get_packet(FFVAPacketFile *pf, uint32_t index,
+    FFVADecoderPacket *packet)
+{
+    const PacketFileEntry *entry;
+
+    if (!pf || !packet || index >= pf->header->num_packets)
+        return false;
+
+    entry = &pf->entries[index];
+    if (!packet_file_has_range(pf, entry->offset, entry->size))
+        return false;
+
+    packet->data = pf->data + entry->offset;
+    packet->size = entry->size;
+    packet->pts = entry->pts;
+    packet->dts = entry->dts;
+    packet->duration = entry->duration;
+    packet->flags = entry->flags & FFVA_DECODER_PACKET_FLAG_KEY;
+
+    // Decode straight from the mapping if the zero padding is there
+    if (pf->is_padded && packet_file_has_range(pf, entry->offset,
+            (uint64_t)entry->size + FF_INPUT_BUFFER_PADDING_SIZE))
+        packet->flags |= FFVA_DECODER_PACKET_FLAG_PADDED;
+    return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * ffvapacketfile.h - Pre-demuxed packet cache file
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_PACKET_FILE_H
+#define FFVA_PACKET_FILE_H
+
+#include <stdint.h>
+#include "ffvadecoder.h"
+
+/*
+ * A packet file holds the packets of one video stream, along with their
+ * timestamps and the codec extradata, in a flat layout with an offset
+ * table. It is memory mapped for replay, so that packets are handed over
+ * to the decoder without any parsing or copy. This is a local cache for
+ * benchmarks and soak tests: fields are stored in host byte order, and
+ * codec ids are those of the FFmpeg build that wrote the file.
+ */
+
+typedef struct ffva_packet_file_s       FFVAPacketFile;
+
+/** Extracts the packets of the first video stream into a packet file */
+int
+ffva_packet_file_extract(const char *filename, const char *video_filename);
+
+/** Maps the supplied packet file in memory for reading */
+FFVAPacketFile *
+ffva_packet_file_new(const char *filename);
+
+/** Unmaps and destroys the supplied packet file instance */
+void
+ffva_packet_file_free(FFVAPacketFile *pf);
+
+/** Releases packet file instance and resets the supplied pointer to NULL */
+void
+ffva_packet_file_freep(FFVAPacketFile **pf_ptr);
+
+/**
+ * Fills in the decoder parameters for the stream. The extradata points
+ * into the mapped file, and remains valid until the packet file is freed
+ */
+bool
+ffva_packet_file_get_codec_params(FFVAPacketFile *pf,
+    FFVADecoderCodecParams *params);
+
+/** Returns the number of packets in the file */
+uint32_t
+ffva_packet_file_get_num_packets(FFVAPacketFile *pf);
+
+/**
+ * Returns the total duration of the stream, in time_base units, i.e. the
+ * timestamp offset to apply to packets when the file is replayed in a loop
+ */
+int64_t
+ffva_packet_file_get_duration(FFVAPacketFile *pf);
+
+/**
+ * Fills in the packet at the supplied index. The data points into the
+ * mapped file, and remains valid until the packet file is freed
+ */
+bool
+ffva_packet_file_get_packet(FFVAPacketFile *pf, uint32_t index,
+    FFVADecoderPacket *packet);
+
+#endif /* FFVA_PACKET_FILE_H */
@@ -0,0 +1,681 @@
+/*
+ * ffvaparalleldecoder.c - GOP-parallel decoder
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include "ffvaparalleldecoder.h"
+#include "ffmpeg_compat.h"
+#include "ffmpeg_utils.h"
+#include "time_utils.h"
+
+// Number of segments per worker the stream is split into, at least, so
+// that workers remain busy even if segments decode at different speeds
+#define SEGMENTS_PER_WORKER 4
+
+// Number of segments each worker could decode ahead of the consumer. This
+// bounds the number of frames held in the reorder buffer
+#define SEGMENTS_AHEAD_PER_WORKER 2
+
+// Maximum number of decoded frames a worker holds until the consumer
+// releases them. Each frame holds a surface of the worker decoder, so that
+// the decoder allocates that many surfaces on top of its own. Segments are
+// kept short enough to fit, whenever keyframes allow
+#define MAX_HELD_FRAMES_PER_WORKER 32
+
+typedef struct worker_s Worker;
+
+typedef struct {
+    FFVADecoderFrame base;
+    Worker *worker;
+} HeldFrame;
+
+typedef struct {
+    uint32_t first_packet;
+    uint32_t num_packets;
+    uint32_t num_preroll_packets; /* decoded before, but not delivered */
+    int64_t min_pts;            /* of delivered frames, or AV_NOPTS_VALUE */
+    HeldFrame **frames;
+    uint32_t num_frames;
+    uint32_t max_frames;
+    uint32_t next_frame;
+    bool is_done;
+    int ret;
+} Segment;
+
+struct worker_s {
+    FFVAParallelDecoder *pd;
+    FFVADecoder *decoder;
+    pthread_t thread;
+    bool has_thread;
+    uint64_t busy_time;
+    uint32_t num_held_frames;   /* frames not released by the consumer yet */
+};
+
+struct ffva_parallel_decoder_s {
+    const void *klass;
+    FFVAPacketFile *packet_file;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    Worker *workers;
+    uint32_t num_workers;
+    Segment *segments;
+    uint32_t num_segments;
+    uint32_t max_held_frames;   /* per worker */
+    uint32_t next_segment;      /* next segment to be decoded */
+    uint32_t output_segment;    /* segment frames are delivered from */
+    uint64_t num_released;
+    bool is_started;
+    bool is_stopped;
+    uint64_t start_time;
+    uint64_t end_time;
+    uint64_t num_frames;
+};
+
+static const AVClass *
+ffva_parallel_decoder_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVAParallelDecoder",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Releases a frame that was held in the reorder buffer
+static void
+free_frame(HeldFrame *frame)
+{
+    if (!frame)
+        return;
+#if AV_FEATURE_AVFRAME_REF
+    av_frame_free(&frame->base.frame);
+#endif
+    free(frame);
+}
+
+// Splits the packets into segments starting at keyframes, with at least
+// min_packets each. Returns the number of segments, and fills them in if
+// an array is supplied. The largest segment size is stored in
+// max_packets_ptr.
+//
+// Keyframes may start open GOPs, whose leading frames reference the
+// previous GOP. So each segment but the first is decoded from the
+// previous keyframe on, and the frames that display before its own ones
+// are dropped. This needs timestamps, without which segments start from
+// a clean decoder state, as if all GOPs were closed
+static uint32_t
+split_segments(FFVAPacketFile *pf, AVRational time_base,
+    uint32_t min_packets, Segment *segments, uint32_t *max_packets_ptr)
+{
+    const uint32_t num_packets = ffva_packet_file_get_num_packets(pf);
+    FFVADecoderPacket packet;
+    Segment tmp_seg, *seg = NULL;
+    uint32_t i, last_key = 0, num_segments = 0, max_packets = 0;
+    int64_t pts;
+
+    for (i = 0; i < num_packets; i++) {
+        if (!ffva_packet_file_get_packet(pf, i, &packet))
+            break;
+        if (i == 0 || ((packet.flags & FFVA_DECODER_PACKET_FLAG_KEY) &&
+                seg->num_packets >= min_packets)) {
+            seg = segments ? &segments[num_segments] : &tmp_seg;
+            seg->first_packet = i;
+            seg->num_packets = 0;
+            seg->num_preroll_packets = i - last_key;
+            seg->min_pts = INT64_MAX;
+            num_segments++;
+        }
+        if (packet.flags & FFVA_DECODER_PACKET_FLAG_KEY)
+            last_key = i;
+
+        // Timestamps of frames are in AV_TIME_BASE units, and rounded
+        // the same way by the decoder
+        if (packet.pts == AV_NOPTS_VALUE || seg->min_pts == AV_NOPTS_VALUE)
+            seg->min_pts = AV_NOPTS_VALUE;
+        else {
+            pts = av_rescale_q(packet.pts, time_base, AV_TIME_BASE_Q);
+            seg->min_pts = FFMIN(seg->min_pts, pts);
+        }
+        if (seg->min_pts == AV_NOPTS_VALUE)
+            seg->num_preroll_packets = 0;
+
+        seg->num_packets++;
+        max_packets = FFMAX(max_packets, seg->num_packets);
+    }
+    if (max_packets_ptr)
+        *max_packets_ptr = max_packets;
+    return num_segments;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Workers                                                          --- */
+/* ------------------------------------------------------------------------ */
+
+// Queues a decoded frame into the reorder buffer of the segment
+static int
+worker_queue_frame(Worker *w, Segment *seg, FFVADecoderFrame *dec_frame)
+{
+    FFVAParallelDecoder * const pd = w->pd;
+    HeldFrame *frame, **frames;
+
+#if AV_FEATURE_AVFRAME_REF
+    // Keep the decoded surface alive until the consumer releases it
+    frame = malloc(sizeof(*frame));
+    if (!frame)
+        return AVERROR(ENOMEM);
+    frame->base = *dec_frame;
+    frame->base.frame = av_frame_clone(dec_frame->frame);
+    if (!frame->base.frame) {
+        free(frame);
+        return AVERROR(ENOMEM);
+    }
+    frame->worker = w;
+#else
+    return AVERROR(ENOSYS);
+#endif
+
+    pthread_mutex_lock(&pd->lock);
+    if (seg->num_frames == seg->max_frames) {
+        seg->max_frames = seg->max_frames ? 2 * seg->max_frames : 16;
+        frames = realloc(seg->frames, seg->max_frames * sizeof(*frames));
+        if (!frames) {
+            pthread_mutex_unlock(&pd->lock);
+            free_frame(frame);
+            return AVERROR(ENOMEM);
+        }
+        seg->frames = frames;
+    }
+    seg->frames[seg->num_frames++] = frame;
+    w->num_held_frames++;
+    pthread_cond_broadcast(&pd->cond);
+    pthread_mutex_unlock(&pd->lock);
+    return 0;
+}
+
+// Returns the number of frames the consumer released so far
+static uint64_t
+worker_get_num_released(Worker *w)
+{
+    FFVAParallelDecoder * const pd = w->pd;
+    uint64_t num_released;
+
+    pthread_mutex_lock(&pd->lock);
+    num_released = pd->num_released;
+    pthread_mutex_unlock(&pd->lock);
+    return num_released;
+}
+
+// Waits until the consumer releases another frame, hence maybe a surface.
+// Returns the time spent waiting, in microseconds
+static uint64_t
+worker_wait_release(Worker *w, uint64_t num_released)
+{
+    FFVAParallelDecoder * const pd = w->pd;
+    const uint64_t start_time = get_time_us();
+
+    pthread_mutex_lock(&pd->lock);
+    while (pd->num_released == num_released && !pd->is_stopped)
+        pthread_cond_wait(&pd->cond, &pd->lock);
+    pthread_mutex_unlock(&pd->lock);
+    return get_time_us() - start_time;
+}
+
+// Decodes all packets of the segment, and its preroll packets, from a
+// clean decoder state. Frames of the preroll packets are dropped. The time
+// spent waiting for surfaces is accounted for into wait_time_ptr
+static int
+worker_decode_segment(Worker *w, Segment *seg, uint64_t *wait_time_ptr)
+{
+    FFVAParallelDecoder * const pd = w->pd;
+    const uint32_t first_packet = seg->first_packet - seg->num_preroll_packets;
+    const uint32_t num_packets = seg->num_preroll_packets + seg->num_packets;
+    FFVADecoderPacket packet;
+    FFVADecoderFrame *dec_frame;
+    uint64_t num_released;
+    uint32_t i = 0;
+    int ret;
+
+    ffva_decoder_flush(w->decoder);
+    do {
+        ret = ffva_decoder_get_frame(w->decoder, &dec_frame);
+        if (ret == 0) {
+            if (seg->num_preroll_packets == 0 ||
+                dec_frame->pts >= seg->min_pts)
+                ret = worker_queue_frame(w, seg, dec_frame);
+            ffva_decoder_put_frame(w->decoder, dec_frame);
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN))
+            break;
+
+        // Send the next packet, or drain at the end of the segment
+        num_released = worker_get_num_released(w);
+        if (i < num_packets) {
+            if (!ffva_packet_file_get_packet(pd->packet_file,
+                    first_packet + i, &packet))
+                return AVERROR_INVALIDDATA;
+            ret = ffva_decoder_send_packet(w->decoder, &packet);
+        }
+        else
+            ret = ffva_decoder_send_packet(w->decoder, NULL);
+        if (ret == 0)
+            i++;
+        else if (ret == AVERROR(EAGAIN)) {
+            *wait_time_ptr += worker_wait_release(w, num_released);
+            ret = 0;
+        }
+    } while (ret == 0 && !pd->is_stopped);
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+// Determines whether the worker has to wait before it decodes the next
+// segment, i.e. if it is too far ahead of the consumer, or if the frames
+// it still holds leave too few surfaces for that segment
+static bool
+worker_is_ahead(Worker *w)
+{
+    FFVAParallelDecoder * const pd = w->pd;
+    const uint32_t max_ahead = pd->num_workers * SEGMENTS_AHEAD_PER_WORKER;
+
+    if (pd->is_stopped || pd->next_segment == pd->num_segments)
+        return false;
+    if (pd->next_segment >= pd->output_segment + max_ahead)
+        return true;
+    return w->num_held_frames > 0 && w->num_held_frames +
+        pd->segments[pd->next_segment].num_packets > pd->max_held_frames;
+}
+
+// Decodes segments in order, while staying close enough to the consumer
+static void *
+worker_thread(void *arg)
+{
+    Worker * const w = arg;
+    FFVAParallelDecoder * const pd = w->pd;
+    uint64_t start_time, wait_time;
+    Segment *seg;
+    int ret;
+
+    do {
+        pthread_mutex_lock(&pd->lock);
+        while (worker_is_ahead(w))
+            pthread_cond_wait(&pd->cond, &pd->lock);
+        if (pd->is_stopped || pd->next_segment == pd->num_segments) {
+            pthread_mutex_unlock(&pd->lock);
+            break;
+        }
+        seg = &pd->segments[pd->next_segment++];
+        pthread_mutex_unlock(&pd->lock);
+
+        start_time = get_time_us();
+        wait_time = 0;
+        ret = worker_decode_segment(w, seg, &wait_time);
+
+        pthread_mutex_lock(&pd->lock);
+        w->busy_time += get_time_us() - start_time - wait_time;
+        seg->ret = ret;
+        seg->is_done = true;
+        pthread_cond_broadcast(&pd->cond);
+        pthread_mutex_unlock(&pd->lock);
+    } while (ret == 0);
+    return NULL;
+}
+
+// Stops the workers, and waits for them to terminate
+static void
+stop_workers(FFVAParallelDecoder *pd)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&pd->lock);
+    pd->is_stopped = true;
+    pthread_cond_broadcast(&pd->cond);
+    pthread_mutex_unlock(&pd->lock);
+
+    for (i = 0; i < pd->num_workers; i++) {
+        Worker * const w = &pd->workers[i];
+        if (w->has_thread)
+            pthread_join(w->thread, NULL);
+        w->has_thread = false;
+    }
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Interface                                                        --- */
+/* ------------------------------------------------------------------------ */
+
+static int
+parallel_decoder_init(FFVAParallelDecoder *pd, FFVADisplay *display,
+    FFVAPacketFile *pf, uint32_t num_workers)
+{
+    FFVADecoderCodecParams params;
+    AVRational time_base;
+    uint32_t i, min_packets, max_packets;
+    int ret;
+
+    pd->klass = ffva_parallel_decoder_class();
+    pd->packet_file = pf;
+    pthread_mutex_init(&pd->lock, NULL);
+    pthread_cond_init(&pd->cond, NULL);
+
+#if !AV_FEATURE_AVFRAME_REF
+    goto error_unsupported;
+#endif
+
+    if (!ffva_packet_file_get_codec_params(pf, &params))
+        return AVERROR_INVALIDDATA;
+    time_base = params.time_base;
+    if (time_base.num <= 0 || time_base.den <= 0)
+        time_base = AV_TIME_BASE_Q;
+
+    // Segments as short as keyframes allow fit into the surfaces held by
+    // workers, and leave many more segments than workers
+    min_packets = FFMIN(ffva_packet_file_get_num_packets(pf) /
+        (num_workers * SEGMENTS_PER_WORKER), MAX_HELD_FRAMES_PER_WORKER / 2);
+    pd->num_segments = split_segments(pf, time_base, min_packets, NULL,
+        &max_packets);
+    if (pd->num_segments > 0) {
+        pd->segments = calloc(pd->num_segments, sizeof(*pd->segments));
+        if (!pd->segments)
+            return AVERROR(ENOMEM);
+        split_segments(pf, time_base, min_packets, pd->segments, NULL);
+    }
+
+    pd->max_held_frames = FFMIN(max_packets, MAX_HELD_FRAMES_PER_WORKER);
+    if (max_packets > pd->max_held_frames)
+        av_log(pd, AV_LOG_WARNING, "segments of up to %u frames exceed the "
+            "%u frames a worker holds, their decoding is throttled by the "
+            "consumer\n", max_packets, pd->max_held_frames);
+
+    pd->workers = calloc(num_workers, sizeof(*pd->workers));
+    if (!pd->workers)
+        return AVERROR(ENOMEM);
+    pd->num_workers = num_workers;
+
+    for (i = 0; i < num_workers; i++) {
+        Worker * const w = &pd->workers[i];
+        w->pd = pd;
+        w->decoder = ffva_decoder_new(display);
+        if (!w->decoder)
+            return AVERROR(ENOMEM);
+        if (!display)
+            ffva_decoder_set_flags(w->decoder,
+                FFVA_DECODER_FLAG_SOFTWARE_FALLBACK);
+        ffva_decoder_set_num_extra_surfaces(w->decoder, pd->max_held_frames);
+        ret = ffva_decoder_open_codec(w->decoder, &params);
+        if (ret < 0)
+            return ret;
+    }
+    av_log(pd, AV_LOG_INFO, "decoding %u segments with %u workers\n",
+        pd->num_segments, pd->num_workers);
+    return 0;
+
+    /* ERRORS */
+#if !AV_FEATURE_AVFRAME_REF
+error_unsupported:
+    av_log(pd, AV_LOG_ERROR, "reference counted frames are required\n");
+    return AVERROR(ENOSYS);
+#endif
+}
+
+static void
+parallel_decoder_finalize(FFVAParallelDecoder *pd)
+{
+    uint32_t i, j;
+
+    stop_workers(pd);
+
+    for (i = 0; i < pd->num_segments; i++) {
+        Segment * const seg = &pd->segments[i];
+        for (j = seg->next_frame; j < seg->num_frames; j++)
+            free_frame(seg->frames[j]);
+        free(seg->frames);
+    }
+    free(pd->segments);
+
+    for (i = 0; i < pd->num_workers; i++)
+        ffva_decoder_freep(&pd->workers[i].decoder);
+    free(pd->workers);
+
+    pthread_cond_destroy(&pd->cond);
+    pthread_mutex_destroy(&pd->lock);
+}
+
+// Creates a new parallel decoder for the supplied packet file
+FFVAParallelDecoder *
+ffva_parallel_decoder_new(FFVADisplay *display, FFVAPacketFile *pf,
+    uint32_t num_workers)
+{
+    FFVAParallelDecoder *pd;
+
+    if (!pf || num_workers == 0)
+        return NULL;
+
+    pd = calloc(1, sizeof(*pd));
+    if (!pd)
+        return NULL;
+    if (parallel_decoder_init(pd, display, pf, num_workers) != 0)
+        goto error;
+    return pd;
+
+error:
+    ffva_parallel_decoder_free(pd);
+    return NULL;
+}
+
+// Stops the workers and destroys the supplied parallel decoder
+void
+ffva_parallel_decoder_free(FFVAParallelDecoder *pd)
+{
+    if (!pd)
+        return;
+    parallel_decoder_finalize(pd);
+    free(pd);
+}
+
+// Releases parallel decoder and resets the supplied pointer to NULL
+void
+ffva_parallel_decoder_freep(FFVAParallelDecoder **pd_ptr)
+{
+    if (!pd_ptr)
+        return;
+    ffva_parallel_decoder_free(*pd_ptr);
+    *pd_ptr = NULL;
+}
+
+// Returns some media info from the packet file. All workers decode the
+// same stream, so the first one tells for all of them
+bool
+ffva_parallel_decoder_get_info(FFVAParallelDecoder *pd,
+    FFVADecoderInfo *info)
+{
+    if (!pd || pd->num_workers == 0)
+        return false;
+    return ffva_decoder_get_info(pd->workers[0].decoder, info);
+}
+
+// Sets the number of extra surfaces released frames may hold. Any worker
+// could have decoded them, so each one allocates that many more surfaces
+void
+ffva_parallel_decoder_set_num_extra_surfaces(FFVAParallelDecoder *pd,
+    uint32_t num_surfaces)
+{
+    uint32_t i;
+
+    if (!pd)
+        return;
+    for (i = 0; i < pd->num_workers; i++)
+        ffva_decoder_set_num_extra_surfaces(pd->workers[i].decoder,
+            pd->max_held_frames + num_surfaces);
+}
+
+// Starts the workers
+int
+ffva_parallel_decoder_start(FFVAParallelDecoder *pd)
+{
+    uint32_t i;
+
+    if (!pd)
+        return AVERROR(EINVAL);
+    if (pd->is_started)
+        return 0;
+
+    pd->start_time = get_time_us();
+    pd->is_started = true;
+    for (i = 0; i < pd->num_workers; i++) {
+        Worker * const w = &pd->workers[i];
+        if (pthread_create(&w->thread, NULL, worker_thread, w) != 0)
+            goto error_create_thread;
+        w->has_thread = true;
+    }
+    return 0;
+
+    /* ERRORS */
+error_create_thread:
+    av_log(pd, AV_LOG_ERROR, "failed to create worker thread\n");
+    stop_workers(pd);
+    return AVERROR(EAGAIN);
+}
+
+// Acquires the next decoded frame in stream order
+int
+ffva_parallel_decoder_get_frame(FFVAParallelDecoder *pd,
+    FFVADecoderFrame **out_frame_ptr)
+{
+    HeldFrame *frame = NULL;
+    Segment *seg;
+    int ret;
+
+    if (!pd || !out_frame_ptr)
+        return AVERROR(EINVAL);
+    if (!pd->is_started) {
+        ret = ffva_parallel_decoder_start(pd);
+        if (ret < 0)
+            return ret;
+    }
+
+    pthread_mutex_lock(&pd->lock);
+    do {
+        if (pd->output_segment == pd->num_segments) {
+            if (!pd->end_time)
+                pd->end_time = get_time_us();
+            ret = AVERROR_EOF;
+            break;
+        }
+
+        seg = &pd->segments[pd->output_segment];
+        if (seg->next_frame < seg->num_frames) {
+            frame = seg->frames[seg->next_frame++];
+            pd->num_frames++;
+            ret = 0;
+            break;
+        }
+        if (!seg->is_done) {
+            pthread_cond_wait(&pd->cond, &pd->lock);
+            continue;
+        }
+        if (seg->ret < 0) {
+            ret = seg->ret;
+            break;
+        }
+
+        // Move on to the next segment, which lets another one be decoded
+        free(seg->frames);
+        seg->frames = NULL;
+        seg->num_frames = seg->max_frames = seg->next_frame = 0;
+        pd->output_segment++;
+        pthread_cond_broadcast(&pd->cond);
+    } while (1);
+    pthread_mutex_unlock(&pd->lock);
+
+    *out_frame_ptr = frame ? &frame->base : NULL;
+    return ret;
+}
+
+// Releases the decoded frame, and its surface, back to its decoder
+void
+ffva_parallel_decoder_put_frame(FFVAParallelDecoder *pd,
+    FFVADecoderFrame *frame)
+{
+    HeldFrame * const held_frame = (HeldFrame *)frame;
+
+    if (!pd || !frame)
+        return;
+
+    pthread_mutex_lock(&pd->lock);
+    held_frame->worker->num_held_frames--;
+    pd->num_released++;
+    pthread_cond_broadcast(&pd->cond);
+    pthread_mutex_unlock(&pd->lock);
+
+    free_frame(held_frame);
+}
+
+// Returns the decoding statistics
+bool
+ffva_parallel_decoder_get_stats(FFVAParallelDecoder *pd,
+    FFVAParallelDecoderStats *stats)
+{
+    uint32_t i;
+
+    if (!pd || !stats || !pd->is_started)
+        return false;
+
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&pd->lock);
+    stats->num_workers = pd->num_workers;
+    stats->num_segments = pd->num_segments;
+    stats->num_frames = pd->num_frames;
+    stats->elapsed_time = (pd->end_time ? pd->end_time : get_time_us()) -
+        pd->start_time;
+    for (i = 0; i < pd->num_workers; i++)
+        stats->decode_time += pd->workers[i].busy_time;
+    pthread_mutex_unlock(&pd->lock);
+
+    if (stats->elapsed_time > 0) {
+        stats->frames_per_second = stats->num_frames * 1000000.0 /
+            stats->elapsed_time;
+        stats->utilization = (double)stats->decode_time /
+            stats->elapsed_time;
+    }
+    return true;
+}
+
+// Prints out the decoding statistics
+void
+ffva_parallel_decoder_report(FFVAParallelDecoder *pd)
+{
+    FFVAParallelDecoderStats stats;
+
+    if (!ffva_parallel_decoder_get_stats(pd, &stats))
+        return;
+
+    av_log(pd, AV_LOG_INFO, "decoded %" PRIu64 " frames in %u segments with "
+        "%u workers, in %.2f s: %.2f fps\n", stats.num_frames,
+        stats.num_segments, stats.num_workers,
+        stats.elapsed_time / 1000000.0, stats.frames_per_second);
+    av_log(pd, AV_LOG_INFO, "workers were busy %.2f s, i.e. %.2f of %u "
+        "workers busy on average\n", stats.decode_time / 1000000.0,
+        stats.utilization, stats.num_workers);
+}
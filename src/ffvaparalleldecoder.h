@@ -0,0 +1,114 @@
+/*
+ * ffvaparalleldecoder.h - GOP-parallel decoder
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_PARALLEL_DECODER_H
+#define FFVA_PARALLEL_DECODER_H
+
+#include <stdint.h>
+#include "ffvadecoder.h"
+#include "ffvapacketfile.h"
+
+/*
+ * The parallel decoder splits a packet file into segments that start at
+ * keyframes, and decodes them concurrently on worker threads. Keyframes
+ * may start open GOPs, so each segment is decoded from the keyframe before
+ * it, and the frames of that preroll are dropped. Each worker owns a
+ * decoder, hence a VA context of its own. Decoded frames are held in a
+ * reorder buffer until all frames of the previous segments were delivered,
+ * so that they are acquired in stream order. Workers stay at most a few
+ * segments ahead of the consumer, and each decoder allocates enough
+ * surfaces for the frames its worker holds in the reorder buffer.
+ */
+
+typedef struct ffva_parallel_decoder_s  FFVAParallelDecoder;
+typedef struct ffva_parallel_decoder_stats_s FFVAParallelDecoderStats;
+
+/** Decoding statistics of the parallel decoder */
+struct ffva_parallel_decoder_stats_s {
+    uint32_t num_workers;
+    uint32_t num_segments;
+    uint64_t num_frames;
+    uint64_t elapsed_time;      /* from start to last frame, in us */
+    uint64_t decode_time;       /* total busy time of workers, in us */
+    double frames_per_second;
+    double utilization;         /* decode time over elapsed time, i.e. the
+                                   mean number of busy workers */
+};
+
+/**
+ * Creates a new parallel decoder for the supplied packet file, with the
+ * supplied number of workers. The packet file has to outlive the decoder.
+ * The display could be NULL to decode in software
+ */
+FFVAParallelDecoder *
+ffva_parallel_decoder_new(FFVADisplay *display, FFVAPacketFile *pf,
+    uint32_t num_workers);
+
+/** Stops the workers and destroys the supplied parallel decoder */
+void
+ffva_parallel_decoder_free(FFVAParallelDecoder *pd);
+
+/** Releases parallel decoder and resets the supplied pointer to NULL */
+void
+ffva_parallel_decoder_freep(FFVAParallelDecoder **pd_ptr);
+
+/** Returns some media info from the packet file, as ffva_decoder_get_info() */
+bool
+ffva_parallel_decoder_get_info(FFVAParallelDecoder *pd,
+    FFVADecoderInfo *info);
+
+/**
+ * Sets the number of surfaces to allocate for frames the user keeps
+ * referenced after they are released, e.g. queued for download. This has
+ * to be called before the workers are started
+ */
+void
+ffva_parallel_decoder_set_num_extra_surfaces(FFVAParallelDecoder *pd,
+    uint32_t num_surfaces);
+
+/** Starts the workers */
+int
+ffva_parallel_decoder_start(FFVAParallelDecoder *pd);
+
+/**
+ * Acquires the next decoded frame in stream order, waiting for it to be
+ * decoded. Returns AVERROR_EOF once all frames were delivered
+ */
+int
+ffva_parallel_decoder_get_frame(FFVAParallelDecoder *pd,
+    FFVADecoderFrame **out_frame_ptr);
+
+/** Releases the decoded frame, and its surface, back to its decoder */
+void
+ffva_parallel_decoder_put_frame(FFVAParallelDecoder *pd,
+    FFVADecoderFrame *frame);
+
+/** Returns the decoding statistics */
+bool
+ffva_parallel_decoder_get_stats(FFVAParallelDecoder *pd,
+    FFVAParallelDecoderStats *stats);
+
+/** Prints out the decoding statistics */
+void
+ffva_parallel_decoder_report(FFVAParallelDecoder *pd);
+
+#endif /* FFVA_PARALLEL_DECODER_H */
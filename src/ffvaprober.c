@@ -0,0 +1,872 @@
+/*
+ * ffvaprober.c - Bulk media prober
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <libavformat/avformat.h>
+#include "ffvaprober.h"
+#include "ffmpeg_utils.h"
+#include "vaapi_utils.h"
+#include "time_utils.h"
+
+// Default maximum number of files being read concurrently
+#define DEFAULT_MAX_IO 4
+
+// Maximum size of the JSON members describing a probed file
+#define RESULT_SIZE 512
+
+typedef struct {
+    char *path;
+    bool has_key;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime;              /* in nanoseconds */
+    int64_t size;
+    char *result;               /* JSON members, without the path */
+    bool is_cached;
+    bool is_cacheable;
+    bool is_error;
+    bool is_hw_decodable;
+} ProbeFile;
+
+typedef struct {
+    VAProfile profile;
+    uint32_t rt_formats;        /* VA_RT_FORMAT_* the decoder outputs */
+    uint32_t max_width;         /* or 0 if unknown */
+    uint32_t max_height;        /* or 0 if unknown */
+} ProbeProfile;
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime;
+    int64_t size;
+    char *result;
+} CacheEntry;
+
+struct ffva_prober_s {
+    const void *klass;
+    ProbeProfile *profiles;     /* profiles with a VLD entrypoint */
+    uint32_t num_profiles;
+    uint32_t num_threads;
+    uint32_t max_io;
+    char *cache_filename;
+    CacheEntry *cache;
+    uint32_t num_cache_entries;
+    ProbeFile *files;
+    uint32_t num_files;
+    uint32_t max_files;
+
+    pthread_mutex_t lock;
+    pthread_cond_t io_cond;
+    uint32_t num_io;
+    uint32_t next_file;
+    FILE *out;
+    FFVAProberStats stats;
+};
+
+static const AVClass *
+ffva_prober_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVAProber",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// FFmpeg lock manager, since codecs are opened from several threads
+static int
+lock_manager(void **mutex_ptr, enum AVLockOp op)
+{
+    pthread_mutex_t *mutex = *mutex_ptr;
+
+    switch (op) {
+    case AV_LOCK_CREATE:
+        mutex = malloc(sizeof(*mutex));
+        if (!mutex)
+            return 1;
+        pthread_mutex_init(mutex, NULL);
+        *mutex_ptr = mutex;
+        break;
+    case AV_LOCK_OBTAIN:
+        return pthread_mutex_lock(mutex) != 0;
+    case AV_LOCK_RELEASE:
+        return pthread_mutex_unlock(mutex) != 0;
+    case AV_LOCK_DESTROY:
+        pthread_mutex_destroy(mutex);
+        free(mutex);
+        *mutex_ptr = NULL;
+        break;
+    }
+    return 0;
+}
+
+// Escapes the supplied string for a JSON string, truncating it if needed
+static const char *
+json_escape(const char *str, char *buf, size_t size)
+{
+    size_t n = 0;
+
+    for (; *str && n + 7 < size; str++) {
+        const unsigned char c = *str;
+        if (c == '"' || c == '\\') {
+            buf[n++] = '\\';
+            buf[n++] = c;
+        }
+        else if (c < 0x20)
+            n += snprintf(&buf[n], size - n, "\\u%04x", c);
+        else
+            buf[n++] = c;
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+// Writes out the supplied string as a JSON string
+static void
+json_print_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    for (; *str; str++) {
+        const unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Files                                                            --- */
+/* ------------------------------------------------------------------------ */
+
+// Appends a file to be probed
+static int
+prober_add_file(FFVAProber *prober, const char *path)
+{
+    ProbeFile *files, *file;
+    uint32_t max_files;
+
+    if (prober->num_files == prober->max_files) {
+        max_files = prober->max_files ? 2 * prober->max_files : 256;
+        files = realloc(prober->files, max_files * sizeof(*files));
+        if (!files)
+            return AVERROR(ENOMEM);
+        prober->files = files;
+        prober->max_files = max_files;
+    }
+
+    file = &prober->files[prober->num_files];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(path);
+    if (!file->path)
+        return AVERROR(ENOMEM);
+    prober->num_files++;
+    return 0;
+}
+
+// Appends all files from the supplied directory, and its subdirectories.
+// Hidden entries and symbolic links to directories are skipped
+static int
+prober_add_directory(FFVAProber *prober, const char *path)
+{
+    struct dirent *entry;
+    struct stat st;
+    char *child_path;
+    bool is_dir;
+    DIR *dir;
+    int ret = 0;
+
+    dir = opendir(path);
+    if (!dir)
+        goto error_open_dir;
+
+    while (ret == 0 && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        child_path = malloc(strlen(path) + strlen(entry->d_name) + 2);
+        if (!child_path) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        sprintf(child_path, "%s/%s", path, entry->d_name);
+
+        switch (entry->d_type) {
+        case DT_DIR:
+            is_dir = true;
+            break;
+        case DT_UNKNOWN:
+            is_dir = lstat(child_path, &st) == 0 && S_ISDIR(st.st_mode);
+            break;
+        default:
+            is_dir = false;
+            break;
+        }
+        if (is_dir)
+            ret = prober_add_directory(prober, child_path);
+        else
+            ret = prober_add_file(prober, child_path);
+        free(child_path);
+    }
+    closedir(dir);
+    return ret;
+
+    /* ERRORS */
+error_open_dir:
+    av_log(prober, AV_LOG_WARNING, "failed to open directory `%s'\n", path);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Cache                                                            --- */
+/* ------------------------------------------------------------------------ */
+
+static int
+compare_cache_entries(const void *a, const void *b)
+{
+    const CacheEntry * const ea = a;
+    const CacheEntry * const eb = b;
+
+    if (ea->dev != eb->dev)
+        return ea->dev < eb->dev ? -1 : 1;
+    if (ea->ino != eb->ino)
+        return ea->ino < eb->ino ? -1 : 1;
+    return 0;
+}
+
+// Loads the cache file, i.e. one line per file with its key and result
+static int
+cache_load(FFVAProber *prober, const char *filename)
+{
+    CacheEntry entry, *entries;
+    uint32_t max_entries = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    FILE *fp;
+    int n;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+        return errno == ENOENT ? 0 : AVERROR(errno);
+
+    while ((len = getline(&line, &line_size, fp)) > 0) {
+        if (line[len - 1] == '\n')
+            line[--len] = '\0';
+        n = 0;
+        if (sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNd64 " %" SCNd64 " %n",
+                &entry.dev, &entry.ino, &entry.mtime, &entry.size, &n) != 4 ||
+            n == 0 || line[n] == '\0')
+            continue;
+
+        if (prober->num_cache_entries == max_entries) {
+            max_entries = max_entries ? 2 * max_entries : 1024;
+            entries = realloc(prober->cache, max_entries * sizeof(*entries));
+            if (!entries)
+                break;
+            prober->cache = entries;
+        }
+        entry.result = strdup(&line[n]);
+        if (!entry.result)
+            break;
+        prober->cache[prober->num_cache_entries++] = entry;
+    }
+    free(line);
+    fclose(fp);
+
+    if (prober->num_cache_entries > 0)
+        qsort(prober->cache, prober->num_cache_entries,
+            sizeof(*prober->cache), compare_cache_entries);
+    return 0;
+}
+
+// Looks up the cached result of an unmodified file
+static const char *
+cache_lookup(FFVAProber *prober, const ProbeFile *file)
+{
+    const CacheEntry *entry;
+    CacheEntry key;
+
+    if (!prober->cache)
+        return NULL;
+
+    key.dev = file->dev;
+    key.ino = file->ino;
+    entry = bsearch(&key, prober->cache, prober->num_cache_entries,
+        sizeof(*prober->cache), compare_cache_entries);
+    if (!entry || entry->mtime != file->mtime || entry->size != file->size)
+        return NULL;
+    return entry->result;
+}
+
+// Saves the results of all files probed, replacing the cache file at once
+static int
+cache_save(FFVAProber *prober, const char *filename)
+{
+    char *tmp_filename;
+    uint32_t i;
+    FILE *fp;
+    int ret = 0;
+
+    tmp_filename = malloc(strlen(filename) + 5);
+    if (!tmp_filename)
+        return AVERROR(ENOMEM);
+    sprintf(tmp_filename, "%s.tmp", filename);
+
+    fp = fopen(tmp_filename, "w");
+    if (!fp)
+        goto error_write_file;
+
+    for (i = 0; i < prober->num_files; i++) {
+        const ProbeFile * const file = &prober->files[i];
+        if (!file->has_key || !file->result || !file->is_cacheable)
+            continue;
+        fprintf(fp, "%" PRIu64 " %" PRIu64 " %" PRId64 " %" PRId64 " %s\n",
+            file->dev, file->ino, file->mtime, file->size, file->result);
+    }
+    if (fclose(fp) != 0 || rename(tmp_filename, filename) != 0)
+        goto error_write_file;
+    free(tmp_filename);
+    return 0;
+
+    /* ERRORS */
+error_write_file:
+    ret = AVERROR(errno);
+    av_log(prober, AV_LOG_ERROR, "failed to write cache file `%s'\n",
+        filename);
+    unlink(tmp_filename);
+    free(tmp_filename);
+    return ret;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Probing                                                          --- */
+/* ------------------------------------------------------------------------ */
+
+// Returns the VA chroma format of decoded frames of the supplied pixel
+// format, as the decoder allocates surfaces for. Formats that are not known
+// before decoding are assumed to be 4:2:0
+static uint32_t
+get_rt_format(enum AVPixelFormat pix_fmt)
+{
+    switch (pix_fmt) {
+    case AV_PIX_FMT_GRAY8:
+        return VA_RT_FORMAT_YUV400;
+    case AV_PIX_FMT_YUV420P10:
+        return VA_RT_FORMAT_YUV420_10BPP;
+    case AV_PIX_FMT_YUV422P:
+        return VA_RT_FORMAT_YUV422;
+    case AV_PIX_FMT_YUV444P:
+        return VA_RT_FORMAT_YUV444;
+    default:
+        break;
+    }
+    return VA_RT_FORMAT_YUV420;
+}
+
+// Checks whether the display has a decoder for the supplied codec profile,
+// that supports the chroma format and size of the stream
+static bool
+prober_is_hw_decodable(FFVAProber *prober, const AVCodecContext *avctx)
+{
+    const uint32_t rt_format = get_rt_format(avctx->pix_fmt);
+    VAProfile profiles[FFMPEG_MAX_VA_PROFILES];
+    uint32_t i, j, num_profiles;
+
+    num_profiles = ffmpeg_to_vaapi_profiles(avctx->codec_id, avctx->profile,
+        profiles);
+    for (i = 0; i < num_profiles; i++) {
+        for (j = 0; j < prober->num_profiles; j++) {
+            const ProbeProfile * const p = &prober->profiles[j];
+            if (p->profile != profiles[i] || !(p->rt_formats & rt_format))
+                continue;
+            if ((p->max_width && avctx->width > p->max_width) ||
+                (p->max_height && avctx->height > p->max_height))
+                continue;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Determines whether the probe error is due to the file contents, rather
+// than to the system, hence whether it would happen again
+static bool
+is_persistent_error(int ret)
+{
+    switch (ret) {
+    case AVERROR_INVALIDDATA:
+    case AVERROR_STREAM_NOT_FOUND:
+    case AVERROR_DEMUXER_NOT_FOUND:
+    case AVERROR_DECODER_NOT_FOUND:
+    case AVERROR_PATCHWELCOME:
+        return true;
+    }
+    return false;
+}
+
+// Waits until another file could be read
+static void
+prober_acquire_io(FFVAProber *prober)
+{
+    pthread_mutex_lock(&prober->lock);
+    while (prober->num_io >= prober->max_io)
+        pthread_cond_wait(&prober->io_cond, &prober->lock);
+    prober->num_io++;
+    pthread_mutex_unlock(&prober->lock);
+}
+
+static void
+prober_release_io(FFVAProber *prober)
+{
+    pthread_mutex_lock(&prober->lock);
+    prober->num_io--;
+    pthread_cond_signal(&prober->io_cond);
+    pthread_mutex_unlock(&prober->lock);
+}
+
+// Identifies the container and the first video stream of the file, the
+// same way the decoder does
+static void
+probe_file(FFVAProber *prober, ProbeFile *file)
+{
+    AVFormatContext *fmtctx = NULL;
+    AVCodecContext *avctx;
+    AVStream *stream;
+    char result[RESULT_SIZE], format[64], codec[64], error[128];
+    char errbuf[BUFSIZ];
+    const char *codec_name;
+    const char *cached_result;
+    struct stat st;
+    int ret;
+
+    if (stat(file->path, &st) != 0) {
+        ret = AVERROR(errno);
+        goto error_probe;
+    }
+    file->has_key = true;
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    file->size = st.st_size;
+
+    cached_result = cache_lookup(prober, file);
+    if (cached_result) {
+        file->result = strdup(cached_result);
+        file->is_cached = true;
+        file->is_cacheable = true;
+        file->is_error = strncmp(cached_result, "\"error\"", 7) == 0;
+        file->is_hw_decodable =
+            strstr(cached_result, "\"hw_decodable\":true") != NULL;
+        return;
+    }
+
+    prober_acquire_io(prober);
+    ret = ffmpeg_open_video_stream(&fmtctx, file->path, NULL, &stream);
+    prober_release_io(prober);
+    if (ret < 0)
+        goto error_probe;
+    avctx = stream->codec;
+
+    codec_name = avcodec_get_name(avctx->codec_id);
+    file->is_hw_decodable = prober_is_hw_decodable(prober, avctx);
+    snprintf(result, sizeof(result), "\"format\":\"%s\",\"duration\":%.3f,"
+        "\"codec\":\"%s\",\"profile\":%d,\"width\":%d,\"height\":%d,"
+        "\"frame_rate\":%.3f,\"hw_decodable\":%s",
+        json_escape(fmtctx->iformat->name, format, sizeof(format)),
+        fmtctx->duration != AV_NOPTS_VALUE ?
+        (double)fmtctx->duration / AV_TIME_BASE : 0.0,
+        json_escape(codec_name ? codec_name : "unknown", codec, sizeof(codec)),
+        avctx->profile, avctx->width, avctx->height,
+        stream->avg_frame_rate.den > 0 ? av_q2d(stream->avg_frame_rate) : 0.0,
+        file->is_hw_decodable ? "true" : "false");
+    file->result = strdup(result);
+    file->is_cacheable = true;
+    avformat_close_input(&fmtctx);
+    return;
+
+    /* ERRORS */
+error_probe:
+    snprintf(result, sizeof(result), "\"error\":\"%s\"",
+        json_escape(ffmpeg_strerror(ret, errbuf), error, sizeof(error)));
+    file->result = strdup(result);
+    file->is_error = true;
+    file->is_cacheable = is_persistent_error(ret);
+    if (fmtctx)
+        avformat_close_input(&fmtctx);
+}
+
+// Probes files until there is none left, and writes out the results
+static void *
+prober_thread(void *arg)
+{
+    FFVAProber * const prober = arg;
+    FFVAProberStats * const stats = &prober->stats;
+    ProbeFile *file;
+
+    do {
+        pthread_mutex_lock(&prober->lock);
+        file = NULL;
+        if (prober->next_file < prober->num_files)
+            file = &prober->files[prober->next_file++];
+        pthread_mutex_unlock(&prober->lock);
+        if (!file)
+            break;
+
+        probe_file(prober, file);
+
+        pthread_mutex_lock(&prober->lock);
+        fputs("{\"path\":", prober->out);
+        json_print_string(prober->out, file->path);
+        fprintf(prober->out, ",%s}\n", file->result ? file->result :
+            "\"error\":\"out of memory\"");
+        stats->num_files++;
+        if (file->is_cached)
+            stats->num_cached++;
+        if (file->is_error)
+            stats->num_errors++;
+        if (file->is_hw_decodable)
+            stats->num_hw_decodable++;
+        pthread_mutex_unlock(&prober->lock);
+    } while (1);
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Interface                                                        --- */
+/* ------------------------------------------------------------------------ */
+
+// Fills in the output formats and maximum picture size of the decoder for
+// the supplied VA profile
+static void
+prober_init_profile(ProbeProfile *p, VADisplay va_display)
+{
+    VAConfigAttrib va_attribs[3];
+    VAStatus va_status;
+
+    va_attribs[0].type = VAConfigAttribRTFormat;
+    va_attribs[1].type = VAConfigAttribMaxPictureWidth;
+    va_attribs[2].type = VAConfigAttribMaxPictureHeight;
+    va_status = vaGetConfigAttributes(va_display, p->profile, VAEntrypointVLD,
+        va_attribs, FF_ARRAY_ELEMS(va_attribs));
+    if (!va_check_status(va_status, "vaGetConfigAttributes()"))
+        return;
+
+    // Drivers that cannot tell the output formats decode to 4:2:0
+    p->rt_formats = va_attribs[0].value != VA_ATTRIB_NOT_SUPPORTED ?
+        va_attribs[0].value : VA_RT_FORMAT_YUV420;
+    if (va_attribs[1].value != VA_ATTRIB_NOT_SUPPORTED)
+        p->max_width = va_attribs[1].value;
+    if (va_attribs[2].value != VA_ATTRIB_NOT_SUPPORTED)
+        p->max_height = va_attribs[2].value;
+}
+
+// Determines the set of VA profiles the display could decode, and their
+// capabilities
+static int
+prober_init_profiles(FFVAProber *prober, VADisplay va_display)
+{
+    VAProfile *va_profiles;
+    VAEntrypoint *entrypoints;
+    int i, j, num_profiles, num_entrypoints;
+    VAStatus va_status;
+
+    num_profiles = vaMaxNumProfiles(va_display);
+    va_profiles = malloc(num_profiles * sizeof(*va_profiles));
+    prober->profiles = calloc(num_profiles, sizeof(*prober->profiles));
+    entrypoints = malloc(vaMaxNumEntrypoints(va_display) *
+        sizeof(*entrypoints));
+    if (!va_profiles || !prober->profiles || !entrypoints)
+        goto error_alloc;
+
+    va_status = vaQueryConfigProfiles(va_display, va_profiles, &num_profiles);
+    if (!va_check_status(va_status, "vaQueryConfigProfiles()"))
+        goto error_query;
+
+    for (i = 0; i < num_profiles; i++) {
+        va_status = vaQueryConfigEntrypoints(va_display, va_profiles[i],
+            entrypoints, &num_entrypoints);
+        if (va_status != VA_STATUS_SUCCESS)
+            continue;
+        for (j = 0; j < num_entrypoints; j++) {
+            if (entrypoints[j] == VAEntrypointVLD) {
+                ProbeProfile * const p =
+                    &prober->profiles[prober->num_profiles++];
+                p->profile = va_profiles[i];
+                prober_init_profile(p, va_display);
+                break;
+            }
+        }
+    }
+    free(entrypoints);
+    free(va_profiles);
+    return 0;
+
+    /* ERRORS */
+error_alloc:
+    free(entrypoints);
+    free(va_profiles);
+    return AVERROR(ENOMEM);
+error_query:
+    free(entrypoints);
+    free(va_profiles);
+    return vaapi_to_ffmpeg_error(va_status);
+}
+
+static int
+prober_init(FFVAProber *prober, FFVADisplay *display)
+{
+    long num_cpus;
+    int ret;
+
+    prober->klass = ffva_prober_class();
+    pthread_mutex_init(&prober->lock, NULL);
+    pthread_cond_init(&prober->io_cond, NULL);
+
+    av_register_all();
+    if (av_lockmgr_register(lock_manager) != 0)
+        return AVERROR_UNKNOWN;
+
+    ret = prober_init_profiles(prober, ffva_display_get_va_display(display));
+    if (ret < 0)
+        return ret;
+
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    prober->num_threads = num_cpus > 0 ? num_cpus : 1;
+    prober->max_io = DEFAULT_MAX_IO;
+    return 0;
+}
+
+static void
+prober_finalize(FFVAProber *prober)
+{
+    uint32_t i;
+
+    for (i = 0; i < prober->num_files; i++) {
+        free(prober->files[i].path);
+        free(prober->files[i].result);
+    }
+    free(prober->files);
+
+    for (i = 0; i < prober->num_cache_entries; i++)
+        free(prober->cache[i].result);
+    free(prober->cache);
+    free(prober->cache_filename);
+    free(prober->profiles);
+
+    pthread_cond_destroy(&prober->io_cond);
+    pthread_mutex_destroy(&prober->lock);
+}
+
+// Creates a new prober, for hardware decoding on the supplied display
+FFVAProber *
+ffva_prober_new(FFVADisplay *display)
+{
+    FFVAProber *prober;
+
+    if (!display)
+        return NULL;
+
+    prober = calloc(1, sizeof(*prober));
+    if (!prober)
+        return NULL;
+    if (prober_init(prober, display) != 0)
+        goto error;
+    return prober;
+
+error:
+    ffva_prober_free(prober);
+    return NULL;
+}
+
+// Destroys the supplied prober
+void
+ffva_prober_free(FFVAProber *prober)
+{
+    if (!prober)
+        return;
+    prober_finalize(prober);
+    free(prober);
+}
+
+// Releases prober and resets the supplied pointer to NULL
+void
+ffva_prober_freep(FFVAProber **prober_ptr)
+{
+    if (!prober_ptr)
+        return;
+    ffva_prober_free(*prober_ptr);
+    *prober_ptr = NULL;
+}
+
+// Sets the number of probing threads, and of files read concurrently
+void
+ffva_prober_set_concurrency(FFVAProber *prober, uint32_t num_threads,
+    uint32_t max_io)
+{
+    if (!prober)
+        return;
+
+    if (num_threads > 0)
+        prober->num_threads = num_threads;
+    if (max_io > 0)
+        prober->max_io = max_io;
+}
+
+// Sets the file results are cached into
+int
+ffva_prober_set_cache_file(FFVAProber *prober, const char *filename)
+{
+    if (!prober || !filename)
+        return AVERROR(EINVAL);
+
+    free(prober->cache_filename);
+    prober->cache_filename = strdup(filename);
+    if (!prober->cache_filename)
+        return AVERROR(ENOMEM);
+    return cache_load(prober, filename);
+}
+
+// Adds a file, or all files from a directory and its subdirectories
+int
+ffva_prober_add_path(FFVAProber *prober, const char *path)
+{
+    struct stat st;
+
+    if (!prober || !path)
+        return AVERROR(EINVAL);
+
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        return prober_add_directory(prober, path);
+    return prober_add_file(prober, path);
+}
+
+// Adds the paths listed in a text file, one per line, or from stdin
+int
+ffva_prober_add_list(FFVAProber *prober, const char *filename)
+{
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    FILE *fp;
+    int ret = 0;
+
+    if (!prober || !filename)
+        return AVERROR(EINVAL);
+
+    fp = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+    if (!fp)
+        goto error_open_file;
+
+    while (ret == 0 && (len = getline(&line, &line_size, fp)) > 0) {
+        if (line[len - 1] == '\n')
+            line[--len] = '\0';
+        if (len > 0)
+            ret = ffva_prober_add_path(prober, line);
+    }
+    free(line);
+    if (fp != stdin)
+        fclose(fp);
+    return ret;
+
+    /* ERRORS */
+error_open_file:
+    ret = AVERROR(errno);
+    av_log(prober, AV_LOG_ERROR, "failed to open file list `%s'\n", filename);
+    return ret;
+}
+
+// Probes all files, and writes one JSON object per file to out
+int
+ffva_prober_run(FFVAProber *prober, FILE *out)
+{
+    pthread_t *threads;
+    uint32_t i, num_threads;
+    uint64_t start_time;
+
+    if (!prober || !out)
+        return AVERROR(EINVAL);
+
+    num_threads = FFMIN(prober->num_threads, prober->num_files);
+    threads = calloc(FFMAX(num_threads, 1), sizeof(*threads));
+    if (!threads)
+        return AVERROR(ENOMEM);
+
+    memset(&prober->stats, 0, sizeof(prober->stats));
+    prober->next_file = 0;
+    prober->out = out;
+    start_time = get_time_us();
+
+    for (i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, prober_thread, prober) != 0)
+            break;
+    }
+    if (i == 0 && num_threads > 0)
+        prober_thread(prober);
+    num_threads = i;
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    fflush(out);
+
+    prober->stats.elapsed_time = get_time_us() - start_time;
+    if (prober->cache_filename)
+        return cache_save(prober, prober->cache_filename);
+    return 0;
+}
+
+// Returns the statistics of the last run
+bool
+ffva_prober_get_stats(FFVAProber *prober, FFVAProberStats *stats)
+{
+    if (!prober || !stats)
+        return false;
+
+    *stats = prober->stats;
+    return true;
+}
+
+// Prints out the statistics of the last run
+void
+ffva_prober_report(FFVAProber *prober)
+{
+    FFVAProberStats stats;
+
+    if (!ffva_prober_get_stats(prober, &stats))
+        return;
+
+    av_log(prober, AV_LOG_INFO, "probed %u files in %.2f s: %u from cache, "
+        "%u errors, %u hardware decodable\n", stats.num_files,
+        stats.elapsed_time / 1000000.0, stats.num_cached, stats.num_errors,
+        stats.num_hw_decodable);
+}
@@ -0,0 +1,98 @@
+/*
+ * ffvaprober.h - Bulk media prober
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_PROBER_H
+#define FFVA_PROBER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ffvadisplay.h"
+
+/*
+ * The prober identifies the container and video stream of many files at
+ * once, from a pool of threads, with a bounded number of files being read
+ * at the same time. Each file is checked against the VA profiles that the
+ * display can decode. Results are written out as JSON lines, and could be
+ * cached by (device, inode, mtime, size), so that only new or modified
+ * files are probed again on later scans.
+ */
+
+typedef struct ffva_prober_s            FFVAProber;
+typedef struct ffva_prober_stats_s      FFVAProberStats;
+
+/** Probing statistics */
+struct ffva_prober_stats_s {
+    uint32_t num_files;
+    uint32_t num_cached;        /* results that came from the cache */
+    uint32_t num_errors;
+    uint32_t num_hw_decodable;
+    uint64_t elapsed_time;      /* in microseconds */
+};
+
+/** Creates a new prober, for hardware decoding on the supplied display */
+FFVAProber *
+ffva_prober_new(FFVADisplay *display);
+
+/** Destroys the supplied prober */
+void
+ffva_prober_free(FFVAProber *prober);
+
+/** Releases prober and resets the supplied pointer to NULL */
+void
+ffva_prober_freep(FFVAProber **prober_ptr);
+
+/**
+ * Sets the number of probing threads, and the maximum number of files
+ * being read concurrently. Zero keeps the current value
+ */
+void
+ffva_prober_set_concurrency(FFVAProber *prober, uint32_t num_threads,
+    uint32_t max_io);
+
+/**
+ * Sets the file results are cached into. Existing results are loaded, and
+ * the file is rewritten with the results of the next run
+ */
+int
+ffva_prober_set_cache_file(FFVAProber *prober, const char *filename);
+
+/** Adds a file, or all files from a directory and its subdirectories */
+int
+ffva_prober_add_path(FFVAProber *prober, const char *path);
+
+/** Adds the paths listed in a text file, one per line, or from stdin */
+int
+ffva_prober_add_list(FFVAProber *prober, const char *filename);
+
+/** Probes all files, and writes one JSON object per file to out */
+int
+ffva_prober_run(FFVAProber *prober, FILE *out);
+
+/** Returns the statistics of the last run */
+bool
+ffva_prober_get_stats(FFVAProber *prober, FFVAProberStats *stats);
+
+/** Prints out the statistics of the last run */
+void
+ffva_prober_report(FFVAProber *prober);
+
+#endif /* FFVA_PROBER_H */
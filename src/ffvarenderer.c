@@ -21,8 +21,10 @@
  */
 
 #include "sysdeps.h"
+#include <libavutil/error.h>
 #include "ffvarenderer.h"
 #include "ffvarenderer_priv.h"
+#include "vaapi_trace.h"
 
 FFVARenderer *
 ffva_renderer_new(const FFVARendererClass *klass, FFVADisplay *display,
@@ -113,6 +115,37 @@ ffva_renderer_set_size(FFVARenderer *rnd, uint32_t width, uint32_t height)
     return klass->set_size ? klass->set_size(rnd, width, height) : true;
 }
 
+// Returns the formats the renderer accepts, or NULL if any VA surface is
+const FFVAFormatCost *
+ffva_renderer_get_formats(FFVARenderer *rnd)
+{
+    FFVARendererClass *klass;
+
+    if (!rnd)
+        return NULL;
+
+    klass = FFVA_RENDERER_GET_CLASS(rnd);
+    return klass->get_formats ? klass->get_formats(rnd) : NULL;
+}
+
+// Allocates a pool of VA surfaces backed by renderer-owned memory
+int
+ffva_renderer_create_surfaces(FFVARenderer *rnd, uint32_t chroma,
+    uint32_t width, uint32_t height, VASurfaceID *surfaces,
+    uint32_t num_surfaces)
+{
+    FFVARendererClass *klass;
+
+    if (!rnd || !surfaces || num_surfaces < 1)
+        return AVERROR(EINVAL);
+
+    klass = FFVA_RENDERER_GET_CLASS(rnd);
+    if (!klass->create_surfaces)
+        return AVERROR(ENOSYS);
+    return klass->create_surfaces(rnd, chroma, width, height, surfaces,
+        num_surfaces);
+}
+
 // Submits the supplied surface to the rendering device
 bool
 ffva_renderer_put_surface(FFVARenderer *rnd, FFVASurface *surface,
@@ -144,8 +177,84 @@ ffva_renderer_put_surface(FFVARenderer *rnd, FFVASurface *surface,
     }
 
     klass = FFVA_RENDERER_GET_CLASS(rnd);
-    return klass->put_surface ? klass->put_surface(rnd, surface, src_rect,
-        dst_rect, flags) : true;
+    if (klass->put_surface && !klass->put_surface(rnd, surface, src_rect,
+            dst_rect, flags))
+        goto error_put_surface;
+    if (!klass->release_surfaces)
+        ffva_renderer_release_surface(rnd, surface);
+    va_trace_frame();
+    return true;
+
+    /* ERRORS */
+error_put_surface:
+    if (!klass->release_surfaces)
+        ffva_renderer_release_surface(rnd, surface);
+    return false;
+}
+
+// Sets the function called once the renderer is done with each surface
+void
+ffva_renderer_set_release_func(FFVARenderer *rnd,
+    FFVARendererReleaseFunc func, void *user_data)
+{
+    if (!rnd)
+        return;
+
+    // Surfaces still being read belong to the previous receiver
+    ffva_renderer_release_surfaces(rnd);
+    rnd->release_func = func;
+    rnd->release_data = user_data;
+}
+
+// Waits for the renderer to be done with all the surfaces it still reads
+void
+ffva_renderer_release_surfaces(FFVARenderer *rnd)
+{
+    FFVARendererClass *klass;
+
+    if (!rnd)
+        return;
+
+    klass = FFVA_RENDERER_GET_CLASS(rnd);
+    if (klass->release_surfaces)
+        klass->release_surfaces(rnd);
+}
+
+// Returns the time the GPU spent drawing the last frame, without waiting
+int
+ffva_renderer_get_gpu_time(FFVARenderer *rnd, uint64_t *time_ptr)
+{
+    FFVARendererClass *klass;
+
+    if (!rnd || !time_ptr)
+        return AVERROR(EINVAL);
+
+    klass = FFVA_RENDERER_GET_CLASS(rnd);
+    if (!klass->get_gpu_time)
+        return AVERROR(ENOSYS);
+    return klass->get_gpu_time(rnd, time_ptr);
+}
+
+// Returns the refresh interval of the display the renderer presents to
+bool
+ffva_renderer_get_refresh_interval(FFVARenderer *rnd, uint64_t *interval_ptr)
+{
+    FFVARendererClass *klass;
+
+    if (!rnd || !interval_ptr)
+        return false;
+
+    klass = FFVA_RENDERER_GET_CLASS(rnd);
+    return klass->get_refresh_interval &&
+        klass->get_refresh_interval(rnd, interval_ptr);
+}
+
+// Notifies the user that the renderer no longer reads from surface
+void
+ffva_renderer_release_surface(FFVARenderer *rnd, FFVASurface *surface)
+{
+    if (rnd->release_func && surface)
+        rnd->release_func(rnd->release_data, surface);
 }
 
 // Returns the native display associated to the supplied renderer
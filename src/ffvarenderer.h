@@ -25,12 +25,17 @@
 
 #include "ffvadisplay.h"
 #include "ffvasurface.h"
+#include "ffvaformat.h"
 
 #define FFVA_RENDERER(rnd) \
     ((FFVARenderer *)(rnd))
 
 typedef struct ffva_renderer_s          FFVARenderer;
 
+/** Function called once the renderer no longer reads from a surface */
+typedef void (*FFVARendererReleaseFunc)(void *user_data,
+    FFVASurface *surface);
+
 typedef enum {
     FFVA_RENDERER_TYPE_X11 = 1,
     FFVA_RENDERER_TYPE_EGL,
@@ -58,11 +63,56 @@ ffva_renderer_get_size(FFVARenderer *rnd, uint32_t *width_ptr,
 bool
 ffva_renderer_set_size(FFVARenderer *rnd, uint32_t width, uint32_t height);
 
+/** Returns the formats the renderer accepts, or NULL if any VA surface is */
+const FFVAFormatCost *
+ffva_renderer_get_formats(FFVARenderer *rnd);
+
+/**
+ * Allocates a pool of VA surfaces backed by renderer-owned memory, so that
+ * the decoder could write into buffers that are directly displayable.
+ * Returns AVERROR(ENOSYS) if the renderer has no such memory to offer
+ */
+int
+ffva_renderer_create_surfaces(FFVARenderer *rnd, uint32_t chroma,
+    uint32_t width, uint32_t height, VASurfaceID *surfaces,
+    uint32_t num_surfaces);
+
 /** Submits the supplied surface to the rendering device */
 bool
 ffva_renderer_put_surface(FFVARenderer *rnd, FFVASurface *surface,
     const VARectangle *src_rect, const VARectangle *dst_rect, uint32_t flags);
 
+/**
+ * Sets the function called once the renderer is done with each surface
+ * submitted through ffva_renderer_put_surface(), so that the surface could
+ * be overwritten. Renderers that read surfaces asynchronously call it once
+ * the GPU has completed the frame, other renderers as soon as the surface
+ * was submitted, whether that succeeded or not
+ */
+void
+ffva_renderer_set_release_func(FFVARenderer *rnd,
+    FFVARendererReleaseFunc func, void *user_data);
+
+/** Waits for the renderer to be done with all the surfaces it still reads */
+void
+ffva_renderer_release_surfaces(FFVARenderer *rnd);
+
+/**
+ * Returns the time the GPU spent drawing the last frame, in microseconds,
+ * without waiting for that frame to complete. Returns AVERROR(EAGAIN) if
+ * the result is not available yet, e.g. if the frame is still in flight,
+ * or AVERROR(ENOSYS) if the renderer could not measure it at all
+ */
+int
+ffva_renderer_get_gpu_time(FFVARenderer *rnd, uint64_t *time_ptr);
+
+/**
+ * Returns the refresh interval of the display the renderer presents to, in
+ * microseconds. Returns false if the renderer could not determine it
+ */
+bool
+ffva_renderer_get_refresh_interval(FFVARenderer *rnd, uint64_t *interval_ptr);
+
 /** Returns the native display associated to the supplied renderer */
 void *
 ffva_renderer_get_native_display(FFVARenderer *rnd);
@@ -22,6 +22,12 @@
 
 #include "sysdeps.h"
 #include <unistd.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <libavutil/common.h>
+#include <libavutil/error.h>
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <va/va.h>
@@ -29,9 +35,11 @@
 #include <drm_fourcc.h>
 #include "egl_compat.h"
 #include "vaapi_utils.h"
-#include "ffvafilter.h"
+#include "ffmpeg_utils.h"
+#include "ffvafilterservice.h"
 #include "ffvarenderer_egl.h"
 #include "ffvarenderer_priv.h"
+#include "time_utils.h"
 
 #if USE_X11
 # include "ffvarenderer_x11.h"
@@ -42,6 +50,22 @@
 #define VA_BUFFER_MEMORY_TYPE 0
 #endif
 
+/* Define whether VA surfaces could be exported with vaExportSurfaceHandle() */
+#ifndef USE_VA_EXPORT_SURFACE
+#define USE_VA_EXPORT_SURFACE VA_CHECK_VERSION(1,1,0)
+#endif
+
+/* Define whether linked GL programs could be cached on disk */
+#ifndef USE_GL_PROGRAM_BINARY
+#define USE_GL_PROGRAM_BINARY (USE_GLES_VERSION >= 2)
+#endif
+
+/* Define whether frames could be read back asynchronously with PBOs */
+#ifndef USE_GL_PIXEL_PACK_BUFFER
+#define USE_GL_PIXEL_PACK_BUFFER \
+    (USE_GLES_VERSION == 0 || USE_GLES_VERSION >= 3)
+#endif
+
 /* Define whether the EGL implementation owns dma_buf fd */
 #ifndef EGL_image_dma_buf_import_owns_fd
 #define EGL_image_dma_buf_import_owns_fd 0
@@ -57,6 +81,43 @@
 #ifndef DRM_FORMAT_GR88
 #define DRM_FORMAT_GR88 fourcc_code('G', 'R', '8', '8')
 #endif
+#ifndef DRM_FORMAT_MOD_INVALID
+#define DRM_FORMAT_MOD_INVALID ((1ULL << 56) - 1)
+#endif
+#ifndef DRM_FORMAT_MOD_LINEAR
+#define DRM_FORMAT_MOD_LINEAR 0
+#endif
+
+/* EGL_MESA_platform_surfaceless */
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+/* EGL_EXT_image_dma_buf_import_modifiers */
+#ifndef EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT
+#define EGL_DMA_BUF_PLANE3_FD_EXT 0x3440
+#define EGL_DMA_BUF_PLANE3_OFFSET_EXT 0x3441
+#define EGL_DMA_BUF_PLANE3_PITCH_EXT 0x3442
+#define EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT 0x3443
+#define EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT 0x3444
+#define EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT 0x3445
+#define EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT 0x3446
+#define EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT 0x3447
+#define EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT 0x3448
+#define EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT 0x3449
+#define EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT 0x344A
+#endif
+
+/* Number of consecutive frames whose exported VA surfaces could not be
+   imported, before vaDeriveImage() is used instead */
+#define EXPORT_SURFACE_MAX_FAILURES 3
+
+/* Texture target for the planes of renderer-allocated surfaces */
+#if USE_GLES_VERSION == 0
+#define RENDERER_IMPORT_TEX_TARGET GL_TEXTURE_2D
+#else
+#define RENDERER_IMPORT_TEX_TARGET GL_TEXTURE_EXTERNAL_OES
+#endif
 
 static bool
 va_format_to_drm_format(const VAImageFormat *va_format, uint32_t *format_ptr)
@@ -129,9 +190,17 @@ get_va_mem_type(uint32_t flags)
 /* --- EGL Helpers                                                      --- */
 /* ------------------------------------------------------------------------ */
 
+typedef void (*GlGenQueriesFunc)(GLsizei n, GLuint *ids);
+typedef void (*GlDeleteQueriesFunc)(GLsizei n, const GLuint *ids);
+typedef void (*GlBeginQueryFunc)(GLenum target, GLuint id);
+typedef void (*GlEndQueryFunc)(GLenum target);
+typedef void (*GlGetQueryObjectUI64vFunc)(GLuint id, GLenum pname,
+    uint64_t *params);
+
 typedef struct egl_vtable_s             EglVTable;
 typedef struct egl_context_s            EglContext;
 typedef struct egl_program_s            EglProgram;
+typedef struct egl_import_buffer_s      EglImportBuffer;
 
 struct egl_vtable_s {
     PFNEGLCREATEIMAGEKHRPROC egl_create_image_khr;
@@ -139,8 +208,29 @@ struct egl_vtable_s {
     PFNGLEGLIMAGETARGETTEXTURE2DOESPROC gl_egl_image_target_texture2d_oes;
     PFNEGLCREATEDRMIMAGEMESAPROC egl_create_drm_image_mesa;
     PFNEGLEXPORTDRMIMAGEMESAPROC egl_export_drm_image_mesa;
+#if USE_GL_PROGRAM_BINARY
+    PFNGLGETPROGRAMBINARYOESPROC gl_get_program_binary_oes;
+    PFNGLPROGRAMBINARYOESPROC gl_program_binary_oes;
+#endif
+    PFNEGLCREATESYNCKHRPROC egl_create_sync_khr;
+    PFNEGLDESTROYSYNCKHRPROC egl_destroy_sync_khr;
+    PFNEGLCLIENTWAITSYNCKHRPROC egl_client_wait_sync_khr;
+    PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC egl_swap_buffers_with_damage;
+    PFNEGLSETDAMAGEREGIONKHRPROC egl_set_damage_region_khr;
+    GlGenQueriesFunc gl_gen_queries;
+    GlDeleteQueriesFunc gl_delete_queries;
+    GlBeginQueryFunc gl_begin_query;
+    GlEndQueryFunc gl_end_query;
+    GlGetQueryObjectUI64vFunc gl_get_query_object_ui64v;
+    bool gl_has_disjoint_queries;
 };
 
+/* Maximum number of linked programs kept around */
+#define EGL_PROGRAM_CACHE_SIZE 8
+
+/* Signature of program binaries cached on disk */
+#define EGL_PROGRAM_BINARY_MAGIC 0x50564646 /* "FFVP" */
+
 struct egl_context_s {
     EglVTable vtable;
     EGLDisplay display;
@@ -160,8 +250,16 @@ struct egl_context_s {
     const char *vert_shader_text;
     EglProgram *program;
     bool program_changed;
+    EglProgram *programs[EGL_PROGRAM_CACHE_SIZE];
+    uint32_t num_programs;
+    char *program_cache_dir;
+    uint64_t program_cache_seed;
+    GLuint vertex_buffer;
+    GLfloat vertices[16];
+    bool has_vertices;
     GLfloat proj[16];
     bool is_initialized;
+    bool has_dma_buf_import_modifiers;
 };
 
 struct egl_program_s {
@@ -170,6 +268,26 @@ struct egl_program_s {
     GLuint vert_shader;
     int proj_uniform;
     int tex_uniforms[3];
+    const char *frag_shader_text;
+    const char *vert_shader_text;
+    GLenum tex_target;
+};
+
+struct egl_program_binary_header_s {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+};
+
+struct egl_import_buffer_s {
+    VASurfaceID va_surface;
+    uint32_t generation;
+    EGLImageKHR storage;
+    EGLImageKHR images[2];
+    uint32_t num_images;
+    GLuint textures[2];
+    uint32_t num_textures;
+    bool bind_failed;
 };
 
 static void
@@ -349,31 +467,162 @@ egl_compile_shader(GLenum type, const char *source)
     return shader;
 }
 
-static EglProgram *
-egl_program_new(const char *frag_shader_text, const char *vert_shader_text)
+// Computes the 64-bit FNV-1a hash of the supplied buffer
+static uint64_t
+hash_buffer(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+static inline uint64_t
+hash_string(uint64_t hash, const char *str)
+{
+    return str ? hash_buffer(hash, str, strlen(str) + 1) : hash;
+}
+
+#if USE_GL_PROGRAM_BINARY
+// Builds the name of the disk cache file for the supplied program
+static void
+egl_program_get_cache_path(EglContext *egl, const EglProgram *program,
+    char *path, size_t size)
+{
+    uint64_t hash = egl->program_cache_seed;
+
+    hash = hash_string(hash, program->vert_shader_text);
+    hash = hash_string(hash, program->frag_shader_text);
+    hash = hash_buffer(hash, &program->tex_target,
+        sizeof(program->tex_target));
+    snprintf(path, size, "%s/%016" PRIx64 ".bin", egl->program_cache_dir,
+        hash);
+}
+
+// Tries to load a linked program binary from the disk cache
+static bool
+egl_program_load_binary(EglContext *egl, EglProgram *program)
+{
+    struct egl_program_binary_header_s header;
+    char path[PATH_MAX];
+    void *binary = NULL;
+    GLint status = GL_FALSE;
+    FILE *fp;
+
+    if (!egl->program_cache_dir)
+        return false;
+
+    egl_program_get_cache_path(egl, program, path, sizeof(path));
+    fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != EGL_PROGRAM_BINARY_MAGIC ||
+        header.length == 0 || header.length > (16U << 20))
+        goto cleanup;
+
+    binary = malloc(header.length);
+    if (!binary || fread(binary, header.length, 1, fp) != 1)
+        goto cleanup;
+
+    program->program = glCreateProgram();
+    if (!program->program)
+        goto cleanup;
+    egl->vtable.gl_program_binary_oes(program->program, header.format,
+        binary, header.length);
+    glGetProgramiv(program->program, GL_LINK_STATUS, &status);
+    if (!status) {
+        // Most likely from another driver version, so just rebuild it
+        av_log(NULL, AV_LOG_DEBUG, "discarding stale program binary %s\n",
+            path);
+        glDeleteProgram(program->program);
+        program->program = 0;
+    }
+
+cleanup:
+    free(binary);
+    fclose(fp);
+    return status == GL_TRUE;
+}
+
+// Stores the linked program binary into the disk cache
+static void
+egl_program_save_binary(EglContext *egl, EglProgram *program)
+{
+    struct egl_program_binary_header_s header;
+    char path[PATH_MAX], tmp_path[PATH_MAX + 16];
+    void *binary = NULL;
+    GLint length = 0;
+    GLsizei binary_length;
+    GLenum binary_format;
+    FILE *fp;
+
+    if (!egl->program_cache_dir)
+        return;
+
+    glGetProgramiv(program->program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0)
+        return;
+
+    binary = malloc(length);
+    if (!binary)
+        return;
+    egl->vtable.gl_get_program_binary_oes(program->program, length,
+        &binary_length, &binary_format, binary);
+    if (binary_length <= 0)
+        goto cleanup;
+
+    // Write to a temporary file first, so that concurrent instances never
+    // observe partial binaries
+    egl_program_get_cache_path(egl, program, path, sizeof(path));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+    fp = fopen(tmp_path, "wb");
+    if (!fp)
+        goto cleanup;
+
+    header.magic = EGL_PROGRAM_BINARY_MAGIC;
+    header.format = binary_format;
+    header.length = binary_length;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(binary, binary_length, 1, fp) != 1) {
+        fclose(fp);
+        unlink(tmp_path);
+        goto cleanup;
+    }
+    if (fclose(fp) != 0 || rename(tmp_path, path) != 0)
+        unlink(tmp_path);
+
+cleanup:
+    free(binary);
+}
+#endif
+
+// Compiles and links the program from its shader sources
+static bool
+egl_program_link(EglProgram *program)
 {
-    EglProgram *program;
     char msg[BUFSIZ];
     GLsizei msglen;
     GLint status;
 
-    program = calloc(1, sizeof(*program));
-    if (!program)
-        return NULL;
-
     program->frag_shader =
-        egl_compile_shader(GL_FRAGMENT_SHADER, frag_shader_text);
+        egl_compile_shader(GL_FRAGMENT_SHADER, program->frag_shader_text);
     if (!program->frag_shader)
-        goto error;
+        return false;
 
     program->vert_shader =
-        egl_compile_shader(GL_VERTEX_SHADER, vert_shader_text);
+        egl_compile_shader(GL_VERTEX_SHADER, program->vert_shader_text);
     if (!program->vert_shader)
-        goto error;
+        return false;
 
     program->program = glCreateProgram();
     if (!program->program)
-        goto error;
+        return false;
     glAttachShader(program->program, program->frag_shader);
     glAttachShader(program->program, program->vert_shader);
     glBindAttribLocation(program->program, 0, "position");
@@ -384,8 +633,35 @@ egl_program_new(const char *frag_shader_text, const char *vert_shader_text)
     if (!status) {
         glGetProgramInfoLog(program->program, sizeof(msg), &msglen, msg);
         av_log(NULL, AV_LOG_ERROR, "failed to link program: %s\n", msg);
-        goto error;
+        return false;
+    }
+    return true;
+}
+
+static EglProgram *
+egl_program_new(EglContext *egl, const char *frag_shader_text,
+    const char *vert_shader_text, GLenum tex_target)
+{
+    EglProgram *program;
+
+    program = calloc(1, sizeof(*program));
+    if (!program)
+        return NULL;
+
+    program->frag_shader_text = frag_shader_text;
+    program->vert_shader_text = vert_shader_text;
+    program->tex_target = tex_target;
+
+#if USE_GL_PROGRAM_BINARY
+    if (!egl_program_load_binary(egl, program)) {
+        if (!egl_program_link(program))
+            goto error;
+        egl_program_save_binary(egl, program);
     }
+#else
+    if (!egl_program_link(program))
+        goto error;
+#endif
 
     glUseProgram(program->program);
     program->proj_uniform    = glGetUniformLocation(program->program, "proj");
@@ -400,6 +676,22 @@ error:
     return NULL;
 }
 
+// Checks whether the program was built from the supplied shaders and target
+static bool
+egl_program_matches(const EglProgram *program, const char *frag_shader_text,
+    const char *vert_shader_text, GLenum tex_target)
+{
+    if (program->tex_target != tex_target)
+        return false;
+    if (program->frag_shader_text != frag_shader_text &&
+        strcmp(program->frag_shader_text, frag_shader_text) != 0)
+        return false;
+    if (program->vert_shader_text != vert_shader_text &&
+        strcmp(program->vert_shader_text, vert_shader_text) != 0)
+        return false;
+    return true;
+}
+
 static void
 egl_program_free(EglProgram *program)
 {
@@ -464,11 +756,59 @@ struct ffva_renderer_egl_s {
     VAImage va_image;
     VABufferInfo va_buf_info;
     uint32_t va_mem_type;
+#if USE_VA_EXPORT_SURFACE
+    bool use_export_surface;
+    uint32_t num_export_failures;
+    int export_fds[4];
+    uint32_t num_export_fds;
+#endif
 
     bool use_mesa_texture;
     bool use_mesa_image;
     FFVASurface mesa_surface;
-    FFVAFilter *mesa_filter;
+    FFVAFilterService *mesa_filter_service;
+
+    pthread_mutex_t import_lock;
+    EglImportBuffer *import_buffers;
+    uint32_t num_import_buffers;
+    uint32_t import_generation;
+
+    bool is_offscreen;
+    GLuint fbo;
+    GLuint fbo_texture;
+    FFVARendererEGLReadbackFunc readback_func;
+    void *readback_data;
+    uint32_t readback_width;
+    uint32_t readback_height;
+#if USE_GL_PIXEL_PACK_BUFFER
+    GLuint readback_pbos[3];
+    uint32_t readback_head;
+    uint32_t readback_count;
+#else
+    uint8_t *readback_buffer;
+#endif
+
+    bool no_vsync;
+    bool use_damage;
+    VARectangle damage_rect;
+    uint32_t damage_rect_frames;
+    bool damage_is_partial;
+    uint32_t max_queued_frames;
+    EGLSyncKHR frame_fences[FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES];
+    uint64_t frame_times[FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES];
+    FFVASurface *frame_surfaces[FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES];
+    FFVASurface *pending_surface;   /* read by the frame being drawn */
+    GLuint gpu_time_query;          /* timer query of the last frame */
+    bool has_gpu_time_query;
+    uint32_t frame_head;
+    uint32_t num_queued_frames;
+    uint64_t num_frames;
+    uint64_t first_frame_time;
+    uint64_t last_frame_time;
+    uint64_t present_time;
+    uint64_t num_latencies;
+    uint64_t total_latency;
+    uint64_t max_latency;
 };
 
 static bool
@@ -477,6 +817,11 @@ ensure_native_renderer(FFVARendererEGL *rnd, uint32_t flags)
     FFVADisplay * const display = rnd->base.display;
     FFVARenderer *native_renderer = rnd->native_renderer;
 
+    if (rnd->is_offscreen) {
+        rnd->va_display = ffva_display_get_va_display(display);
+        return true;
+    }
+
     if (!native_renderer) {
         switch (ffva_display_get_type(display)) {
 #if USE_X11
@@ -497,6 +842,30 @@ ensure_native_renderer(FFVARendererEGL *rnd, uint32_t flags)
     return true;
 }
 
+// Opens a display that needs no window system, preferably surfaceless
+static EGLDisplay
+get_offscreen_display(FFVARendererEGL *rnd)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+    EGLDisplay display;
+    const char *extensions;
+
+    extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless")) {
+        get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+            eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display) {
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                EGL_DEFAULT_DISPLAY, NULL);
+            if (display != EGL_NO_DISPLAY)
+                return display;
+        }
+    }
+    av_log(rnd, AV_LOG_DEBUG, "no surfaceless platform, using the default "
+        "EGL display\n");
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
 static bool
 ensure_display(FFVARendererEGL *rnd)
 {
@@ -505,7 +874,10 @@ ensure_display(FFVARendererEGL *rnd)
     const char *str;
 
     if (!egl->display) {
-        egl->display = eglGetDisplay(rnd->native_display);
+        if (rnd->is_offscreen)
+            egl->display = get_offscreen_display(rnd);
+        else
+            egl->display = eglGetDisplay(rnd->native_display);
         if (!egl->display)
             goto error_create_display;
     }
@@ -565,12 +937,21 @@ ensure_vtable(FFVARendererEGL *rnd)
 
     for (i = 0; egl_extensions_required[i] != NULL; i++) {
         const char * const name = egl_extensions_required[i];
+        // Offscreen rendering has no pixmaps, and only needs Mesa images
+        // if it was asked to render through them
+        if (rnd->is_offscreen && (strcmp(name, "EGL_KHR_image_pixmap") == 0 ||
+                (!rnd->use_mesa_image &&
+                 strcmp(name, "EGL_MESA_drm_image") == 0)))
+            continue;
         if (!strstr(extensions, name)) {
             av_log(rnd, AV_LOG_ERROR, "EGL stack does not support %s\n", name);
             return false;
         }
     }
 
+    egl->has_dma_buf_import_modifiers =
+        strstr(extensions, "EGL_EXT_image_dma_buf_import_modifiers") != NULL;
+
     vtable->egl_create_image_khr =
         (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress("eglCreateImageKHR");
     vtable->egl_destroy_image_khr =
@@ -584,12 +965,36 @@ ensure_vtable(FFVARendererEGL *rnd)
         (PFNEGLCREATEDRMIMAGEMESAPROC)eglGetProcAddress("eglCreateDRMImageMESA");
     vtable->egl_export_drm_image_mesa =
         (PFNEGLEXPORTDRMIMAGEMESAPROC)eglGetProcAddress("eglExportDRMImageMESA");
-    if (!vtable->egl_create_drm_image_mesa ||
-        !vtable->egl_export_drm_image_mesa) {
+    if ((!rnd->is_offscreen || rnd->use_mesa_image) &&
+        (!vtable->egl_create_drm_image_mesa ||
+         !vtable->egl_export_drm_image_mesa)) {
         av_log(rnd, AV_LOG_ERROR, "failed to load EGL_MESA_drm_image hooks\n");
         return false;
     }
 
+    // Optional presentation hooks
+    if (strstr(extensions, "EGL_KHR_fence_sync")) {
+        vtable->egl_create_sync_khr = (PFNEGLCREATESYNCKHRPROC)
+            eglGetProcAddress("eglCreateSyncKHR");
+        vtable->egl_destroy_sync_khr = (PFNEGLDESTROYSYNCKHRPROC)
+            eglGetProcAddress("eglDestroySyncKHR");
+        vtable->egl_client_wait_sync_khr = (PFNEGLCLIENTWAITSYNCKHRPROC)
+            eglGetProcAddress("eglClientWaitSyncKHR");
+        if (!vtable->egl_destroy_sync_khr || !vtable->egl_client_wait_sync_khr)
+            vtable->egl_create_sync_khr = NULL;
+    }
+    if (strstr(extensions, "EGL_KHR_swap_buffers_with_damage"))
+        vtable->egl_swap_buffers_with_damage =
+            (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    else if (strstr(extensions, "EGL_EXT_swap_buffers_with_damage"))
+        vtable->egl_swap_buffers_with_damage =
+            (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+    if (strstr(extensions, "EGL_KHR_partial_update"))
+        vtable->egl_set_damage_region_khr = (PFNEGLSETDAMAGEREGIONKHRPROC)
+            eglGetProcAddress("eglSetDamageRegionKHR");
+
     extensions = (const char *)glGetString(GL_EXTENSIONS);
     if (!extensions)
         return false;
@@ -609,9 +1014,101 @@ ensure_vtable(FFVARendererEGL *rnd)
         av_log(rnd, AV_LOG_ERROR, "failed to load GL_OES_EGL_image hooks\n");
         return false;
     }
+
+    // Optional timer queries, so that the GPU time of frames is known
+    if (strstr(extensions, "GL_ARB_timer_query")) {
+        vtable->gl_gen_queries = (GlGenQueriesFunc)
+            eglGetProcAddress("glGenQueries");
+        vtable->gl_delete_queries = (GlDeleteQueriesFunc)
+            eglGetProcAddress("glDeleteQueries");
+        vtable->gl_begin_query = (GlBeginQueryFunc)
+            eglGetProcAddress("glBeginQuery");
+        vtable->gl_end_query = (GlEndQueryFunc)
+            eglGetProcAddress("glEndQuery");
+        vtable->gl_get_query_object_ui64v = (GlGetQueryObjectUI64vFunc)
+            eglGetProcAddress("glGetQueryObjectui64v");
+    }
+    else if (strstr(extensions, "GL_EXT_disjoint_timer_query")) {
+        vtable->gl_gen_queries = (GlGenQueriesFunc)
+            eglGetProcAddress("glGenQueriesEXT");
+        vtable->gl_delete_queries = (GlDeleteQueriesFunc)
+            eglGetProcAddress("glDeleteQueriesEXT");
+        vtable->gl_begin_query = (GlBeginQueryFunc)
+            eglGetProcAddress("glBeginQueryEXT");
+        vtable->gl_end_query = (GlEndQueryFunc)
+            eglGetProcAddress("glEndQueryEXT");
+        vtable->gl_get_query_object_ui64v = (GlGetQueryObjectUI64vFunc)
+            eglGetProcAddress("glGetQueryObjectui64vEXT");
+        vtable->gl_has_disjoint_queries = true;
+    }
+    if (!vtable->gl_delete_queries || !vtable->gl_begin_query ||
+        !vtable->gl_end_query || !vtable->gl_get_query_object_ui64v)
+        vtable->gl_gen_queries = NULL;
+
+#if USE_GL_PROGRAM_BINARY
+    if (strstr(extensions, "GL_OES_get_program_binary")) {
+        vtable->gl_get_program_binary_oes = (PFNGLGETPROGRAMBINARYOESPROC)
+            eglGetProcAddress("glGetProgramBinaryOES");
+        vtable->gl_program_binary_oes = (PFNGLPROGRAMBINARYOESPROC)
+            eglGetProcAddress("glProgramBinaryOES");
+    }
+#endif
     return true;
 }
 
+#if USE_GL_PROGRAM_BINARY
+// Creates the directory, if needed, ignoring whether it already existed
+static bool
+ensure_directory(const char *path)
+{
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// Sets up the disk cache of linked programs, keyed by the GL driver too
+static void
+ensure_program_cache(FFVARendererEGL *rnd)
+{
+    EglContext * const egl = &rnd->egl_context;
+    EglVTable * const vtable = &egl->vtable;
+    const char *base_dir;
+    char path[PATH_MAX];
+    GLint num_formats = 0;
+    uint64_t seed;
+
+    if (egl->program_cache_dir)
+        return;
+    if (!vtable->gl_get_program_binary_oes || !vtable->gl_program_binary_oes)
+        return;
+
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &num_formats);
+    if (num_formats < 1)
+        return;
+
+    if ((base_dir = getenv("XDG_CACHE_HOME")) && *base_dir)
+        snprintf(path, sizeof(path), "%s", base_dir);
+    else if ((base_dir = getenv("HOME")) && *base_dir)
+        snprintf(path, sizeof(path), "%s/.cache", base_dir);
+    else
+        return;
+    if (!ensure_directory(path))
+        return;
+    if (strlen(path) + sizeof("/ffvademo") > sizeof(path))
+        return;
+    strcat(path, "/ffvademo");
+    if (!ensure_directory(path))
+        return;
+
+    // Binaries are only valid for the exact same driver build
+    seed = UINT64_C(0xcbf29ce484222325);
+    seed = hash_string(seed, (const char *)glGetString(GL_VENDOR));
+    seed = hash_string(seed, (const char *)glGetString(GL_RENDERER));
+    seed = hash_string(seed, (const char *)glGetString(GL_VERSION));
+    egl->program_cache_seed = seed;
+    egl->program_cache_dir = strdup(path);
+    av_log(rnd, AV_LOG_DEBUG, "caching GL program binaries in %s\n", path);
+}
+#endif
+
 static bool
 ensure_config(FFVARendererEGL *rnd)
 {
@@ -629,17 +1126,32 @@ ensure_config(FFVARendererEGL *rnd)
         EGL_NONE
     };
 
+    static const EGLint offscreen_attribs[] = {
+        EGL_RED_SIZE,           8,
+        EGL_GREEN_SIZE,         8,
+        EGL_BLUE_SIZE,          8,
+        EGL_SURFACE_TYPE,       EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE,    OPENGL_BIT,
+        EGL_NONE
+    };
+
     if (!ensure_display(rnd))
         return 0;
 
     if (!egl->config) {
-        if (!eglChooseConfig(egl->display, attribs, &config, 1, &num_configs))
+        if (!eglChooseConfig(egl->display,
+                rnd->is_offscreen ? offscreen_attribs : attribs, &config, 1,
+                &num_configs))
             goto error_choose_config;
         if (num_configs != 1)
             return 0;
         egl->config = config;
     }
 
+    // There is no native window to match a visual to
+    if (rnd->is_offscreen)
+        return true;
+
     if (!egl->visualid) {
         if (!eglGetConfigAttrib(egl->display, config, EGL_NATIVE_VISUAL_ID,
                 &vid))
@@ -662,9 +1174,14 @@ ensure_context(FFVARendererEGL *rnd)
 {
     EglContext * const egl = &rnd->egl_context;
     const EGLint *attribs;
+    const char *extensions;
 
+    if (egl->context)
+        return true;
     if (!ensure_native_renderer(rnd, 0))
         return false;
+    if (!ensure_config(rnd))
+        return false;
 
     eglBindAPI(OPENGL_API);
 
@@ -695,15 +1212,49 @@ ensure_context(FFVARendererEGL *rnd)
     if (!egl->context)
         goto error_create_context;
 
-    egl->surface = eglCreateWindowSurface(egl->display, egl->config,
-        (EGLNativeWindowType)rnd->native_window, NULL);
-    if (!egl->surface)
-        goto error_create_surface;
+    if (rnd->is_offscreen) {
+        static const EGLint pbuffer_attribs[] = {
+            EGL_WIDTH,  1,
+            EGL_HEIGHT, 1,
+            EGL_NONE
+        };
+
+        // Rendering goes to an FBO, so only create a dummy pbuffer if the
+        // context cannot be made current without any surface
+        extensions = eglQueryString(egl->display, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+            egl->surface = eglCreatePbufferSurface(egl->display, egl->config,
+                pbuffer_attribs);
+            if (!egl->surface)
+                goto error_create_surface;
+        }
+    }
+    else {
+        egl->surface = eglCreateWindowSurface(egl->display, egl->config,
+            (EGLNativeWindowType)rnd->native_window, NULL);
+        if (!egl->surface)
+            goto error_create_surface;
+    }
 
     eglMakeCurrent(egl->display, egl->surface, egl->surface, egl->context);
 
     if (!ensure_vtable(rnd))
         return false;
+#if USE_GL_PROGRAM_BINARY
+    ensure_program_cache(rnd);
+#endif
+
+    // Don't wait for vertical blanking, at the expense of tearing
+    if (!rnd->is_offscreen && rnd->no_vsync &&
+        !eglSwapInterval(egl->display, 0))
+        av_log(rnd, AV_LOG_WARNING, "failed to disable vsync\n");
+    if (rnd->max_queued_frames > 0 && !egl->vtable.egl_create_sync_khr)
+        av_log(rnd, AV_LOG_WARNING, "EGL stack does not support "
+            "EGL_KHR_fence_sync, queued frames are not bounded\n");
+    if (rnd->use_damage && !egl->vtable.egl_swap_buffers_with_damage &&
+        !egl->vtable.egl_set_damage_region_khr)
+        av_log(rnd, AV_LOG_WARNING, "EGL stack does not support damage "
+            "regions, presenting full frames\n");
 
     glClearColor(0.0, 0.0, 0.0, 1.0);
 #if USE_GLES_VERSION == 0
@@ -727,14 +1278,33 @@ renderer_init(FFVARendererEGL *rnd, uint32_t flags)
 {
     EglContext * const egl = &rnd->egl_context;
 
+    pthread_mutex_init(&rnd->import_lock, NULL);
+
+    rnd->is_offscreen = (flags & FFVA_RENDERER_EGL_OFFSCREEN) != 0;
+    rnd->no_vsync = (flags & FFVA_RENDERER_EGL_NO_VSYNC) != 0;
+    rnd->use_damage = (flags & FFVA_RENDERER_EGL_DAMAGE) != 0;
+#if USE_GLES_VERSION == 1
+    if (rnd->is_offscreen) {
+        av_log(rnd, AV_LOG_ERROR, "offscreen rendering needs GLES 2 or later\n");
+        return false;
+    }
+#endif
+
     if (!ensure_native_renderer(rnd, flags))
         return false;
     if (!ensure_display(rnd))
         return false;
 
     matrix_set_identity(egl->proj);
+    // Render upside down, so that frames are read back top-down
+    if (rnd->is_offscreen)
+        egl->proj[5] = -1.0f;
     va_image_init_defaults(&rnd->va_image);
     rnd->va_mem_type = get_va_mem_type(flags);
+#if USE_VA_EXPORT_SURFACE
+    rnd->use_export_surface = rnd->va_mem_type == 0 ||
+        rnd->va_mem_type == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME;
+#endif
     ffva_surface_init_defaults(&rnd->mesa_surface);
 
     switch (flags & FFVA_RENDERER_EGL_MEM_TYPE_MASK) {
@@ -747,8 +1317,9 @@ renderer_init(FFVARendererEGL *rnd, uint32_t flags)
     }
 
     if (rnd->use_mesa_image) {
-        rnd->mesa_filter = ffva_filter_new(rnd->base.display);
-        if (!rnd->mesa_filter)
+        /* Share VPP contexts with any other stream on the same display */
+        rnd->mesa_filter_service = ffva_filter_service_get(rnd->base.display);
+        if (!rnd->mesa_filter_service)
             return false;
     }
     return true;
@@ -784,82 +1355,621 @@ renderer_clear_textures(FFVARendererEGL *rnd)
     egl->num_textures = 0;
 }
 
+// Releases the per-plane EGL images and GL textures of an imported buffer
 static void
-renderer_finalize(FFVARendererEGL *rnd)
+import_buffer_unbind(FFVARendererEGL *rnd, EglImportBuffer *buf)
 {
     EglContext * const egl = &rnd->egl_context;
+    uint32_t i;
 
-    if (egl->display)
-        eglMakeCurrent(egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
-            EGL_NO_CONTEXT);
+    if (buf->num_textures > 0) {
+        glDeleteTextures(buf->num_textures, buf->textures);
+        buf->num_textures = 0;
+    }
 
-    egl_program_freep(&egl->program);
+    for (i = 0; i < buf->num_images; i++)
+        egl->vtable.egl_destroy_image_khr(egl->display, buf->images[i]);
+    buf->num_images = 0;
+}
 
-    renderer_clear_images(rnd);
-    renderer_clear_textures(rnd);
+// Releases all EGL resources of an imported buffer, including its storage
+static void
+import_buffer_clear(FFVARendererEGL *rnd, EglImportBuffer *buf)
+{
+    EglContext * const egl = &rnd->egl_context;
 
-    if (egl->surface) {
-        eglDestroySurface(egl->display, egl->surface);
-        egl->surface = NULL;
+    import_buffer_unbind(rnd, buf);
+    if (buf->storage != EGL_NO_IMAGE_KHR) {
+        egl->vtable.egl_destroy_image_khr(egl->display, buf->storage);
+        buf->storage = EGL_NO_IMAGE_KHR;
     }
+}
 
-    if (egl->context) {
-        eglDestroyContext(egl->display, egl->context);
-        egl->context = NULL;
-    }
+// Destroys the imported buffers from previous allocations, or all of them.
+// The import lock shall be held, and GL textures can only be released from
+// the rendering thread
+static void
+renderer_purge_import_buffers(FFVARendererEGL *rnd, bool purge_all)
+{
+    uint32_t i, n = 0;
 
-    if (egl->display) {
-        eglTerminate(egl->display);
-        egl->display = NULL;
+    for (i = 0; i < rnd->num_import_buffers; i++) {
+        EglImportBuffer * const buf = &rnd->import_buffers[i];
+
+        if (!purge_all && buf->generation == rnd->import_generation) {
+            rnd->import_buffers[n++] = *buf;
+            continue;
+        }
+        import_buffer_clear(rnd, buf);
     }
-    ffva_renderer_freep(&rnd->native_renderer);
+    rnd->num_import_buffers = n;
 
-    ffva_filter_freep(&rnd->mesa_filter);
-    va_destroy_surface(rnd->va_display, &rnd->mesa_surface.id);
+    if (n == 0) {
+        free(rnd->import_buffers);
+        rnd->import_buffers = NULL;
+    }
 }
 
-static uintptr_t
-renderer_get_visual_id(FFVARendererEGL *rnd)
+#if USE_GLES_VERSION != 1
+// (Re)allocates the framebuffer that offscreen rendering targets
+static bool
+renderer_ensure_fbo(FFVARendererEGL *rnd, uint32_t width, uint32_t height)
 {
-    EglContext * const egl = &rnd->egl_context;
+    GLenum status;
+
+    if (!rnd->fbo)
+        glGenFramebuffers(1, &rnd->fbo);
+    if (!rnd->fbo_texture)
+        glGenTextures(1, &rnd->fbo_texture);
+
+    glBindTexture(GL_TEXTURE_2D, rnd->fbo_texture);
+    gl_texture_init_defaults(rnd->fbo_texture, GL_TEXTURE_2D);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+        GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, rnd->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, rnd->fbo_texture, 0);
+    status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+        goto error_incomplete_fbo;
+    return true;
 
-    if (!ensure_config(rnd))
-        return 0;
-    return egl->visualid;
+    /* ERRORS */
+error_incomplete_fbo:
+    av_log(rnd, AV_LOG_ERROR, "incomplete offscreen framebuffer (0x%04x)\n",
+        status);
+    return false;
 }
 
-static bool
-renderer_get_size(FFVARendererEGL *rnd, uint32_t *width_ptr,
-    uint32_t *height_ptr)
+static void
+renderer_destroy_fbo(FFVARendererEGL *rnd)
 {
-    if (!rnd->native_renderer)
-        return false;
-    return ffva_renderer_get_size(rnd->native_renderer, width_ptr, height_ptr);
+    if (rnd->fbo) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &rnd->fbo);
+        rnd->fbo = 0;
+    }
+    if (rnd->fbo_texture) {
+        glDeleteTextures(1, &rnd->fbo_texture);
+        rnd->fbo_texture = 0;
+    }
 }
+#endif
 
-static bool
-renderer_set_size(FFVARendererEGL *rnd, uint32_t width, uint32_t height)
+#if USE_GL_PIXEL_PACK_BUFFER
+// Hands the oldest frame of the readback ring over to the client
+static void
+renderer_deliver_readback(FFVARendererEGL *rnd)
 {
-    EglContext * const egl = &rnd->egl_context;
-
-    if (!rnd->native_renderer)
-        return false;
-    if (!ffva_renderer_set_size(rnd->native_renderer, width, height))
-        return false;
-
-    if (!ensure_context(rnd))
-        return false;
-    glViewport(0, 0, width, height);
-    egl->surface_width = width;
-    egl->surface_height = height;
-    return true;
+    const uint32_t num_pbos = FF_ARRAY_ELEMS(rnd->readback_pbos);
+    const uint32_t idx = (rnd->readback_head + num_pbos -
+        rnd->readback_count) % num_pbos;
+    const uint32_t stride = rnd->readback_width * 4;
+    const uint8_t *pixels;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rnd->readback_pbos[idx]);
+    pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+        stride * rnd->readback_height, GL_MAP_READ_BIT);
+    if (pixels) {
+        rnd->readback_func(rnd->readback_data, pixels, rnd->readback_width,
+            rnd->readback_height, stride);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+        av_log(rnd, AV_LOG_ERROR, "failed to map readback buffer\n");
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    rnd->readback_count--;
 }
+#endif
 
+// Delivers all frames that are still being read back
 static void
-renderer_set_shader_text(FFVARendererEGL *rnd, const char *frag_shader_text,
-    const char *vert_shader_text)
+renderer_flush_readbacks(FFVARendererEGL *rnd)
 {
-    EglContext * const egl = &rnd->egl_context;
+#if USE_GL_PIXEL_PACK_BUFFER
+    while (rnd->readback_count > 0)
+        renderer_deliver_readback(rnd);
+#endif
+}
+
+// Reads the rendered frame back. With PBOs, the transfer runs while the
+// next frames are rendered, and the oldest frame is only delivered once
+// all buffers of the ring are in flight
+static bool
+renderer_readback(FFVARendererEGL *rnd)
+{
+    EglContext * const egl = &rnd->egl_context;
+    const uint32_t width = egl->surface_width;
+    const uint32_t height = egl->surface_height;
+    const uint32_t stride = width * 4;
+#if USE_GL_PIXEL_PACK_BUFFER
+    const uint32_t num_pbos = FF_ARRAY_ELEMS(rnd->readback_pbos);
+#endif
+
+    if (!rnd->readback_func)
+        return true;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+#if USE_GL_PIXEL_PACK_BUFFER
+    if (rnd->readback_count == num_pbos)
+        renderer_deliver_readback(rnd);
+    if (!rnd->readback_pbos[0])
+        glGenBuffers(num_pbos, rnd->readback_pbos);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rnd->readback_pbos[rnd->readback_head]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, stride * height, NULL, GL_STREAM_READ);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glFlush();
+
+    rnd->readback_head = (rnd->readback_head + 1) % num_pbos;
+    rnd->readback_count++;
+    rnd->readback_width = width;
+    rnd->readback_height = height;
+#else
+    if (!rnd->readback_buffer || rnd->readback_width != width ||
+        rnd->readback_height != height) {
+        free(rnd->readback_buffer);
+        rnd->readback_buffer = malloc(stride * height);
+        if (!rnd->readback_buffer)
+            return false;
+        rnd->readback_width = width;
+        rnd->readback_height = height;
+    }
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+        rnd->readback_buffer);
+    rnd->readback_func(rnd->readback_data, rnd->readback_buffer, width,
+        height, stride);
+#endif
+    return true;
+}
+
+// Releases the offscreen framebuffer and readback buffers
+static void
+renderer_finalize_offscreen(FFVARendererEGL *rnd)
+{
+    renderer_flush_readbacks(rnd);
+#if USE_GL_PIXEL_PACK_BUFFER
+    if (rnd->readback_pbos[0]) {
+        glDeleteBuffers(FF_ARRAY_ELEMS(rnd->readback_pbos),
+            rnd->readback_pbos);
+        memset(rnd->readback_pbos, 0, sizeof(rnd->readback_pbos));
+    }
+#else
+    free(rnd->readback_buffer);
+    rnd->readback_buffer = NULL;
+#endif
+#if USE_GLES_VERSION != 1
+    renderer_destroy_fbo(rnd);
+#endif
+}
+
+// Converts the video rectangle to an EGL rectangle, with a bottom-left origin
+static void
+renderer_get_damage_rect(FFVARendererEGL *rnd, EGLint rect[4])
+{
+    EglContext * const egl = &rnd->egl_context;
+    const VARectangle * const r = &rnd->damage_rect;
+
+    rect[0] = r->x;
+    rect[1] = (EGLint)egl->surface_height - (r->y + r->height);
+    rect[2] = r->width;
+    rect[3] = r->height;
+}
+
+// Determines the region of the back buffer the next frame is rendered to.
+// Returns true if only the video rectangle is, and the borders are still
+// valid from the last time that buffer was rendered
+static bool
+renderer_begin_frame(FFVARendererEGL *rnd, const VARectangle *dst_rect)
+{
+    EglContext * const egl = &rnd->egl_context;
+    EGLint rect[4], age = 0;
+
+    rnd->damage_is_partial = false;
+    if (!rnd->use_damage || rnd->is_offscreen)
+        return false;
+
+    if (memcmp(&rnd->damage_rect, dst_rect, sizeof(*dst_rect)) != 0) {
+        rnd->damage_rect = *dst_rect;
+        rnd->damage_rect_frames = 0;
+    }
+
+    // The compositor only needs to update the video rectangle if it did
+    // not move since the previous frame
+    rnd->damage_is_partial = rnd->damage_rect_frames > 0;
+    if (!rnd->damage_is_partial || !egl->vtable.egl_set_damage_region_khr)
+        return false;
+
+    // Rendering could be restricted to the video rectangle too, if it did
+    // not move since the back buffer was last rendered
+    if (!eglQuerySurface(egl->display, egl->surface, EGL_BUFFER_AGE_KHR,
+            &age) || age == 0 || (uint32_t)age > rnd->damage_rect_frames)
+        return false;
+
+    renderer_get_damage_rect(rnd, rect);
+    return egl->vtable.egl_set_damage_region_khr(egl->display, egl->surface,
+        rect, 1);
+}
+
+// Presents the rendered frame, reporting only the video rectangle as
+// damaged whenever possible
+static bool
+renderer_present(FFVARendererEGL *rnd)
+{
+    EglContext * const egl = &rnd->egl_context;
+    EGLint rect[4];
+    EGLBoolean success;
+
+    if (rnd->damage_is_partial && egl->vtable.egl_swap_buffers_with_damage) {
+        renderer_get_damage_rect(rnd, rect);
+        success = egl->vtable.egl_swap_buffers_with_damage(egl->display,
+            egl->surface, rect, 1);
+    }
+    else
+        success = eglSwapBuffers(egl->display, egl->surface);
+    if (!success)
+        goto error_swap_buffers;
+    rnd->damage_rect_frames++;
+    return true;
+
+    /* ERRORS */
+error_swap_buffers:
+    av_log(rnd, AV_LOG_ERROR, "failed to swap EGL buffers (0x%04x)\n",
+        eglGetError());
+    return false;
+}
+
+// Waits for the oldest frame in flight to be completed by the GPU, and
+// accounts for its latency. Returns false if the timeout expired first
+static bool
+renderer_retire_frame(FFVARendererEGL *rnd, EGLTimeKHR timeout)
+{
+    EglContext * const egl = &rnd->egl_context;
+    const uint32_t idx = rnd->frame_head;
+    uint64_t latency;
+    EGLint status;
+
+    status = egl->vtable.egl_client_wait_sync_khr(egl->display,
+        rnd->frame_fences[idx], EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, timeout);
+    if (status == EGL_TIMEOUT_EXPIRED_KHR)
+        return false;
+
+    // Completion is only noticed here, so the latency is an upper bound
+    if (status == EGL_CONDITION_SATISFIED_KHR) {
+        latency = get_time_us() - rnd->frame_times[idx];
+        rnd->total_latency += latency;
+        rnd->max_latency = FFMAX(rnd->max_latency, latency);
+        rnd->num_latencies++;
+    }
+    egl->vtable.egl_destroy_sync_khr(egl->display, rnd->frame_fences[idx]);
+    rnd->frame_fences[idx] = EGL_NO_SYNC_KHR;
+    rnd->frame_head = (idx + 1) % FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES;
+    rnd->num_queued_frames--;
+
+    // The GPU no longer reads from the surface displayed in that frame
+    if (rnd->frame_surfaces[idx]) {
+        ffva_renderer_release_surface(FFVA_RENDERER(rnd),
+            rnd->frame_surfaces[idx]);
+        rnd->frame_surfaces[idx] = NULL;
+    }
+    return true;
+}
+
+// Tracks the frame that was just submitted with a fence, and waits for older
+// frames to complete until no more than the allowed number are in flight
+static void
+renderer_queue_frame(FFVARendererEGL *rnd)
+{
+    EglContext * const egl = &rnd->egl_context;
+    const uint32_t max_frames = FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES;
+    EGLSyncKHR fence;
+    uint32_t idx;
+
+    if (!egl->vtable.egl_create_sync_khr)
+        return;
+
+    while (rnd->num_queued_frames > 0 && renderer_retire_frame(rnd, 0))
+        ;
+
+    // Without any bound, the oldest fence is dropped rather than waited for,
+    // unless a surface is to be released once it is signalled
+    if (rnd->num_queued_frames == max_frames) {
+        if (rnd->frame_surfaces[rnd->frame_head])
+            renderer_retire_frame(rnd, EGL_FOREVER_KHR);
+        else {
+            egl->vtable.egl_destroy_sync_khr(egl->display,
+                rnd->frame_fences[rnd->frame_head]);
+            rnd->frame_head = (rnd->frame_head + 1) % max_frames;
+            rnd->num_queued_frames--;
+        }
+    }
+
+    fence = egl->vtable.egl_create_sync_khr(egl->display, EGL_SYNC_FENCE_KHR,
+        NULL);
+    if (fence == EGL_NO_SYNC_KHR)
+        return;
+    idx = (rnd->frame_head + rnd->num_queued_frames) % max_frames;
+    rnd->frame_fences[idx] = fence;
+    rnd->frame_times[idx] = get_time_us();
+    rnd->frame_surfaces[idx] = rnd->pending_surface;
+    rnd->pending_surface = NULL;
+    rnd->num_queued_frames++;
+
+    if (rnd->max_queued_frames > 0) {
+        while (rnd->num_queued_frames > rnd->max_queued_frames)
+            renderer_retire_frame(rnd, EGL_FOREVER_KHR);
+    }
+}
+
+// Waits for all frames in flight to be completed by the GPU
+static void
+renderer_flush_frames(FFVARendererEGL *rnd)
+{
+    while (rnd->num_queued_frames > 0)
+        renderer_retire_frame(rnd, EGL_FOREVER_KHR);
+}
+
+// Releases the surface of the frame that was just drawn, if no fence could
+// track it. The GPU has to complete the frame first, if asked to wait
+static void
+renderer_release_pending_surface(FFVARendererEGL *rnd, bool wait)
+{
+    FFVASurface * const surface = rnd->pending_surface;
+
+    if (!surface)
+        return;
+    rnd->pending_surface = NULL;
+    if (wait && FFVA_RENDERER(rnd)->release_func)
+        glFinish();
+    ffva_renderer_release_surface(FFVA_RENDERER(rnd), surface);
+}
+
+static void
+renderer_release_surfaces(FFVARendererEGL *rnd)
+{
+    if (rnd->egl_context.context)
+        renderer_flush_frames(rnd);
+    renderer_release_pending_surface(rnd, false);
+}
+
+// Returns the time the GPU spent drawing the last frame, from its timer
+// query. The result is only read once available, so that frames in flight
+// are never waited for. Without timer queries, completion could only be
+// noticed late, which is no measure of the GPU time
+static int
+renderer_get_gpu_time(FFVARendererEGL *rnd, uint64_t *time_ptr)
+{
+    EglVTable * const vtable = &rnd->egl_context.vtable;
+    uint64_t gpu_time, available = 0;
+    GLint disjoint = 0;
+
+    if (!vtable->gl_gen_queries)
+        return AVERROR(ENOSYS);
+    if (!rnd->has_gpu_time_query)
+        return AVERROR(EAGAIN);
+
+    vtable->gl_get_query_object_ui64v(rnd->gpu_time_query,
+        GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return AVERROR(EAGAIN);
+    rnd->has_gpu_time_query = false;
+    vtable->gl_get_query_object_ui64v(rnd->gpu_time_query, GL_QUERY_RESULT,
+        &gpu_time);
+
+    // Results are undefined if the GPU clock changed meanwhile
+    if (vtable->gl_has_disjoint_queries)
+        glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint)
+        return AVERROR(EAGAIN);
+    *time_ptr = gpu_time / 1000;
+    return 0;
+}
+
+// Accounts for a frame that was presented, or read back, since start_time
+static void
+renderer_account_frame(FFVARendererEGL *rnd, uint64_t start_time)
+{
+    const uint64_t end_time = get_time_us();
+
+    if (rnd->num_frames++ == 0)
+        rnd->first_frame_time = end_time;
+    rnd->last_frame_time = end_time;
+    rnd->present_time += end_time - start_time;
+}
+
+static void
+renderer_clear_programs(FFVARendererEGL *rnd)
+{
+    EglContext * const egl = &rnd->egl_context;
+    uint32_t i;
+
+    for (i = 0; i < egl->num_programs; i++)
+        egl_program_freep(&egl->programs[i]);
+    egl->num_programs = 0;
+    egl->program = NULL;
+}
+
+static void
+renderer_finalize(FFVARendererEGL *rnd)
+{
+    EglContext * const egl = &rnd->egl_context;
+
+    pthread_mutex_lock(&rnd->import_lock);
+    renderer_purge_import_buffers(rnd, true);
+    pthread_mutex_unlock(&rnd->import_lock);
+
+    if (egl->context)
+        renderer_flush_frames(rnd);
+    if (rnd->is_offscreen && egl->context)
+        renderer_finalize_offscreen(rnd);
+
+    if (egl->display)
+        eglMakeCurrent(egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+            EGL_NO_CONTEXT);
+
+    renderer_clear_programs(rnd);
+    if (rnd->gpu_time_query) {
+        egl->vtable.gl_delete_queries(1, &rnd->gpu_time_query);
+        rnd->gpu_time_query = 0;
+    }
+    if (egl->vertex_buffer) {
+#if USE_GLES_VERSION != 1
+        glDeleteBuffers(1, &egl->vertex_buffer);
+#endif
+        egl->vertex_buffer = 0;
+    }
+    free(egl->program_cache_dir);
+    egl->program_cache_dir = NULL;
+
+    renderer_clear_images(rnd);
+    renderer_clear_textures(rnd);
+
+    if (egl->surface) {
+        eglDestroySurface(egl->display, egl->surface);
+        egl->surface = NULL;
+    }
+
+    if (egl->context) {
+        eglDestroyContext(egl->display, egl->context);
+        egl->context = NULL;
+    }
+
+    if (egl->display) {
+        eglTerminate(egl->display);
+        egl->display = NULL;
+    }
+    ffva_renderer_freep(&rnd->native_renderer);
+
+    va_destroy_surface(rnd->va_display, &rnd->mesa_surface.id);
+    pthread_mutex_destroy(&rnd->import_lock);
+}
+
+static uintptr_t
+renderer_get_visual_id(FFVARendererEGL *rnd)
+{
+    EglContext * const egl = &rnd->egl_context;
+
+    if (!ensure_config(rnd))
+        return 0;
+    return egl->visualid;
+}
+
+static const FFVAFormatCost *
+renderer_get_formats(FFVARendererEGL *rnd)
+{
+    /* YUV formats are sampled with a conversion shader, or by the hardware
+       when imported as a single external image */
+    static const FFVAFormatCost g_dma_buf_formats[] = {
+        { VA_FOURCC('N','V','1','2'),  8 },
+        { VA_FOURCC('I','4','2','0'),  9 },
+        { VA_FOURCC('Y','V','1','2'),  9 },
+        { VA_FOURCC('B','G','R','A'), 16 },
+        { VA_FOURCC('R','G','B','A'), 16 },
+        { 0, }
+    };
+    static const FFVAFormatCost g_gem_buf_formats[] = {
+        { VA_FOURCC('B','G','R','A'), 16 },
+        { 0, }
+    };
+
+    // Mesa images are always converted through VPP, from any format
+    if (rnd->use_mesa_image)
+        return NULL;
+
+    switch (rnd->va_mem_type) {
+    case VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME:
+        return g_dma_buf_formats;
+    case VA_SURFACE_ATTRIB_MEM_TYPE_KERNEL_DRM:
+        return g_gem_buf_formats;
+    }
+    return NULL;
+}
+
+static bool
+renderer_get_size(FFVARendererEGL *rnd, uint32_t *width_ptr,
+    uint32_t *height_ptr)
+{
+    EglContext * const egl = &rnd->egl_context;
+
+    if (rnd->is_offscreen) {
+        *width_ptr = egl->surface_width;
+        *height_ptr = egl->surface_height;
+        return true;
+    }
+
+    if (!rnd->native_renderer)
+        return false;
+    return ffva_renderer_get_size(rnd->native_renderer, width_ptr, height_ptr);
+}
+
+// EGL does not expose the refresh rate, the native window system does
+static bool
+renderer_get_refresh_interval(FFVARendererEGL *rnd, uint64_t *interval_ptr)
+{
+    if (rnd->is_offscreen || !rnd->native_renderer)
+        return false;
+    return ffva_renderer_get_refresh_interval(rnd->native_renderer,
+        interval_ptr);
+}
+
+static bool
+renderer_set_size(FFVARendererEGL *rnd, uint32_t width, uint32_t height)
+{
+    EglContext * const egl = &rnd->egl_context;
+
+    if (rnd->is_offscreen) {
+        if (!ensure_context(rnd))
+            return false;
+        renderer_flush_readbacks(rnd);
+#if USE_GLES_VERSION != 1
+        if (!renderer_ensure_fbo(rnd, width, height))
+            return false;
+#endif
+    }
+    else {
+        if (!rnd->native_renderer)
+            return false;
+        if (!ffva_renderer_set_size(rnd->native_renderer, width, height))
+            return false;
+
+        if (!ensure_context(rnd))
+            return false;
+    }
+    glViewport(0, 0, width, height);
+    egl->surface_width = width;
+    egl->surface_height = height;
+    rnd->damage_rect_frames = 0;
+    return true;
+}
+
+static void
+renderer_set_shader_text(FFVARendererEGL *rnd, const char *frag_shader_text,
+    const char *vert_shader_text)
+{
+    EglContext * const egl = &rnd->egl_context;
 
     if (!vert_shader_text)
         vert_shader_text = vert_shader_text_default;
@@ -1227,7 +2337,8 @@ renderer_bind_mesa_image(FFVARendererEGL *rnd, FFVASurface *s)
             s->width, s->height);
     }
 
-    ret = ffva_filter_process(rnd->mesa_filter, s, d, 0);
+    ret = ffva_filter_service_process(rnd->mesa_filter_service, s, NULL,
+        d, NULL, NULL, 0);
     if (ret != 0)
         goto error_transfer_surface;
 
@@ -1251,6 +2362,188 @@ error_transfer_surface:
     return false;
 }
 
+#if USE_VA_EXPORT_SURFACE
+// Binds the layers of a VA surface exported with vaExportSurfaceHandle(),
+// so that tiled or compressed surfaces are sampled without any resolve
+static bool
+renderer_bind_exported_surface(FFVARendererEGL *rnd, FFVASurface *s)
+{
+    EglContext * const egl = &rnd->egl_context;
+    VADRMPRIMESurfaceDescriptor va_desc;
+    VAStatus va_status;
+    EGLImageKHR image;
+    GLint attribs[7 + 10 * 4], *attrib;
+    const char *frag_shader_text;
+    uint32_t i, j, num_fds = 0, swap_uv_planes = 0;
+    uint64_t modifier;
+    int fds[4];
+
+    // Per-plane attributes: fd, offset, pitch, modifier (lo, hi). Planes
+    // beyond the first one hold e.g. compression metadata of the layer
+    static const GLint g_plane_attribs[4][5] = {
+        { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT,
+          EGL_DMA_BUF_PLANE0_PITCH_EXT, EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT,
+          EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT,
+          EGL_DMA_BUF_PLANE1_PITCH_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT,
+          EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT,
+          EGL_DMA_BUF_PLANE2_PITCH_EXT, EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT,
+          EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE3_FD_EXT, EGL_DMA_BUF_PLANE3_OFFSET_EXT,
+          EGL_DMA_BUF_PLANE3_PITCH_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT,
+          EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT },
+    };
+
+    va_status = vaSyncSurface(rnd->va_display, s->id);
+    if (!va_check_status(va_status, "vaSyncSurface()"))
+        return false;
+
+    va_status = vaExportSurfaceHandle(rnd->va_display, s->id,
+        VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
+        VA_EXPORT_SURFACE_READ_ONLY | VA_EXPORT_SURFACE_SEPARATE_LAYERS,
+        &va_desc);
+    if (va_status == VA_STATUS_ERROR_UNIMPLEMENTED ||
+        va_status == VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE)
+        goto error_unsupported_export;
+    if (!va_check_status(va_status, "vaExportSurfaceHandle()"))
+        return false;
+    for (i = 0; i < va_desc.num_objects; i++)
+        rnd->export_fds[rnd->num_export_fds++] = va_desc.objects[i].fd;
+
+    switch (va_desc.fourcc) {
+    case VA_FOURCC('N','V','1','2'):
+        if (va_desc.num_layers != 2)
+            goto error_unsupported_format;
+        frag_shader_text = frag_shader_text_nv12;
+        break;
+    case VA_FOURCC('Y','V','1','2'):
+        swap_uv_planes = 1;
+        // fall-through
+    case VA_FOURCC('I','4','2','0'):
+        if (va_desc.num_layers != 3)
+            goto error_unsupported_format;
+        frag_shader_text = frag_shader_text_yuv;
+        break;
+    case VA_FOURCC('R','G','B','A'):
+    case VA_FOURCC('R','G','B','X'):
+    case VA_FOURCC('B','G','R','A'):
+    case VA_FOURCC('B','G','R','X'):
+        if (va_desc.num_layers != 1)
+            goto error_unsupported_format;
+#if USE_GLES_VERSION != 0
+        frag_shader_text = frag_shader_text_egl_external;
+#else
+        frag_shader_text = frag_shader_text_rgba;
+#endif
+        break;
+    default:
+        goto error_unsupported_format;
+    }
+
+    for (i = 0; i < va_desc.num_layers; i++) {
+        const uint32_t is_uv_plane = i > 0;
+        const uint32_t p = i ^ (3 & -(is_uv_plane & swap_uv_planes));
+        const uint32_t num_planes = va_desc.layers[p].num_planes;
+
+        if (num_planes < 1 || num_planes > 4)
+            goto error_unsupported_format;
+
+        // All planes of a layer share the modifier of the main surface,
+        // and auxiliary planes only make sense along with it
+        modifier = va_desc.objects[va_desc.layers[p].object_index[0]].
+            drm_format_modifier;
+        if (!egl->has_dma_buf_import_modifiers &&
+            (num_planes > 1 || (modifier != DRM_FORMAT_MOD_LINEAR &&
+                                modifier != DRM_FORMAT_MOD_INVALID)))
+            goto error_unsupported_modifier;
+
+        attrib = attribs;
+        *attrib++ = EGL_LINUX_DRM_FOURCC_EXT;
+        *attrib++ = va_desc.layers[p].drm_format;
+        *attrib++ = EGL_WIDTH;
+        *attrib++ = (va_desc.width + is_uv_plane) >> is_uv_plane;
+        *attrib++ = EGL_HEIGHT;
+        *attrib++ = (va_desc.height + is_uv_plane) >> is_uv_plane;
+
+        for (j = 0; j < num_planes; j++) {
+            const uint32_t obj = va_desc.layers[p].object_index[j];
+            int fd;
+
+            fd = va_desc.objects[obj].fd;
+            if (EGL_image_dma_buf_import_owns_fd && (fd = dup(fd)) < 0)
+                goto error_cleanup;
+            fds[num_fds++] = fd;
+
+            *attrib++ = g_plane_attribs[j][0];
+            *attrib++ = fd;
+            *attrib++ = g_plane_attribs[j][1];
+            *attrib++ = va_desc.layers[p].offset[j];
+            *attrib++ = g_plane_attribs[j][2];
+            *attrib++ = va_desc.layers[p].pitch[j];
+            if (egl->has_dma_buf_import_modifiers &&
+                modifier != DRM_FORMAT_MOD_INVALID) {
+                *attrib++ = g_plane_attribs[j][3];
+                *attrib++ = (GLint)(modifier & 0xffffffff);
+                *attrib++ = g_plane_attribs[j][4];
+                *attrib++ = (GLint)(modifier >> 32);
+            }
+        }
+        *attrib++ = EGL_NONE;
+        image = egl->vtable.egl_create_image_khr(egl->display, EGL_NO_CONTEXT,
+            EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)NULL, attribs);
+        if (!image)
+            goto error_import_layer;
+        egl->images[egl->num_images++] = image;
+        num_fds = 0;
+    }
+
+#if USE_GLES_VERSION == 0
+    egl->tex_target = GL_TEXTURE_2D;
+#else
+    egl->tex_target = GL_TEXTURE_EXTERNAL_OES;
+#endif
+    renderer_set_shader_text(rnd, frag_shader_text, NULL);
+    rnd->num_export_failures = 0;
+    return true;
+
+    /* ERRORS */
+error_unsupported_export:
+    av_log(rnd, AV_LOG_INFO, "vaExportSurfaceHandle() is not supported, "
+        "falling back to vaDeriveImage()\n");
+    rnd->use_export_surface = false;
+    return false;
+error_unsupported_modifier:
+    av_log(rnd, AV_LOG_INFO, "EGL stack cannot import DRM format modifier "
+        "0x%016" PRIx64 ", falling back to vaDeriveImage()\n", modifier);
+    rnd->use_export_surface = false;
+    goto error_cleanup;
+error_unsupported_format:
+    av_log(rnd, AV_LOG_DEBUG, "unsupported exported VA surface layout "
+        "(%.4s, %u layers)\n", (char *)&va_desc.fourcc, va_desc.num_layers);
+    goto error_persistent;
+error_import_layer:
+    av_log(rnd, AV_LOG_DEBUG, "failed to import exported VA surface layer "
+        "(%.4s:%u) into EGL image\n", (char *)&va_desc.fourcc, i);
+    // fall-through
+error_persistent:
+    // Surfaces keep the same layout, so this is not going to get better
+    if (++rnd->num_export_failures >= EXPORT_SURFACE_MAX_FAILURES) {
+        av_log(rnd, AV_LOG_INFO, "exported VA surfaces cannot be imported, "
+            "falling back to vaDeriveImage()\n");
+        rnd->use_export_surface = false;
+    }
+    // fall-through
+error_cleanup:
+    if (EGL_image_dma_buf_import_owns_fd) {
+        for (i = 0; i < num_fds; i++)
+            close(fds[i]);
+    }
+    renderer_clear_images(rnd);
+    return false;
+}
+#endif
+
 static bool
 renderer_bind_surface(FFVARendererEGL *rnd, FFVASurface *s)
 {
@@ -1259,6 +2552,11 @@ renderer_bind_surface(FFVARendererEGL *rnd, FFVASurface *s)
     if (rnd->use_mesa_image)
         return renderer_bind_mesa_image(rnd, s);
 
+#if USE_VA_EXPORT_SURFACE
+    if (rnd->use_export_surface && renderer_bind_exported_surface(rnd, s))
+        return true;
+#endif
+
     va_image_init_defaults(&rnd->va_image);
     va_status = vaDeriveImage(rnd->va_display, s->id, &rnd->va_image);
     if (!va_check_status(va_status, "vaDeriveImage()"))
@@ -1303,6 +2601,11 @@ renderer_unbind_surface(FFVARendererEGL *rnd)
     if (rnd->use_mesa_image)
         return renderer_unbind_mesa_image(rnd);
 
+#if USE_VA_EXPORT_SURFACE
+    while (rnd->num_export_fds > 0)
+        close(rnd->export_fds[--rnd->num_export_fds]);
+#endif
+
     if (rnd->va_buf_info.mem_size > 0) {
         va_status = vaReleaseBufferHandle(rnd->va_display, rnd->va_image.buf);
         if (!va_check_status(va_status, "vaReleaseBufferHandle()"))
@@ -1319,6 +2622,39 @@ renderer_unbind_surface(FFVARendererEGL *rnd)
     return !has_errors;
 }
 
+#if USE_GLES_VERSION != 1
+// Looks up the program matching the current shaders and texture target,
+// or builds a new one, evicting the oldest cached program if needed
+static EglProgram *
+renderer_ensure_program(FFVARendererEGL *rnd)
+{
+    EglContext * const egl = &rnd->egl_context;
+    EglProgram *program;
+    uint32_t i;
+
+    for (i = 0; i < egl->num_programs; i++) {
+        program = egl->programs[i];
+        if (egl_program_matches(program, egl->frag_shader_text,
+                egl->vert_shader_text, egl->tex_target))
+            return program;
+    }
+
+    program = egl_program_new(egl, egl->frag_shader_text,
+        egl->vert_shader_text, egl->tex_target);
+    if (!program)
+        return NULL;
+
+    if (egl->num_programs == EGL_PROGRAM_CACHE_SIZE) {
+        egl_program_free(egl->programs[0]);
+        memmove(&egl->programs[0], &egl->programs[1],
+            (EGL_PROGRAM_CACHE_SIZE - 1) * sizeof(egl->programs[0]));
+        egl->num_programs--;
+    }
+    egl->programs[egl->num_programs++] = program;
+    return program;
+}
+#endif
+
 static bool
 renderer_redraw(FFVARendererEGL *rnd, FFVASurface *s,
     const VARectangle *src_rect, const VARectangle *dst_rect)
@@ -1326,8 +2662,11 @@ renderer_redraw(FFVARendererEGL *rnd, FFVASurface *s,
     EglContext * const egl = &rnd->egl_context;
     EglProgram *program;
     GLfloat x0, y0, x1, y1;
-    GLfloat texcoords[4][2];
-    GLfloat positions[4][2];
+    GLfloat vertices[16];
+    GLfloat (* const positions)[2] = (GLfloat (*)[2])&vertices[0];
+    GLfloat (* const texcoords)[2] = (GLfloat (*)[2])&vertices[8];
+    uint64_t start_time;
+    bool success;
     uint32_t i;
 
     // Source coords in VA surface
@@ -1352,7 +2691,21 @@ renderer_redraw(FFVARendererEGL *rnd, FFVASurface *s,
     positions[2][0] = x1; positions[2][1] = y1;
     positions[3][0] = x0; positions[3][1] = y1;
 
-    glClear(GL_COLOR_BUFFER_BIT);
+    // Time the GPU work of the frame, whenever the GL stack could tell
+    if (egl->vtable.gl_gen_queries) {
+        if (!rnd->gpu_time_query)
+            egl->vtable.gl_gen_queries(1, &rnd->gpu_time_query);
+        egl->vtable.gl_begin_query(GL_TIME_ELAPSED, rnd->gpu_time_query);
+        rnd->has_gpu_time_query = false;
+    }
+
+    // Borders only need to be cleared if the video does not cover them all,
+    // and if they were not preserved from an earlier frame
+    if (!renderer_begin_frame(rnd, dst_rect) &&
+        (dst_rect->x > 0 || dst_rect->y > 0 ||
+         dst_rect->x + dst_rect->width < egl->surface_width ||
+         dst_rect->y + dst_rect->height < egl->surface_height))
+        glClear(GL_COLOR_BUFFER_BIT);
 
 #if USE_GLES_VERSION == 1
     glBindTexture(egl->tex_target, egl->textures[0]);
@@ -1367,11 +2720,11 @@ renderer_redraw(FFVARendererEGL *rnd, FFVASurface *s,
     glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 #else
     program = egl->program;
-    if (egl->program_changed) {
-        egl_program_freep(&egl->program);
+    if (egl->program_changed ||
+        (program && program->tex_target != egl->tex_target)) {
         egl->program_changed = false;
 
-        program = egl_program_new(egl->frag_shader_text, egl->vert_shader_text);
+        program = renderer_ensure_program(rnd);
         if (!program)
             return false;
         egl->program = program;
@@ -1381,10 +2734,23 @@ renderer_redraw(FFVARendererEGL *rnd, FFVASurface *s,
         glUseProgram(program->program);
         glUniformMatrix4fv(program->proj_uniform, 1, GL_FALSE, egl->proj);
     }
+
+    // Geometry only changes along with the source or target rectangles
+    if (!egl->vertex_buffer)
+        glGenBuffers(1, &egl->vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, egl->vertex_buffer);
+    if (!egl->has_vertices ||
+        memcmp(egl->vertices, vertices, sizeof(vertices)) != 0) {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices,
+            GL_STATIC_DRAW);
+        memcpy(egl->vertices, vertices, sizeof(vertices));
+        egl->has_vertices = true;
+    }
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, positions);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0);
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texcoords);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0,
+        (const void *)(8 * sizeof(GLfloat)));
 
     for (i = 0; i < egl->num_textures; i++) {
         glActiveTexture(GL_TEXTURE0 + i);
@@ -1396,12 +2762,310 @@ renderer_redraw(FFVARendererEGL *rnd, FFVASurface *s,
 
     glDisableVertexAttribArray(1);
     glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     if (program)
         glUseProgram(0);
 #endif
 
-    eglSwapBuffers(egl->display, egl->surface);
-    return true;
+    if (egl->vtable.gl_gen_queries) {
+        egl->vtable.gl_end_query(GL_TIME_ELAPSED);
+        rnd->has_gpu_time_query = true;
+    }
+
+    start_time = get_time_us();
+    if (rnd->is_offscreen)
+        success = renderer_readback(rnd);
+    else
+        success = renderer_present(rnd);
+    if (success)
+        renderer_queue_frame(rnd);
+    renderer_account_frame(rnd, start_time);
+    return success;
+}
+
+// Allocates decoder surfaces from Mesa DRM images, so that decoded frames
+// directly land into memory the renderer can display without any copy
+static int
+renderer_create_surfaces(FFVARendererEGL *rnd, uint32_t chroma,
+    uint32_t width, uint32_t height, VASurfaceID *surfaces,
+    uint32_t num_surfaces)
+{
+    EglContext * const egl = &rnd->egl_context;
+    EglVTable * const vtable = &egl->vtable;
+    EglImportBuffer *bufs = NULL, *buf;
+    VASurfaceAttribExternalBuffers va_extbuf;
+    unsigned long va_extbuf_handle;
+    VASurfaceAttrib va_attribs[2], *va_attrib;
+    uint32_t i = 0, j, num_bufs, generation, luma_height, buf_height;
+    VAStatus va_status;
+    EGLImageKHR image = EGL_NO_IMAGE_KHR;
+    EGLint name, stride;
+    GLint attribs[9], *attrib;
+    int ret = AVERROR(ENOMEM);
+
+    if (!rnd->use_mesa_image)
+        return AVERROR(ENOSYS);
+    if (chroma != VA_RT_FORMAT_YUV420)
+        return AVERROR(ENOTSUP);
+
+    pthread_mutex_lock(&rnd->import_lock);
+    num_bufs = rnd->num_import_buffers;
+    bufs = realloc(rnd->import_buffers,
+        (num_bufs + num_surfaces) * sizeof(*bufs));
+    if (!bufs)
+        goto error_cleanup;
+    rnd->import_buffers = bufs;
+    generation = rnd->import_generation + 1;
+
+    /* Mesa only allocates ARGB32 images, so NV12 surfaces are laid out as
+       the luma plane followed by the interleaved chroma plane, both using
+       the pitch of a single image of one and a half times the height */
+    luma_height = FFALIGN(height, 32);
+    buf_height = luma_height + luma_height / 2;
+
+    for (i = 0; i < num_surfaces; i++) {
+        buf = &bufs[num_bufs + i];
+        memset(buf, 0, sizeof(*buf));
+        buf->va_surface = VA_INVALID_ID;
+        buf->generation = generation;
+        buf->storage = EGL_NO_IMAGE_KHR;
+
+        attrib = attribs;
+        *attrib++ = EGL_DRM_BUFFER_FORMAT_MESA;
+        *attrib++ = EGL_DRM_BUFFER_FORMAT_ARGB32_MESA;
+        *attrib++ = EGL_WIDTH;
+        *attrib++ = FFALIGN(width, 16) / 4;
+        *attrib++ = EGL_HEIGHT;
+        *attrib++ = buf_height;
+        *attrib++ = EGL_DRM_BUFFER_USE_MESA;
+        *attrib++ = EGL_DRM_BUFFER_USE_SHARE_MESA;
+        *attrib++ = EGL_NONE;
+        image = vtable->egl_create_drm_image_mesa(egl->display, attribs);
+        if (!image)
+            goto error_create_image;
+        buf->storage = image;
+
+        if (!vtable->egl_export_drm_image_mesa(egl->display, image, &name,
+                NULL, &stride))
+            goto error_export_image;
+
+        va_attrib = va_attribs;
+        va_attrib->type = VASurfaceAttribExternalBufferDescriptor;
+        va_attrib->flags = VA_SURFACE_ATTRIB_SETTABLE;
+        va_attrib->value.type = VAGenericValueTypePointer;
+        va_attrib->value.value.p = &va_extbuf;
+        va_attrib++;
+        va_attrib->type = VASurfaceAttribMemoryType;
+        va_attrib->flags = VA_SURFACE_ATTRIB_SETTABLE;
+        va_attrib->value.type = VAGenericValueTypeInteger;
+        va_attrib->value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_KERNEL_DRM;
+        va_attrib++;
+
+        va_extbuf_handle = name;
+        va_extbuf.pixel_format = VA_FOURCC('N','V','1','2');
+        va_extbuf.width = width;
+        va_extbuf.height = height;
+        va_extbuf.data_size = buf_height * stride;
+        va_extbuf.num_planes = 2;
+        va_extbuf.pitches[0] = stride;
+        va_extbuf.pitches[1] = stride;
+        va_extbuf.offsets[0] = 0;
+        va_extbuf.offsets[1] = luma_height * stride;
+        va_extbuf.buffers = &va_extbuf_handle;
+        va_extbuf.num_buffers = 1;
+        va_extbuf.flags = 0;
+        va_extbuf.private_data = NULL;
+        va_status = vaCreateSurfaces(rnd->va_display, chroma, width, height,
+            &buf->va_surface, 1, va_attribs, va_attrib - va_attribs);
+        if (!va_check_status(va_status, "vaCreateSurfaces()"))
+            goto error_create_surface;
+        surfaces[i] = buf->va_surface;
+    }
+    rnd->num_import_buffers = num_bufs + num_surfaces;
+    rnd->import_generation = generation;
+    pthread_mutex_unlock(&rnd->import_lock);
+
+    av_log(rnd, AV_LOG_VERBOSE, "allocated %u NV12 surfaces of size %ux%u "
+        "from Mesa DRM images\n", num_surfaces, width, height);
+    return 0;
+
+    /* ERRORS */
+error_create_image:
+    av_log(rnd, AV_LOG_ERROR, "failed to create Mesa DRM image of size %ux%u\n",
+        width, height);
+    ret = AVERROR(ENOMEM);
+    goto error_cleanup;
+error_export_image:
+    av_log(rnd, AV_LOG_ERROR, "failed to export Mesa DRM image %p\n", image);
+    ret = AVERROR(EIO);
+    goto error_cleanup;
+error_create_surface:
+    av_log(rnd, AV_LOG_ERROR, "failed to create VA surface from Mesa image\n");
+    ret = vaapi_to_ffmpeg_error(va_status);
+    goto error_cleanup;
+error_cleanup:
+    if (bufs) {
+        for (j = 0; j <= i && j < num_surfaces; j++) {
+            buf = &bufs[num_bufs + j];
+            va_destroy_surface(rnd->va_display, &buf->va_surface);
+            import_buffer_clear(rnd, buf);
+        }
+    }
+    pthread_mutex_unlock(&rnd->import_lock);
+    return ret;
+}
+
+// Looks up the imported buffer that backs the supplied VA surface, if any.
+// The import lock shall be held
+static EglImportBuffer *
+renderer_find_import_buffer(FFVARendererEGL *rnd, FFVASurface *s)
+{
+    uint32_t i;
+
+    for (i = 0; i < rnd->num_import_buffers; i++) {
+        EglImportBuffer * const buf = &rnd->import_buffers[i];
+
+        if (buf->va_surface == s->id)
+            return buf->bind_failed ? NULL : buf;
+    }
+    return NULL;
+}
+
+// Creates the EGL images and GL textures for the Y and UV planes of an
+// imported buffer. This is only performed once, on first display
+static bool
+renderer_bind_import_buffer(FFVARendererEGL *rnd, EglImportBuffer *buf,
+    FFVASurface *s)
+{
+    EglContext * const egl = &rnd->egl_context;
+    VAImage va_image;
+    VABufferInfo va_buf_info;
+    VAStatus va_status;
+    EGLImageKHR image;
+    GLint attribs[13], *attrib;
+    GLuint texture;
+    bool has_buf_handle = false, success = false;
+    uint32_t i;
+    int fd;
+
+    va_image_init_defaults(&va_image);
+    va_status = vaDeriveImage(rnd->va_display, s->id, &va_image);
+    if (!va_check_status(va_status, "vaDeriveImage()"))
+        return false;
+
+    memset(&va_buf_info, 0, sizeof(va_buf_info));
+    va_buf_info.mem_type = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME;
+    va_status = vaAcquireBufferHandle(rnd->va_display, va_image.buf,
+        &va_buf_info);
+    if (!va_check_status(va_status, "vaAcquireBufferHandle()"))
+        goto cleanup;
+    has_buf_handle = true;
+
+    for (i = 0; i < 2; i++) {
+        const uint32_t is_uv_plane = i > 0;
+
+        fd = (intptr_t)va_buf_info.handle;
+        if (EGL_image_dma_buf_import_owns_fd && (fd = dup(fd)) < 0)
+            goto cleanup;
+
+        attrib = attribs;
+        *attrib++ = EGL_LINUX_DRM_FOURCC_EXT;
+        *attrib++ = is_uv_plane ? DRM_FORMAT_GR88 : DRM_FORMAT_R8;
+        *attrib++ = EGL_WIDTH;
+        *attrib++ = (va_image.width + is_uv_plane) >> is_uv_plane;
+        *attrib++ = EGL_HEIGHT;
+        *attrib++ = (va_image.height + is_uv_plane) >> is_uv_plane;
+        *attrib++ = EGL_DMA_BUF_PLANE0_FD_EXT;
+        *attrib++ = fd;
+        *attrib++ = EGL_DMA_BUF_PLANE0_OFFSET_EXT;
+        *attrib++ = va_image.offsets[i];
+        *attrib++ = EGL_DMA_BUF_PLANE0_PITCH_EXT;
+        *attrib++ = va_image.pitches[i];
+        *attrib++ = EGL_NONE;
+        image = egl->vtable.egl_create_image_khr(egl->display, EGL_NO_CONTEXT,
+            EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)NULL, attribs);
+        if (!image) {
+            av_log(rnd, AV_LOG_ERROR,
+                "failed to import Mesa VA surface (NV12:%s) into EGL image\n",
+                is_uv_plane ? "UV" : "Y");
+            if (EGL_image_dma_buf_import_owns_fd)
+                close(fd);
+            goto cleanup;
+        }
+        buf->images[buf->num_images++] = image;
+
+        glGenTextures(1, &texture);
+        glBindTexture(RENDERER_IMPORT_TEX_TARGET, texture);
+        gl_texture_init_defaults(texture, RENDERER_IMPORT_TEX_TARGET);
+        egl->vtable.gl_egl_image_target_texture2d_oes(
+            RENDERER_IMPORT_TEX_TARGET, image);
+        glBindTexture(RENDERER_IMPORT_TEX_TARGET, 0);
+        buf->textures[buf->num_textures++] = texture;
+    }
+    success = true;
+
+cleanup:
+    if (has_buf_handle) {
+        va_status = vaReleaseBufferHandle(rnd->va_display, va_image.buf);
+        va_check_status(va_status, "vaReleaseBufferHandle()");
+    }
+    va_status = vaDestroyImage(rnd->va_display, va_image.image_id);
+    va_check_status(va_status, "vaDestroyImage()");
+    if (!success)
+        import_buffer_unbind(rnd, buf);
+    return success;
+}
+
+// Renders an imported buffer through its cached plane textures
+static bool
+renderer_put_import_buffer(FFVARendererEGL *rnd, EglImportBuffer *buf,
+    FFVASurface *s, const VARectangle *src_rect, const VARectangle *dst_rect)
+{
+    EglContext * const egl = &rnd->egl_context;
+    GLuint textures[FF_ARRAY_ELEMS(egl->textures)];
+    uint32_t num_textures;
+    bool success;
+
+    // Swap in the cached textures, so that they survive the next redraw
+    num_textures = egl->num_textures;
+    memcpy(textures, egl->textures, sizeof(textures));
+    memcpy(egl->textures, buf->textures,
+        buf->num_textures * sizeof(buf->textures[0]));
+    egl->num_textures = buf->num_textures;
+
+    egl->tex_target = RENDERER_IMPORT_TEX_TARGET;
+    renderer_set_shader_text(rnd, frag_shader_text_nv12, NULL);
+    success = renderer_redraw(rnd, s, src_rect, dst_rect);
+
+    memcpy(egl->textures, textures, sizeof(textures));
+    egl->num_textures = num_textures;
+    return success;
+}
+
+// Displays the supplied surface if it was allocated by the renderer. Returns
+// false if it was not, and the regular import paths have to be used instead
+static bool
+renderer_put_imported_surface(FFVARendererEGL *rnd, FFVASurface *surface,
+    const VARectangle *src_rect, const VARectangle *dst_rect,
+    bool *success_ptr)
+{
+    EglImportBuffer *buf;
+
+    pthread_mutex_lock(&rnd->import_lock);
+    renderer_purge_import_buffers(rnd, false);
+    buf = renderer_find_import_buffer(rnd, surface);
+    if (buf && buf->num_textures == 0 &&
+        !renderer_bind_import_buffer(rnd, buf, surface)) {
+        av_log(rnd, AV_LOG_WARNING, "failed to bind Mesa VA surface 0x%08x, "
+            "falling back to copies\n", surface->id);
+        buf->bind_failed = true;
+        buf = NULL;
+    }
+    if (buf)
+        *success_ptr = renderer_put_import_buffer(rnd, buf, surface,
+            src_rect, dst_rect);
+    pthread_mutex_unlock(&rnd->import_lock);
+    return buf != NULL;
 }
 
 static bool
@@ -1409,6 +3073,16 @@ renderer_put_surface(FFVARendererEGL *rnd, FFVASurface *surface,
     const VARectangle *src_rect, const VARectangle *dst_rect, uint32_t flags)
 {
     uint32_t has_errors = 0;
+    bool success;
+
+    // The surface is released along with the fence of the drawn frame
+    rnd->pending_surface = surface;
+
+    if (rnd->use_mesa_image && renderer_put_imported_surface(rnd, surface,
+            src_rect, dst_rect, &success)) {
+        renderer_release_pending_surface(rnd, true);
+        return success;
+    }
 
     if (!rnd->use_mesa_image)
         renderer_clear_images(rnd);
@@ -1436,6 +3110,7 @@ renderer_put_surface(FFVARendererEGL *rnd, FFVASurface *surface,
             surface->id);
         has_errors++;
     }
+    renderer_release_pending_surface(rnd, true);
     return !has_errors;
 }
 
@@ -1456,7 +3131,15 @@ ffva_renderer_egl_class(void)
         .get_visual_id  = (FFVARendererGetVisualIdFunc)renderer_get_visual_id,
         .get_size       = (FFVARendererGetSizeFunc)renderer_get_size,
         .set_size       = (FFVARendererSetSizeFunc)renderer_set_size,
+        .get_formats    = (FFVARendererGetFormatsFunc)renderer_get_formats,
+        .create_surfaces =
+            (FFVARendererCreateSurfacesFunc)renderer_create_surfaces,
         .put_surface    = (FFVARendererPutSurfaceFunc)renderer_put_surface,
+        .release_surfaces =
+            (FFVARendererReleaseSurfacesFunc)renderer_release_surfaces,
+        .get_gpu_time   = (FFVARendererGetGpuTimeFunc)renderer_get_gpu_time,
+        .get_refresh_interval =
+            (FFVARendererGetRefreshIntervalFunc)renderer_get_refresh_interval,
     };
     return &g_class;
 }
@@ -1467,3 +3150,100 @@ ffva_renderer_egl_new(FFVADisplay *display, uint32_t flags)
 {
     return ffva_renderer_new(ffva_renderer_egl_class(), display, flags);
 }
+
+// Sets the function that receives the frames rendered offscreen
+void
+ffva_renderer_egl_set_readback_func(FFVARenderer *base_rnd,
+    FFVARendererEGLReadbackFunc func, void *user_data)
+{
+    FFVARendererEGL * const rnd = FFVA_RENDERER_EGL(base_rnd);
+
+    if (!rnd || ffva_renderer_get_type(base_rnd) != FFVA_RENDERER_TYPE_EGL)
+        return;
+
+    // Frames in flight belong to the previous receiver
+    if (rnd->egl_context.context)
+        renderer_flush_readbacks(rnd);
+    rnd->readback_func = func;
+    rnd->readback_data = user_data;
+}
+
+// Delivers all the frames that are still being read back
+bool
+ffva_renderer_egl_flush(FFVARenderer *base_rnd)
+{
+    FFVARendererEGL * const rnd = FFVA_RENDERER_EGL(base_rnd);
+
+    if (!rnd || ffva_renderer_get_type(base_rnd) != FFVA_RENDERER_TYPE_EGL)
+        return false;
+
+    if (rnd->egl_context.context) {
+        renderer_flush_readbacks(rnd);
+        renderer_flush_frames(rnd);
+    }
+    return true;
+}
+
+// Bounds the number of frames queued in the driver
+bool
+ffva_renderer_egl_set_max_queued_frames(FFVARenderer *base_rnd,
+    uint32_t num_frames)
+{
+    FFVARendererEGL * const rnd = FFVA_RENDERER_EGL(base_rnd);
+
+    if (!rnd || ffva_renderer_get_type(base_rnd) != FFVA_RENDERER_TYPE_EGL)
+        return false;
+    if (num_frames > FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES)
+        return false;
+
+    rnd->max_queued_frames = num_frames;
+    if (num_frames > 0 && rnd->egl_context.context) {
+        while (rnd->num_queued_frames > num_frames)
+            renderer_retire_frame(rnd, EGL_FOREVER_KHR);
+    }
+    return true;
+}
+
+// Returns the presentation statistics of the renderer
+bool
+ffva_renderer_egl_get_stats(FFVARenderer *base_rnd,
+    FFVARendererEGLStats *stats)
+{
+    FFVARendererEGL * const rnd = FFVA_RENDERER_EGL(base_rnd);
+    double seconds;
+
+    if (!rnd || ffva_renderer_get_type(base_rnd) != FFVA_RENDERER_TYPE_EGL ||
+        !stats)
+        return false;
+
+    stats->num_frames = rnd->num_frames;
+    stats->total_time = rnd->last_frame_time - rnd->first_frame_time;
+    seconds = stats->total_time / 1000000.0;
+    stats->frames_per_second = seconds > 0 ?
+        (rnd->num_frames - 1) / seconds : 0.0;
+    stats->present_time = rnd->num_frames > 0 ?
+        (double)rnd->present_time / rnd->num_frames : 0.0;
+    stats->num_latencies = rnd->num_latencies;
+    stats->latency = rnd->num_latencies > 0 ?
+        (double)rnd->total_latency / rnd->num_latencies : 0.0;
+    stats->max_latency = rnd->max_latency;
+    return true;
+}
+
+// Prints out the presentation statistics of the renderer
+void
+ffva_renderer_egl_report(FFVARenderer *base_rnd)
+{
+    FFVARendererEGLStats stats;
+
+    if (!ffva_renderer_egl_get_stats(base_rnd, &stats))
+        return;
+
+    av_log(base_rnd, AV_LOG_INFO, "presented %" PRIu64 " frames, %.1f fps, "
+        "%.2f ms blocked per frame\n", stats.num_frames,
+        stats.frames_per_second, stats.present_time / 1000.0);
+    if (stats.num_latencies > 0)
+        av_log(base_rnd, AV_LOG_INFO, "GPU completion latency: %.2f ms mean, "
+            "%.2f ms max\n", stats.latency / 1000.0,
+            stats.max_latency / 1000.0);
+}
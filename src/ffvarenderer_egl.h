@@ -29,6 +29,7 @@
     ((FFVARendererEGL *)(rnd))
 
 typedef struct ffva_renderer_egl_s      FFVARendererEGL;
+typedef struct ffva_renderer_egl_stats_s FFVARendererEGLStats;
 
 enum {
     FFVA_RENDERER_EGL_MEM_TYPE_DMA_BUFFER = 1,
@@ -36,10 +37,67 @@ enum {
     FFVA_RENDERER_EGL_MEM_TYPE_MESA_IMAGE,
     FFVA_RENDERER_EGL_MEM_TYPE_MESA_TEXTURE,
     FFVA_RENDERER_EGL_MEM_TYPE_MASK = (0x7 << 0),
+
+    /* Render into an offscreen framebuffer, without any native window */
+    FFVA_RENDERER_EGL_OFFSCREEN = 1 << 3,
+
+    /* Present frames immediately, without waiting for vertical blanking */
+    FFVA_RENDERER_EGL_NO_VSYNC = 1 << 4,
+
+    /* Only report the video rectangle as damaged, whenever it is unchanged */
+    FFVA_RENDERER_EGL_DAMAGE = 1 << 5,
 };
 
+/** Maximum number of frames the renderer could keep queued in the driver */
+#define FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES 4
+
+/** Presentation statistics of the EGL renderer */
+struct ffva_renderer_egl_stats_s {
+    uint64_t num_frames;
+    uint64_t total_time;        /* in microseconds, from first to last frame */
+    double frames_per_second;
+    double present_time;        /* mean time blocked in presentation, in us */
+    uint64_t num_latencies;
+    double latency;             /* mean time until the GPU completed a frame */
+    uint64_t max_latency;       /* in microseconds */
+};
+
+/** Receives RGBA frames read back from an offscreen renderer, top-down */
+typedef void (*FFVARendererEGLReadbackFunc)(void *user_data,
+    const uint8_t *pixels, uint32_t width, uint32_t height, uint32_t stride);
+
 /** Creates a new renderer object from the supplied VA display */
 FFVARenderer *
 ffva_renderer_egl_new(FFVADisplay *display, uint32_t flags);
 
+/**
+ * Sets the function that receives the frames rendered offscreen. Frames are
+ * read back asynchronously, so they are delivered a few frames late
+ */
+void
+ffva_renderer_egl_set_readback_func(FFVARenderer *rnd,
+    FFVARendererEGLReadbackFunc func, void *user_data);
+
+/** Delivers all the frames that are still being read back */
+bool
+ffva_renderer_egl_flush(FFVARenderer *rnd);
+
+/**
+ * Bounds the number of frames queued in the driver, i.e. presented but not
+ * yet completed by the GPU, to the supplied value. Zero lets the driver
+ * decide. The number of frames shall not exceed
+ * FFVA_RENDERER_EGL_MAX_QUEUED_FRAMES
+ */
+bool
+ffva_renderer_egl_set_max_queued_frames(FFVARenderer *rnd,
+    uint32_t num_frames);
+
+/** Returns the presentation statistics of the renderer */
+bool
+ffva_renderer_egl_get_stats(FFVARenderer *rnd, FFVARendererEGLStats *stats);
+
+/** Prints out the presentation statistics of the renderer */
+void
+ffva_renderer_egl_report(FFVARenderer *rnd);
+
 #endif /* FFVA_RENDERER_EGL_H */
@@ -39,8 +39,17 @@ typedef bool (*FFVARendererGetSizeFunc)(FFVARenderer *rnd, uint32_t *width_ptr,
     uint32_t *height_ptr);
 typedef bool (*FFVARendererSetSizeFunc)(FFVARenderer *rnd, uint32_t width,
     uint32_t height);
+typedef const FFVAFormatCost *(*FFVARendererGetFormatsFunc)(FFVARenderer *rnd);
+typedef int (*FFVARendererCreateSurfacesFunc)(FFVARenderer *rnd,
+    uint32_t chroma, uint32_t width, uint32_t height, VASurfaceID *surfaces,
+    uint32_t num_surfaces);
 typedef bool (*FFVARendererPutSurfaceFunc)(FFVARenderer *rnd, FFVASurface *s,
     const VARectangle *src_rect, const VARectangle *dst_rect, uint32_t flags);
+typedef void (*FFVARendererReleaseSurfacesFunc)(FFVARenderer *rnd);
+typedef int (*FFVARendererGetGpuTimeFunc)(FFVARenderer *rnd,
+    uint64_t *time_ptr);
+typedef bool (*FFVARendererGetRefreshIntervalFunc)(FFVARenderer *rnd,
+    uint64_t *interval_ptr);
 
 struct ffva_renderer_s {
     const void *klass;
@@ -49,6 +58,8 @@ struct ffva_renderer_s {
     void *window;
     uint32_t width;
     uint32_t height;
+    FFVARendererReleaseFunc release_func;
+    void *release_data;
 };
 
 struct ffva_renderer_class_s {
@@ -60,7 +71,13 @@ struct ffva_renderer_class_s {
     FFVARendererGetVisualIdFunc get_visual_id;
     FFVARendererGetSizeFunc get_size;
     FFVARendererSetSizeFunc set_size;
+    FFVARendererGetFormatsFunc get_formats;
+    FFVARendererCreateSurfacesFunc create_surfaces;
     FFVARendererPutSurfaceFunc put_surface;
+    /* Renderers that implement this hook release surfaces on their own */
+    FFVARendererReleaseSurfacesFunc release_surfaces;
+    FFVARendererGetGpuTimeFunc get_gpu_time;
+    FFVARendererGetRefreshIntervalFunc get_refresh_interval;
 };
 
 DLL_HIDDEN
@@ -72,4 +89,8 @@ DLL_HIDDEN
 uintptr_t
 ffva_renderer_get_visual_id(FFVARenderer *rnd);
 
+DLL_HIDDEN
+void
+ffva_renderer_release_surface(FFVARenderer *rnd, FFVASurface *surface);
+
 #endif /* FFVA_RENDERER_PRIV_H */
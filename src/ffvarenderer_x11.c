@@ -24,6 +24,9 @@
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#if USE_XRANDR
+# include <X11/extensions/Xrandr.h>
+#endif
 #include <va/va_x11.h>
 #include "ffvarenderer_x11.h"
 #include "ffvarenderer_priv.h"
@@ -266,6 +269,78 @@ error_put_surface:
     return false;
 }
 
+#if USE_XRANDR
+// Returns the refresh interval of the supplied mode, in microseconds
+static uint64_t
+xrandr_get_mode_interval(const XRRModeInfo *mode)
+{
+    uint64_t num_lines = mode->vTotal;
+
+    if (mode->modeFlags & RR_DoubleScan)
+        num_lines *= 2;
+    if (mode->modeFlags & RR_Interlace)
+        num_lines /= 2;
+    if (!mode->dotClock || !mode->hTotal || !num_lines)
+        return 0;
+    return (mode->hTotal * num_lines * 1000000 + mode->dotClock / 2) /
+        mode->dotClock;
+}
+#endif
+
+// Determines the refresh interval of the CRTC the window lies on, or of
+// the first active CRTC if none does
+static bool
+renderer_get_refresh_interval(FFVARendererX11 *rnd, uint64_t *interval_ptr)
+{
+#if USE_XRANDR
+    XRRScreenResources *res;
+    XRRCrtcInfo *crtc;
+    Window child;
+    uint64_t interval = 0, mode_interval;
+    int i, j, x = 0, y = 0, event_base, error_base;
+    bool is_window_crtc;
+
+    if (!XRRQueryExtension(rnd->display, &event_base, &error_base))
+        return false;
+
+    if (rnd->window)
+        XTranslateCoordinates(rnd->display, rnd->window, rnd->root_window,
+            rnd->window_width / 2, rnd->window_height / 2, &x, &y, &child);
+
+    res = XRRGetScreenResourcesCurrent(rnd->display, rnd->root_window);
+    if (!res)
+        return false;
+
+    for (i = 0; i < res->ncrtc; i++) {
+        crtc = XRRGetCrtcInfo(rnd->display, res, res->crtc[i]);
+        if (!crtc)
+            continue;
+        mode_interval = 0;
+        for (j = 0; j < res->nmode && crtc->mode != None; j++) {
+            if (res->modes[j].id == crtc->mode) {
+                mode_interval = xrandr_get_mode_interval(&res->modes[j]);
+                break;
+            }
+        }
+        is_window_crtc = x >= crtc->x && x < crtc->x + (int)crtc->width &&
+            y >= crtc->y && y < crtc->y + (int)crtc->height;
+        XRRFreeCrtcInfo(crtc);
+        if (mode_interval && (!interval || is_window_crtc))
+            interval = mode_interval;
+        if (mode_interval && is_window_crtc)
+            break;
+    }
+    XRRFreeScreenResources(res);
+
+    if (!interval)
+        return false;
+    *interval_ptr = interval;
+    return true;
+#else
+    return false;
+#endif
+}
+
 static const FFVARendererClass *
 ffva_renderer_x11_class(void)
 {
@@ -283,6 +358,8 @@ ffva_renderer_x11_class(void)
         .get_size       = (FFVARendererGetSizeFunc)renderer_get_size,
         .set_size       = (FFVARendererSetSizeFunc)renderer_set_size,
         .put_surface    = (FFVARendererPutSurfaceFunc)renderer_put_surface,
+        .get_refresh_interval =
+            (FFVARendererGetRefreshIntervalFunc)renderer_get_refresh_interval,
     };
     return &g_class;
 }
@@ -0,0 +1,216 @@
+/*
+ * ffvascalepolicy.c - Scale placement policy
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include "ffvascalepolicy.h"
+
+/* Minimum source to target area ratio for VPP downscaling to be tried */
+#define FFVA_SCALE_POLICY_MIN_AREA_RATIO 2.0
+
+/* Number of frames timed on each path before a decision is made */
+#define FFVA_SCALE_POLICY_MIN_SAMPLES 8
+
+/* Interval, in frames, at which both paths are timed again */
+#define FFVA_SCALE_POLICY_PROBE_INTERVAL 256
+
+/* Weight of the latest frame time in the moving averages */
+#define FFVA_SCALE_POLICY_EWMA_ALPHA 0.125
+
+typedef enum {
+    PATH_RENDERER = 0,
+    PATH_VPP,
+    PATH_COUNT
+} Path;
+
+typedef struct {
+    double cost;                        /* EWMA of GPU frame time, in us */
+    uint32_t num_samples;
+} PathStats;
+
+struct ffva_scale_policy_s {
+    const void *klass;
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_width;
+    uint32_t dst_height;
+    PathStats paths[PATH_COUNT];
+    Path path;
+    Path frame_path;
+    bool frame_is_timed;
+    uint32_t num_frames;
+};
+
+static const char *g_path_names[PATH_COUNT] = { "renderer", "VPP" };
+
+// Resets all measurements, e.g. when the stream geometry changes
+static void
+policy_reset(FFVAScalePolicy *policy, uint32_t src_width, uint32_t src_height,
+    uint32_t dst_width, uint32_t dst_height)
+{
+    memset(policy->paths, 0, sizeof(policy->paths));
+    policy->src_width = src_width;
+    policy->src_height = src_height;
+    policy->dst_width = dst_width;
+    policy->dst_height = dst_height;
+    policy->path = PATH_VPP;
+    policy->num_frames = 0;
+}
+
+// Selects the path for the next frame, given the geometry is a candidate
+// for VPP downscaling, and whether that frame is to be timed
+static Path
+policy_select_path(FFVAScalePolicy *policy, bool *is_timed_ptr)
+{
+    PathStats * const renderer = &policy->paths[PATH_RENDERER];
+    PathStats * const vpp = &policy->paths[PATH_VPP];
+    uint32_t phase;
+    Path path;
+
+    // Time both paths first, starting with VPP
+    *is_timed_ptr = true;
+    if (vpp->num_samples < FFVA_SCALE_POLICY_MIN_SAMPLES)
+        return PATH_VPP;
+    if (renderer->num_samples < FFVA_SCALE_POLICY_MIN_SAMPLES)
+        return PATH_RENDERER;
+
+    path = vpp->cost < renderer->cost ? PATH_VPP : PATH_RENDERER;
+    if (path != policy->path) {
+        av_log(policy, AV_LOG_VERBOSE, "scaling %ux%u to %ux%u in %s "
+            "(%.0f us vs. %.0f us per frame)\n", policy->src_width,
+            policy->src_height, policy->dst_width, policy->dst_height,
+            g_path_names[path], policy->paths[path].cost,
+            policy->paths[path ^ 1].cost);
+        policy->path = path;
+    }
+
+    // Periodically refresh both estimates, on two consecutive frames
+    phase = ++policy->num_frames % FFVA_SCALE_POLICY_PROBE_INTERVAL;
+    *is_timed_ptr = phase <= 1;
+    return phase == 0 ? path ^ 1 : path;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Interface                                                         --- */
+/* ------------------------------------------------------------------------- */
+
+static const AVClass *
+ffva_scale_policy_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVAScalePolicy",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Creates a new scale placement policy
+FFVAScalePolicy *
+ffva_scale_policy_new(void)
+{
+    FFVAScalePolicy *policy;
+
+    policy = calloc(1, sizeof(*policy));
+    if (!policy)
+        return NULL;
+
+    policy->klass = ffva_scale_policy_class();
+    policy_reset(policy, 0, 0, 0, 0);
+    return policy;
+}
+
+// Destroys the supplied scale placement policy
+void
+ffva_scale_policy_free(FFVAScalePolicy *policy)
+{
+    free(policy);
+}
+
+// Releases scale placement policy and resets the supplied pointer
+void
+ffva_scale_policy_freep(FFVAScalePolicy **policy_ptr)
+{
+    if (!policy_ptr)
+        return;
+    ffva_scale_policy_free(*policy_ptr);
+    *policy_ptr = NULL;
+}
+
+// Decides whether to downscale src_rect to the target size with VPP
+bool
+ffva_scale_policy_begin_frame(FFVAScalePolicy *policy,
+    const VARectangle *src_rect, uint32_t dst_width, uint32_t dst_height,
+    bool vpp_required)
+{
+    uint64_t src_area, dst_area;
+
+    if (!policy || !src_rect)
+        return false;
+
+    policy->frame_is_timed = false;
+
+    // Never upscale with VPP, the renderer does it at no bandwidth cost
+    src_area = (uint64_t)src_rect->width * src_rect->height;
+    dst_area = (uint64_t)dst_width * dst_height;
+    if (dst_width > src_rect->width || dst_height > src_rect->height ||
+        src_area <= dst_area)
+        return false;
+    if (vpp_required)
+        return true;
+    if (src_area < FFVA_SCALE_POLICY_MIN_AREA_RATIO * dst_area)
+        return false;
+
+    if (src_rect->width != policy->src_width ||
+        src_rect->height != policy->src_height ||
+        dst_width != policy->dst_width || dst_height != policy->dst_height)
+        policy_reset(policy, src_rect->width, src_rect->height, dst_width,
+            dst_height);
+
+    policy->frame_path = policy_select_path(policy, &policy->frame_is_timed);
+    return policy->frame_path == PATH_VPP;
+}
+
+// Determines whether the GPU time of the frame is to be measured
+bool
+ffva_scale_policy_is_frame_timed(FFVAScalePolicy *policy)
+{
+    return policy && policy->frame_is_timed;
+}
+
+// Accounts for the GPU time spent processing and presenting the frame
+void
+ffva_scale_policy_end_frame(FFVAScalePolicy *policy, uint64_t gpu_time)
+{
+    PathStats *stats;
+
+    if (!policy || !policy->frame_is_timed)
+        return;
+    policy->frame_is_timed = false;
+
+    stats = &policy->paths[policy->frame_path];
+    if (stats->num_samples++ == 0)
+        stats->cost = gpu_time;
+    else
+        stats->cost += FFVA_SCALE_POLICY_EWMA_ALPHA *
+            ((double)gpu_time - stats->cost);
+}
@@ -0,0 +1,70 @@
+/*
+ * ffvascalepolicy.h - Scale placement policy
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_SCALE_POLICY_H
+#define FFVA_SCALE_POLICY_H
+
+#include <stdint.h>
+#include <va/va.h>
+
+/*
+ * The scale policy decides, for one stream, whether the source rectangle
+ * is downscaled to the target size with VPP before presentation, or
+ * sampled down by the renderer. The cheapest path on the GPU is kept for
+ * a given geometry. Measuring GPU time means waiting for the frame to
+ * complete, so only a few frames are timed: the first ones on each path,
+ * then one on each path from time to time.
+ */
+
+typedef struct ffva_scale_policy_s      FFVAScalePolicy;
+
+/** Creates a new scale placement policy */
+FFVAScalePolicy *
+ffva_scale_policy_new(void);
+
+/** Destroys the supplied scale placement policy */
+void
+ffva_scale_policy_free(FFVAScalePolicy *policy);
+
+/** Releases scale placement policy and resets the supplied pointer */
+void
+ffva_scale_policy_freep(FFVAScalePolicy **policy_ptr);
+
+/** Decides whether to downscale src_rect to the target size with VPP.
+    vpp_required is set if a VPP pass is needed anyway, in which case
+    scaling there is considered free */
+bool
+ffva_scale_policy_begin_frame(FFVAScalePolicy *policy,
+    const VARectangle *src_rect, uint32_t dst_width, uint32_t dst_height,
+    bool vpp_required);
+
+/** Determines whether the GPU time of the frame is to be measured, with
+    no other frame in flight, and passed to ffva_scale_policy_end_frame() */
+bool
+ffva_scale_policy_is_frame_timed(FFVAScalePolicy *policy);
+
+/** Accounts for the GPU time spent processing and presenting the frame,
+    in microseconds */
+void
+ffva_scale_policy_end_frame(FFVAScalePolicy *policy, uint64_t gpu_time);
+
+#endif /* FFVA_SCALE_POLICY_H */
@@ -0,0 +1,1305 @@
+/*
+ * ffvascaler.c - CPU video scaling and color conversion
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <math.h>
+#include <libavutil/common.h>
+#include "ffvascaler.h"
+#include "ffvakernels.h"
+
+#if USE_X86_KERNELS
+# include <immintrin.h>
+#endif
+#if USE_NEON_KERNELS
+# include <arm_neon.h>
+#endif
+
+/* Maximum number of planes of any supported format */
+#define FFVA_SCALER_MAX_PLANES 3
+
+/* Maximum number of filter taps, hence of cached source rows. Filters are
+   widened by the downscaling factor, up to that number of taps */
+#define FFVA_SCALER_MAX_TAPS 64
+
+/* Fixed-point precision of filter weights */
+#define WEIGHT_BITS 14
+#define WEIGHT_ONE (1 << WEIGHT_BITS)
+
+typedef enum {
+    LAYOUT_NV12 = 0,
+    LAYOUT_I420,
+    LAYOUT_I422,
+    LAYOUT_YUY2,
+    LAYOUT_RGB32,
+} Layout;
+
+typedef struct {
+    uint8_t channels;                   /* bytes per (macro)pixel */
+    uint8_t x_shift;
+    uint8_t y_shift;
+} PlaneInfo;
+
+typedef struct {
+    uint32_t num_planes;
+    PlaneInfo planes[FFVA_SCALER_MAX_PLANES];
+} LayoutInfo;
+
+typedef struct {
+    uint32_t fourcc;
+    Layout layout;
+    uint8_t swap_uv;
+    uint8_t has_alpha;
+    uint8_t rgba_index[4];
+} FormatInfo;
+
+typedef struct {
+    const FormatInfo *format;
+    uint32_t width;
+    uint32_t height;
+    uint8_t *planes[FFVA_SCALER_MAX_PLANES];
+    uint32_t pitches[FFVA_SCALER_MAX_PLANES];
+} ImageView;
+
+typedef struct {
+    uint32_t num_taps;
+    uint32_t size;
+    uint32_t capacity;
+    int32_t *indices;
+    int16_t *weights;
+    bool is_identity;
+} ScaleFilter;
+
+typedef struct {
+    void (*vfilter)(uint8_t *dst, const uint8_t * const *src,
+        const int16_t *weights, uint32_t num_taps, uint32_t n);
+    void (*yuv_to_rgb)(uint8_t *dst, const uint8_t *src, uint32_t n);
+} Kernels;
+
+struct ffva_scaler_s {
+    const void *klass;
+    const Kernels *kernels;
+    const char *kernels_name;
+    FFVASlicePool *pool;
+    uint8_t *scratch[FFVA_SLICE_POOL_MAX_THREADS];
+    size_t scratch_size[FFVA_SLICE_POOL_MAX_THREADS];
+    uint8_t *temp[2];
+    size_t temp_size[2];
+    ScaleFilter filters[FFVA_SCALER_MAX_PLANES][2];
+};
+
+static const LayoutInfo g_layouts[] = {
+    [LAYOUT_NV12]  = { 2, { { 1, 0, 0 }, { 2, 1, 1 } } },
+    [LAYOUT_I420]  = { 3, { { 1, 0, 0 }, { 1, 1, 1 }, { 1, 1, 1 } } },
+    [LAYOUT_I422]  = { 3, { { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 0 } } },
+    [LAYOUT_YUY2]  = { 1, { { 4, 1, 0 } } },
+    [LAYOUT_RGB32] = { 1, { { 4, 0, 0 } } },
+};
+
+static const FormatInfo g_formats[] = {
+    { VA_FOURCC('N','V','1','2'), LAYOUT_NV12,  0, 0, },
+    { VA_FOURCC('I','4','2','0'), LAYOUT_I420,  0, 0, },
+    { VA_FOURCC('Y','V','1','2'), LAYOUT_I420,  1, 0, },
+    { VA_FOURCC('4','2','2','H'), LAYOUT_I422,  0, 0, },
+    { VA_FOURCC('Y','U','Y','2'), LAYOUT_YUY2,  0, 0, },
+    { VA_FOURCC('R','G','B','A'), LAYOUT_RGB32, 0, 1, { 0, 1, 2, 3 } },
+    { VA_FOURCC('R','G','B','X'), LAYOUT_RGB32, 0, 0, { 0, 1, 2, 3 } },
+    { VA_FOURCC('B','G','R','A'), LAYOUT_RGB32, 0, 1, { 2, 1, 0, 3 } },
+    { VA_FOURCC('B','G','R','X'), LAYOUT_RGB32, 0, 0, { 2, 1, 0, 3 } },
+    { 0, }
+};
+
+static const uint32_t g_fourccs[] = {
+    VA_FOURCC('N','V','1','2'),
+    VA_FOURCC('I','4','2','0'),
+    VA_FOURCC('Y','V','1','2'),
+    VA_FOURCC('4','2','2','H'),
+    VA_FOURCC('Y','U','Y','2'),
+    VA_FOURCC('R','G','B','A'),
+    VA_FOURCC('R','G','B','X'),
+    VA_FOURCC('B','G','R','A'),
+    VA_FOURCC('B','G','R','X'),
+    0
+};
+
+static inline uint8_t
+clip_u8(int32_t v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline uint32_t
+plane_size(uint32_t size, uint32_t shift)
+{
+    return (size + (1U << shift) - 1) >> shift;
+}
+
+static const FormatInfo *
+find_format(uint32_t fourcc)
+{
+    const FormatInfo *f;
+
+    for (f = g_formats; f->fourcc != 0; f++) {
+        if (f->fourcc == fourcc)
+            return f;
+    }
+    return NULL;
+}
+
+static inline const LayoutInfo *
+get_layout(const FormatInfo *format)
+{
+    return &g_layouts[format->layout];
+}
+
+static inline bool
+is_rgb_format(const FormatInfo *format)
+{
+    return format->layout == LAYOUT_RGB32;
+}
+
+// Returns the format in which the supplied one is scaled: packed 4:2:2
+// is scaled as planar 4:2:2, since luma and chroma samples interleave
+static const FormatInfo *
+get_scale_format(const FormatInfo *format)
+{
+    if (format->layout == LAYOUT_YUY2)
+        return find_format(VA_FOURCC('4','2','2','H'));
+    return format;
+}
+
+// Sets up a view on rect of image, aligned to chroma subsampling
+static int
+view_init(ImageView *view, const FFVAScalerImage *image,
+    const VARectangle *rect)
+{
+    const LayoutInfo *layout;
+    uint32_t i, x, y, x_mask = 0, y_mask = 0;
+
+    if (!image || !image->pixels[0])
+        return AVERROR(EINVAL);
+
+    view->format = find_format(image->fourcc);
+    if (!view->format)
+        return AVERROR(ENOTSUP);
+    layout = get_layout(view->format);
+
+    if (rect) {
+        if (rect->x < 0 || rect->y < 0 || rect->width == 0 ||
+            rect->height == 0 ||
+            rect->x + rect->width > image->width ||
+            rect->y + rect->height > image->height)
+            return AVERROR(ERANGE);
+        x = rect->x;
+        y = rect->y;
+        view->width = rect->width;
+        view->height = rect->height;
+    }
+    else {
+        x = 0;
+        y = 0;
+        view->width = image->width;
+        view->height = image->height;
+    }
+
+    for (i = 0; i < layout->num_planes; i++) {
+        x_mask |= (1U << layout->planes[i].x_shift) - 1;
+        y_mask |= (1U << layout->planes[i].y_shift) - 1;
+    }
+    x &= ~x_mask;
+    y &= ~y_mask;
+
+    for (i = 0; i < layout->num_planes; i++) {
+        const PlaneInfo * const plane = &layout->planes[i];
+
+        if (!image->pixels[i])
+            return AVERROR(EINVAL);
+        view->pitches[i] = image->pitches[i];
+        view->planes[i] = image->pixels[i] +
+            (y >> plane->y_shift) * image->pitches[i] +
+            (x >> plane->x_shift) * plane->channels;
+    }
+    if (view->format->swap_uv) {
+        uint8_t * const planes1 = view->planes[1];
+        const uint32_t pitches1 = view->pitches[1];
+
+        view->planes[1] = view->planes[2];
+        view->pitches[1] = view->pitches[2];
+        view->planes[2] = planes1;
+        view->pitches[2] = pitches1;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Kernels                                                           --- */
+/* ------------------------------------------------------------------------- */
+
+// Applies vertical filter taps to n bytes of the supplied source rows
+static void
+vfilter_c(uint8_t *dst, const uint8_t * const *src, const int16_t *weights,
+    uint32_t num_taps, uint32_t n)
+{
+    uint32_t i, k;
+    int32_t sum;
+
+    for (i = 0; i < n; i++) {
+        sum = WEIGHT_ONE / 2;
+        for (k = 0; k < num_taps; k++)
+            sum += weights[k] * src[k][i];
+        dst[i] = clip_u8(sum >> WEIGHT_BITS);
+    }
+}
+
+// Converts n 4:4:4 pixels from limited range BT.601 YUVA to RGBA
+static void
+yuv_to_rgb_c(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    uint32_t i;
+    int32_t c, d, e;
+
+    for (i = 0; i < n; i++, src += 4, dst += 4) {
+        c = 298 * (src[0] - 16) + 128;
+        d = src[1] - 128;
+        e = src[2] - 128;
+        dst[3] = src[3];
+        dst[0] = clip_u8((c + 409 * e) >> 8);
+        dst[1] = clip_u8((c - 100 * d - 208 * e) >> 8);
+        dst[2] = clip_u8((c + 516 * d) >> 8);
+    }
+}
+
+static const Kernels g_kernels_c = {
+    vfilter_c, yuv_to_rgb_c
+};
+
+#if USE_X86_KERNELS
+static void __attribute__((target("sse4.1")))
+vfilter_sse4(uint8_t *dst, const uint8_t * const *src, const int16_t *weights,
+    uint32_t num_taps, uint32_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(WEIGHT_ONE / 2);
+    const uint8_t *tail_src[FFVA_SCALER_MAX_TAPS];
+    uint32_t i, k;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+
+        for (k = 0; k < num_taps; k += 2) {
+            const __m128i w = _mm_set1_epi32((uint16_t)weights[k] |
+                ((uint32_t)(uint16_t)weights[k + 1] << 16));
+            const __m128i a = _mm_loadu_si128((const __m128i *)&src[k][i]);
+            const __m128i b = _mm_loadu_si128((const __m128i *)&src[k + 1][i]);
+            const __m128i lo = _mm_unpacklo_epi8(a, b);
+            const __m128i hi = _mm_unpackhi_epi8(a, b);
+
+            acc0 = _mm_add_epi32(acc0,
+                _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+            acc1 = _mm_add_epi32(acc1,
+                _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+            acc2 = _mm_add_epi32(acc2,
+                _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+            acc3 = _mm_add_epi32(acc3,
+                _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+        }
+        acc0 = _mm_packs_epi32(_mm_srai_epi32(acc0, WEIGHT_BITS),
+            _mm_srai_epi32(acc1, WEIGHT_BITS));
+        acc2 = _mm_packs_epi32(_mm_srai_epi32(acc2, WEIGHT_BITS),
+            _mm_srai_epi32(acc3, WEIGHT_BITS));
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_packus_epi16(acc0, acc2));
+    }
+
+    if (i < n) {
+        for (k = 0; k < num_taps; k++)
+            tail_src[k] = src[k] + i;
+        vfilter_c(dst + i, tail_src, weights, num_taps, n - i);
+    }
+}
+
+static void __attribute__((target("sse4.1")))
+yuv_to_rgb_sse4(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    const __m128i mask = _mm_set1_epi32(0xff);
+    const __m128i alpha_mask = _mm_set1_epi32((int)0xff000000);
+    const __m128i max = _mm_set1_epi32(255);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i *)&src[i * 4]);
+        const __m128i y = _mm_sub_epi32(_mm_and_si128(px, mask),
+            _mm_set1_epi32(16));
+        const __m128i u = _mm_sub_epi32(
+            _mm_and_si128(_mm_srli_epi32(px, 8), mask), _mm_set1_epi32(128));
+        const __m128i v = _mm_sub_epi32(
+            _mm_and_si128(_mm_srli_epi32(px, 16), mask), _mm_set1_epi32(128));
+        const __m128i c = _mm_add_epi32(
+            _mm_mullo_epi32(y, _mm_set1_epi32(298)), _mm_set1_epi32(128));
+        __m128i r, g, b;
+
+        r = _mm_add_epi32(c, _mm_mullo_epi32(v, _mm_set1_epi32(409)));
+        g = _mm_sub_epi32(c, _mm_add_epi32(
+                _mm_mullo_epi32(u, _mm_set1_epi32(100)),
+                _mm_mullo_epi32(v, _mm_set1_epi32(208))));
+        b = _mm_add_epi32(c, _mm_mullo_epi32(u, _mm_set1_epi32(516)));
+        r = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(r, 8), zero), max);
+        g = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(g, 8), zero), max);
+        b = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(b, 8), zero), max);
+        _mm_storeu_si128((__m128i *)&dst[i * 4], _mm_or_si128(
+                _mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                _mm_or_si128(_mm_slli_epi32(b, 16),
+                    _mm_and_si128(px, alpha_mask))));
+    }
+
+    if (i < n)
+        yuv_to_rgb_c(dst + i * 4, src + i * 4, n - i);
+}
+
+static const Kernels g_kernels_sse4 = {
+    vfilter_sse4, yuv_to_rgb_sse4
+};
+
+static void __attribute__((target("avx2")))
+vfilter_avx2(uint8_t *dst, const uint8_t * const *src, const int16_t *weights,
+    uint32_t num_taps, uint32_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(WEIGHT_ONE / 2);
+    const uint8_t *tail_src[FFVA_SCALER_MAX_TAPS];
+    uint32_t i, k;
+
+    /* Unpacking and packing both operate within 128-bit lanes, so the
+       pixel order is preserved end to end */
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+
+        for (k = 0; k < num_taps; k += 2) {
+            const __m256i w = _mm256_set1_epi32((uint16_t)weights[k] |
+                ((uint32_t)(uint16_t)weights[k + 1] << 16));
+            const __m256i a =
+                _mm256_loadu_si256((const __m256i *)&src[k][i]);
+            const __m256i b =
+                _mm256_loadu_si256((const __m256i *)&src[k + 1][i]);
+            const __m256i lo = _mm256_unpacklo_epi8(a, b);
+            const __m256i hi = _mm256_unpackhi_epi8(a, b);
+
+            acc0 = _mm256_add_epi32(acc0,
+                _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), w));
+            acc1 = _mm256_add_epi32(acc1,
+                _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), w));
+            acc2 = _mm256_add_epi32(acc2,
+                _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), w));
+            acc3 = _mm256_add_epi32(acc3,
+                _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), w));
+        }
+        acc0 = _mm256_packs_epi32(_mm256_srai_epi32(acc0, WEIGHT_BITS),
+            _mm256_srai_epi32(acc1, WEIGHT_BITS));
+        acc2 = _mm256_packs_epi32(_mm256_srai_epi32(acc2, WEIGHT_BITS),
+            _mm256_srai_epi32(acc3, WEIGHT_BITS));
+        _mm256_storeu_si256((__m256i *)&dst[i],
+            _mm256_packus_epi16(acc0, acc2));
+    }
+
+    if (i < n) {
+        for (k = 0; k < num_taps; k++)
+            tail_src[k] = src[k] + i;
+        vfilter_sse4(dst + i, tail_src, weights, num_taps, n - i);
+    }
+}
+
+static void __attribute__((target("avx2")))
+yuv_to_rgb_avx2(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    const __m256i alpha_mask = _mm256_set1_epi32((int)0xff000000);
+    const __m256i max = _mm256_set1_epi32(255);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        const __m256i px = _mm256_loadu_si256((const __m256i *)&src[i * 4]);
+        const __m256i y = _mm256_sub_epi32(_mm256_and_si256(px, mask),
+            _mm256_set1_epi32(16));
+        const __m256i u = _mm256_sub_epi32(_mm256_and_si256(
+                _mm256_srli_epi32(px, 8), mask), _mm256_set1_epi32(128));
+        const __m256i v = _mm256_sub_epi32(_mm256_and_si256(
+                _mm256_srli_epi32(px, 16), mask), _mm256_set1_epi32(128));
+        const __m256i c = _mm256_add_epi32(
+            _mm256_mullo_epi32(y, _mm256_set1_epi32(298)),
+            _mm256_set1_epi32(128));
+        __m256i r, g, b;
+
+        r = _mm256_add_epi32(c, _mm256_mullo_epi32(v, _mm256_set1_epi32(409)));
+        g = _mm256_sub_epi32(c, _mm256_add_epi32(
+                _mm256_mullo_epi32(u, _mm256_set1_epi32(100)),
+                _mm256_mullo_epi32(v, _mm256_set1_epi32(208))));
+        b = _mm256_add_epi32(c, _mm256_mullo_epi32(u, _mm256_set1_epi32(516)));
+        r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, 8), zero),
+            max);
+        g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, 8), zero),
+            max);
+        b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, 8), zero),
+            max);
+        _mm256_storeu_si256((__m256i *)&dst[i * 4], _mm256_or_si256(
+                _mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+                _mm256_or_si256(_mm256_slli_epi32(b, 16),
+                    _mm256_and_si256(px, alpha_mask))));
+    }
+
+    if (i < n)
+        yuv_to_rgb_sse4(dst + i * 4, src + i * 4, n - i);
+}
+
+static const Kernels g_kernels_avx2 = {
+    vfilter_avx2, yuv_to_rgb_avx2
+};
+#endif
+
+#if USE_NEON_KERNELS
+static void
+vfilter_neon(uint8_t *dst, const uint8_t * const *src, const int16_t *weights,
+    uint32_t num_taps, uint32_t n)
+{
+    const uint8_t *tail_src[FFVA_SCALER_MAX_TAPS];
+    uint32_t i, k;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        int32x4_t acc0 = vdupq_n_s32(WEIGHT_ONE / 2);
+        int32x4_t acc1 = acc0, acc2 = acc0, acc3 = acc0;
+        int16x8_t r0, r1;
+
+        for (k = 0; k < num_taps; k++) {
+            const uint8x16_t a = vld1q_u8(&src[k][i]);
+            const int16x8_t lo =
+                vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(a)));
+            const int16x8_t hi =
+                vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(a)));
+
+            acc0 = vmlal_n_s16(acc0, vget_low_s16(lo), weights[k]);
+            acc1 = vmlal_n_s16(acc1, vget_high_s16(lo), weights[k]);
+            acc2 = vmlal_n_s16(acc2, vget_low_s16(hi), weights[k]);
+            acc3 = vmlal_n_s16(acc3, vget_high_s16(hi), weights[k]);
+        }
+        r0 = vcombine_s16(vqshrn_n_s32(acc0, WEIGHT_BITS),
+            vqshrn_n_s32(acc1, WEIGHT_BITS));
+        r1 = vcombine_s16(vqshrn_n_s32(acc2, WEIGHT_BITS),
+            vqshrn_n_s32(acc3, WEIGHT_BITS));
+        vst1q_u8(&dst[i], vcombine_u8(vqmovun_s16(r0), vqmovun_s16(r1)));
+    }
+
+    if (i < n) {
+        for (k = 0; k < num_taps; k++)
+            tail_src[k] = src[k] + i;
+        vfilter_c(dst + i, tail_src, weights, num_taps, n - i);
+    }
+}
+
+static inline uint16x4_t
+yuv_to_rgb_neon_channel(int32x4_t c, int16x4_t d, int16_t d_coeff,
+    int16x4_t e, int16_t e_coeff)
+{
+    return vqrshrun_n_s32(vmlal_n_s16(vmlal_n_s16(c, d, d_coeff), e, e_coeff),
+        8);
+}
+
+static void
+yuv_to_rgb_neon(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    uint32_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        const uint8x8x4_t px = vld4_u8(&src[i * 4]);
+        const int16x8_t y = vsubq_s16(
+            vreinterpretq_s16_u16(vmovl_u8(px.val[0])), vdupq_n_s16(16));
+        const int16x8_t u = vsubq_s16(
+            vreinterpretq_s16_u16(vmovl_u8(px.val[1])), vdupq_n_s16(128));
+        const int16x8_t v = vsubq_s16(
+            vreinterpretq_s16_u16(vmovl_u8(px.val[2])), vdupq_n_s16(128));
+        const int32x4_t c_lo = vmull_n_s16(vget_low_s16(y), 298);
+        const int32x4_t c_hi = vmull_n_s16(vget_high_s16(y), 298);
+        uint8x8x4_t out;
+
+        out.val[0] = vqmovn_u16(vcombine_u16(
+                yuv_to_rgb_neon_channel(c_lo, vget_low_s16(u), 0,
+                    vget_low_s16(v), 409),
+                yuv_to_rgb_neon_channel(c_hi, vget_high_s16(u), 0,
+                    vget_high_s16(v), 409)));
+        out.val[1] = vqmovn_u16(vcombine_u16(
+                yuv_to_rgb_neon_channel(c_lo, vget_low_s16(u), -100,
+                    vget_low_s16(v), -208),
+                yuv_to_rgb_neon_channel(c_hi, vget_high_s16(u), -100,
+                    vget_high_s16(v), -208)));
+        out.val[2] = vqmovn_u16(vcombine_u16(
+                yuv_to_rgb_neon_channel(c_lo, vget_low_s16(u), 516,
+                    vget_low_s16(v), 0),
+                yuv_to_rgb_neon_channel(c_hi, vget_high_s16(u), 516,
+                    vget_high_s16(v), 0)));
+        out.val[3] = px.val[3];
+        vst4_u8(&dst[i * 4], out);
+    }
+
+    if (i < n)
+        yuv_to_rgb_c(dst + i * 4, src + i * 4, n - i);
+}
+
+static const Kernels g_kernels_neon = {
+    vfilter_neon, yuv_to_rgb_neon
+};
+#endif
+
+// Kernels sets, best first
+static const FFVAKernelsInfo g_kernels_list[] = {
+#if USE_X86_KERNELS
+    { "AVX2",   FFVA_CPU_FEATURE_AVX2,   &g_kernels_avx2 },
+    { "SSE4.1", FFVA_CPU_FEATURE_SSE4_1, &g_kernels_sse4 },
+#endif
+#if USE_NEON_KERNELS
+    { "NEON",   FFVA_CPU_FEATURE_NEON,   &g_kernels_neon },
+#endif
+    { "C",      0,                       &g_kernels_c },
+};
+
+// Converts n 4:4:4 pixels from RGBA to limited range BT.601 YUVA
+static void
+rgb_to_yuv(uint8_t *dst, const uint8_t *src, uint32_t n)
+{
+    uint32_t i;
+    int32_t r, g, b;
+
+    for (i = 0; i < n; i++, src += 4, dst += 4) {
+        r = src[0];
+        g = src[1];
+        b = src[2];
+        dst[3] = src[3];
+        dst[0] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        dst[1] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        dst[2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Format conversion                                                 --- */
+/* ------------------------------------------------------------------------- */
+
+typedef struct {
+    FFVAScaler *scaler;
+    const ImageView *src;
+    const ImageView *dst;
+} ConvertArgs;
+
+// Expands row y of view to 4:4:4 YUVA, or RGBA, pixels
+static void
+unpack_row(const ImageView *view, uint32_t y, uint8_t *out)
+{
+    const FormatInfo * const format = view->format;
+    const uint8_t *p0 = view->planes[0] + y * view->pitches[0];
+    const uint8_t *p1, *p2;
+    uint32_t x;
+
+    switch (format->layout) {
+    case LAYOUT_NV12:
+        p1 = view->planes[1] + (y >> 1) * view->pitches[1];
+        for (x = 0; x < view->width; x++, out += 4) {
+            out[0] = p0[x];
+            out[1] = p1[x & ~1U];
+            out[2] = p1[x | 1U];
+            out[3] = 255;
+        }
+        break;
+    case LAYOUT_I420:
+    case LAYOUT_I422:
+        if (format->layout == LAYOUT_I420)
+            y >>= 1;
+        p1 = view->planes[1] + y * view->pitches[1];
+        p2 = view->planes[2] + y * view->pitches[2];
+        for (x = 0; x < view->width; x++, out += 4) {
+            out[0] = p0[x];
+            out[1] = p1[x >> 1];
+            out[2] = p2[x >> 1];
+            out[3] = 255;
+        }
+        break;
+    case LAYOUT_YUY2:
+        for (x = 0; x < view->width; x++, out += 4) {
+            out[0] = p0[x * 2];
+            out[1] = p0[(x & ~1U) * 2 + 1];
+            out[2] = p0[(x & ~1U) * 2 + 3];
+            out[3] = 255;
+        }
+        break;
+    case LAYOUT_RGB32: {
+        const uint8_t * const idx = format->rgba_index;
+
+        for (x = 0; x < view->width; x++, p0 += 4, out += 4) {
+            out[0] = p0[idx[0]];
+            out[1] = p0[idx[1]];
+            out[2] = p0[idx[2]];
+            out[3] = format->has_alpha ? p0[idx[3]] : 255;
+        }
+        break;
+    }
+    }
+}
+
+// Writes 4:2:x chroma for row y, from the averaged 4:4:4 chroma samples
+static void
+pack_chroma(const ImageView *view, uint32_t y, const uint8_t *in0,
+    const uint8_t *in1)
+{
+    const uint32_t last = view->width - 1;
+    uint8_t *p1, *p2;
+    uint32_t cx, x0, x1, u, v;
+
+    p1 = view->planes[1] + y * view->pitches[1];
+    p2 = view->planes[2] + y * view->pitches[2];
+    for (cx = 0; cx < plane_size(view->width, 1); cx++) {
+        x0 = cx * 2 * 4;
+        x1 = FFMIN(cx * 2 + 1, last) * 4;
+        u = in0[x0 + 1] + in0[x1 + 1] + in1[x0 + 1] + in1[x1 + 1];
+        v = in0[x0 + 2] + in0[x1 + 2] + in1[x0 + 2] + in1[x1 + 2];
+        if (view->format->layout == LAYOUT_NV12) {
+            p1[cx * 2 + 0] = (u + 2) >> 2;
+            p1[cx * 2 + 1] = (v + 2) >> 2;
+        }
+        else {
+            p1[cx] = (u + 2) >> 2;
+            p2[cx] = (v + 2) >> 2;
+        }
+    }
+}
+
+// Writes a single row y of view from 4:4:4 pixels
+static void
+pack_row(const ImageView *view, uint32_t y, const uint8_t *in)
+{
+    const FormatInfo * const format = view->format;
+    uint8_t *p0 = view->planes[0] + y * view->pitches[0];
+    uint32_t x, x1;
+
+    switch (format->layout) {
+    case LAYOUT_NV12:
+    case LAYOUT_I420:
+        for (x = 0; x < view->width; x++)
+            p0[x] = in[x * 4];
+        break;
+    case LAYOUT_I422:
+        for (x = 0; x < view->width; x++)
+            p0[x] = in[x * 4];
+        pack_chroma(view, y, in, in);
+        break;
+    case LAYOUT_YUY2:
+        for (x = 0; x < view->width; x += 2, p0 += 4) {
+            x1 = FFMIN(x + 1, view->width - 1);
+            p0[0] = in[x * 4];
+            p0[1] = (in[x * 4 + 1] + in[x1 * 4 + 1] + 1) >> 1;
+            p0[2] = in[x1 * 4];
+            p0[3] = (in[x * 4 + 2] + in[x1 * 4 + 2] + 1) >> 1;
+        }
+        break;
+    case LAYOUT_RGB32: {
+        const uint8_t * const idx = format->rgba_index;
+
+        for (x = 0; x < view->width; x++, p0 += 4, in += 4) {
+            p0[idx[0]] = in[0];
+            p0[idx[1]] = in[1];
+            p0[idx[2]] = in[2];
+            p0[idx[3]] = in[3];
+        }
+        break;
+    }
+    }
+}
+
+// Copies rows [y0, y1) of identically formatted views
+static void
+copy_rows(const ImageView *src, const ImageView *dst, uint32_t y0,
+    uint32_t y1)
+{
+    const LayoutInfo * const layout = get_layout(src->format);
+    uint32_t i, y, row_size;
+
+    for (i = 0; i < layout->num_planes; i++) {
+        const PlaneInfo * const plane = &layout->planes[i];
+
+        row_size = plane_size(src->width, plane->x_shift) * plane->channels;
+        for (y = y0 >> plane->y_shift; y < plane_size(y1, plane->y_shift); y++)
+            memcpy(dst->planes[i] + y * dst->pitches[i],
+                src->planes[i] + y * src->pitches[i], row_size);
+    }
+}
+
+static void
+convert_slice(void *arg, uint32_t slice, uint32_t num_slices)
+{
+    const ConvertArgs * const args = arg;
+    FFVAScaler * const scaler = args->scaler;
+    const ImageView * const src = args->src;
+    const ImageView * const dst = args->dst;
+    const bool src_is_rgb = is_rgb_format(src->format);
+    const bool dst_is_rgb = is_rgb_format(dst->format);
+    uint8_t * const row0 = scaler->scratch[slice];
+    uint8_t * const row1 = row0 + src->width * 4;
+    uint32_t y, y0, y1, num_rows;
+
+    ffva_slice_get_range(src->height, 2, slice, num_slices, &y0, &y1);
+    if (src->format == dst->format) {
+        copy_rows(src, dst, y0, y1);
+        return;
+    }
+
+    for (y = y0; y < y1; y += 2) {
+        num_rows = FFMIN(y1 - y, 2);
+
+        unpack_row(src, y, row0);
+        if (num_rows > 1)
+            unpack_row(src, y + 1, row1);
+
+        if (src_is_rgb != dst_is_rgb) {
+            if (dst_is_rgb) {
+                scaler->kernels->yuv_to_rgb(row0, row0, src->width);
+                if (num_rows > 1)
+                    scaler->kernels->yuv_to_rgb(row1, row1, src->width);
+            }
+            else {
+                rgb_to_yuv(row0, row0, src->width);
+                if (num_rows > 1)
+                    rgb_to_yuv(row1, row1, src->width);
+            }
+        }
+
+        pack_row(dst, y, row0);
+        if (num_rows > 1)
+            pack_row(dst, y + 1, row1);
+
+        switch (dst->format->layout) {
+        case LAYOUT_NV12:
+        case LAYOUT_I420:
+            pack_chroma(dst, y >> 1, row0, num_rows > 1 ? row1 : row0);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Scaling                                                           --- */
+/* ------------------------------------------------------------------------- */
+
+typedef struct {
+    FFVAScaler *scaler;
+    const ImageView *src;
+    const ImageView *dst;
+    uint32_t row_size;
+    uint32_t num_rows;                  /* of the row cache */
+} ScaleArgs;
+
+// Linear interpolation kernel
+static double
+linear_weight(double x)
+{
+    if (x < 0.0)
+        x = -x;
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+// Catmull-Rom cubic kernel
+static double
+cubic_weight(double x)
+{
+    if (x < 0.0)
+        x = -x;
+    if (x < 1.0)
+        return (1.5 * x - 2.5) * x * x + 1.0;
+    if (x < 2.0)
+        return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+    return 0.0;
+}
+
+// Computes filter taps to resample src_size samples into dst_size. When
+// downscaling, the filter support is widened by the scale factor, so that
+// all source samples contribute, and the weights are normalized
+static bool
+scale_filter_init(ScaleFilter *filter, uint32_t src_size, uint32_t dst_size,
+    FFVAScalerMethod method)
+{
+    const bool is_bicubic = method == FFVA_SCALER_METHOD_BICUBIC;
+    const double radius = is_bicubic ? 2.0 : 1.0;
+    const double scale = (double)src_size / dst_size;
+    const double factor = FFMIN(FFMAX(scale, 1.0),
+        FFVA_SCALER_MAX_TAPS / (2.0 * radius));
+    uint32_t i, k, n, num_taps, max_k;
+    double pos, t, w_sum, w[FFVA_SCALER_MAX_TAPS];
+    int32_t first, sum, idx;
+    int32_t *indices;
+    int16_t *weights;
+
+    /* The SIMD kernels process taps by pairs */
+    num_taps = (uint32_t)ceil(2.0 * radius * factor);
+    num_taps = FFMIN(FFALIGN(num_taps, 2), FFVA_SCALER_MAX_TAPS);
+    n = dst_size * num_taps;
+
+    if (filter->capacity < n) {
+        indices = realloc(filter->indices, n * sizeof(*indices));
+        if (!indices)
+            return false;
+        filter->indices = indices;
+        weights = realloc(filter->weights, n * sizeof(*weights));
+        if (!weights)
+            return false;
+        filter->weights = weights;
+        filter->capacity = n;
+    }
+    filter->num_taps = num_taps;
+    filter->size = dst_size;
+    filter->is_identity = src_size == dst_size;
+
+    for (i = 0; i < dst_size; i++) {
+        pos = (i + 0.5) * scale - 0.5;
+        first = (int32_t)floor(pos - radius * factor) + 1;
+        for (k = 0, w_sum = 0.0; k < num_taps; k++) {
+            t = (first + (int32_t)k - pos) / factor;
+            w[k] = is_bicubic ? cubic_weight(t) : linear_weight(t);
+            w_sum += w[k];
+        }
+
+        indices = &filter->indices[i * num_taps];
+        weights = &filter->weights[i * num_taps];
+        for (k = 0, sum = 0, max_k = 0; k < num_taps; k++) {
+            w[k] /= w_sum;
+            weights[k] = (int16_t)(w[k] * WEIGHT_ONE + (w[k] < 0 ? -0.5 : 0.5));
+            sum += weights[k];
+            if (w[k] > w[max_k])
+                max_k = k;
+            idx = first + (int32_t)k;
+            indices[k] = idx < 0 ? 0 : idx >= (int32_t)src_size ?
+                (int32_t)src_size - 1 : idx;
+        }
+        weights[max_k] += WEIGHT_ONE - sum;
+    }
+    return true;
+}
+
+// Resamples one row horizontally
+static void
+hscale_row(uint8_t *dst, const uint8_t *src, const ScaleFilter *filter,
+    uint32_t channels)
+{
+    const uint32_t num_taps = filter->num_taps;
+    const int32_t *indices = filter->indices;
+    const int16_t *weights = filter->weights;
+    uint32_t x, c, k;
+    int32_t sum;
+
+    for (x = 0; x < filter->size; x++) {
+        for (c = 0; c < channels; c++) {
+            sum = WEIGHT_ONE / 2;
+            for (k = 0; k < num_taps; k++)
+                sum += weights[k] * src[indices[k] * channels + c];
+            *dst++ = clip_u8(sum >> WEIGHT_BITS);
+        }
+        indices += num_taps;
+        weights += num_taps;
+    }
+}
+
+typedef struct {
+    uint8_t *rows[FFVA_SCALER_MAX_TAPS];
+    int32_t tags[FFVA_SCALER_MAX_TAPS];
+    uint32_t num_rows;
+} RowCache;
+
+// Returns source row sy, horizontally resampled. Rows before min_row are
+// no longer needed, since output rows are produced in order
+static const uint8_t *
+get_hscaled_row(RowCache *cache, const uint8_t *src, uint32_t pitch,
+    int32_t sy, int32_t min_row, const ScaleFilter *filter, uint32_t channels)
+{
+    uint32_t i, victim = 0;
+
+    if (filter->is_identity)
+        return src + sy * pitch;
+
+    for (i = 0; i < cache->num_rows; i++) {
+        if (cache->tags[i] == sy)
+            return cache->rows[i];
+        if (cache->tags[i] < min_row)
+            victim = i;
+    }
+    hscale_row(cache->rows[victim], src + sy * pitch, filter, channels);
+    cache->tags[victim] = sy;
+    return cache->rows[victim];
+}
+
+static void
+scale_slice(void *arg, uint32_t slice, uint32_t num_slices)
+{
+    const ScaleArgs * const args = arg;
+    FFVAScaler * const scaler = args->scaler;
+    const ImageView * const src = args->src;
+    const ImageView * const dst = args->dst;
+    const LayoutInfo * const layout = get_layout(src->format);
+    const uint8_t *rows[FFVA_SCALER_MAX_TAPS];
+    uint32_t i, k, y, y0, y1;
+    RowCache cache;
+
+    ffva_slice_get_range(dst->height, 2, slice, num_slices, &y0, &y1);
+    if (y0 >= y1)
+        return;
+
+    for (i = 0; i < layout->num_planes; i++) {
+        const PlaneInfo * const plane = &layout->planes[i];
+        const ScaleFilter * const hfilter = &scaler->filters[i][0];
+        const ScaleFilter * const vfilter = &scaler->filters[i][1];
+        const uint32_t num_taps = vfilter->num_taps;
+
+        cache.num_rows = args->num_rows;
+        for (k = 0; k < cache.num_rows; k++) {
+            cache.rows[k] = scaler->scratch[slice] + k * args->row_size;
+            cache.tags[k] = -1;
+        }
+
+        for (y = y0 >> plane->y_shift; y < plane_size(y1, plane->y_shift);
+             y++) {
+            const int32_t * const indices = &vfilter->indices[y * num_taps];
+
+            for (k = 0; k < num_taps; k++)
+                rows[k] = get_hscaled_row(&cache, src->planes[i],
+                    src->pitches[i], indices[k], indices[0], hfilter,
+                    plane->channels);
+            scaler->kernels->vfilter(dst->planes[i] + y * dst->pitches[i],
+                rows, &vfilter->weights[y * num_taps], num_taps,
+                hfilter->size * plane->channels);
+        }
+    }
+}
+
+static bool
+ensure_scratch(FFVAScaler *scaler, size_t size)
+{
+    const uint32_t num_threads = ffva_slice_pool_get_num_threads(scaler->pool);
+    uint32_t i;
+
+    for (i = 0; i < num_threads; i++) {
+        if (scaler->scratch_size[i] >= size)
+            continue;
+        av_freep(&scaler->scratch[i]);
+        scaler->scratch_size[i] = 0;
+        scaler->scratch[i] = av_malloc(size);
+        if (!scaler->scratch[i])
+            return false;
+        scaler->scratch_size[i] = size;
+    }
+    return true;
+}
+
+// Sets up view on an intermediate image of the supplied format and size
+static bool
+ensure_temp_view(FFVAScaler *scaler, uint32_t index, const FormatInfo *format,
+    uint32_t width, uint32_t height, ImageView *view)
+{
+    const LayoutInfo * const layout = get_layout(format);
+    size_t offsets[FFVA_SCALER_MAX_PLANES], size = 0;
+    uint32_t i;
+
+    for (i = 0; i < layout->num_planes; i++) {
+        const PlaneInfo * const plane = &layout->planes[i];
+
+        view->pitches[i] = FFALIGN(plane_size(width, plane->x_shift) *
+            plane->channels, 32);
+        offsets[i] = size;
+        size += (size_t)view->pitches[i] * plane_size(height, plane->y_shift);
+    }
+
+    if (scaler->temp_size[index] < size) {
+        av_freep(&scaler->temp[index]);
+        scaler->temp_size[index] = 0;
+        scaler->temp[index] = av_malloc(size);
+        if (!scaler->temp[index])
+            return false;
+        scaler->temp_size[index] = size;
+    }
+
+    view->format = format;
+    view->width = width;
+    view->height = height;
+    for (i = 0; i < layout->num_planes; i++)
+        view->planes[i] = scaler->temp[index] + offsets[i];
+    return true;
+}
+
+static int
+convert(FFVAScaler *scaler, const ImageView *src, const ImageView *dst)
+{
+    ConvertArgs args;
+
+    if (!ensure_scratch(scaler, (size_t)src->width * 4 * 2))
+        return AVERROR(ENOMEM);
+
+    args.scaler = scaler;
+    args.src = src;
+    args.dst = dst;
+    ffva_slice_pool_run(scaler->pool, convert_slice, &args);
+    return 0;
+}
+
+static int
+scale(FFVAScaler *scaler, const ImageView *src, const ImageView *dst,
+    FFVAScalerMethod method)
+{
+    const LayoutInfo * const layout = get_layout(src->format);
+    ScaleArgs args;
+    uint32_t i, row_size = 0, num_rows = 0;
+
+    for (i = 0; i < layout->num_planes; i++) {
+        const PlaneInfo * const plane = &layout->planes[i];
+
+        if (!scale_filter_init(&scaler->filters[i][0],
+                plane_size(src->width, plane->x_shift),
+                plane_size(dst->width, plane->x_shift), method) ||
+            !scale_filter_init(&scaler->filters[i][1],
+                plane_size(src->height, plane->y_shift),
+                plane_size(dst->height, plane->y_shift), method))
+            return AVERROR(ENOMEM);
+        row_size = FFMAX(row_size,
+            plane_size(dst->width, plane->x_shift) * plane->channels);
+        num_rows = FFMAX(num_rows, scaler->filters[i][1].num_taps);
+    }
+
+    if (!ensure_scratch(scaler, (size_t)row_size * num_rows))
+        return AVERROR(ENOMEM);
+
+    args.scaler = scaler;
+    args.src = src;
+    args.dst = dst;
+    args.row_size = row_size;
+    args.num_rows = num_rows;
+    ffva_slice_pool_run(scaler->pool, scale_slice, &args);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Interface                                                         --- */
+/* ------------------------------------------------------------------------- */
+
+static const AVClass *
+ffva_scaler_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVAScaler",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Creates a new CPU scaler with num_threads row slices (0 = automatic)
+FFVAScaler *
+ffva_scaler_new(uint32_t num_threads)
+{
+    const FFVAKernelsInfo *kernels_info;
+    FFVAScaler *scaler;
+
+    scaler = calloc(1, sizeof(*scaler));
+    if (!scaler)
+        return NULL;
+
+    scaler->klass = ffva_scaler_class();
+    kernels_info = ffva_kernels_select(g_kernels_list,
+        FF_ARRAY_ELEMS(g_kernels_list));
+    scaler->kernels = kernels_info->kernels;
+    scaler->kernels_name = kernels_info->name;
+    scaler->pool = ffva_slice_pool_new(num_threads);
+    if (!scaler->pool)
+        goto error_create_pool;
+
+    av_log(scaler, AV_LOG_VERBOSE, "using %s kernels, %u threads\n",
+        scaler->kernels_name, ffva_slice_pool_get_num_threads(scaler->pool));
+    return scaler;
+
+    /* ERRORS */
+error_create_pool:
+    av_log(scaler, AV_LOG_ERROR, "failed to create worker threads\n");
+    ffva_scaler_free(scaler);
+    return NULL;
+}
+
+// Destroys the supplied CPU scaler
+void
+ffva_scaler_free(FFVAScaler *scaler)
+{
+    uint32_t i;
+
+    if (!scaler)
+        return;
+
+    ffva_slice_pool_free(scaler->pool);
+    for (i = 0; i < FFVA_SLICE_POOL_MAX_THREADS; i++)
+        av_freep(&scaler->scratch[i]);
+    for (i = 0; i < FF_ARRAY_ELEMS(scaler->temp); i++)
+        av_freep(&scaler->temp[i]);
+    for (i = 0; i < FFVA_SCALER_MAX_PLANES; i++) {
+        free(scaler->filters[i][0].indices);
+        free(scaler->filters[i][0].weights);
+        free(scaler->filters[i][1].indices);
+        free(scaler->filters[i][1].weights);
+    }
+    free(scaler);
+}
+
+// Releases CPU scaler and resets the supplied pointer to NULL
+void
+ffva_scaler_freep(FFVAScaler **scaler_ptr)
+{
+    if (!scaler_ptr)
+        return;
+    ffva_scaler_free(*scaler_ptr);
+    *scaler_ptr = NULL;
+}
+
+// Returns the 0-terminated list of supported VA fourccs
+const uint32_t *
+ffva_scaler_get_formats(void)
+{
+    return g_fourccs;
+}
+
+// Determines whether the supplied VA fourcc is supported
+bool
+ffva_scaler_has_format(uint32_t fourcc)
+{
+    return find_format(fourcc) != NULL;
+}
+
+// Returns the name of the kernels selected for this CPU
+const char *
+ffva_scaler_get_kernels_name(FFVAScaler *scaler)
+{
+    return scaler ? scaler->kernels_name : NULL;
+}
+
+// Crops, scales and converts src_rect of src_image into dst_rect of dst_image
+int
+ffva_scaler_process(FFVAScaler *scaler, const FFVAScalerImage *src_image,
+    const VARectangle *src_rect, const FFVAScalerImage *dst_image,
+    const VARectangle *dst_rect, FFVAScalerMethod method)
+{
+    const FormatInfo *scale_format;
+    ImageView src, dst, tmp_src, tmp_dst;
+    const ImageView *in, *out;
+    int ret;
+
+    if (!scaler)
+        return AVERROR(EINVAL);
+
+    ret = view_init(&src, src_image, src_rect);
+    if (ret < 0)
+        return ret;
+    ret = view_init(&dst, dst_image, dst_rect);
+    if (ret < 0)
+        return ret;
+
+    if (src.width == dst.width && src.height == dst.height)
+        return convert(scaler, &src, &dst);
+
+    /* Convert formats at the smallest of the source or target sizes */
+    if (src.format == dst.format)
+        scale_format = get_scale_format(src.format);
+    else if ((uint64_t)src.width * src.height <=
+             (uint64_t)dst.width * dst.height)
+        scale_format = get_scale_format(dst.format);
+    else
+        scale_format = get_scale_format(src.format);
+
+    in = &src;
+    if (scale_format != src.format) {
+        if (!ensure_temp_view(scaler, 0, scale_format, src.width, src.height,
+                &tmp_src))
+            return AVERROR(ENOMEM);
+        ret = convert(scaler, &src, &tmp_src);
+        if (ret < 0)
+            return ret;
+        in = &tmp_src;
+    }
+
+    out = &dst;
+    if (scale_format != dst.format) {
+        if (!ensure_temp_view(scaler, 1, scale_format, dst.width, dst.height,
+                &tmp_dst))
+            return AVERROR(ENOMEM);
+        out = &tmp_dst;
+    }
+
+    ret = scale(scaler, in, out, method);
+    if (ret < 0)
+        return ret;
+
+    if (out != &dst)
+        return convert(scaler, out, &dst);
+    return 0;
+}
+
+// Fills the supplied image with black
+int
+ffva_scaler_clear(FFVAScaler *scaler, const FFVAScalerImage *image)
+{
+    static const uint8_t yuy2_black[4] = { 16, 128, 16, 128 };
+    const LayoutInfo *layout;
+    ImageView view;
+    uint32_t i, x, y;
+    uint8_t *p;
+    int ret;
+
+    if (!scaler)
+        return AVERROR(EINVAL);
+
+    ret = view_init(&view, image, NULL);
+    if (ret < 0)
+        return ret;
+    layout = get_layout(view.format);
+
+    for (i = 0; i < layout->num_planes; i++) {
+        const PlaneInfo * const plane = &layout->planes[i];
+        const uint32_t row_size =
+            plane_size(view.width, plane->x_shift) * plane->channels;
+
+        for (y = 0; y < plane_size(view.height, plane->y_shift); y++) {
+            p = view.planes[i] + y * view.pitches[i];
+            switch (view.format->layout) {
+            case LAYOUT_YUY2:
+                for (x = 0; x < row_size; x += 4)
+                    memcpy(&p[x], yuy2_black, 4);
+                break;
+            case LAYOUT_RGB32:
+                memset(p, 0, row_size);
+                for (x = 0; x < row_size; x += 4)
+                    p[x + view.format->rgba_index[3]] = 255;
+                break;
+            default:
+                memset(p, i == 0 ? 16 : 128, row_size);
+                break;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * ffvascaler.h - CPU video scaling and color conversion
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_SCALER_H
+#define FFVA_SCALER_H
+
+#include <va/va.h>
+
+/*
+ * The CPU scaler only operates on memory buffers, so that it can be
+ * exercised without any VA driver. FFVAFilter falls back to it when the
+ * VA driver does not expose VAEntrypointVideoProc.
+ */
+
+typedef struct ffva_scaler_s            FFVAScaler;
+typedef struct ffva_scaler_image_s      FFVAScalerImage;
+
+/** Scaling algorithms */
+typedef enum {
+    FFVA_SCALER_METHOD_BILINEAR = 0,
+    FFVA_SCALER_METHOD_BICUBIC,
+} FFVAScalerMethod;
+
+/** Image in system memory, with VA fourcc and plane layout */
+struct ffva_scaler_image_s {
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint8_t *pixels[3];
+    uint32_t pitches[3];
+};
+
+/** Creates a new CPU scaler with num_threads row slices (0 = automatic) */
+FFVAScaler *
+ffva_scaler_new(uint32_t num_threads);
+
+/** Destroys the supplied CPU scaler */
+void
+ffva_scaler_free(FFVAScaler *scaler);
+
+/** Releases CPU scaler and resets the supplied pointer to NULL */
+void
+ffva_scaler_freep(FFVAScaler **scaler_ptr);
+
+/** Returns the 0-terminated list of supported VA fourccs */
+const uint32_t *
+ffva_scaler_get_formats(void);
+
+/** Determines whether the supplied VA fourcc is supported */
+bool
+ffva_scaler_has_format(uint32_t fourcc);
+
+/**
+ * Returns the name of the kernels selected for this CPU: "AVX2", "SSE4.1",
+ * "NEON" or "C". The FFVA_KERNELS environment variable selects other
+ * kernels, among those the CPU supports, e.g. for testing purposes
+ */
+const char *
+ffva_scaler_get_kernels_name(FFVAScaler *scaler);
+
+/** Crops, scales and converts src_rect of src_image into dst_rect of
+    dst_image. NULL rectangles stand for the whole image */
+int
+ffva_scaler_process(FFVAScaler *scaler, const FFVAScalerImage *src_image,
+    const VARectangle *src_rect, const FFVAScalerImage *dst_image,
+    const VARectangle *dst_rect, FFVAScalerMethod method);
+
+/** Fills the supplied image with black */
+int
+ffva_scaler_clear(FFVAScaler *scaler, const FFVAScalerImage *image);
+
+#endif /* FFVA_SCALER_H */
@@ -0,0 +1,396 @@
+/*
+ * ffvascheduler.c - Presentation scheduler
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <libavutil/avutil.h>
+#include <libavutil/common.h>
+#include "ffvascheduler.h"
+#include "time_utils.h"
+
+/* Duration assumed for frames without any, in us */
+#define FFVA_SCHEDULER_DEFAULT_DURATION 40000
+
+/* Deviation from the master clock beyond which it is restarted, in us */
+#define FFVA_SCHEDULER_RESYNC_THRESHOLD 1000000
+
+/* Maximum number of frames dropped in a row, so that the display still
+   makes progress when decoding is persistently too slow */
+#define FFVA_SCHEDULER_MAX_DROPS 8
+
+/* Bounds of plausible display refresh intervals, in us */
+#define FFVA_SCHEDULER_MIN_REFRESH 4000
+#define FFVA_SCHEDULER_MAX_REFRESH 50000
+
+/* Minimum time a presentation has to block to be considered throttled by
+   the display, in us */
+#define FFVA_SCHEDULER_MIN_BLOCKED_TIME 1000
+
+/* Lead over the previous presentation, in refresh cycles, beyond which the
+   previous frame is presented again while waiting for the next one */
+#define FFVA_SCHEDULER_REPEAT_THRESHOLD 1.5
+
+/* Weight of the latest sample in the refresh interval estimate */
+#define FFVA_SCHEDULER_EWMA_ALPHA 0.125
+
+struct ffva_scheduler_s {
+    const void *klass;
+    bool has_clock;
+    uint64_t clock_base;
+    int64_t pts_base;
+    int64_t next_pts;
+    int64_t last_duration;
+    uint64_t target_time;
+    uint64_t start_time;
+    uint64_t last_present_time;
+    bool has_last_present;
+    double refresh_interval;
+    bool has_fixed_refresh;
+    bool repeat_frames;
+    bool is_repeating;
+    int64_t repeat_pts;
+    int64_t repeat_duration;
+    uint32_t num_drops_in_row;
+
+    uint64_t num_frames;
+    uint64_t num_presented;
+    uint64_t num_dropped;
+    uint64_t num_repeated;
+    uint64_t num_resyncs;
+    double total_lateness;
+    int64_t max_lateness;
+    double error_mean;
+    double error_m2;
+};
+
+// Sleeps until the supplied monotonic time, in microseconds
+static void
+sleep_until_us(uint64_t time)
+{
+    struct timespec ts;
+
+    ts.tv_sec = time / 1000000;
+    ts.tv_nsec = (time % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+// Restarts the master clock so that the frame of the supplied timestamp is
+// due right now
+static void
+scheduler_resync(FFVAScheduler *sched, int64_t pts, uint64_t now)
+{
+    if (sched->has_clock)
+        sched->num_resyncs++;
+    sched->clock_base = now;
+    sched->pts_base = pts;
+    sched->has_clock = true;
+    sched->num_drops_in_row = 0;
+}
+
+// Refines the refresh interval estimate from two presentations in a row
+// that were both throttled by the display
+static void
+scheduler_update_refresh(FFVAScheduler *sched, uint64_t end_time)
+{
+    const uint64_t blocked_time = end_time - sched->start_time;
+    uint64_t interval;
+
+    if (sched->has_fixed_refresh || !sched->has_last_present)
+        return;
+
+    // Only frames that were submitted late, without any wait, follow the
+    // previous one by exactly one refresh cycle when throttled
+    if (sched->start_time < sched->target_time ||
+        blocked_time < FFVA_SCHEDULER_MIN_BLOCKED_TIME)
+        return;
+
+    interval = end_time - sched->last_present_time;
+    if (interval < FFVA_SCHEDULER_MIN_REFRESH ||
+        interval > FFVA_SCHEDULER_MAX_REFRESH)
+        return;
+
+    if (sched->refresh_interval > 0)
+        sched->refresh_interval += FFVA_SCHEDULER_EWMA_ALPHA *
+            (interval - sched->refresh_interval);
+    else
+        sched->refresh_interval = interval;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Interface                                                         --- */
+/* ------------------------------------------------------------------------- */
+
+static const AVClass *
+ffva_scheduler_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVAScheduler",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Creates a new presentation scheduler
+FFVAScheduler *
+ffva_scheduler_new(void)
+{
+    FFVAScheduler *sched;
+
+    sched = calloc(1, sizeof(*sched));
+    if (!sched)
+        return NULL;
+
+    sched->klass = ffva_scheduler_class();
+    sched->next_pts = AV_NOPTS_VALUE;
+    sched->last_duration = FFVA_SCHEDULER_DEFAULT_DURATION;
+    return sched;
+}
+
+// Destroys the supplied presentation scheduler
+void
+ffva_scheduler_free(FFVAScheduler *sched)
+{
+    free(sched);
+}
+
+// Releases presentation scheduler and resets the supplied pointer
+void
+ffva_scheduler_freep(FFVAScheduler **sched_ptr)
+{
+    if (!sched_ptr)
+        return;
+    ffva_scheduler_free(*sched_ptr);
+    *sched_ptr = NULL;
+}
+
+// Returns the master clock time, in microseconds
+uint64_t
+ffva_scheduler_get_time(FFVAScheduler *sched)
+{
+    return get_time_us();
+}
+
+// Sets the display refresh interval, if it is known
+void
+ffva_scheduler_set_refresh_interval(FFVAScheduler *sched, uint64_t interval)
+{
+    if (!sched)
+        return;
+
+    sched->refresh_interval = interval;
+    sched->has_fixed_refresh = interval > 0;
+}
+
+// Enables the presentation of the previous frame again
+void
+ffva_scheduler_set_repeat_frames(FFVAScheduler *sched, bool repeat_frames)
+{
+    if (!sched)
+        return;
+
+    sched->repeat_frames = repeat_frames;
+}
+
+// Restarts the master clock from the next frame
+void
+ffva_scheduler_reset(FFVAScheduler *sched)
+{
+    if (!sched)
+        return;
+
+    sched->has_clock = false;
+    sched->has_last_present = false;
+    sched->is_repeating = false;
+    sched->next_pts = AV_NOPTS_VALUE;
+    sched->num_drops_in_row = 0;
+}
+
+// Schedules the frame of the supplied timestamp and duration
+FFVASchedulerAction
+ffva_scheduler_schedule_frame(FFVAScheduler *sched, int64_t pts,
+    int64_t duration)
+{
+    const uint64_t now = get_time_us();
+    int64_t delay;
+
+    if (!sched)
+        return FFVA_SCHEDULER_ACTION_PRESENT;
+
+    // The frame is scheduled again after a repeat of the previous one
+    if (sched->is_repeating) {
+        sched->is_repeating = false;
+        pts = sched->repeat_pts;
+        duration = sched->repeat_duration;
+    }
+    else {
+        if (duration <= 0)
+            duration = sched->last_duration;
+        if (pts == AV_NOPTS_VALUE)
+            pts = sched->next_pts != AV_NOPTS_VALUE ? sched->next_pts : 0;
+        sched->last_duration = duration;
+        sched->next_pts = pts + duration;
+        sched->num_frames++;
+    }
+
+    // Timestamp discontinuities, or long stalls, restart the clock
+    if (!sched->has_clock)
+        scheduler_resync(sched, pts, now);
+    delay = (int64_t)(sched->clock_base + (pts - sched->pts_base)) -
+        (int64_t)now;
+    if (delay > FFVA_SCHEDULER_RESYNC_THRESHOLD ||
+        delay < -FFVA_SCHEDULER_RESYNC_THRESHOLD) {
+        av_log(sched, AV_LOG_VERBOSE, "master clock is off by %" PRId64
+            " us, resynchronizing\n", delay);
+        scheduler_resync(sched, pts, now);
+        delay = 0;
+    }
+    sched->target_time = now + delay;
+
+    // Drop frames whose display interval is already over
+    if (-delay > duration &&
+        sched->num_drops_in_row < FFVA_SCHEDULER_MAX_DROPS) {
+        sched->num_drops_in_row++;
+        sched->num_dropped++;
+        return FFVA_SCHEDULER_ACTION_DROP;
+    }
+    sched->num_drops_in_row = 0;
+
+    // Present the previous frame again on the next vblank, if this frame is
+    // only due on a later one
+    if (sched->repeat_frames && sched->has_last_present &&
+        sched->refresh_interval > 0 &&
+        sched->target_time > sched->last_present_time +
+        FFVA_SCHEDULER_REPEAT_THRESHOLD * sched->refresh_interval) {
+        sched->is_repeating = true;
+        sched->repeat_pts = pts;
+        sched->repeat_duration = duration;
+        sched->target_time = sched->last_present_time +
+            (uint64_t)sched->refresh_interval;
+        return FFVA_SCHEDULER_ACTION_REPEAT;
+    }
+    return FFVA_SCHEDULER_ACTION_PRESENT;
+}
+
+// Waits until the last scheduled frame is due for presentation
+void
+ffva_scheduler_wait(FFVAScheduler *sched)
+{
+    uint64_t wakeup_time, half_refresh;
+
+    if (!sched)
+        return;
+
+    // Submit half a refresh cycle early, so that a throttled presentation
+    // completes on the vblank closest to the target time
+    half_refresh = (uint64_t)(sched->refresh_interval / 2);
+    wakeup_time = sched->target_time - FFMIN(sched->target_time, half_refresh);
+    if (wakeup_time > get_time_us())
+        sleep_until_us(wakeup_time);
+    sched->start_time = get_time_us();
+}
+
+// Accounts for the presentation of the last scheduled frame
+void
+ffva_scheduler_frame_presented(FFVAScheduler *sched)
+{
+    const uint64_t end_time = get_time_us();
+    int64_t error;
+    double delta;
+
+    if (!sched)
+        return;
+
+    scheduler_update_refresh(sched, end_time);
+    sched->last_present_time = end_time;
+    sched->has_last_present = true;
+
+    // Repeats do not present any new frame, and are not due at any
+    // timestamp to be accounted for
+    if (sched->is_repeating) {
+        sched->num_repeated++;
+        return;
+    }
+
+    // Welford's online algorithm for the deviation of presentation times
+    error = (int64_t)end_time - (int64_t)sched->target_time;
+    sched->num_presented++;
+    delta = error - sched->error_mean;
+    sched->error_mean += delta / sched->num_presented;
+    sched->error_m2 += delta * (error - sched->error_mean);
+
+    if (error > 0) {
+        sched->total_lateness += error;
+        sched->max_lateness = FFMAX(sched->max_lateness, error);
+
+        // The previous frame stayed on screen for extra refresh cycles, that
+        // were not presented again
+        if (sched->refresh_interval > 0)
+            sched->num_repeated += (uint64_t)(error /
+                sched->refresh_interval + 0.5);
+    }
+}
+
+// Returns the presentation statistics
+bool
+ffva_scheduler_get_stats(FFVAScheduler *sched, FFVASchedulerStats *stats)
+{
+    if (!sched || !stats)
+        return false;
+
+    stats->num_frames = sched->num_frames;
+    stats->num_presented = sched->num_presented;
+    stats->num_dropped = sched->num_dropped;
+    stats->num_repeated = sched->num_repeated;
+    stats->num_resyncs = sched->num_resyncs;
+    stats->refresh_interval = (uint64_t)(sched->refresh_interval + 0.5);
+    stats->lateness = sched->num_presented > 0 ?
+        sched->total_lateness / sched->num_presented : 0.0;
+    stats->max_lateness = sched->max_lateness;
+    stats->jitter = sched->num_presented > 1 ?
+        sqrt(sched->error_m2 / (sched->num_presented - 1)) : 0.0;
+    return true;
+}
+
+// Prints out the presentation statistics
+void
+ffva_scheduler_report(FFVAScheduler *sched)
+{
+    FFVASchedulerStats stats;
+
+    if (!ffva_scheduler_get_stats(sched, &stats))
+        return;
+
+    av_log(sched, AV_LOG_INFO, "scheduled %" PRIu64 " frames: %" PRIu64
+        " presented, %" PRIu64 " dropped, %" PRIu64 " repeated, %" PRIu64
+        " resyncs\n", stats.num_frames, stats.num_presented,
+        stats.num_dropped, stats.num_repeated, stats.num_resyncs);
+    av_log(sched, AV_LOG_INFO, "refresh interval %.2f ms, lateness %.2f ms "
+        "mean, %.2f ms max, jitter %.2f ms\n",
+        stats.refresh_interval / 1000.0, stats.lateness / 1000.0,
+        stats.max_lateness / 1000.0, stats.jitter / 1000.0);
+}
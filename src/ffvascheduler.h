@@ -0,0 +1,124 @@
+/*
+ * ffvascheduler.h - Presentation scheduler
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_SCHEDULER_H
+#define FFVA_SCHEDULER_H
+
+#include <stdint.h>
+
+/*
+ * The presentation scheduler paces frames against a monotonic master
+ * clock. Each frame is given a target presentation time derived from its
+ * timestamp. Frames that are already late by more than their duration are
+ * dropped. When repeats are enabled, the previous frame is presented again
+ * on every refresh cycle until the next frame is due, so that presentation
+ * stays locked to the display refresh. The display refresh interval is
+ * either supplied by the renderer, or estimated from the presentations that
+ * the renderer throttled, so that frames are submitted half a refresh cycle
+ * ahead and land on the closest vblank.
+ */
+
+typedef struct ffva_scheduler_s         FFVAScheduler;
+typedef struct ffva_scheduler_stats_s   FFVASchedulerStats;
+
+typedef enum {
+    FFVA_SCHEDULER_ACTION_PRESENT = 1,
+    FFVA_SCHEDULER_ACTION_DROP,
+    FFVA_SCHEDULER_ACTION_REPEAT,
+} FFVASchedulerAction;
+
+/** Presentation statistics of the scheduler */
+struct ffva_scheduler_stats_s {
+    uint64_t num_frames;
+    uint64_t num_presented;
+    uint64_t num_dropped;
+    uint64_t num_repeated;      /* refresh cycles the previous frame was
+                                   presented again, or shown while late */
+    uint64_t num_resyncs;
+    uint64_t refresh_interval;  /* in microseconds, or 0 if unknown */
+    double lateness;            /* mean lateness of presented frames, in us */
+    int64_t max_lateness;       /* in microseconds */
+    double jitter;              /* std deviation of presentation error */
+};
+
+/** Creates a new presentation scheduler */
+FFVAScheduler *
+ffva_scheduler_new(void);
+
+/** Destroys the supplied presentation scheduler */
+void
+ffva_scheduler_free(FFVAScheduler *sched);
+
+/** Releases presentation scheduler and resets the supplied pointer */
+void
+ffva_scheduler_freep(FFVAScheduler **sched_ptr);
+
+/** Returns the master clock time, in microseconds */
+uint64_t
+ffva_scheduler_get_time(FFVAScheduler *sched);
+
+/** Sets the display refresh interval, in microseconds, if it is known */
+void
+ffva_scheduler_set_refresh_interval(FFVAScheduler *sched, uint64_t interval);
+
+/**
+ * Enables the presentation of the previous frame again, on refresh cycles
+ * where the next frame is not due yet. This requires a known or estimated
+ * refresh interval, and a renderer that throttles presentations to vblanks
+ */
+void
+ffva_scheduler_set_repeat_frames(FFVAScheduler *sched, bool repeat_frames);
+
+/** Restarts the master clock from the next frame, e.g. after a seek */
+void
+ffva_scheduler_reset(FFVAScheduler *sched);
+
+/**
+ * Schedules the frame of the supplied timestamp and duration, both in
+ * AV_TIME_BASE units. Returns whether the frame shall be presented, in
+ * which case ffva_scheduler_wait() and ffva_scheduler_frame_presented()
+ * are to be called around presentation, or dropped. Returns REPEAT if the
+ * previous frame shall be presented again first, the same way, after which
+ * this frame is to be scheduled again
+ */
+FFVASchedulerAction
+ffva_scheduler_schedule_frame(FFVAScheduler *sched, int64_t pts,
+    int64_t duration);
+
+/** Waits until the last scheduled frame is due for presentation */
+void
+ffva_scheduler_wait(FFVAScheduler *sched);
+
+/** Accounts for the presentation of the last scheduled frame, or of the
+    repeat of the previous frame, just done */
+void
+ffva_scheduler_frame_presented(FFVAScheduler *sched);
+
+/** Returns the presentation statistics */
+bool
+ffva_scheduler_get_stats(FFVAScheduler *sched, FFVASchedulerStats *stats);
+
+/** Prints out the presentation statistics */
+void
+ffva_scheduler_report(FFVAScheduler *sched);
+
+#endif /* FFVA_SCHEDULER_H */
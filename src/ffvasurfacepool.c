@@ -0,0 +1,255 @@
+/*
+ * ffvasurfacepool.c - VA surface pool
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <pthread.h>
+#include "ffvasurfacepool.h"
+#include "vaapi_compat.h"
+#include "vaapi_utils.h"
+
+typedef struct {
+    FFVASurface surface;
+    uint32_t in_use : 1;
+    uint64_t release_seqno;
+} FFVASurfacePoolEntry;
+
+struct ffva_surface_pool_s {
+    const void *klass;
+    FFVADisplay *display;
+    VADisplay va_display;
+    pthread_mutex_t lock;
+    FFVASurfacePoolEntry *entries;
+    uint32_t num_entries;
+    uint32_t max_entries;
+    uint64_t release_seqno;
+};
+
+static inline bool
+entry_matches(const FFVASurfacePoolEntry *e, uint32_t fourcc, uint32_t chroma,
+    uint32_t width, uint32_t height)
+{
+    const FFVASurface * const s = &e->surface;
+
+    return s->fourcc == fourcc && s->chroma == chroma &&
+        s->width == width && s->height == height;
+}
+
+static bool
+entry_init_surface(FFVASurfacePool *pool, FFVASurfacePoolEntry *e,
+    uint32_t fourcc, uint32_t chroma, uint32_t width, uint32_t height)
+{
+    VASurfaceID va_surface;
+    VASurfaceAttrib attrib;
+    VAStatus va_status;
+
+    va_destroy_surface(pool->va_display, &e->surface.id);
+
+    attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attrib.type = VASurfaceAttribPixelFormat;
+    attrib.value.type = VAGenericValueTypeInteger;
+    attrib.value.value.i = fourcc;
+
+    va_status = vaCreateSurfaces(pool->va_display, chroma, width, height,
+        &va_surface, 1, &attrib, fourcc ? 1 : 0);
+    if (!va_check_status(va_status, "vaCreateSurfaces()"))
+        goto error;
+
+    ffva_surface_init(&e->surface, va_surface, chroma, width, height);
+    e->surface.fourcc = fourcc;
+    return true;
+
+error:
+    ffva_surface_init_defaults(&e->surface);
+    return false;
+}
+
+// Looks up a free entry to hold a surface with the supplied format and size
+static FFVASurfacePoolEntry *
+find_free_entry(FFVASurfacePool *pool, uint32_t fourcc, uint32_t chroma,
+    uint32_t width, uint32_t height)
+{
+    FFVASurfacePoolEntry *e, *best_entry = NULL, *evict_entry = NULL;
+    uint32_t i;
+
+    /* Prefer the matching surface that was released the longest time ago,
+       so that surfaces still in flight down the pipeline are reused last */
+    for (i = 0; i < pool->num_entries; i++) {
+        e = &pool->entries[i];
+        if (e->in_use)
+            continue;
+        if (entry_matches(e, fourcc, chroma, width, height)) {
+            if (!best_entry || e->release_seqno < best_entry->release_seqno)
+                best_entry = e;
+        }
+        else if (!evict_entry || e->release_seqno < evict_entry->release_seqno)
+            evict_entry = e;
+    }
+    if (best_entry)
+        return best_entry;
+
+    if (pool->num_entries < pool->max_entries) {
+        e = &pool->entries[pool->num_entries++];
+        ffva_surface_init_defaults(&e->surface);
+        e->in_use = 0;
+        e->release_seqno = 0;
+        return e;
+    }
+    return evict_entry;
+}
+
+/* ------------------------------------------------------------------------- */
+/* --- Interface                                                         --- */
+/* ------------------------------------------------------------------------- */
+
+static const AVClass *
+ffva_surface_pool_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVASurfacePool",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Creates a new pool holding at most max_surfaces VA surfaces
+FFVASurfacePool *
+ffva_surface_pool_new(FFVADisplay *display, uint32_t max_surfaces)
+{
+    FFVASurfacePool *pool;
+
+    if (!display || !max_surfaces)
+        return NULL;
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return NULL;
+
+    pool->klass = ffva_surface_pool_class();
+    pool->display = display;
+    pool->va_display = ffva_display_get_va_display(display);
+    pool->max_entries = max_surfaces;
+    pthread_mutex_init(&pool->lock, NULL);
+
+    pool->entries = calloc(max_surfaces, sizeof(*pool->entries));
+    if (!pool->entries)
+        goto error;
+    return pool;
+
+error:
+    ffva_surface_pool_free(pool);
+    return NULL;
+}
+
+// Destroys the supplied surface pool, and all the surfaces it holds
+void
+ffva_surface_pool_free(FFVASurfacePool *pool)
+{
+    uint32_t i;
+
+    if (!pool)
+        return;
+
+    for (i = 0; i < pool->num_entries; i++) {
+        FFVASurfacePoolEntry * const e = &pool->entries[i];
+        if (e->in_use)
+            av_log(pool, AV_LOG_WARNING, "surface 0x%08x is still in use\n",
+                e->surface.id);
+        va_destroy_surface(pool->va_display, &e->surface.id);
+    }
+    free(pool->entries);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+// Releases surface pool and resets the supplied pointer to NULL
+void
+ffva_surface_pool_freep(FFVASurfacePool **pool_ptr)
+{
+    if (!pool_ptr)
+        return;
+    ffva_surface_pool_free(*pool_ptr);
+    *pool_ptr = NULL;
+}
+
+// Returns the maximum number of surfaces the pool can hold
+uint32_t
+ffva_surface_pool_get_depth(FFVASurfacePool *pool)
+{
+    return pool ? pool->max_entries : 0;
+}
+
+// Acquires a free surface with the supplied format and size from the pool
+FFVASurface *
+ffva_surface_pool_acquire(FFVASurfacePool *pool, uint32_t fourcc,
+    uint32_t chroma, uint32_t width, uint32_t height)
+{
+    FFVASurfacePoolEntry *e;
+
+    if (!pool || !width || !height)
+        return NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    e = find_free_entry(pool, fourcc, chroma, width, height);
+    if (!e)
+        goto error_pool_exhausted;
+    if (e->surface.id == VA_INVALID_ID ||
+        !entry_matches(e, fourcc, chroma, width, height)) {
+        if (!entry_init_surface(pool, e, fourcc, chroma, width, height))
+            goto error_create_surface;
+    }
+    e->in_use = 1;
+    pthread_mutex_unlock(&pool->lock);
+    return &e->surface;
+
+    /* ERRORS */
+error_pool_exhausted:
+    av_log(pool, AV_LOG_ERROR, "no free surface left in pool (depth %u)\n",
+        pool->max_entries);
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+error_create_surface:
+    av_log(pool, AV_LOG_ERROR, "failed to allocate %ux%u surface\n",
+        width, height);
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Releases the supplied surface back to the pool
+void
+ffva_surface_pool_release(FFVASurfacePool *pool, FFVASurface *surface)
+{
+    FFVASurfacePoolEntry *e;
+
+    if (!pool || !surface)
+        return;
+
+    // The number of entries grows as surfaces are acquired from other threads
+    e = (FFVASurfacePoolEntry *)surface;
+    pthread_mutex_lock(&pool->lock);
+    if (e >= pool->entries && e < pool->entries + pool->num_entries) {
+        e->in_use = 0;
+        e->release_seqno = ++pool->release_seqno;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
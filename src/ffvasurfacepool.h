@@ -0,0 +1,57 @@
+/*
+ * ffvasurfacepool.h - VA surface pool
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_SURFACE_POOL_H
+#define FFVA_SURFACE_POOL_H
+
+#include <stdint.h>
+#include "ffvadisplay.h"
+#include "ffvasurface.h"
+
+typedef struct ffva_surface_pool_s      FFVASurfacePool;
+
+/** Creates a new pool holding at most max_surfaces VA surfaces */
+FFVASurfacePool *
+ffva_surface_pool_new(FFVADisplay *display, uint32_t max_surfaces);
+
+/** Destroys the supplied surface pool, and all the surfaces it holds */
+void
+ffva_surface_pool_free(FFVASurfacePool *pool);
+
+/** Releases surface pool and resets the supplied pointer to NULL */
+void
+ffva_surface_pool_freep(FFVASurfacePool **pool_ptr);
+
+/** Returns the maximum number of surfaces the pool can hold */
+uint32_t
+ffva_surface_pool_get_depth(FFVASurfacePool *pool);
+
+/** Acquires a free surface with the supplied format and size from the pool */
+FFVASurface *
+ffva_surface_pool_acquire(FFVASurfacePool *pool, uint32_t fourcc,
+    uint32_t chroma, uint32_t width, uint32_t height);
+
+/** Releases the supplied surface back to the pool */
+void
+ffva_surface_pool_release(FFVASurfacePool *pool, FFVASurface *surface);
+
+#endif /* FFVA_SURFACE_POOL_H */
@@ -0,0 +1,653 @@
+/*
+ * ffvathumbnailer.c - Keyframe thumbnail extraction
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <libavutil/pixfmt.h>
+#include "ffvathumbnailer.h"
+#include "ffvadecoder.h"
+#include "ffvafilterservice.h"
+#include "ffvasurfacepool.h"
+#include "ffmpeg_utils.h"
+#include "vaapi_utils.h"
+#include "time_utils.h"
+
+// Number of thumbnails being scaled while the previous one is read back
+#define THUMBNAILS_IN_FLIGHT 2
+
+// Default thumbnail width, if no size was specified
+#define DEFAULT_WIDTH 160
+
+// Thumbnails are written out as packed 24-bit RGB images
+#define BYTES_PER_PIXEL 3
+
+struct ffva_thumbnailer_s {
+    const void *klass;
+    FFVADisplay *display;
+    VADisplay va_display;
+    FFVADecoder *decoder;
+    FFVAFilterService *filter_service;
+    FFVAFilterJobParams filter_params;
+    FFVASurfacePool *surface_pool;
+    uint32_t fourcc;
+    uint32_t chroma;
+    uint32_t req_width;
+    uint32_t req_height;
+    int64_t interval;
+    uint32_t grid_columns;
+    uint32_t grid_rows;
+
+    /* State of the active run */
+    const char *dirname;
+    uint32_t width;
+    uint32_t height;
+    uint32_t columns;
+    uint32_t rows;
+    uint8_t *sheet;
+    uint32_t sheet_stride;
+    uint32_t sheet_size;
+    uint32_t num_tiles;
+    FFVASurface *pending_surface;
+    FFVAThumbnailerStats stats;
+};
+
+static const enum AVPixelFormat g_pix_fmts[] = {
+    AV_PIX_FMT_RGBA,
+    AV_PIX_FMT_BGRA,
+    AV_PIX_FMT_NONE
+};
+
+static const AVClass *
+ffva_thumbnailer_class(void)
+{
+    static const AVClass g_class = {
+        .class_name     = "FFVAThumbnailer",
+        .item_name      = av_default_item_name,
+        .option         = NULL,
+        .version        = LIBAVUTIL_VERSION_INT,
+    };
+    return &g_class;
+}
+
+// Returns the byte offset of the red component in a 32-bit RGB pixel, or
+// -1 if the format is not supported
+static int
+get_red_offset(uint32_t fourcc)
+{
+    switch (fourcc) {
+    case VA_FOURCC('R','G','B','A'):
+    case VA_FOURCC('R','G','B','X'):
+        return 0;
+    case VA_FOURCC('B','G','R','A'):
+    case VA_FOURCC('B','G','R','X'):
+        return 2;
+    }
+    return -1;
+}
+
+// Rounds the supplied thumbnail dimension to an even size
+static inline uint32_t
+round_size(uint64_t size)
+{
+    return size < 2 ? 2 : (size + 1) & ~1;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Readback and output                                              --- */
+/* ------------------------------------------------------------------------ */
+
+// Reads the supplied RGB surface back, as packed 24-bit RGB pixels
+static int
+read_surface(FFVAThumbnailer *thumbnailer, FFVASurface *surface,
+    uint8_t *dst, uint32_t dst_stride)
+{
+    VADisplay const va_display = thumbnailer->va_display;
+    VAImageFormat va_format;
+    VAImage va_image;
+    VAStatus va_status;
+    const uint8_t *src;
+    uint8_t *pixels;
+    uint32_t x, y;
+    int r;
+
+    va_image_init_defaults(&va_image);
+
+    va_status = vaSyncSurface(va_display, surface->id);
+    if (!va_check_status(va_status, "vaSyncSurface()"))
+        return vaapi_to_ffmpeg_error(va_status);
+
+    // Access the surface contents directly, if the layout is supported.
+    // Otherwise, go through an intermediate image
+    va_status = vaDeriveImage(va_display, surface->id, &va_image);
+    if (va_status == VA_STATUS_SUCCESS &&
+        get_red_offset(va_image.format.fourcc) < 0) {
+        vaDestroyImage(va_display, va_image.image_id);
+        va_image_init_defaults(&va_image);
+    }
+    if (va_image.image_id == VA_INVALID_ID) {
+        memset(&va_format, 0, sizeof(va_format));
+        va_format.fourcc = surface->fourcc;
+        va_format.byte_order = VA_LSB_FIRST;
+        va_status = vaCreateImage(va_display, &va_format, surface->width,
+            surface->height, &va_image);
+        if (!va_check_status(va_status, "vaCreateImage()"))
+            return vaapi_to_ffmpeg_error(va_status);
+
+        va_status = vaGetImage(va_display, surface->id, 0, 0,
+            surface->width, surface->height, va_image.image_id);
+        if (!va_check_status(va_status, "vaGetImage()"))
+            goto error;
+    }
+
+    pixels = va_map_buffer(va_display, va_image.buf);
+    if (!pixels) {
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
+        goto error;
+    }
+
+    r = get_red_offset(va_image.format.fourcc);
+    for (y = 0; y < surface->height; y++) {
+        src = pixels + va_image.offsets[0] + y * va_image.pitches[0];
+        for (x = 0; x < surface->width; x++, src += 4) {
+            dst[x * BYTES_PER_PIXEL + 0] = src[r];
+            dst[x * BYTES_PER_PIXEL + 1] = src[1];
+            dst[x * BYTES_PER_PIXEL + 2] = src[2 - r];
+        }
+        dst += dst_stride;
+    }
+
+    va_unmap_buffer(va_display, va_image.buf, NULL);
+    vaDestroyImage(va_display, va_image.image_id);
+    return 0;
+
+error:
+    vaDestroyImage(va_display, va_image.image_id);
+    return vaapi_to_ffmpeg_error(va_status);
+}
+
+// Writes the supplied packed 24-bit RGB pixels to a binary PPM file
+static int
+write_image(FFVAThumbnailer *thumbnailer, const char *filename,
+    const uint8_t *pixels, uint32_t width, uint32_t height, uint32_t stride)
+{
+    FILE *fp;
+    uint32_t y;
+    int ret;
+
+    fp = fopen(filename, "wb");
+    if (!fp)
+        goto error_open_file;
+
+    fprintf(fp, "P6\n%u %u\n255\n", width, height);
+    for (y = 0; y < height; y++) {
+        if (fwrite(pixels + y * stride, BYTES_PER_PIXEL, width, fp) != width)
+            goto error_write_file;
+    }
+    if (fclose(fp) != 0) {
+        fp = NULL;
+        goto error_write_file;
+    }
+    return 0;
+
+    /* ERRORS */
+error_open_file:
+    ret = AVERROR(errno);
+    av_log(thumbnailer, AV_LOG_ERROR, "failed to create file `%s': %s\n",
+        filename, strerror(errno));
+    return ret;
+error_write_file:
+    av_log(thumbnailer, AV_LOG_ERROR, "failed to write file `%s'\n",
+        filename);
+    if (fp)
+        fclose(fp);
+    return AVERROR(EIO);
+}
+
+// Writes out the current sprite sheet, or the last thumbnail, and clears
+// the sheet for the next ones
+static int
+write_sheet(FFVAThumbnailer *thumbnailer)
+{
+    FFVAThumbnailerStats * const stats = &thumbnailer->stats;
+    char filename[PATH_MAX];
+    uint32_t rows;
+    int ret;
+
+    if (thumbnailer->num_tiles == 0)
+        return 0;
+
+    if (thumbnailer->grid_columns > 0)
+        snprintf(filename, sizeof(filename), "%s/sprite-%04u.ppm",
+            thumbnailer->dirname, stats->num_files);
+    else
+        snprintf(filename, sizeof(filename), "%s/thumb-%06u.ppm",
+            thumbnailer->dirname, stats->num_files);
+
+    // Drop the trailing empty rows of the last sprite sheet
+    rows = (thumbnailer->num_tiles + thumbnailer->columns - 1) /
+        thumbnailer->columns;
+    ret = write_image(thumbnailer, filename, thumbnailer->sheet,
+        thumbnailer->columns * thumbnailer->width,
+        rows * thumbnailer->height, thumbnailer->sheet_stride);
+    if (ret < 0)
+        return ret;
+    stats->num_files++;
+
+    if (thumbnailer->columns * thumbnailer->rows > 1)
+        memset(thumbnailer->sheet, 0, thumbnailer->sheet_size);
+    thumbnailer->num_tiles = 0;
+    return 0;
+}
+
+// Reads back the pending thumbnail into the next tile of the sheet
+static int
+flush_pending_surface(FFVAThumbnailer *thumbnailer)
+{
+    FFVASurface * const surface = thumbnailer->pending_surface;
+    const uint32_t tile = thumbnailer->num_tiles;
+    uint8_t *dst;
+    int ret;
+
+    if (!surface)
+        return 0;
+
+    dst = thumbnailer->sheet +
+        (tile / thumbnailer->columns) * thumbnailer->height *
+        thumbnailer->sheet_stride +
+        (tile % thumbnailer->columns) * thumbnailer->width * BYTES_PER_PIXEL;
+    ret = read_surface(thumbnailer, surface, dst, thumbnailer->sheet_stride);
+    ffva_surface_pool_release(thumbnailer->surface_pool, surface);
+    thumbnailer->pending_surface = NULL;
+    if (ret < 0)
+        return ret;
+
+    thumbnailer->stats.num_thumbnails++;
+    if (++thumbnailer->num_tiles == thumbnailer->columns * thumbnailer->rows)
+        return write_sheet(thumbnailer);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Thumbnailer                                                      --- */
+/* ------------------------------------------------------------------------ */
+
+// Selects an RGB format both VPP, or the CPU scaler, and readback support
+static int
+thumbnailer_init_format(FFVAThumbnailer *thumbnailer)
+{
+    FFVAFilterJobParams * const params = &thumbnailer->filter_params;
+    const enum AVPixelFormat *p;
+
+    ffva_filter_job_params_init_defaults(params);
+    for (p = g_pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+        if (!ffmpeg_to_vaapi_pix_fmt(*p, &thumbnailer->fourcc,
+                &thumbnailer->chroma))
+            continue;
+        params->pix_fmt = *p;
+        if (ffva_filter_service_check_params(thumbnailer->filter_service,
+                params) == 0)
+            return 0;
+    }
+    av_log(thumbnailer, AV_LOG_ERROR, "no RGB format for scaling "
+        "thumbnails\n");
+    return AVERROR(ENOTSUP);
+}
+
+static int
+thumbnailer_init(FFVAThumbnailer *thumbnailer, FFVADisplay *display)
+{
+    thumbnailer->klass = ffva_thumbnailer_class();
+    thumbnailer->display = display;
+    thumbnailer->va_display = ffva_display_get_va_display(display);
+
+    thumbnailer->filter_service = ffva_filter_service_get(display);
+    if (!thumbnailer->filter_service)
+        return AVERROR(ENOMEM);
+
+    thumbnailer->surface_pool = ffva_surface_pool_new(display,
+        THUMBNAILS_IN_FLIGHT);
+    if (!thumbnailer->surface_pool)
+        return AVERROR(ENOMEM);
+    return thumbnailer_init_format(thumbnailer);
+}
+
+static void
+thumbnailer_close(FFVAThumbnailer *thumbnailer)
+{
+    if (thumbnailer->pending_surface) {
+        ffva_surface_pool_release(thumbnailer->surface_pool,
+            thumbnailer->pending_surface);
+        thumbnailer->pending_surface = NULL;
+    }
+    ffva_decoder_freep(&thumbnailer->decoder);
+    av_freep(&thumbnailer->sheet);
+    thumbnailer->num_tiles = 0;
+    thumbnailer->dirname = NULL;
+}
+
+static void
+thumbnailer_finalize(FFVAThumbnailer *thumbnailer)
+{
+    thumbnailer_close(thumbnailer);
+    ffva_surface_pool_freep(&thumbnailer->surface_pool);
+}
+
+// Determines the thumbnail size, preserving the video aspect ratio for
+// any dimension left unspecified
+static void
+thumbnailer_init_size(FFVAThumbnailer *thumbnailer,
+    const FFVADecoderInfo *info)
+{
+    uint32_t width = thumbnailer->req_width;
+    uint32_t height = thumbnailer->req_height;
+
+    if (!width && !height)
+        width = DEFAULT_WIDTH;
+    if (!height)
+        height = (uint64_t)width * info->height / info->width;
+    else if (!width)
+        width = (uint64_t)height * info->width / info->height;
+    thumbnailer->width = round_size(width);
+    thumbnailer->height = round_size(height);
+}
+
+// Opens the video file for keyframe decoding, and allocates the sheet
+static int
+thumbnailer_open(FFVAThumbnailer *thumbnailer, const char *filename,
+    const char *dirname, FFVADecoderInfo *info)
+{
+    int ret;
+
+    thumbnailer->decoder = ffva_decoder_new(thumbnailer->display);
+    if (!thumbnailer->decoder)
+        goto error_create_decoder;
+    ffva_decoder_set_flags(thumbnailer->decoder,
+        FFVA_DECODER_FLAG_KEYFRAMES_ONLY);
+    ret = ffva_decoder_open(thumbnailer->decoder, filename);
+    if (ret < 0)
+        return ret;
+    if (!ffva_decoder_get_info(thumbnailer->decoder, info) ||
+        info->width <= 0 || info->height <= 0)
+        goto error_no_info;
+
+    if (mkdir(dirname, 0777) < 0 && errno != EEXIST)
+        goto error_create_dir;
+    thumbnailer->dirname = dirname;
+
+    thumbnailer_init_size(thumbnailer, info);
+    thumbnailer->columns = thumbnailer->grid_columns ?
+        thumbnailer->grid_columns : 1;
+    thumbnailer->rows = thumbnailer->grid_rows ? thumbnailer->grid_rows : 1;
+    thumbnailer->sheet_stride = thumbnailer->columns * thumbnailer->width *
+        BYTES_PER_PIXEL;
+    thumbnailer->sheet_size = thumbnailer->rows * thumbnailer->height *
+        thumbnailer->sheet_stride;
+    thumbnailer->sheet = av_mallocz(thumbnailer->sheet_size);
+    if (!thumbnailer->sheet)
+        goto error_alloc_sheet;
+
+    thumbnailer->stats.width = thumbnailer->width;
+    thumbnailer->stats.height = thumbnailer->height;
+    return 0;
+
+    /* ERRORS */
+error_create_decoder:
+    av_log(thumbnailer, AV_LOG_ERROR, "failed to create decoder\n");
+    return AVERROR(ENOMEM);
+error_no_info:
+    av_log(thumbnailer, AV_LOG_ERROR, "failed to determine video size\n");
+    return AVERROR_INVALIDDATA;
+error_create_dir:
+    ret = AVERROR(errno);
+    av_log(thumbnailer, AV_LOG_ERROR, "failed to create directory `%s': %s\n",
+        dirname, strerror(errno));
+    return ret;
+error_alloc_sheet:
+    av_log(thumbnailer, AV_LOG_ERROR, "failed to allocate %ux%u sprite "
+        "sheet\n", thumbnailer->columns * thumbnailer->width,
+        thumbnailer->rows * thumbnailer->height);
+    return AVERROR(ENOMEM);
+}
+
+// Scales the decoded keyframe down, and reads back the previous thumbnail
+// while this one is being processed. The job is waited for before the
+// decoded surface is returned
+static int
+thumbnailer_process_frame(FFVAThumbnailer *thumbnailer,
+    FFVADecoderFrame *frame)
+{
+    FFVAFilterJob *job;
+    FFVASurface *surface;
+    int ret, job_ret;
+
+    surface = ffva_surface_pool_acquire(thumbnailer->surface_pool,
+        thumbnailer->fourcc, thumbnailer->chroma, thumbnailer->width,
+        thumbnailer->height);
+    if (!surface)
+        return AVERROR(ENOMEM);
+
+    job = ffva_filter_service_submit(thumbnailer->filter_service,
+        frame->surface, frame->has_crop_rect ? &frame->crop_rect : NULL,
+        surface, NULL, &thumbnailer->filter_params, VA_FILTER_SCALING_FAST);
+    if (!job) {
+        ffva_surface_pool_release(thumbnailer->surface_pool, surface);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = flush_pending_surface(thumbnailer);
+    job_ret = ffva_filter_service_wait(thumbnailer->filter_service, job);
+    if (job_ret < 0) {
+        ffva_surface_pool_release(thumbnailer->surface_pool, surface);
+        return job_ret;
+    }
+    thumbnailer->pending_surface = surface;
+    return ret;
+}
+
+static int
+thumbnailer_run(FFVAThumbnailer *thumbnailer, const char *filename,
+    const char *dirname)
+{
+    FFVAThumbnailerStats * const stats = &thumbnailer->stats;
+    FFVADecoderInfo info;
+    FFVADecoderFrame *frame;
+    const uint64_t start_time = get_time_us();
+    int64_t next_pts, last_pts = AV_NOPTS_VALUE;
+    bool use_seek;
+    int ret;
+
+    memset(stats, 0, sizeof(*stats));
+    ret = thumbnailer_open(thumbnailer, filename, dirname, &info);
+    if (ret < 0)
+        goto cleanup;
+
+    // Seek to each interval, if the file duration is known. Otherwise,
+    // read all keyframes and drop the ones that are too close
+    use_seek = thumbnailer->interval > 0 && info.duration > 0;
+    next_pts = use_seek ? 0 : INT64_MIN;
+    for (;;) {
+        if (use_seek) {
+            if (next_pts >= info.duration)
+                break;
+            ret = ffva_decoder_seek(thumbnailer->decoder, next_pts);
+            if (ret < 0)
+                goto cleanup;
+            stats->num_seeks++;
+            next_pts += thumbnailer->interval;
+        }
+
+        ret = ffva_decoder_get_frame(thumbnailer->decoder, &frame);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret < 0)
+            goto cleanup;
+
+        // Seeking lands on the same keyframe again if keyframes are further
+        // apart than the interval
+        if ((last_pts != AV_NOPTS_VALUE && frame->pts <= last_pts) ||
+            (!use_seek && frame->pts < next_pts)) {
+            ffva_decoder_put_frame(thumbnailer->decoder, frame);
+            continue;
+        }
+        last_pts = frame->pts;
+        if (!use_seek && thumbnailer->interval > 0)
+            next_pts = frame->pts + thumbnailer->interval;
+
+        ret = thumbnailer_process_frame(thumbnailer, frame);
+        ffva_decoder_put_frame(thumbnailer->decoder, frame);
+        if (ret < 0)
+            goto cleanup;
+    }
+
+    ret = flush_pending_surface(thumbnailer);
+    if (ret == 0)
+        ret = write_sheet(thumbnailer);
+
+cleanup:
+    stats->elapsed_time = get_time_us() - start_time;
+    if (stats->elapsed_time > 0)
+        stats->thumbnails_per_second = stats->num_thumbnails * 1000000.0 /
+            stats->elapsed_time;
+    thumbnailer_close(thumbnailer);
+    return ret;
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Interface                                                        --- */
+/* ------------------------------------------------------------------------ */
+
+// Creates a new thumbnailer, for hardware decoding on the supplied display
+FFVAThumbnailer *
+ffva_thumbnailer_new(FFVADisplay *display)
+{
+    FFVAThumbnailer *thumbnailer;
+
+    if (!display)
+        return NULL;
+
+    thumbnailer = calloc(1, sizeof(*thumbnailer));
+    if (!thumbnailer)
+        return NULL;
+    if (thumbnailer_init(thumbnailer, display) != 0)
+        goto error;
+    return thumbnailer;
+
+error:
+    ffva_thumbnailer_free(thumbnailer);
+    return NULL;
+}
+
+// Destroys the supplied thumbnailer
+void
+ffva_thumbnailer_free(FFVAThumbnailer *thumbnailer)
+{
+    if (!thumbnailer)
+        return;
+    thumbnailer_finalize(thumbnailer);
+    free(thumbnailer);
+}
+
+// Releases thumbnailer and resets the supplied pointer to NULL
+void
+ffva_thumbnailer_freep(FFVAThumbnailer **thumbnailer_ptr)
+{
+    if (!thumbnailer_ptr)
+        return;
+    ffva_thumbnailer_free(*thumbnailer_ptr);
+    *thumbnailer_ptr = NULL;
+}
+
+// Sets the size of the thumbnails
+int
+ffva_thumbnailer_set_size(FFVAThumbnailer *thumbnailer, uint32_t width,
+    uint32_t height)
+{
+    if (!thumbnailer)
+        return AVERROR(EINVAL);
+
+    thumbnailer->req_width = width;
+    thumbnailer->req_height = height;
+    return 0;
+}
+
+// Sets the interval between thumbnails, or zero for every keyframe
+int
+ffva_thumbnailer_set_interval(FFVAThumbnailer *thumbnailer, int64_t interval)
+{
+    if (!thumbnailer || interval < 0)
+        return AVERROR(EINVAL);
+
+    thumbnailer->interval = interval;
+    return 0;
+}
+
+// Sets the number of columns and rows of thumbnails in each sprite sheet
+int
+ffva_thumbnailer_set_grid(FFVAThumbnailer *thumbnailer, uint32_t columns,
+    uint32_t rows)
+{
+    if (!thumbnailer || (!columns != !rows))
+        return AVERROR(EINVAL);
+
+    thumbnailer->grid_columns = columns;
+    thumbnailer->grid_rows = rows;
+    return 0;
+}
+
+// Generates the thumbnails of the video file into the supplied directory
+int
+ffva_thumbnailer_run(FFVAThumbnailer *thumbnailer, const char *filename,
+    const char *dirname)
+{
+    if (!thumbnailer || !filename || !dirname)
+        return AVERROR(EINVAL);
+    return thumbnailer_run(thumbnailer, filename, dirname);
+}
+
+// Returns the statistics of the last run
+bool
+ffva_thumbnailer_get_stats(FFVAThumbnailer *thumbnailer,
+    FFVAThumbnailerStats *stats)
+{
+    if (!thumbnailer || !stats)
+        return false;
+
+    *stats = thumbnailer->stats;
+    return true;
+}
+
+// Prints out the statistics of the last run
+void
+ffva_thumbnailer_report(FFVAThumbnailer *thumbnailer)
+{
+    FFVAThumbnailerStats stats;
+
+    if (!ffva_thumbnailer_get_stats(thumbnailer, &stats))
+        return;
+
+    av_log(thumbnailer, AV_LOG_INFO, "generated %u thumbnails (%ux%u) into "
+        "%u files in %.2f s: %.1f thumbnails/s, %u seeks\n",
+        stats.num_thumbnails, stats.width, stats.height, stats.num_files,
+        stats.elapsed_time / 1000000.0, stats.thumbnails_per_second,
+        stats.num_seeks);
+}
@@ -0,0 +1,100 @@
+/*
+ * ffvathumbnailer.h - Keyframe thumbnail extraction
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef FFVA_THUMBNAILER_H
+#define FFVA_THUMBNAILER_H
+
+#include <stdint.h>
+#include "ffvadisplay.h"
+
+/*
+ * The thumbnailer only decodes the keyframes of a video file, either all
+ * of them in sequence, or the ones found at a fixed interval by seeking.
+ * Each keyframe is scaled down with VPP, or the CPU scaler if VPP is not
+ * available, and read back to system memory. Thumbnails are written as
+ * individual PPM images, or tiled into sprite sheets, in row-major order.
+ */
+
+typedef struct ffva_thumbnailer_s       FFVAThumbnailer;
+typedef struct ffva_thumbnailer_stats_s FFVAThumbnailerStats;
+
+/** Thumbnailing statistics */
+struct ffva_thumbnailer_stats_s {
+    uint32_t num_thumbnails;
+    uint32_t num_files;         /* images written out */
+    uint32_t num_seeks;
+    uint32_t width;             /* size of each thumbnail */
+    uint32_t height;
+    uint64_t elapsed_time;      /* in microseconds */
+    double thumbnails_per_second;
+};
+
+/** Creates a new thumbnailer, for hardware decoding on the supplied display */
+FFVAThumbnailer *
+ffva_thumbnailer_new(FFVADisplay *display);
+
+/** Destroys the supplied thumbnailer */
+void
+ffva_thumbnailer_free(FFVAThumbnailer *thumbnailer);
+
+/** Releases thumbnailer and resets the supplied pointer to NULL */
+void
+ffva_thumbnailer_freep(FFVAThumbnailer **thumbnailer_ptr);
+
+/**
+ * Sets the size of the thumbnails. If either dimension is zero, it is
+ * derived from the other one so that the video aspect ratio is preserved
+ */
+int
+ffva_thumbnailer_set_size(FFVAThumbnailer *thumbnailer, uint32_t width,
+    uint32_t height);
+
+/**
+ * Sets the interval between thumbnails, in AV_TIME_BASE units. Zero, the
+ * default, generates a thumbnail for every keyframe
+ */
+int
+ffva_thumbnailer_set_interval(FFVAThumbnailer *thumbnailer, int64_t interval);
+
+/**
+ * Sets the number of columns and rows of thumbnails in each sprite sheet.
+ * Zero, the default, writes each thumbnail to a file of its own
+ */
+int
+ffva_thumbnailer_set_grid(FFVAThumbnailer *thumbnailer, uint32_t columns,
+    uint32_t rows);
+
+/** Generates the thumbnails of the video file into the supplied directory */
+int
+ffva_thumbnailer_run(FFVAThumbnailer *thumbnailer, const char *filename,
+    const char *dirname);
+
+/** Returns the statistics of the last run */
+bool
+ffva_thumbnailer_get_stats(FFVAThumbnailer *thumbnailer,
+    FFVAThumbnailerStats *stats);
+
+/** Prints out the statistics of the last run */
+void
+ffva_thumbnailer_report(FFVAThumbnailer *thumbnailer);
+
+#endif /* FFVA_THUMBNAILER_H */
@@ -0,0 +1,205 @@
+/*
+ * test_copier.c - Surface copier tests, against a reference copy
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <libavutil/common.h>
+#include "ffvacopier.h"
+#include "ffmpeg_utils.h"
+#include "test_utils.h"
+
+typedef struct {
+    const char *name;
+    uint32_t src_fourcc;
+    uint32_t dst_fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t crop_x;    /* even, so that the source rows are misaligned */
+} TestCase;
+
+static const TestCase g_test_cases[] = {
+    { "NV12 copy",
+      TEST_FOURCC_NV12, TEST_FOURCC_NV12, 1280, 720, 0 },
+    { "NV12 copy, odd size",
+      TEST_FOURCC_NV12, TEST_FOURCC_NV12, 641, 361, 0 },
+    { "NV12 copy, cropped",
+      TEST_FOURCC_NV12, TEST_FOURCC_NV12, 1280, 720, 6 },
+    { "NV12 to I420",
+      TEST_FOURCC_NV12, TEST_FOURCC_I420, 1280, 720, 0 },
+    { "NV12 to I420, odd size",
+      TEST_FOURCC_NV12, TEST_FOURCC_I420, 641, 361, 0 },
+    { "NV12 to YV12",
+      TEST_FOURCC_NV12, TEST_FOURCC_YV12, 1280, 720, 0 },
+    { "NV12 to YV12, cropped",
+      TEST_FOURCC_NV12, TEST_FOURCC_YV12, 1280, 720, 10 },
+    { "P010 copy",
+      TEST_FOURCC_P010, TEST_FOURCC_P010, 1280, 720, 0 },
+    { "P010 to P016",
+      TEST_FOURCC_P010, TEST_FOURCC_P016, 1280, 720, 0 },
+    { "P010 to P016, odd size",
+      TEST_FOURCC_P010, TEST_FOURCC_P016, 641, 361, 0 },
+    { "P010 to P016, cropped",
+      TEST_FOURCC_P010, TEST_FOURCC_P016, 1280, 720, 2 },
+};
+
+typedef struct {
+    const TestCase *test;
+    const FFVAScalerImage *src;
+    TestImage *dst;
+    const TestImage *ref;
+    uint32_t seed;              /* of the garbage filling dst */
+} TestArgs;
+
+// Returns a view of the supplied semi-planar image, without the first x
+// columns. Both planes start x samples further, as x is even
+static void
+get_cropped_image(FFVAScalerImage *view, const TestImage *image, uint32_t x)
+{
+    uint32_t i;
+
+    *view = image->image;
+    view->width -= x;
+    for (i = 0; i < image->num_planes; i++)
+        view->pixels[i] += x * image->sample_size;
+}
+
+// Copies src into dst one sample at a time, as the copier shall do
+static void
+reference_copy(const FFVAScalerImage *src, TestImage *dst)
+{
+    const FFVAScalerImage * const d = &dst->image;
+    const uint32_t u = d->fourcc == TEST_FOURCC_YV12 ? 2 : 1;
+    const uint8_t *s;
+    uint8_t *p;
+    uint32_t i, x, y, v;
+
+    for (i = 0; i < 2; i++) {
+        for (y = 0; y < dst->plane_heights[i]; y++) {
+            s = src->pixels[i] + y * src->pitches[i];
+            p = d->pixels[i] + y * d->pitches[i];
+            if (i == 1 && dst->num_planes == 3) {
+                for (x = 0; x < dst->plane_widths[1]; x++) {
+                    d->pixels[u][y * d->pitches[u] + x] = s[2 * x];
+                    d->pixels[3 - u][y * d->pitches[3 - u] + x] =
+                        s[2 * x + 1];
+                }
+            }
+            else if (d->fourcc == TEST_FOURCC_P016) {
+                for (x = 0; x < dst->plane_widths[i]; x += 2) {
+                    v = s[x] | (s[x + 1] << 8);
+                    v |= v >> 10;
+                    p[x] = v;
+                    p[x + 1] = v >> 8;
+                }
+            }
+            else
+                memcpy(p, s, dst->plane_widths[i]);
+        }
+    }
+}
+
+// Copies the source image with the selected kernels. All kernels shall
+// produce the same output as the reference copy, bit for bit, including the
+// C ones
+static int
+test_kernels(void *arg, const char *kernels_name,
+    char status[TEST_STATUS_SIZE])
+{
+    TestArgs * const args = arg;
+    const TestCase * const t = args->test;
+    FFVACopier *copier;
+    char errbuf[BUFSIZ];
+    int ret;
+
+    copier = ffva_copier_new(0);
+    if (!copier)
+        goto error_copier;
+    if (strcmp(ffva_copier_get_kernels_name(copier), kernels_name) != 0) {
+        ffva_copier_free(copier);
+        return 0;
+    }
+    test_image_fill_random(args->dst, ++args->seed);
+    ret = ffva_copier_copy(copier, args->src, &args->dst->image);
+    ffva_copier_free(copier);
+    if (ret < 0)
+        goto error_copy;
+    if (!test_image_equals(args->dst, args->ref))
+        goto error_mismatch;
+    return 1;
+
+    /* ERRORS */
+error_copier:
+    fprintf(stderr, "%s: failed to create copier\n", t->name);
+    return -1;
+error_copy:
+    fprintf(stderr, "%s: %s kernels failed to copy image (%s)\n",
+        t->name, kernels_name, ffmpeg_strerror(ret, errbuf));
+    return -1;
+error_mismatch:
+    fprintf(stderr, "%s: %s kernels output differs from reference copy\n",
+        t->name, kernels_name);
+    return -1;
+}
+
+// Runs the supplied test case with all kernels the CPU supports
+static bool
+run_test(const void *test_case)
+{
+    const TestCase * const t = test_case;
+    TestImage src = { { 0, } }, dst = { { 0, } }, ref = { { 0, } };
+    const uint32_t width = t->width - t->crop_x;
+    FFVAScalerImage src_image;
+    TestArgs args;
+    bool success = false;
+
+    if (!test_image_init(&src, t->src_fourcc, t->width, t->height) ||
+        !test_image_init(&dst, t->dst_fourcc, width, t->height) ||
+        !test_image_init(&ref, t->dst_fourcc, width, t->height))
+        goto error_alloc;
+    test_image_fill_random(&src, t->width * t->height);
+    get_cropped_image(&src_image, &src, t->crop_x);
+    reference_copy(&src_image, &ref);
+
+    args.test = t;
+    args.src = &src_image;
+    args.dst = &dst;
+    args.ref = &ref;
+    args.seed = 0;
+    success = test_run_kernels(t->name, test_kernels, &args);
+
+cleanup:
+    test_image_finalize(&src);
+    test_image_finalize(&dst);
+    test_image_finalize(&ref);
+    return success;
+
+    /* ERRORS */
+error_alloc:
+    fprintf(stderr, "%s: failed to allocate images\n", t->name);
+    goto cleanup;
+}
+
+int
+main(void)
+{
+    return test_run_cases("copier", run_test, g_test_cases,
+        sizeof(g_test_cases[0]), FF_ARRAY_ELEMS(g_test_cases));
+}
@@ -0,0 +1,229 @@
+/*
+ * test_downloader.c - Downloader tests, with software decoded frames
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include "ffvadownloader.h"
+#include "ffmpeg_compat.h"
+#include "ffmpeg_utils.h"
+#include "test_utils.h"
+
+/* Number of frames per test case, more than the downloader could queue */
+#define NUM_FRAMES 16
+
+/* Frame duration, in AV_TIME_BASE units */
+#define FRAME_DURATION 40000
+
+typedef struct {
+    const char *name;
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint32_t num_threads;
+} TestCase;
+
+static const TestCase g_test_cases[] = {
+    { "I420",                   TEST_FOURCC_I420, 1280, 720, 0 },
+    { "I420, odd size",         TEST_FOURCC_I420,  641, 361, 0 },
+    { "NV12",                   TEST_FOURCC_NV12, 1280, 720, 0 },
+    { "NV12, one thread",       TEST_FOURCC_NV12,  641, 361, 1 },
+    { "P010",                   TEST_FOURCC_P010, 1280, 720, 0 },
+};
+
+#if AV_FEATURE_AVFRAME_REF
+// Returns a new frame, as a software decoder outputs, with the pixels of
+// the supplied image
+static AVFrame *
+new_frame(const TestImage *image, int64_t pts)
+{
+    uint8_t *planes[4] = { NULL, };
+    int pitches[4] = { 0, };
+    AVFrame *frame;
+
+    frame = av_frame_alloc();
+    if (!frame)
+        return NULL;
+    frame->format = test_image_get_pix_fmt(image);
+    frame->width = image->image.width;
+    frame->height = image->image.height;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    frame->pts = pts;
+
+    test_image_get_planes(image, planes, pitches);
+    av_image_copy(frame->data, frame->linesize, (const uint8_t **)planes,
+        pitches, frame->format, frame->width, frame->height);
+    return frame;
+}
+
+// Determines whether the supplied frame has the pixels of the image
+static bool
+frame_equals(const AVFrame *frame, const TestImage *image)
+{
+    uint8_t *planes[3];
+    int pitches[3];
+    uint32_t i, y;
+
+    if (frame->format != test_image_get_pix_fmt(image) ||
+        frame->width != (int)image->image.width ||
+        frame->height != (int)image->image.height)
+        return false;
+
+    test_image_get_planes(image, planes, pitches);
+    for (i = 0; i < image->num_planes; i++) {
+        for (y = 0; y < image->plane_heights[i]; y++) {
+            if (memcmp(frame->data[i] + y * frame->linesize[i],
+                    planes[i] + y * pitches[i], image->plane_widths[i]) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Receives the next frame, which shall be the supplied image at pts
+static int
+receive_frame(FFVADownloader *dl, AVFrame *frame, const TestImage *image,
+    int64_t pts)
+{
+    int ret;
+
+    ret = ffva_downloader_receive(dl, frame);
+    if (ret < 0)
+        return ret;
+    if (frame->pts != pts || !frame_equals(frame, image))
+        return AVERROR_INVALIDDATA;
+    av_frame_unref(frame);
+    return 0;
+}
+
+// Runs the supplied frames through a downloader, keeping its queue full,
+// and checks they are received in order with the same pixels
+static bool
+run_test(const void *test_case)
+{
+    const TestCase * const t = test_case;
+    TestImage images[NUM_FRAMES];
+    FFVADecoderFrame dec_frame;
+    FFVADownloaderStats stats;
+    FFVADownloader *dl = NULL;
+    AVFrame *frame = NULL;
+    uint32_t i, num_received = 0;
+    char errbuf[BUFSIZ];
+    bool success = false;
+    int ret;
+
+    memset(images, 0, sizeof(images));
+    for (i = 0; i < NUM_FRAMES; i++) {
+        if (!test_image_init(&images[i], t->fourcc, t->width, t->height))
+            goto error_alloc;
+        test_image_fill_random(&images[i], i + 1);
+    }
+    frame = av_frame_alloc();
+    if (!frame)
+        goto error_alloc;
+
+    dl = ffva_downloader_new(NULL, t->num_threads);
+    if (!dl)
+        goto error_downloader;
+
+    memset(&dec_frame, 0, sizeof(dec_frame));
+    for (i = 0; i < NUM_FRAMES; i++) {
+        dec_frame.frame = new_frame(&images[i], i * FRAME_DURATION);
+        if (!dec_frame.frame)
+            goto error_alloc;
+        dec_frame.crop_rect.width = t->width;
+        dec_frame.crop_rect.height = t->height;
+        dec_frame.pts = i * FRAME_DURATION;
+
+        // The source frame is referenced, so it is released right away
+        while ((ret = ffva_downloader_submit(dl, &dec_frame)) ==
+               AVERROR(EAGAIN)) {
+            ret = receive_frame(dl, frame, &images[num_received],
+                num_received * FRAME_DURATION);
+            if (ret < 0)
+                break;
+            num_received++;
+        }
+        av_frame_free(&dec_frame.frame);
+        if (ret < 0)
+            goto error_download;
+    }
+    while (num_received < NUM_FRAMES) {
+        ret = receive_frame(dl, frame, &images[num_received],
+            num_received * FRAME_DURATION);
+        if (ret < 0)
+            goto error_download;
+        num_received++;
+    }
+    if (ffva_downloader_receive(dl, frame) != AVERROR(EAGAIN))
+        goto error_extra_frame;
+
+    if (!ffva_downloader_get_stats(dl, &stats) ||
+        stats.num_frames != NUM_FRAMES ||
+        stats.num_software_frames != NUM_FRAMES || stats.num_bytes != 0)
+        goto error_stats;
+    printf("  %-28s  ok\n", t->name);
+    success = true;
+
+cleanup:
+    ffva_downloader_freep(&dl);
+    av_frame_free(&frame);
+    for (i = 0; i < NUM_FRAMES; i++)
+        test_image_finalize(&images[i]);
+    return success;
+
+    /* ERRORS */
+error_alloc:
+    fprintf(stderr, "%s: failed to allocate frames\n", t->name);
+    goto cleanup;
+error_downloader:
+    fprintf(stderr, "%s: failed to create downloader\n", t->name);
+    goto cleanup;
+error_download:
+    fprintf(stderr, "%s: frame %u was not received as submitted (%s)\n",
+        t->name, num_received, ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_extra_frame:
+    fprintf(stderr, "%s: received more frames than submitted\n", t->name);
+    goto cleanup;
+error_stats:
+    fprintf(stderr, "%s: invalid download statistics\n", t->name);
+    goto cleanup;
+}
+
+int
+main(void)
+{
+    return test_run_cases("downloader", run_test, g_test_cases,
+        sizeof(g_test_cases[0]), FF_ARRAY_ELEMS(g_test_cases));
+}
+#else
+int
+main(void)
+{
+    /* Frames could not be referenced, so there is nothing to download */
+    return 77;
+}
+#endif
@@ -0,0 +1,250 @@
+/*
+ * test_filter.c - Filter tests, with CPU video processing
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <libavutil/common.h>
+#include "ffvafilter.h"
+#include "ffmpeg_utils.h"
+#include "vaapi_utils.h"
+#include "test_utils.h"
+
+typedef struct {
+    const char *name;
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_width;
+    uint32_t dst_height;
+    VARectangle crop_rect;      /* zero width for the whole source */
+    VARectangle target_rect;    /* zero width for the whole destination */
+    uint32_t flags;
+} TestCase;
+
+static const TestCase g_test_cases[] = {
+    { "copy",                   640,  360, 640, 360,
+      { 0, }, { 0, }, 0 },
+    { "downscale",              1280, 720, 640, 360,
+      { 0, }, { 0, }, 0 },
+    { "downscale, HQ",          1280, 720, 480, 270,
+      { 0, }, { 0, }, VA_FILTER_SCALING_HQ },
+    { "upscale, odd size",      322,  182, 641, 361,
+      { 0, }, { 0, }, 0 },
+    { "cropped",                640,  360, 320, 180,
+      { 64, 32, 320, 180 }, { 0, }, 0 },
+    { "target rectangle",       640,  360, 640, 360,
+      { 0, }, { 160, 90, 320, 180 }, 0 },
+};
+
+static FFVADisplay *g_display;
+
+// Copies the pixels of the supplied NV12 image into the surface, or back
+static bool
+transfer_surface(FFVASurface *surface, TestImage *image, bool put)
+{
+    VADisplay const va_display = ffva_display_get_va_display(g_display);
+    VAImageFormat va_format;
+    VAImage va_image;
+    VAStatus va_status;
+    uint8_t *pixels, *p, *q;
+    uint32_t i, y;
+
+    memset(&va_format, 0, sizeof(va_format));
+    va_format.fourcc = image->image.fourcc;
+    va_format.byte_order = VA_LSB_FIRST;
+    va_status = vaCreateImage(va_display, &va_format, surface->width,
+        surface->height, &va_image);
+    if (!va_check_status(va_status, "vaCreateImage()"))
+        return false;
+
+    if (!put) {
+        va_status = vaGetImage(va_display, surface->id, 0, 0,
+            surface->width, surface->height, va_image.image_id);
+        if (!va_check_status(va_status, "vaGetImage()"))
+            goto cleanup;
+    }
+
+    pixels = va_map_buffer(va_display, va_image.buf);
+    if (!pixels) {
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
+        goto cleanup;
+    }
+    for (i = 0; i < image->num_planes; i++) {
+        for (y = 0; y < image->plane_heights[i]; y++) {
+            p = pixels + va_image.offsets[i] + y * va_image.pitches[i];
+            q = image->image.pixels[i] + y * image->image.pitches[i];
+            if (put)
+                memcpy(p, q, image->plane_widths[i]);
+            else
+                memcpy(q, p, image->plane_widths[i]);
+        }
+    }
+    va_unmap_buffer(va_display, va_image.buf, NULL);
+
+    if (put) {
+        va_status = vaPutImage(va_display, surface->id, va_image.image_id,
+            0, 0, surface->width, surface->height,
+            0, 0, surface->width, surface->height);
+        if (!va_check_status(va_status, "vaPutImage()"))
+            goto cleanup;
+    }
+
+cleanup:
+    vaDestroyImage(va_display, va_image.image_id);
+    return va_status == VA_STATUS_SUCCESS;
+}
+
+// Allocates an NV12 surface of the supplied size
+static bool
+create_surface(FFVASurface *surface, uint32_t width, uint32_t height)
+{
+    VADisplay const va_display = ffva_display_get_va_display(g_display);
+    VASurfaceID va_surface;
+    VAStatus va_status;
+
+    va_status = vaCreateSurfaces(va_display, VA_RT_FORMAT_YUV420,
+        width, height, &va_surface, 1, NULL, 0);
+    if (!va_check_status(va_status, "vaCreateSurfaces()"))
+        return false;
+    ffva_surface_init(surface, va_surface, VA_RT_FORMAT_YUV420, width, height);
+    surface->fourcc = TEST_FOURCC_NV12;
+    return true;
+}
+
+// Processes the source surface through a filter, which falls back to the
+// CPU scaler, and checks the output matches the one of the scaler alone
+static bool
+run_test(const void *test_case)
+{
+    const TestCase * const t = test_case;
+    const VARectangle * const crop_rect =
+        t->crop_rect.width ? &t->crop_rect : NULL;
+    const VARectangle * const target_rect =
+        t->target_rect.width ? &t->target_rect : NULL;
+    const FFVAScalerMethod method =
+        (t->flags & VA_FILTER_SCALING_MASK) == VA_FILTER_SCALING_HQ ?
+        FFVA_SCALER_METHOD_BICUBIC : FFVA_SCALER_METHOD_BILINEAR;
+    TestImage src = { { 0, } }, dst = { { 0, } }, ref = { { 0, } };
+    FFVASurface src_surface, dst_surface;
+    FFVAFilter *filter = NULL;
+    FFVAScaler *scaler = NULL;
+    char errbuf[BUFSIZ];
+    bool success = false;
+    int ret;
+
+    ffva_surface_init_defaults(&src_surface);
+    ffva_surface_init_defaults(&dst_surface);
+
+    if (!test_image_init(&src, TEST_FOURCC_NV12, t->src_width,
+            t->src_height) ||
+        !test_image_init(&dst, TEST_FOURCC_NV12, t->dst_width,
+            t->dst_height) ||
+        !test_image_init(&ref, TEST_FOURCC_NV12, t->dst_width,
+            t->dst_height))
+        goto error_alloc;
+    test_image_fill(&src);
+
+    // Reference output, from the scaler alone
+    scaler = ffva_scaler_new(0);
+    if (!scaler)
+        goto error_scaler;
+    ret = target_rect ? ffva_scaler_clear(scaler, &ref.image) : 0;
+    if (ret == 0)
+        ret = ffva_scaler_process(scaler, &src.image, crop_rect, &ref.image,
+            target_rect, method);
+    if (ret < 0)
+        goto error_process;
+
+    if (!create_surface(&src_surface, t->src_width, t->src_height) ||
+        !create_surface(&dst_surface, t->dst_width, t->dst_height) ||
+        !transfer_surface(&src_surface, &src, true))
+        goto error_surface;
+
+    filter = ffva_filter_new(g_display);
+    if (!filter)
+        goto error_filter;
+    if (crop_rect)
+        ffva_filter_set_cropping_rectangle(filter, crop_rect);
+    if (target_rect)
+        ffva_filter_set_target_rectangle(filter, target_rect);
+    ret = ffva_filter_process(filter, &src_surface, &dst_surface, t->flags);
+    if (ret < 0)
+        goto error_process;
+
+    if (!transfer_surface(&dst_surface, &dst, false))
+        goto error_surface;
+    if (!test_image_equals(&dst, &ref))
+        goto error_mismatch;
+    printf("  %-28s  ok\n", t->name);
+    success = true;
+
+cleanup:
+    ffva_filter_freep(&filter);
+    ffva_scaler_freep(&scaler);
+    va_destroy_surface(ffva_display_get_va_display(g_display),
+        &src_surface.id);
+    va_destroy_surface(ffva_display_get_va_display(g_display),
+        &dst_surface.id);
+    test_image_finalize(&src);
+    test_image_finalize(&dst);
+    test_image_finalize(&ref);
+    return success;
+
+    /* ERRORS */
+error_alloc:
+    fprintf(stderr, "%s: failed to allocate images\n", t->name);
+    goto cleanup;
+error_scaler:
+    fprintf(stderr, "%s: failed to create scaler\n", t->name);
+    goto cleanup;
+error_surface:
+    fprintf(stderr, "%s: failed to transfer surface pixels\n", t->name);
+    goto cleanup;
+error_filter:
+    fprintf(stderr, "%s: failed to create filter\n", t->name);
+    goto cleanup;
+error_process:
+    fprintf(stderr, "%s: failed to process image (%s)\n", t->name,
+        ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_mismatch:
+    fprintf(stderr, "%s: filter output differs from scaler output\n",
+        t->name);
+    goto cleanup;
+}
+
+int
+main(void)
+{
+    int ret;
+
+    av_log_set_level(AV_LOG_QUIET);
+
+    // Surfaces need a VA driver, though not one with VPP
+    g_display = ffva_display_new(NULL);
+    if (!g_display)
+        return 77;
+
+    setenv("FFVA_VPP", "0", 1);
+    ret = test_run_cases("filter", run_test, g_test_cases,
+        sizeof(g_test_cases[0]), FF_ARRAY_ELEMS(g_test_cases));
+    ffva_display_freep(&g_display);
+    return ret;
+}
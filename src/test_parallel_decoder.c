@@ -0,0 +1,389 @@
+/*
+ * test_parallel_decoder.c - Parallel decoder tests, against serial decoding
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <inttypes.h>
+#include <unistd.h>
+#include <libavformat/avformat.h>
+#include <libavutil/common.h>
+#include "ffvaparalleldecoder.h"
+#include "ffmpeg_compat.h"
+#include "ffmpeg_utils.h"
+
+/* Files the test stream is written to, in the current directory */
+#define VIDEO_FILENAME  "test_parallel_decoder.nut"
+#define PACKET_FILENAME "test_parallel_decoder.pkt"
+
+/* Test stream parameters. MPEG-2 GOPs are open, unless told otherwise, so
+   that the B-frames that lead each GOP reference the previous one */
+#define STREAM_WIDTH    176
+#define STREAM_HEIGHT   144
+#define STREAM_FPS      25
+#define NUM_FRAMES      100
+#define GOP_SIZE        12
+#define NUM_B_FRAMES    2
+
+/* Maximum number of workers to decode with */
+#define MAX_WORKERS     4
+
+typedef struct {
+    int64_t *pts;
+    uint32_t num_frames;
+    uint32_t max_frames;
+} FrameList;
+
+// Appends the supplied timestamp to the list
+static bool
+frame_list_append(FrameList *list, int64_t pts)
+{
+    int64_t *new_pts;
+
+    if (list->num_frames == list->max_frames) {
+        list->max_frames = list->max_frames ? 2 * list->max_frames : 64;
+        new_pts = realloc(list->pts, list->max_frames * sizeof(*new_pts));
+        if (!new_pts)
+            return false;
+        list->pts = new_pts;
+    }
+    list->pts[list->num_frames++] = pts;
+    return true;
+}
+
+// Releases the timestamps of the list
+static void
+frame_list_finalize(FrameList *list)
+{
+    free(list->pts);
+    memset(list, 0, sizeof(*list));
+}
+
+// Draws a moving gradient into the supplied frame
+static void
+fill_frame(AVFrame *frame, uint32_t index)
+{
+    int i, x, y, w, h;
+
+    for (i = 0; i < 3; i++) {
+        w = i > 0 ? frame->width / 2 : frame->width;
+        h = i > 0 ? frame->height / 2 : frame->height;
+        for (y = 0; y < h; y++) {
+            for (x = 0; x < w; x++)
+                frame->data[i][y * frame->linesize[i] + x] =
+                    x + y + index * (i + 1) * 3;
+        }
+    }
+}
+
+// Encodes the supplied frame, or flushes the encoder if frame is NULL,
+// and writes out the resulting packet. Returns 1 if a packet was written
+static int
+write_frame(AVFormatContext *fmtctx, AVStream *stream, AVFrame *frame)
+{
+    AVCodecContext * const avctx = stream->codec;
+    AVPacket packet;
+    int ret, got_packet = 0;
+
+    av_init_packet(&packet);
+    packet.data = NULL;
+    packet.size = 0;
+    ret = avcodec_encode_video2(avctx, &packet, frame, &got_packet);
+    if (ret < 0 || !got_packet)
+        return ret;
+
+    if (packet.pts != AV_NOPTS_VALUE)
+        packet.pts = av_rescale_q(packet.pts, avctx->time_base,
+            stream->time_base);
+    if (packet.dts != AV_NOPTS_VALUE)
+        packet.dts = av_rescale_q(packet.dts, avctx->time_base,
+            stream->time_base);
+    packet.duration = av_rescale_q(1, avctx->time_base, stream->time_base);
+    packet.stream_index = stream->index;
+    ret = av_interleaved_write_frame(fmtctx, &packet);
+    return ret < 0 ? ret : 1;
+}
+
+// Encodes the test stream, with open GOPs, into the supplied file
+static int
+write_stream(const char *filename)
+{
+    AVFormatContext *fmtctx = NULL;
+    AVCodecContext *avctx;
+    AVStream *stream;
+    AVCodec *codec;
+    AVFrame *frame = NULL;
+    uint32_t i;
+    int ret;
+
+    codec = avcodec_find_encoder(AV_CODEC_ID_MPEG2VIDEO);
+    if (!codec)
+        return AVERROR_ENCODER_NOT_FOUND;
+    ret = avformat_alloc_output_context2(&fmtctx, NULL, "nut", filename);
+    if (ret < 0)
+        return ret;
+    stream = avformat_new_stream(fmtctx, codec);
+    if (!stream)
+        goto error_alloc;
+
+    avctx = stream->codec;
+    avctx->width = STREAM_WIDTH;
+    avctx->height = STREAM_HEIGHT;
+    avctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    avctx->time_base = (AVRational){ 1, STREAM_FPS };
+    avctx->gop_size = GOP_SIZE;
+    avctx->max_b_frames = NUM_B_FRAMES;
+    avctx->scenechange_threshold = 1000000000;
+    if (fmtctx->oformat->flags & AVFMT_GLOBALHEADER)
+        avctx->flags |= CODEC_FLAG_GLOBAL_HEADER;
+    stream->time_base = avctx->time_base;
+    ret = avcodec_open2(avctx, codec, NULL);
+    if (ret < 0)
+        goto cleanup;
+
+    frame = av_frame_alloc();
+    if (!frame)
+        goto error_alloc;
+    frame->format = avctx->pix_fmt;
+    frame->width = avctx->width;
+    frame->height = avctx->height;
+    ret = av_frame_get_buffer(frame, 32);
+    if (ret < 0)
+        goto cleanup;
+
+    ret = avio_open(&fmtctx->pb, filename, AVIO_FLAG_WRITE);
+    if (ret < 0)
+        goto cleanup;
+    ret = avformat_write_header(fmtctx, NULL);
+    if (ret < 0)
+        goto cleanup;
+
+    for (i = 0; i < NUM_FRAMES; i++) {
+        ret = av_frame_make_writable(frame);
+        if (ret < 0)
+            goto cleanup;
+        fill_frame(frame, i);
+        frame->pts = i;
+        ret = write_frame(fmtctx, stream, frame);
+        if (ret < 0)
+            goto cleanup;
+    }
+    while ((ret = write_frame(fmtctx, stream, NULL)) > 0)
+        ;
+    if (ret == 0)
+        ret = av_write_trailer(fmtctx);
+
+cleanup:
+    av_frame_free(&frame);
+    if (fmtctx->nb_streams > 0)
+        avcodec_close(fmtctx->streams[0]->codec);
+    if (fmtctx->pb)
+        avio_close(fmtctx->pb);
+    avformat_free_context(fmtctx);
+    return ret;
+
+    /* ERRORS */
+error_alloc:
+    ret = AVERROR(ENOMEM);
+    goto cleanup;
+}
+
+// Decodes all packets of the file, in order, with a single decoder
+static int
+decode_serial(FFVAPacketFile *pf, FrameList *list)
+{
+    const uint32_t num_packets = ffva_packet_file_get_num_packets(pf);
+    FFVADecoderCodecParams params;
+    FFVADecoderPacket packet;
+    FFVADecoderFrame *dec_frame;
+    FFVADecoder *decoder;
+    uint32_t i = 0;
+    int ret;
+
+    decoder = ffva_decoder_new(NULL);
+    if (!decoder)
+        return AVERROR(ENOMEM);
+    ffva_decoder_set_flags(decoder, FFVA_DECODER_FLAG_SOFTWARE_FALLBACK);
+    if (!ffva_packet_file_get_codec_params(pf, &params)) {
+        ret = AVERROR_INVALIDDATA;
+        goto cleanup;
+    }
+    ret = ffva_decoder_open_codec(decoder, &params);
+    if (ret < 0)
+        goto cleanup;
+
+    do {
+        ret = ffva_decoder_get_frame(decoder, &dec_frame);
+        if (ret == 0) {
+            if (!frame_list_append(list, dec_frame->pts))
+                ret = AVERROR(ENOMEM);
+            ffva_decoder_put_frame(decoder, dec_frame);
+            continue;
+        }
+        if (ret != AVERROR(EAGAIN))
+            break;
+
+        // Send the next packet, or drain at the end of the file
+        if (i < num_packets) {
+            if (!ffva_packet_file_get_packet(pf, i, &packet)) {
+                ret = AVERROR_INVALIDDATA;
+                break;
+            }
+            ret = ffva_decoder_send_packet(decoder, &packet);
+        }
+        else
+            ret = ffva_decoder_send_packet(decoder, NULL);
+        if (ret == 0)
+            i++;
+        else if (ret == AVERROR(EAGAIN))
+            ret = 0;
+    } while (ret == 0);
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+cleanup:
+    ffva_decoder_free(decoder);
+    return ret;
+}
+
+// Decodes all packets of the file, with the supplied number of workers
+static int
+decode_parallel(FFVAPacketFile *pf, uint32_t num_workers, FrameList *list)
+{
+    FFVAParallelDecoder *pd;
+    FFVADecoderFrame *dec_frame;
+    int ret;
+
+    pd = ffva_parallel_decoder_new(NULL, pf, num_workers);
+    if (!pd)
+        return AVERROR(ENOMEM);
+
+    while ((ret = ffva_parallel_decoder_get_frame(pd, &dec_frame)) == 0) {
+        if (!frame_list_append(list, dec_frame->pts))
+            ret = AVERROR(ENOMEM);
+        ffva_parallel_decoder_put_frame(pd, dec_frame);
+        if (ret < 0)
+            break;
+    }
+    ffva_parallel_decoder_free(pd);
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
+// Checks the parallel decoder delivers the same frames as a serial decoder
+static bool
+run_test(FFVAPacketFile *pf, const FrameList *ref, uint32_t num_workers)
+{
+    FrameList list = { NULL, };
+    char errbuf[BUFSIZ];
+    bool success = false;
+    uint32_t i;
+    int ret;
+
+    ret = decode_parallel(pf, num_workers, &list);
+    if (ret < 0)
+        goto error_decode;
+    if (list.num_frames != ref->num_frames)
+        goto error_num_frames;
+    for (i = 0; i < list.num_frames; i++) {
+        if (list.pts[i] != ref->pts[i])
+            goto error_pts;
+    }
+    printf("  %u workers  %u frames  ok\n", num_workers, list.num_frames);
+    success = true;
+
+cleanup:
+    frame_list_finalize(&list);
+    return success;
+
+    /* ERRORS */
+error_decode:
+    fprintf(stderr, "%u workers: failed to decode stream (%s)\n",
+        num_workers, ffmpeg_strerror(ret, errbuf));
+    goto cleanup;
+error_num_frames:
+    fprintf(stderr, "%u workers: decoded %u frames, instead of %u\n",
+        num_workers, list.num_frames, ref->num_frames);
+    goto cleanup;
+error_pts:
+    fprintf(stderr, "%u workers: frame %u has pts %" PRId64 ", instead of "
+        "%" PRId64 "\n", num_workers, i, list.pts[i], ref->pts[i]);
+    goto cleanup;
+}
+
+int
+main(void)
+{
+    FFVAPacketFile *pf = NULL;
+    FrameList ref = { NULL, };
+    uint32_t num_workers, num_failures = 0;
+    char errbuf[BUFSIZ];
+    int ret;
+
+    av_log_set_level(AV_LOG_QUIET);
+    av_register_all();
+
+    // Skip the test if this FFmpeg build cannot write the stream
+    if (!avcodec_find_encoder(AV_CODEC_ID_MPEG2VIDEO) ||
+        !av_guess_format("nut", NULL, NULL)) {
+        printf("MPEG-2 encoder or NUT muxer not found, skipped\n");
+        return 77;
+    }
+
+    ret = write_stream(VIDEO_FILENAME);
+    if (ret < 0)
+        goto error_write_stream;
+    ret = ffva_packet_file_extract(PACKET_FILENAME, VIDEO_FILENAME);
+    if (ret < 0)
+        goto error_write_stream;
+    pf = ffva_packet_file_new(PACKET_FILENAME);
+    if (!pf)
+        goto error_read_stream;
+
+    ret = decode_serial(pf, &ref);
+    if (ret < 0 || ref.num_frames == 0)
+        goto error_read_stream;
+
+    for (num_workers = 1; num_workers <= MAX_WORKERS; num_workers++) {
+        if (!run_test(pf, &ref, num_workers))
+            num_failures++;
+    }
+    if (num_failures > 0)
+        fprintf(stderr, "%u of %u parallel decoder tests failed\n",
+            num_failures, MAX_WORKERS);
+    ret = num_failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+cleanup:
+    frame_list_finalize(&ref);
+    ffva_packet_file_freep(&pf);
+    unlink(PACKET_FILENAME);
+    unlink(VIDEO_FILENAME);
+    return ret;
+
+    /* ERRORS */
+error_write_stream:
+    fprintf(stderr, "failed to write test stream (%s)\n",
+        ffmpeg_strerror(ret, errbuf));
+    ret = EXIT_FAILURE;
+    goto cleanup;
+error_read_stream:
+    fprintf(stderr, "failed to decode test stream serially\n");
+    ret = EXIT_FAILURE;
+    goto cleanup;
+}
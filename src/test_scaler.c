@@ -0,0 +1,309 @@
+/*
+ * test_scaler.c - CPU scaler tests, against C kernels and swscale
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <math.h>
+#include <libavutil/common.h>
+#if HAVE_SWSCALE
+# include <libswscale/swscale.h>
+#endif
+#include "ffvascaler.h"
+#include "ffmpeg_utils.h"
+#include "test_utils.h"
+
+/* Minimum PSNR against swscale output, in dB */
+#define MIN_PSNR_CONVERT 40.0
+#define MIN_PSNR_SCALE   35.0
+
+/* Sample value of flat images */
+#define FLAT_VALUE 0x5a
+
+typedef struct {
+    const char *name;
+    uint32_t src_fourcc;
+    uint32_t src_width;
+    uint32_t src_height;
+    uint32_t dst_fourcc;
+    uint32_t dst_width;
+    uint32_t dst_height;
+    FFVAScalerMethod method;
+} TestCase;
+
+static const TestCase g_test_cases[] = {
+    { "NV12 copy",
+      TEST_FOURCC_NV12, 640, 360, TEST_FOURCC_NV12, 640, 360,
+      FFVA_SCALER_METHOD_BILINEAR },
+    { "NV12 downscale, bilinear",
+      TEST_FOURCC_NV12, 1280, 720, TEST_FOURCC_NV12, 640, 360,
+      FFVA_SCALER_METHOD_BILINEAR },
+    { "NV12 downscale, bicubic",
+      TEST_FOURCC_NV12, 1280, 720, TEST_FOURCC_NV12, 480, 270,
+      FFVA_SCALER_METHOD_BICUBIC },
+    { "NV12 downscale 6x, bicubic",
+      TEST_FOURCC_NV12, 1920, 1080, TEST_FOURCC_NV12, 320, 180,
+      FFVA_SCALER_METHOD_BICUBIC },
+    { "NV12 upscale, bicubic",
+      TEST_FOURCC_NV12, 320, 180, TEST_FOURCC_NV12, 1280, 720,
+      FFVA_SCALER_METHOD_BICUBIC },
+    { "I420 to NV12",
+      TEST_FOURCC_I420, 640, 360, TEST_FOURCC_NV12, 640, 360,
+      FFVA_SCALER_METHOD_BILINEAR },
+    { "NV12 to YV12, downscale",
+      TEST_FOURCC_NV12, 1280, 720, TEST_FOURCC_YV12, 854, 480,
+      FFVA_SCALER_METHOD_BILINEAR },
+    { "YUY2 to I420",
+      TEST_FOURCC_YUY2, 640, 360, TEST_FOURCC_I420, 640, 360,
+      FFVA_SCALER_METHOD_BILINEAR },
+    { "NV12 to BGRA",
+      TEST_FOURCC_NV12, 640, 360, TEST_FOURCC_BGRA, 640, 360,
+      FFVA_SCALER_METHOD_BILINEAR },
+    { "I420 to RGBA, upscale",
+      TEST_FOURCC_I420, 320, 180, TEST_FOURCC_RGBA, 640, 360,
+      FFVA_SCALER_METHOD_BICUBIC },
+    { "RGBA to NV12",
+      TEST_FOURCC_RGBA, 640, 360, TEST_FOURCC_NV12, 640, 360,
+      FFVA_SCALER_METHOD_BILINEAR },
+};
+
+typedef struct {
+    const TestCase *test;
+    const TestImage *src;
+    TestImage *dst;
+    const TestImage *ref;       /* swscale output, if available */
+    TestImage *c_dst;           /* C kernels output */
+    bool has_c_dst;
+    double min_psnr;
+} TestArgs;
+
+// Fills the supplied image with the same value for all samples
+static void
+fill_flat(TestImage *image)
+{
+    uint32_t i, y;
+
+    for (i = 0; i < image->num_planes; i++) {
+        for (y = 0; y < image->plane_heights[i]; y++)
+            memset(image->image.pixels[i] + y * image->image.pitches[i],
+                FLAT_VALUE, image->plane_widths[i]);
+    }
+}
+
+// Determines whether all samples of the supplied image have the same value
+static bool
+is_flat(const TestImage *image)
+{
+    const uint8_t *p;
+    uint32_t i, x, y;
+
+    for (i = 0; i < image->num_planes; i++) {
+        for (y = 0; y < image->plane_heights[i]; y++) {
+            p = image->image.pixels[i] + y * image->image.pitches[i];
+            for (x = 0; x < image->plane_widths[i]; x++) {
+                if (p[x] != FLAT_VALUE)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Scales a flat image into dst. Weights are normalized, so that the
+// output shall be flat too
+static bool
+check_flat(const TestCase *t, TestImage *dst)
+{
+    TestImage src = { { 0, } };
+    FFVAScaler *scaler;
+    int ret = -1;
+
+    if (!test_image_init(&src, t->src_fourcc, t->src_width, t->src_height))
+        return false;
+    fill_flat(&src);
+
+    scaler = ffva_scaler_new(0);
+    if (scaler) {
+        ret = ffva_scaler_process(scaler, &src.image, NULL, &dst->image,
+            NULL, t->method);
+        ffva_scaler_free(scaler);
+    }
+    test_image_finalize(&src);
+    return ret == 0 && is_flat(dst);
+}
+
+#if HAVE_SWSCALE
+// Scales src into dst with swscale, for reference
+static bool
+sws_process(const TestImage *src, const TestImage *dst,
+    FFVAScalerMethod method)
+{
+    struct SwsContext *sws;
+    const uint8_t *src_planes[3];
+    uint8_t *dst_planes[3];
+    int src_pitches[3], dst_pitches[3];
+    int flags;
+
+    flags = SWS_ACCURATE_RND | SWS_FULL_CHR_H_INT | SWS_FULL_CHR_H_INP;
+    flags |= method == FFVA_SCALER_METHOD_BICUBIC ? SWS_BICUBIC : SWS_BILINEAR;
+
+    sws = sws_getContext(src->image.width, src->image.height,
+        test_image_get_pix_fmt(src), dst->image.width, dst->image.height,
+        test_image_get_pix_fmt(dst), flags, NULL, NULL, NULL);
+    if (!sws)
+        return false;
+
+    test_image_get_planes(src, (uint8_t **)src_planes, src_pitches);
+    test_image_get_planes(dst, dst_planes, dst_pitches);
+    sws_scale(sws, src_planes, src_pitches, 0, src->image.height,
+        dst_planes, dst_pitches);
+    sws_freeContext(sws);
+    return true;
+}
+#endif
+
+// Scales the source image with the selected kernels, and checks the output
+// matches the C kernels one, and is close to the swscale one
+static int
+test_kernels(void *arg, const char *kernels_name,
+    char status[TEST_STATUS_SIZE])
+{
+    TestArgs * const args = arg;
+    const TestCase * const t = args->test;
+    FFVAScaler *scaler;
+#if HAVE_SWSCALE
+    double psnr;
+#endif
+    char errbuf[BUFSIZ];
+    int ret;
+
+    scaler = ffva_scaler_new(0);
+    if (!scaler)
+        goto error_scaler;
+    if (strcmp(ffva_scaler_get_kernels_name(scaler), kernels_name) != 0) {
+        ffva_scaler_free(scaler);
+        return 0;
+    }
+    ret = ffva_scaler_process(scaler, &args->src->image, NULL,
+        &args->dst->image, NULL, t->method);
+    ffva_scaler_free(scaler);
+    if (ret < 0)
+        goto error_process;
+
+#if HAVE_SWSCALE
+    psnr = test_image_get_psnr(args->dst, args->ref);
+    if (psnr < args->min_psnr)
+        goto error_psnr;
+    snprintf(status, TEST_STATUS_SIZE, "%6.2f dB", psnr);
+#endif
+
+    // SIMD kernels shall produce the same output as the C ones
+    if (!args->has_c_dst) {
+        test_image_copy(args->c_dst, args->dst);
+        args->has_c_dst = true;
+    }
+    else if (!test_image_equals(args->dst, args->c_dst))
+        goto error_mismatch;
+    return 1;
+
+    /* ERRORS */
+error_scaler:
+    fprintf(stderr, "%s: failed to create scaler\n", t->name);
+    return -1;
+error_process:
+    fprintf(stderr, "%s: %s kernels failed to process image (%s)\n",
+        t->name, kernels_name, ffmpeg_strerror(ret, errbuf));
+    return -1;
+#if HAVE_SWSCALE
+error_psnr:
+    fprintf(stderr, "%s: %s kernels output differs from swscale (%.2f dB, "
+        "expected %.2f dB at least)\n", t->name, kernels_name, psnr,
+        args->min_psnr);
+    return -1;
+#endif
+error_mismatch:
+    fprintf(stderr, "%s: %s kernels output differs from C kernels\n",
+        t->name, kernels_name);
+    return -1;
+}
+
+// Runs the supplied test case with all kernels the CPU supports
+static bool
+run_test(const void *test_case)
+{
+    const TestCase * const t = test_case;
+    TestImage src = { { 0, } }, dst = { { 0, } };
+    TestImage ref = { { 0, } }, c_dst = { { 0, } };
+    TestArgs args;
+    bool success = false;
+
+    if (!test_image_init(&src, t->src_fourcc, t->src_width, t->src_height) ||
+        !test_image_init(&dst, t->dst_fourcc, t->dst_width, t->dst_height) ||
+        !test_image_init(&c_dst, t->dst_fourcc, t->dst_width,
+            t->dst_height))
+        goto error_alloc;
+
+    if (t->src_fourcc == t->dst_fourcc && !check_flat(t, &dst))
+        goto error_flat;
+    test_image_fill(&src);
+
+    args.test = t;
+    args.src = &src;
+    args.dst = &dst;
+    args.ref = &ref;
+    args.c_dst = &c_dst;
+    args.has_c_dst = false;
+    args.min_psnr = t->src_width == t->dst_width &&
+        t->src_height == t->dst_height ? MIN_PSNR_CONVERT : MIN_PSNR_SCALE;
+#if HAVE_SWSCALE
+    if (!test_image_init(&ref, t->dst_fourcc, t->dst_width, t->dst_height))
+        goto error_alloc;
+    if (!sws_process(&src, &ref, t->method))
+        goto error_sws;
+#endif
+    success = test_run_kernels(t->name, test_kernels, &args);
+
+cleanup:
+    test_image_finalize(&src);
+    test_image_finalize(&dst);
+    test_image_finalize(&ref);
+    test_image_finalize(&c_dst);
+    return success;
+
+    /* ERRORS */
+error_alloc:
+    fprintf(stderr, "%s: failed to allocate images\n", t->name);
+    goto cleanup;
+error_flat:
+    fprintf(stderr, "%s: flat image output is not flat\n", t->name);
+    goto cleanup;
+#if HAVE_SWSCALE
+error_sws:
+    fprintf(stderr, "%s: failed to create swscale context\n", t->name);
+    goto cleanup;
+#endif
+}
+
+int
+main(void)
+{
+    return test_run_cases("scaler", run_test, g_test_cases,
+        sizeof(g_test_cases[0]), FF_ARRAY_ELEMS(g_test_cases));
+}
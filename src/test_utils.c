@@ -0,0 +1,327 @@
+/*
+ * test_utils.c - Helpers for tests and benchmarks
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#include "sysdeps.h"
+#include <math.h>
+#include <libavutil/common.h>
+#include <libavutil/log.h>
+#include "test_utils.h"
+
+/* Extra bytes at the end of each row, so that pitches are honoured */
+#define ROW_PADDING 64
+
+const char * const g_test_kernels[] = {
+    "C", "SSE4.1", "AVX2", "NEON", NULL
+};
+
+// Runs the named test case with all kernels, selected through FFVA_KERNELS
+bool
+test_run_kernels(const char *test_name, TestKernelsFunc func, void *arg)
+{
+    const char * const *kernels_name;
+    char status[TEST_STATUS_SIZE];
+    int ret;
+
+    for (kernels_name = g_test_kernels; *kernels_name; kernels_name++) {
+        setenv("FFVA_KERNELS", *kernels_name, 1);
+        strcpy(status, "ok");
+        ret = func(arg, *kernels_name, status);
+        unsetenv("FFVA_KERNELS");
+        if (ret < 0)
+            return false;
+        printf("  %-28s  %-6s  %s\n", test_name, *kernels_name,
+            ret > 0 ? status : "skipped");
+    }
+    return true;
+}
+
+// Runs all test cases, and returns the exit status of the test program
+int
+test_run_cases(const char *module_name, TestCaseFunc func,
+    const void *test_cases, size_t test_case_size, uint32_t num_test_cases)
+{
+    const uint8_t * const p = test_cases;
+    uint32_t i, num_failures = 0;
+
+    av_log_set_level(AV_LOG_QUIET);
+
+    for (i = 0; i < num_test_cases; i++) {
+        if (!func(p + i * test_case_size))
+            num_failures++;
+    }
+    if (num_failures > 0)
+        fprintf(stderr, "%u of %u %s tests failed\n", num_failures,
+            num_test_cases, module_name);
+    return num_failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Allocates an image of the supplied VA fourcc and size
+bool
+test_image_init(TestImage *image, uint32_t fourcc, uint32_t width,
+    uint32_t height)
+{
+    const uint32_t chroma_width = (width + 1) / 2;
+    const uint32_t chroma_height = (height + 1) / 2;
+    uint32_t i, offset, size;
+
+    memset(image, 0, sizeof(*image));
+    image->image.fourcc = fourcc;
+    image->image.width = width;
+    image->image.height = height;
+    image->sample_size = 1;
+
+    switch (fourcc) {
+    case TEST_FOURCC_P010:
+    case TEST_FOURCC_P016:
+        image->sample_size = 2;
+        // fall-through
+    case TEST_FOURCC_NV12:
+        image->num_planes = 2;
+        image->plane_widths[0] = width * image->sample_size;
+        image->plane_heights[0] = height;
+        image->plane_widths[1] = chroma_width * 2 * image->sample_size;
+        image->plane_heights[1] = chroma_height;
+        break;
+    case TEST_FOURCC_I420:
+    case TEST_FOURCC_YV12:
+        image->num_planes = 3;
+        image->plane_widths[0] = width;
+        image->plane_heights[0] = height;
+        for (i = 1; i < 3; i++) {
+            image->plane_widths[i] = chroma_width;
+            image->plane_heights[i] = chroma_height;
+        }
+        break;
+    case TEST_FOURCC_YUY2:
+        image->num_planes = 1;
+        image->plane_widths[0] = chroma_width * 4;
+        image->plane_heights[0] = height;
+        break;
+    case TEST_FOURCC_RGBA:
+    case TEST_FOURCC_BGRA:
+        image->num_planes = 1;
+        image->plane_widths[0] = width * 4;
+        image->plane_heights[0] = height;
+        break;
+    default:
+        return false;
+    }
+
+    for (i = 0, size = 0; i < image->num_planes; i++) {
+        image->image.pitches[i] =
+            FFALIGN(image->plane_widths[i], 16) + ROW_PADDING;
+        size += image->image.pitches[i] * image->plane_heights[i];
+    }
+
+    image->buffer = av_mallocz(size);
+    if (!image->buffer)
+        return false;
+
+    for (i = 0, offset = 0; i < image->num_planes; i++) {
+        image->image.pixels[i] = image->buffer + offset;
+        offset += image->image.pitches[i] * image->plane_heights[i];
+    }
+    return true;
+}
+
+// Releases the pixels of the supplied image
+void
+test_image_finalize(TestImage *image)
+{
+    av_freep(&image->buffer);
+}
+
+static inline bool
+is_rgb_image(const TestImage *image)
+{
+    return image->image.fourcc == TEST_FOURCC_RGBA ||
+        image->image.fourcc == TEST_FOURCC_BGRA;
+}
+
+// Stores the supplied 16-bit value, either as is or with the precision
+// of the image samples
+static inline void
+put_sample(const TestImage *image, uint8_t *p, uint32_t value)
+{
+    switch (image->image.fourcc) {
+    case TEST_FOURCC_P010:
+        value &= 0xffc0;
+        // fall-through
+    case TEST_FOURCC_P016:
+        p[0] = value;
+        p[1] = value >> 8;
+        break;
+    default:
+        p[0] = value >> 8;
+        break;
+    }
+}
+
+// Fills the supplied image with smooth gradients, as natural images
+void
+test_image_fill(TestImage *image)
+{
+    const uint32_t sample_size = image->sample_size;
+    uint32_t i, x, y, n;
+    double fx, fy, v;
+    uint8_t *p;
+
+    for (i = 0; i < image->num_planes; i++) {
+        n = image->plane_widths[i] / sample_size;
+        for (y = 0; y < image->plane_heights[i]; y++) {
+            p = image->image.pixels[i] + y * image->image.pitches[i];
+            fy = (double)y / image->plane_heights[i];
+            for (x = 0; x < n; x++, p += sample_size) {
+                if (is_rgb_image(image) && (x & 3) == 3) {
+                    p[0] = 0xff;
+                    continue;
+                }
+                fx = (double)x / n;
+                v = 128.0 + 48.0 * sin(2 * M_PI * (1.5 * fx + 0.25 * i)) +
+                    48.0 * cos(2 * M_PI * (fy + 0.125 * i));
+                put_sample(image, p, (uint32_t)(v * 256.0));
+            }
+        }
+    }
+}
+
+// Fills the supplied image with pseudo-random samples
+void
+test_image_fill_random(TestImage *image, uint32_t seed)
+{
+    const uint32_t sample_size = image->sample_size;
+    uint32_t i, x, y, n, state = seed ? seed : 1;
+    uint8_t *p;
+
+    for (i = 0; i < image->num_planes; i++) {
+        n = image->plane_widths[i] / sample_size;
+        for (y = 0; y < image->plane_heights[i]; y++) {
+            p = image->image.pixels[i] + y * image->image.pitches[i];
+            for (x = 0; x < n; x++, p += sample_size) {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                put_sample(image, p, state >> 16);
+            }
+        }
+    }
+}
+
+// Copies src image into dst image, of the same format and size
+void
+test_image_copy(TestImage *dst, const TestImage *src)
+{
+    uint32_t i, y;
+
+    for (i = 0; i < src->num_planes; i++) {
+        for (y = 0; y < src->plane_heights[i]; y++)
+            memcpy(dst->image.pixels[i] + y * dst->image.pitches[i],
+                src->image.pixels[i] + y * src->image.pitches[i],
+                src->plane_widths[i]);
+    }
+}
+
+// Determines whether both images have the same pixels
+bool
+test_image_equals(const TestImage *a, const TestImage *b)
+{
+    uint32_t i, y;
+
+    if (a->image.fourcc != b->image.fourcc ||
+        a->image.width != b->image.width ||
+        a->image.height != b->image.height)
+        return false;
+
+    for (i = 0; i < a->num_planes; i++) {
+        for (y = 0; y < a->plane_heights[i]; y++) {
+            if (memcmp(a->image.pixels[i] + y * a->image.pitches[i],
+                    b->image.pixels[i] + y * b->image.pitches[i],
+                    a->plane_widths[i]) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Returns the PSNR of image a against image b, of 8-bit samples
+double
+test_image_get_psnr(const TestImage *a, const TestImage *b)
+{
+    const uint8_t *pa, *pb;
+    uint64_t sse = 0, count = 0;
+    uint32_t i, x, y;
+    int32_t d;
+
+    for (i = 0; i < a->num_planes; i++) {
+        for (y = 0; y < a->plane_heights[i]; y++) {
+            pa = a->image.pixels[i] + y * a->image.pitches[i];
+            pb = b->image.pixels[i] + y * b->image.pitches[i];
+            for (x = 0; x < a->plane_widths[i]; x++) {
+                d = (int32_t)pa[x] - pb[x];
+                sse += d * d;
+            }
+            count += a->plane_widths[i];
+        }
+    }
+    if (sse == 0)
+        return INFINITY;
+    return 10.0 * log10(255.0 * 255.0 * count / sse);
+}
+
+// Returns the FFmpeg pixel format matching the image layout. The VA RGBA
+// fourcc stands for R, G, B, A bytes in memory, as AV_PIX_FMT_RGBA
+enum AVPixelFormat
+test_image_get_pix_fmt(const TestImage *image)
+{
+    switch (image->image.fourcc) {
+    case TEST_FOURCC_NV12:
+        return AV_PIX_FMT_NV12;
+    case TEST_FOURCC_I420:
+    case TEST_FOURCC_YV12:
+        return AV_PIX_FMT_YUV420P;
+    case TEST_FOURCC_YUY2:
+        return AV_PIX_FMT_YUYV422;
+    case TEST_FOURCC_RGBA:
+        return AV_PIX_FMT_RGBA;
+    case TEST_FOURCC_BGRA:
+        return AV_PIX_FMT_BGRA;
+    case TEST_FOURCC_P010:
+        return AV_PIX_FMT_P010LE;
+    case TEST_FOURCC_P016:
+        return AV_PIX_FMT_P016LE;
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+// Fills in plane pointers and pitches in FFmpeg (Y, U, V) order
+void
+test_image_get_planes(const TestImage *image, uint8_t *planes[3],
+    int pitches[3])
+{
+    uint32_t i, j;
+
+    for (i = 0; i < 3; i++) {
+        j = image->image.fourcc == TEST_FOURCC_YV12 && i > 0 ? 3 - i : i;
+        planes[i] = image->image.pixels[j];
+        pitches[i] = image->image.pitches[j];
+    }
+}
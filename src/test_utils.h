@@ -0,0 +1,118 @@
+/*
+ * test_utils.h - Helpers for tests and benchmarks
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef TEST_UTILS_H
+#define TEST_UTILS_H
+
+#include <libavutil/pixfmt.h>
+#include "ffvascaler.h"
+
+#define TEST_FOURCC_NV12 VA_FOURCC('N','V','1','2')
+#define TEST_FOURCC_I420 VA_FOURCC('I','4','2','0')
+#define TEST_FOURCC_YV12 VA_FOURCC('Y','V','1','2')
+#define TEST_FOURCC_YUY2 VA_FOURCC('Y','U','Y','2')
+#define TEST_FOURCC_RGBA VA_FOURCC('R','G','B','A')
+#define TEST_FOURCC_BGRA VA_FOURCC('B','G','R','A')
+#define TEST_FOURCC_P010 VA_FOURCC('P','0','1','0')
+#define TEST_FOURCC_P016 VA_FOURCC('P','0','1','6')
+
+typedef struct {
+    FFVAScalerImage image;
+    uint32_t num_planes;
+    uint32_t sample_size;               /* bytes per sample */
+    uint32_t plane_widths[3];           /* in bytes */
+    uint32_t plane_heights[3];
+    uint8_t *buffer;
+} TestImage;
+
+/** Size of the status that a test prints out for each kernels */
+#define TEST_STATUS_SIZE 32
+
+/**
+ * Runs a test case with the named kernels. Returns 1 if the test passed,
+ * with the status to print out, 0 if the CPU does not support the kernels,
+ * or a negative value if the test failed, after printing out why
+ */
+typedef int (*TestKernelsFunc)(void *arg, const char *kernels_name,
+    char status[TEST_STATUS_SIZE]);
+
+/** Runs a test case, and returns false if it failed */
+typedef bool (*TestCaseFunc)(const void *test_case);
+
+/** The 0-terminated list of kernels names, C ones first */
+extern const char * const g_test_kernels[];
+
+/**
+ * Runs the named test case with all kernels of g_test_kernels, selected
+ * through the FFVA_KERNELS environment variable. Prints out one line per
+ * kernels, and stops at the first failure
+ */
+bool
+test_run_kernels(const char *test_name, TestKernelsFunc func, void *arg);
+
+/**
+ * Runs num_test_cases test cases, of test_case_size bytes each, and
+ * returns the exit status of the test program
+ */
+int
+test_run_cases(const char *module_name, TestCaseFunc func,
+    const void *test_cases, size_t test_case_size, uint32_t num_test_cases);
+
+/** Allocates an image of the supplied VA fourcc and size */
+bool
+test_image_init(TestImage *image, uint32_t fourcc, uint32_t width,
+    uint32_t height);
+
+/** Releases the pixels of the supplied image */
+void
+test_image_finalize(TestImage *image);
+
+/** Fills the supplied image with smooth gradients, as natural images */
+void
+test_image_fill(TestImage *image);
+
+/** Fills the supplied image with pseudo-random samples */
+void
+test_image_fill_random(TestImage *image, uint32_t seed);
+
+/** Copies src image into dst image, of the same format and size */
+void
+test_image_copy(TestImage *dst, const TestImage *src);
+
+/** Determines whether both images have the same pixels */
+bool
+test_image_equals(const TestImage *a, const TestImage *b);
+
+/** Returns the PSNR of image a against image b, of 8-bit samples */
+double
+test_image_get_psnr(const TestImage *a, const TestImage *b);
+
+/** Returns the FFmpeg pixel format matching the image layout */
+enum AVPixelFormat
+test_image_get_pix_fmt(const TestImage *image);
+
+/** Fills in plane pointers and pitches in FFmpeg (Y, U, V) order */
+void
+test_image_get_planes(const TestImage *image, uint8_t *planes[3],
+    int pitches[3]);
+
+#endif /* TEST_UTILS_H */
@@ -42,6 +42,9 @@
 #ifndef VA_RT_FORMAT_RGB32
 #define VA_RT_FORMAT_RGB32      0x00020000
 #endif
+#ifndef VA_RT_FORMAT_YUV420_10BPP
+#define VA_RT_FORMAT_YUV420_10BPP 0x00000100
+#endif
 
 /* Profiles */
 enum {
@@ -61,6 +64,16 @@ enum {
 #define VAProfileVP9Profile0    VACompatProfileVP9Profile0
 #endif
 
+/* Config attributes */
+enum {
+    VACompatConfigAttribMaxPictureWidth  = 18,
+    VACompatConfigAttribMaxPictureHeight = 19,
+};
+#if !VA_CHECK_VERSION(0,40,0)
+#define VAConfigAttribMaxPictureWidth   VACompatConfigAttribMaxPictureWidth
+#define VAConfigAttribMaxPictureHeight  VACompatConfigAttribMaxPictureHeight
+#endif
+
 /* Entrypoints */
 enum {
     VACompatEntrypointVideoProc = 10,
@@ -0,0 +1,492 @@
+/*
+ * vaapi_trace.c - VA-API call tracing
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#define _GNU_SOURCE 1
+#include "sysdeps.h"
+#include <inttypes.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <va/va.h>
+#if USE_VA_VPP
+# include <va/va_vpp.h>
+#endif
+#if USE_VA_X11
+# include <va/va_x11.h>
+#endif
+#include "vaapi_trace.h"
+
+/* Number of log2(nsec) buckets in latency histograms, i.e. up to ~4 s */
+#define HIST_BUCKETS 32
+
+/* The set of traced VA-API entrypoints */
+#define VA_TRACE_CORE_FUNCS(X)                  \
+    X(Initialize)                               \
+    X(Terminate)                                \
+    X(QueryConfigProfiles)                      \
+    X(QueryConfigEntrypoints)                   \
+    X(GetConfigAttributes)                      \
+    X(CreateConfig)                             \
+    X(DestroyConfig)                            \
+    X(CreateSurfaces)                           \
+    X(DestroySurfaces)                          \
+    X(CreateContext)                            \
+    X(DestroyContext)                           \
+    X(CreateBuffer)                             \
+    X(DestroyBuffer)                            \
+    X(MapBuffer)                                \
+    X(UnmapBuffer)                              \
+    X(BeginPicture)                             \
+    X(RenderPicture)                            \
+    X(EndPicture)                               \
+    X(SyncSurface)                              \
+    X(QuerySurfaceStatus)                       \
+    X(CreateImage)                              \
+    X(DestroyImage)                             \
+    X(DeriveImage)                              \
+    X(GetImage)                                 \
+    X(PutImage)
+
+#if VA_CHECK_VERSION(0,34,0)
+# define VA_TRACE_SURFACE_ATTRIBS_FUNCS(X)      \
+    X(QuerySurfaceAttributes)
+#else
+# define VA_TRACE_SURFACE_ATTRIBS_FUNCS(X)
+#endif
+
+#if VA_CHECK_VERSION(0,36,0)
+# define VA_TRACE_BUFFER_HANDLE_FUNCS(X)        \
+    X(AcquireBufferHandle)                      \
+    X(ReleaseBufferHandle)
+#else
+# define VA_TRACE_BUFFER_HANDLE_FUNCS(X)
+#endif
+
+#if VA_CHECK_VERSION(1,1,0)
+# define VA_TRACE_EXPORT_FUNCS(X)               \
+    X(ExportSurfaceHandle)
+#else
+# define VA_TRACE_EXPORT_FUNCS(X)
+#endif
+
+#if USE_VA_VPP
+# define VA_TRACE_VPP_FUNCS(X)                  \
+    X(QueryVideoProcFilters)                    \
+    X(QueryVideoProcFilterCaps)                 \
+    X(QueryVideoProcPipelineCaps)
+#else
+# define VA_TRACE_VPP_FUNCS(X)
+#endif
+
+#if USE_VA_X11
+# define VA_TRACE_X11_FUNCS(X)                  \
+    X(PutSurface)
+#else
+# define VA_TRACE_X11_FUNCS(X)
+#endif
+
+#define VA_TRACE_FUNCS(X)                       \
+    VA_TRACE_CORE_FUNCS(X)                      \
+    VA_TRACE_SURFACE_ATTRIBS_FUNCS(X)           \
+    VA_TRACE_BUFFER_HANDLE_FUNCS(X)             \
+    VA_TRACE_EXPORT_FUNCS(X)                    \
+    VA_TRACE_VPP_FUNCS(X)                       \
+    VA_TRACE_X11_FUNCS(X)
+
+enum {
+#define DEFINE_ID(NAME) U_GEN_CONCAT(VA_TRACE_ID_,NAME),
+    VA_TRACE_FUNCS(DEFINE_ID)
+#undef DEFINE_ID
+    VA_TRACE_ID_COUNT
+};
+
+typedef struct {
+    const char *name;
+    void *func;
+    uint64_t count;
+    uint64_t errors;
+    uint64_t total_time;
+    uint64_t max_time;
+    uint64_t hist[HIST_BUCKETS];
+} VATraceEntry;
+
+typedef struct {
+    VATraceEntry entries[VA_TRACE_ID_COUNT];
+    uint64_t num_frames;
+    uint64_t num_calls;
+    uint64_t num_calls_at_last_frame;
+    uint64_t max_calls_per_frame;
+} VATraceState;
+
+static VATraceState g_trace = {
+    .entries = {
+#define DEFINE_ENTRY(NAME) \
+        [U_GEN_CONCAT(VA_TRACE_ID_,NAME)] = { .name = "va" #NAME },
+        VA_TRACE_FUNCS(DEFINE_ENTRY)
+#undef DEFINE_ENTRY
+    },
+};
+
+// Returns the current monotonic time, in nanoseconds
+static inline uint64_t
+get_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Returns the histogram bucket for the supplied duration, in nanoseconds
+static inline uint32_t
+get_hist_bucket(uint64_t t)
+{
+    uint32_t n = 0;
+
+    while (t > 1 && n < HIST_BUCKETS - 1) {
+        t >>= 1;
+        n++;
+    }
+    return n;
+}
+
+// Atomically updates the maximum value stored at the supplied location
+static inline void
+atomic_max(uint64_t *ptr, uint64_t value)
+{
+    uint64_t old_value = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+    while (value > old_value && !__atomic_compare_exchange_n(ptr, &old_value,
+               value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+// Resolves the next definition of the supplied VA-API entrypoint
+static void *
+trace_lookup(uint32_t id)
+{
+    VATraceEntry * const e = &g_trace.entries[id];
+    void *func;
+
+    func = __atomic_load_n(&e->func, __ATOMIC_ACQUIRE);
+    if (!func) {
+        func = dlsym(RTLD_NEXT, e->name);
+        if (!func) {
+            fprintf(stderr, "error: failed to resolve %s()\n", e->name);
+            abort();
+        }
+        __atomic_store_n(&e->func, func, __ATOMIC_RELEASE);
+    }
+    return func;
+}
+
+// Records a call to the supplied VA-API entrypoint
+static void
+trace_record(uint32_t id, uint64_t start_time, VAStatus va_status)
+{
+    VATraceEntry * const e = &g_trace.entries[id];
+    const uint64_t t = get_time_ns() - start_time;
+
+    __atomic_fetch_add(&e->count, 1, __ATOMIC_RELAXED);
+    if (va_status != VA_STATUS_SUCCESS)
+        __atomic_fetch_add(&e->errors, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->total_time, t, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->hist[get_hist_bucket(t)], 1, __ATOMIC_RELAXED);
+    atomic_max(&e->max_time, t);
+    __atomic_fetch_add(&g_trace.num_calls, 1, __ATOMIC_RELAXED);
+}
+
+/* ------------------------------------------------------------------------ */
+/* --- Interposed VA-API entrypoints                                    --- */
+/* ------------------------------------------------------------------------ */
+
+#define DEFINE_VA_FUNC(NAME, PARAMS, ARGS)                              \
+VAStatus                                                                \
+(U_GEN_CONCAT(va,NAME)) PARAMS                                          \
+{                                                                       \
+    VAStatus (*func) PARAMS;                                            \
+    uint64_t start_time;                                                \
+    VAStatus va_status;                                                 \
+                                                                        \
+    func = trace_lookup(U_GEN_CONCAT(VA_TRACE_ID_,NAME));               \
+    start_time = get_time_ns();                                         \
+    va_status = func ARGS;                                              \
+    trace_record(U_GEN_CONCAT(VA_TRACE_ID_,NAME), start_time, va_status); \
+    return va_status;                                                   \
+}
+
+DEFINE_VA_FUNC(Initialize,
+    (VADisplay dpy, int *major_version, int *minor_version),
+    (dpy, major_version, minor_version))
+
+DEFINE_VA_FUNC(Terminate,
+    (VADisplay dpy),
+    (dpy))
+
+DEFINE_VA_FUNC(QueryConfigProfiles,
+    (VADisplay dpy, VAProfile *profile_list, int *num_profiles),
+    (dpy, profile_list, num_profiles))
+
+DEFINE_VA_FUNC(QueryConfigEntrypoints,
+    (VADisplay dpy, VAProfile profile, VAEntrypoint *entrypoint_list,
+     int *num_entrypoints),
+    (dpy, profile, entrypoint_list, num_entrypoints))
+
+DEFINE_VA_FUNC(GetConfigAttributes,
+    (VADisplay dpy, VAProfile profile, VAEntrypoint entrypoint,
+     VAConfigAttrib *attrib_list, int num_attribs),
+    (dpy, profile, entrypoint, attrib_list, num_attribs))
+
+DEFINE_VA_FUNC(CreateConfig,
+    (VADisplay dpy, VAProfile profile, VAEntrypoint entrypoint,
+     VAConfigAttrib *attrib_list, int num_attribs, VAConfigID *config_id),
+    (dpy, profile, entrypoint, attrib_list, num_attribs, config_id))
+
+DEFINE_VA_FUNC(DestroyConfig,
+    (VADisplay dpy, VAConfigID config_id),
+    (dpy, config_id))
+
+DEFINE_VA_FUNC(CreateSurfaces,
+    (VADisplay dpy, unsigned int format, unsigned int width,
+     unsigned int height, VASurfaceID *surfaces, unsigned int num_surfaces,
+     VASurfaceAttrib *attrib_list, unsigned int num_attribs),
+    (dpy, format, width, height, surfaces, num_surfaces, attrib_list,
+     num_attribs))
+
+DEFINE_VA_FUNC(DestroySurfaces,
+    (VADisplay dpy, VASurfaceID *surfaces, int num_surfaces),
+    (dpy, surfaces, num_surfaces))
+
+DEFINE_VA_FUNC(CreateContext,
+    (VADisplay dpy, VAConfigID config_id, int picture_width,
+     int picture_height, int flag, VASurfaceID *render_targets,
+     int num_render_targets, VAContextID *context),
+    (dpy, config_id, picture_width, picture_height, flag, render_targets,
+     num_render_targets, context))
+
+DEFINE_VA_FUNC(DestroyContext,
+    (VADisplay dpy, VAContextID context),
+    (dpy, context))
+
+DEFINE_VA_FUNC(CreateBuffer,
+    (VADisplay dpy, VAContextID context, VABufferType type, unsigned int size,
+     unsigned int num_elements, void *data, VABufferID *buf_id),
+    (dpy, context, type, size, num_elements, data, buf_id))
+
+DEFINE_VA_FUNC(DestroyBuffer,
+    (VADisplay dpy, VABufferID buffer_id),
+    (dpy, buffer_id))
+
+DEFINE_VA_FUNC(MapBuffer,
+    (VADisplay dpy, VABufferID buf_id, void **pbuf),
+    (dpy, buf_id, pbuf))
+
+DEFINE_VA_FUNC(UnmapBuffer,
+    (VADisplay dpy, VABufferID buf_id),
+    (dpy, buf_id))
+
+DEFINE_VA_FUNC(BeginPicture,
+    (VADisplay dpy, VAContextID context, VASurfaceID render_target),
+    (dpy, context, render_target))
+
+DEFINE_VA_FUNC(RenderPicture,
+    (VADisplay dpy, VAContextID context, VABufferID *buffers, int num_buffers),
+    (dpy, context, buffers, num_buffers))
+
+DEFINE_VA_FUNC(EndPicture,
+    (VADisplay dpy, VAContextID context),
+    (dpy, context))
+
+DEFINE_VA_FUNC(SyncSurface,
+    (VADisplay dpy, VASurfaceID render_target),
+    (dpy, render_target))
+
+DEFINE_VA_FUNC(QuerySurfaceStatus,
+    (VADisplay dpy, VASurfaceID render_target, VASurfaceStatus *status),
+    (dpy, render_target, status))
+
+DEFINE_VA_FUNC(CreateImage,
+    (VADisplay dpy, VAImageFormat *format, int width, int height,
+     VAImage *image),
+    (dpy, format, width, height, image))
+
+DEFINE_VA_FUNC(DestroyImage,
+    (VADisplay dpy, VAImageID image),
+    (dpy, image))
+
+DEFINE_VA_FUNC(DeriveImage,
+    (VADisplay dpy, VASurfaceID surface, VAImage *image),
+    (dpy, surface, image))
+
+DEFINE_VA_FUNC(GetImage,
+    (VADisplay dpy, VASurfaceID surface, int x, int y, unsigned int width,
+     unsigned int height, VAImageID image),
+    (dpy, surface, x, y, width, height, image))
+
+DEFINE_VA_FUNC(PutImage,
+    (VADisplay dpy, VASurfaceID surface, VAImageID image, int src_x,
+     int src_y, unsigned int src_width, unsigned int src_height, int dest_x,
+     int dest_y, unsigned int dest_width, unsigned int dest_height),
+    (dpy, surface, image, src_x, src_y, src_width, src_height, dest_x,
+     dest_y, dest_width, dest_height))
+
+#if VA_CHECK_VERSION(0,34,0)
+DEFINE_VA_FUNC(QuerySurfaceAttributes,
+    (VADisplay dpy, VAConfigID config, VASurfaceAttrib *attrib_list,
+     unsigned int *num_attribs),
+    (dpy, config, attrib_list, num_attribs))
+#endif
+
+#if VA_CHECK_VERSION(0,36,0)
+DEFINE_VA_FUNC(AcquireBufferHandle,
+    (VADisplay dpy, VABufferID buf_id, VABufferInfo *buf_info),
+    (dpy, buf_id, buf_info))
+
+DEFINE_VA_FUNC(ReleaseBufferHandle,
+    (VADisplay dpy, VABufferID buf_id),
+    (dpy, buf_id))
+#endif
+
+#if VA_CHECK_VERSION(1,1,0)
+DEFINE_VA_FUNC(ExportSurfaceHandle,
+    (VADisplay dpy, VASurfaceID surface_id, uint32_t mem_type, uint32_t flags,
+     void *descriptor),
+    (dpy, surface_id, mem_type, flags, descriptor))
+#endif
+
+#if USE_VA_VPP
+DEFINE_VA_FUNC(QueryVideoProcFilters,
+    (VADisplay dpy, VAContextID context, VAProcFilterType *filters,
+     unsigned int *num_filters),
+    (dpy, context, filters, num_filters))
+
+DEFINE_VA_FUNC(QueryVideoProcFilterCaps,
+    (VADisplay dpy, VAContextID context, VAProcFilterType type,
+     void *filter_caps, unsigned int *num_filter_caps),
+    (dpy, context, type, filter_caps, num_filter_caps))
+
+DEFINE_VA_FUNC(QueryVideoProcPipelineCaps,
+    (VADisplay dpy, VAContextID context, VABufferID *filters,
+     unsigned int num_filters, VAProcPipelineCaps *pipeline_caps),
+    (dpy, context, filters, num_filters, pipeline_caps))
+#endif
+
+#if USE_VA_X11
+DEFINE_VA_FUNC(PutSurface,
+    (VADisplay dpy, VASurfaceID surface, Drawable draw, short srcx,
+     short srcy, unsigned short srcw, unsigned short srch, short destx,
+     short desty, unsigned short destw, unsigned short desth,
+     VARectangle *cliprects, unsigned int number_cliprects,
+     unsigned int flags),
+    (dpy, surface, draw, srcx, srcy, srcw, srch, destx, desty, destw, desth,
+     cliprects, number_cliprects, flags))
+#endif
+
+#undef DEFINE_VA_FUNC
+
+/* ------------------------------------------------------------------------ */
+/* --- Interface                                                        --- */
+/* ------------------------------------------------------------------------ */
+
+// Returns the upper bound of the histogram bucket holding the percentile p
+static uint64_t
+get_percentile(const VATraceEntry *e, uint64_t count, uint32_t p)
+{
+    uint64_t n, threshold;
+    uint32_t i;
+
+    threshold = (count * p + 99) / 100;
+    for (i = 0, n = 0; i < HIST_BUCKETS; i++) {
+        n += e->hist[i];
+        if (n >= threshold)
+            break;
+    }
+    return i < HIST_BUCKETS ? UINT64_C(2) << i : e->max_time;
+}
+
+// Accounts for a frame that was presented by a renderer
+void
+va_trace_frame(void)
+{
+    uint64_t num_calls, num_frame_calls;
+
+    num_calls = __atomic_load_n(&g_trace.num_calls, __ATOMIC_RELAXED);
+    num_frame_calls = num_calls - __atomic_exchange_n(
+        &g_trace.num_calls_at_last_frame, num_calls, __ATOMIC_RELAXED);
+    atomic_max(&g_trace.max_calls_per_frame, num_frame_calls);
+    __atomic_fetch_add(&g_trace.num_frames, 1, __ATOMIC_RELAXED);
+}
+
+// Resets all the collected VA-API call statistics
+void
+va_trace_reset(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < VA_TRACE_ID_COUNT; i++) {
+        VATraceEntry * const e = &g_trace.entries[i];
+        e->count = 0;
+        e->errors = 0;
+        e->total_time = 0;
+        e->max_time = 0;
+        memset(e->hist, 0, sizeof(e->hist));
+    }
+    g_trace.num_frames = 0;
+    g_trace.num_calls = 0;
+    g_trace.num_calls_at_last_frame = 0;
+    g_trace.max_calls_per_frame = 0;
+}
+
+// Prints out the collected VA-API call statistics
+void
+va_trace_report(void)
+{
+    const uint64_t num_frames = g_trace.num_frames;
+    uint32_t i;
+
+    av_log(NULL, AV_LOG_INFO, "VA-API call statistics: %" PRIu64 " calls, "
+        "%" PRIu64 " frames presented\n", g_trace.num_calls, num_frames);
+    av_log(NULL, AV_LOG_INFO, "  %-28s %10s %6s %11s %9s %9s %9s %9s\n",
+        "entrypoint", "calls", "errors", "calls/frame", "avg(us)", "p50(us)",
+        "p99(us)", "max(us)");
+
+    for (i = 0; i < VA_TRACE_ID_COUNT; i++) {
+        const VATraceEntry * const e = &g_trace.entries[i];
+        const uint64_t count = e->count;
+
+        if (!count)
+            continue;
+        av_log(NULL, AV_LOG_INFO,
+            "  %-28s %10" PRIu64 " %6" PRIu64 " %11.2f %9.1f %9.1f %9.1f "
+            "%9.1f\n", e->name, count, e->errors,
+            num_frames ? (double)count / num_frames : 0.0,
+            e->total_time / (count * 1000.0),
+            get_percentile(e, count, 50) / 1000.0,
+            get_percentile(e, count, 99) / 1000.0,
+            e->max_time / 1000.0);
+    }
+
+    if (num_frames > 0) {
+        av_log(NULL, AV_LOG_INFO, "  VA calls per frame: %.2f avg, "
+            "%" PRIu64 " max\n", (double)g_trace.num_calls / num_frames,
+            g_trace.max_calls_per_frame);
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * vaapi_trace.h - VA-API call tracing
+ *
+ * Copyright (C) 2014 Intel Corporation
+ *   Author: Gwenole Beauchesne <gwenole.beauchesne@intel.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301
+ */
+
+#ifndef VAAPI_TRACE_H
+#define VAAPI_TRACE_H
+
+/*
+ * When configured with --enable-va-trace, every va*() entrypoint used
+ * by the library, and by FFmpeg through symbol interposition, is routed
+ * through a timed wrapper that records call counts and latencies. The
+ * interface below is a no-op otherwise.
+ */
+
+#if USE_VA_TRACE
+
+/** Accounts for a frame that was presented by a renderer */
+void
+va_trace_frame(void);
+
+/** Resets all the collected VA-API call statistics */
+void
+va_trace_reset(void);
+
+/** Prints out the collected VA-API call statistics */
+void
+va_trace_report(void);
+
+#else
+
+static inline void
+va_trace_frame(void)
+{
+}
+
+static inline void
+va_trace_reset(void)
+{
+}
+
+static inline void
+va_trace_report(void)
+{
+}
+
+#endif
+
+#endif /* VAAPI_TRACE_H */